@@ -0,0 +1,492 @@
+/*******************************************************************************
+ * End to end benchmark
+ *
+ * Drives the complete HAL -> GW -> UDP pipeline, with the same main loop as
+ * the forwarder, from the virtual radio at increasing uplink rates and
+ * forwards to a UDP sink in the same process:
+ *
+ *   make bench      or      ./bench_e2e -o bench.json > /dev/null
+ *
+ * Every uplink carries a sequence number, the sink matches the rxpk it
+ * receives against the time the uplink ended on the air. Per rate it reports:
+ * - uplinks generated, forwarded and lost (on the air because the radio was
+ *   not polled in time, LORA RX FIFO full, UDP TX FIFO full)
+ * - latency from the end of the uplink on the air until the sink received
+ *   the PUSH_DATA (includes the loopback hop), p50/p99/p999/max
+ * - p50/p99 of every pipeline stage (metrics.h)
+ * - CPU time per forwarded uplink, process memory high-water
+ * The sustained rate is the highest rate without any loss. The results are
+ * written as JSON so they can be compared across commits.
+ *
+ * After the steps the sink answers with one PULL_RESP whose txpk has a freq,
+ * datr, codr, powe and ipol none of the uplinks used. The virtual radio must
+ * send the frame with exactly those, else the benchmark fails (exit code 2).
+ *
+ * With -P the engines run as the three thread pipeline of pipeline.c instead
+ * of the main loop, the utilisation of every stage is added per rate. Compare
+ * the sustained rate and the CPU per uplink of both runs to see how the
+ * pipeline scales with the number of cores.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include <unistd.h>           // used in this module for getopt()
+#include <fcntl.h>            // Required for the nonblocking socket
+#include <sys/time.h>
+#include <sys/resource.h>     // Required for getrusage
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "base64.h"
+#include "hal.h"
+#include "udp.h"
+#include "gateway.h"
+#include "metrics.h"
+#include "hist.h"
+#include "vradio.h"
+#include "pipeline.h"
+#include "os.h"
+
+
+#define BENCH_DEFAULT_RATES       "10,20,50,100,200,500,1000,2000"  // Uplinks per second
+#define BENCH_DEFAULT_SECONDS     3         // Length of every step
+#define BENCH_DRAIN_MS            500       // Keep running after a step for the uplinks in flight
+#define BENCH_LOOP_DELAY_MS       1         // Same as the main loop of the forwarder
+#define BENCH_FRAME_SIZE          23        // Typical unconfirmed data up with a few bytes of payload
+#define BENCH_MAX_RATES           32
+#define BENCH_MAX_INFLIGHT        65536     // Must be a power of 2
+#define BENCH_STOP_LOSS           10        // Stop when a step loses more than 10 % of the uplinks
+#define BENCH_DOWNLINK_MS         500       // Time for the downlink check to reach the virtual radio
+
+// End to end benchmark Variables
+int BENCH_Running = 0;                    // 1 = generator produces uplinks, atomic, the generator may run on the radio thread
+uint64_t BENCH_Interval = 0;              // Time between uplinks (us)
+uint64_t BENCH_NextDue = 0;               // Time the next uplink ends on the air
+uint32_t BENCH_Generated = 0;             // Uplinks generated this step
+uint32_t BENCH_MissedOnAir = 0;           // Uplinks lost because the radio was not polled in time
+uint32_t BENCH_Forwarded = 0;             // Uplinks received by the sink this step
+uint64_t BENCH_RxTime[BENCH_MAX_INFLIGHT];  // Time every uplink ended on the air, by sequence number
+struct HIST_STRUCT BENCH_Latency;         // End of the uplink on the air until received by the sink
+int BENCH_Sink = -1;                      // Socket of the UDP sink
+struct sockaddr_in BENCH_GwAddr;          // Address the forwarder sends from, the PULL_RESP goes there
+int BENCH_GwAddrValid = 0;
+struct HAL_TX_PARAMS_STRUCT BENCH_DownlinkTx;   // Parameters of the last downlink sent by the virtual radio
+int BENCH_Downlinks = 0;                  // Downlinks sent by the virtual radio, atomic, the hook may run on the radio thread
+struct HAL_CONTEXT_STRUCT BENCH_Hal;      // The forwarder under test
+struct UDP_CONTEXT_STRUCT BENCH_Udp;
+struct GW_CONTEXT_STRUCT BENCH_Gw;
+
+
+/**
+* __Function__: BENCH_Generator
+*
+* __Description__: Virtual radio generator, one uplink every BENCH_Interval
+*
+* __Input__: HAL context of the virtual radio, not used, pointer to the uplink to fill
+*
+* __Output__: 1 = Uplink filled, 0 = nothing due
+*
+* __Status__: Completed
+*
+* __Remarks__: Like the chip holds one frame, uplinks that ended while an earlier one was not
+*              picked up yet are lost on the air. The sequence number goes in the DevAddr.
+*/
+static int BENCH_Generator( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink )
+{
+  uint64_t Now = OS_GetMicros();
+  uint32_t Seq;
+  int i;
+
+  if(!__atomic_load_n(&BENCH_Running, __ATOMIC_ACQUIRE) || Now < BENCH_NextDue)
+  {
+    return 0;
+  }
+  while(BENCH_NextDue + BENCH_Interval <= Now)
+  {
+    BENCH_Generated++;
+    BENCH_MissedOnAir++;
+    BENCH_NextDue += BENCH_Interval;
+  }
+
+  Seq = BENCH_Generated++;
+  BENCH_RxTime[Seq & (BENCH_MAX_INFLIGHT - 1)] = BENCH_NextDue;
+  BENCH_NextDue += BENCH_Interval;
+
+  Uplink->Frame[0] = 0x40;                    // Unconfirmed data up
+  Uplink->Frame[1] = Seq;
+  Uplink->Frame[2] = Seq >> 8;
+  Uplink->Frame[3] = Seq >> 16;
+  Uplink->Frame[4] = Seq >> 24;
+  for(i = 5; i < BENCH_FRAME_SIZE; i++)
+  {
+    Uplink->Frame[i] = i;
+  }
+  Uplink->FrameSize = BENCH_FRAME_SIZE;
+  Uplink->Rssi = -60;
+  Uplink->Snr = 7;
+  Uplink->CrcError = 0;
+  return 1;
+}
+
+/**
+* __Function__: BENCH_SinkOpen
+*
+* __Description__: Open the UDP sink on a free port on localhost and point the forwarder at it
+*
+* __Input__: void
+*
+* __Output__: Error code: 0 = no error, 1 = Socket error
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before UDP_Init
+*/
+static int BENCH_SinkOpen( void )
+{
+  struct sockaddr_in Addr;
+  socklen_t AddrLen = sizeof(Addr);
+
+  if((BENCH_Sink = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+  {
+    return 1;
+  }
+  memset((char *) &Addr, 0, sizeof(Addr));
+  Addr.sin_family = AF_INET;
+  Addr.sin_port = 0;
+  inet_aton("127.0.0.1", &Addr.sin_addr);
+  if(bind(BENCH_Sink, (struct sockaddr *) &Addr, sizeof(Addr)) == -1 || getsockname(BENCH_Sink, (struct sockaddr *) &Addr, &AddrLen) == -1)
+  {
+    return 1;
+  }
+  fcntl(BENCH_Sink, F_SETFL, O_NONBLOCK);
+  return UDP_SetServer(&BENCH_Udp, "127.0.0.1", ntohs(Addr.sin_port));
+}
+
+/**
+* __Function__: BENCH_SinkPoll
+*
+* __Description__: Read everything the forwarder sent, match the rxpk against the uplinks generated
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Only the first 8 base64 characters of "data" are decoded, enough for the sequence number
+*/
+static void BENCH_SinkPoll( void )
+{
+  uint8_t Datagram[2048];
+  uint8_t Head[6];
+  char *Data;
+  uint32_t Seq;
+  int NumBytes;
+  uint64_t Now;
+  struct sockaddr_in From;
+  socklen_t FromLen = sizeof(From);
+
+  while((NumBytes = recvfrom(BENCH_Sink, Datagram, sizeof(Datagram) - 1, 0, (struct sockaddr *) &From, &FromLen)) > 0)
+  {
+    Now = OS_GetMicros();
+    BENCH_GwAddr = From;
+    BENCH_GwAddrValid = 1;
+    if(NumBytes <= 12 || Datagram[3] != PKT_PUSH_DATA)
+    {
+      continue;
+    }
+    Datagram[NumBytes] = 0;
+    if((Data = strstr((char *)Datagram + 12, "\"data\":\"")) == NULL)
+    {
+      continue;
+    }
+    if(b64_to_bin_nopad(Data + 8, 8, Head, sizeof(Head)) != 6)
+    {
+      continue;
+    }
+    Seq = Head[1] | (Head[2] << 8) | (Head[3] << 16) | ((uint32_t)Head[4] << 24);
+    HIST_Record(&BENCH_Latency, Now - BENCH_RxTime[Seq & (BENCH_MAX_INFLIGHT - 1)]);
+    BENCH_Forwarded++;
+  }
+}
+
+/**
+* __Function__: BENCH_Loop
+*
+* __Description__: Run the forwarder main loop for a while
+*
+* __Input__: Time to run in micro seconds, delay per loop in ms
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Same as the loop in main.c, plus polling the sink. With the pipeline running only polls the sink
+*/
+static void BENCH_Loop( uint64_t Micros, int LoopDelay )
+{
+  uint64_t End = OS_GetMicros() + Micros;
+
+  while(OS_GetMicros() < End)
+  {
+    if(!PL_Running())
+    {
+      HAL_Engine(&BENCH_Hal);
+      UDP_Engine(&BENCH_Udp);
+      GW_Engine(&BENCH_Gw);
+    }
+    BENCH_SinkPoll();
+    if(LoopDelay)
+    {
+      OS_Delay(LoopDelay);
+    }
+  }
+}
+
+/**
+* Virtual radio downlink hook, remembers the parameters the frame went out with
+*/
+static void BENCH_DownlinkHook( const uint8_t *Frame, int FrameSize, uint64_t TxTime, const struct HAL_TX_PARAMS_STRUCT *Tx )
+{
+  BENCH_DownlinkTx = *Tx;
+  __atomic_fetch_add(&BENCH_Downlinks, 1, __ATOMIC_RELEASE);
+}
+
+/**
+* __Function__: BENCH_DownlinkCheck
+*
+* __Description__: Send a PULL_RESP to the forwarder and check the virtual radio sends the frame as the txpk asks
+*
+* __Input__: File to write the result in, delay per main loop in ms
+*
+* __Output__: 0 = sent with the freq, datr, codr, powe and ipol of the txpk, 1 = not sent or sent with others
+*
+* __Status__: Completed
+*
+* __Remarks__: The values differ from the uplinks and the defaults of the radio, so none of them can pass by accident.
+*              The freq is on the reported frequencies, the radio sends it shifted back by as much as the rxpk are.
+*/
+static int BENCH_DownlinkCheck( FILE *Out, int LoopDelay )
+{
+  static const uint8_t Frame[12] = { 0x60, 0x04, 0x03, 0x02, 0x01, 0x00, 0x01, 0x00, 0x01, 0x02, 0x03, 0x04 };
+  struct HAL_TX_PARAMS_STRUCT Expected = { 869525000, SF10, HAL_BW_250, HAL_CR_4_7, HAL_IQ_INVERTED, 20 };
+  uint8_t Datagram[512];
+  char B64[32];
+  int Len, Ok;
+
+  if(BENCH_Gw.ReportFreq != 0)
+  {
+    Expected.Freq = (uint32_t)(Expected.Freq - (BENCH_Gw.ReportFreq - HAL_GetFreq(&BENCH_Hal)) + 0.5);
+  }
+  if(!BENCH_GwAddrValid || bin_to_b64(Frame, sizeof(Frame), B64, sizeof(B64)) < 0)
+  {
+    fprintf(Out, ",\"downlink\":{\"sent\":0,\"ok\":0}");
+    return 1;
+  }
+  Datagram[0] = PROTOCOL_VERSION;
+  Datagram[1] = 0x12;
+  Datagram[2] = 0x34;
+  Datagram[3] = PKT_PULL_RESP;
+  Len = 4 + snprintf((char *)Datagram + 4, sizeof(Datagram) - 4,
+    "{\"txpk\":{\"imme\":true,\"freq\":869.525,\"rfch\":0,\"powe\":20,\"modu\":\"LORA\",\"datr\":\"SF10BW250\",\"codr\":\"4/7\",\"ipol\":true,\"size\":%d,\"data\":\"%s\"}}",
+    (int)sizeof(Frame), B64);
+
+  VR_SetDownlinkHook(BENCH_DownlinkHook);
+  sendto(BENCH_Sink, Datagram, Len, 0, (struct sockaddr *) &BENCH_GwAddr, sizeof(BENCH_GwAddr));
+  BENCH_Loop(BENCH_DOWNLINK_MS * 1000, LoopDelay);
+  VR_SetDownlinkHook(NULL);
+
+  Ok = __atomic_load_n(&BENCH_Downlinks, __ATOMIC_ACQUIRE) == 1 && BENCH_DownlinkTx.Freq == Expected.Freq &&
+    BENCH_DownlinkTx.SF == Expected.SF && BENCH_DownlinkTx.BW == Expected.BW && BENCH_DownlinkTx.CR == Expected.CR &&
+    BENCH_DownlinkTx.IQ == Expected.IQ && BENCH_DownlinkTx.Power == Expected.Power;
+  fprintf(Out, ",\"downlink\":{\"sent\":%d,\"freq\":%u,\"datr\":\"SF%dBW%d\",\"codr\":\"4/%d\",\"powe\":%d,\"ipol\":%s,\"ok\":%d}",
+    BENCH_Downlinks, BENCH_DownlinkTx.Freq, BENCH_DownlinkTx.SF, 125 << BENCH_DownlinkTx.BW, BENCH_DownlinkTx.CR + 5,
+    BENCH_DownlinkTx.Power, BENCH_DownlinkTx.IQ == HAL_IQ_INVERTED ? "true" : "false", Ok);
+  fprintf(stderr, "bench_e2e: downlink %s: sent %d, %u Hz SF%dBW%d 4/%d %d dBm ipol %d, expected %u Hz SF10BW250 4/7 20 dBm ipol 1\n",
+    Ok ? "ok" : "FAILED", BENCH_Downlinks, BENCH_DownlinkTx.Freq, BENCH_DownlinkTx.SF, 125 << BENCH_DownlinkTx.BW,
+    BENCH_DownlinkTx.CR + 5, BENCH_DownlinkTx.Power, BENCH_DownlinkTx.IQ == HAL_IQ_INVERTED, Expected.Freq);
+  return !Ok;
+}
+
+static uint64_t BENCH_CpuMicros( void )
+{
+  struct rusage Usage;
+
+  getrusage(RUSAGE_SELF, &Usage);
+  return (uint64_t)(Usage.ru_utime.tv_sec + Usage.ru_stime.tv_sec) * 1000000 + Usage.ru_utime.tv_usec + Usage.ru_stime.tv_usec;
+}
+
+static long BENCH_MaxRssKb( void )
+{
+  struct rusage Usage;
+
+  getrusage(RUSAGE_SELF, &Usage);
+  return Usage.ru_maxrss;
+}
+
+static void Usage( const char *Name )
+{
+  printf("Usage: %s [-r rates] [-t seconds] [-l ms] [-P] [-o file]\n", Name);
+  printf("  -r rates    Comma separated uplinks per second, default %s\n", BENCH_DEFAULT_RATES);
+  printf("  -t seconds  Length of every step, default %d\n", BENCH_DEFAULT_SECONDS);
+  printf("  -l ms       Delay per main loop, default %d as in the forwarder\n", BENCH_LOOP_DELAY_MS);
+  printf("  -P          Run the engines as the three thread pipeline instead of the main loop\n");
+  printf("  -o file     Write the results as JSON to file, default stderr\n");
+}
+
+int main( int argc, char *argv[] )
+{
+  char RateList[256] = BENCH_DEFAULT_RATES;
+  int Rates[BENCH_MAX_RATES];
+  int NumRates = 0;
+  int Seconds = BENCH_DEFAULT_SECONDS;
+  int LoopDelay = BENCH_LOOP_DELAY_MS;
+  int Sustained = 0;
+  int Pipeline = 0;
+  uint64_t BusyStart[PL_NUM_STAGES];
+  FILE *Out = stderr;
+  char *Token;
+  uint64_t CpuStart, CpuUsed;
+  uint32_t Lost;
+  int DownlinkFailed;
+  int Option, i, s;
+
+  while((Option = getopt(argc, argv, "r:t:l:Po:h")) != -1)
+  {
+    switch(Option)
+    {
+      case 'r': snprintf(RateList, sizeof(RateList), "%s", optarg); break;
+      case 't': Seconds = atoi(optarg); break;
+      case 'l': LoopDelay = atoi(optarg); break;
+      case 'P': Pipeline = 1; break;
+      case 'o':
+        if((Out = fopen(optarg, "w")) == NULL)
+        {
+          fprintf(stderr, "Error opening: %s\n", optarg);
+          return 1;
+        }
+      break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  for(Token = strtok(RateList, ","); Token != NULL && NumRates < BENCH_MAX_RATES; Token = strtok(NULL, ","))
+  {
+    if(atoi(Token) > 0)
+    {
+      Rates[NumRates++] = atoi(Token);
+    }
+  }
+
+  HAL_InitContext(&BENCH_Hal);
+  UDP_InitContext(&BENCH_Udp);
+  GW_InitContext(&BENCH_Gw, &BENCH_Hal, &BENCH_Udp);
+  if(BENCH_SinkOpen() != 0)
+  {
+    fprintf(stderr, "Error opening the UDP sink!\n");
+    return 1;
+  }
+  HAL_SetRadio(&BENCH_Hal, &HAL_RadioVirtual);
+  VR_SetGenerator(BENCH_Generator);
+  VR_SetSource(VR_SOURCE_GENERATOR, NULL);
+
+  MET_Init();
+  MET_Watch(&BENCH_Hal, &BENCH_Udp);
+  if(HAL_Init(&BENCH_Hal) != 0 || UDP_Init(&BENCH_Udp) != 0 || GW_Init(&BENCH_Gw) != 0)
+  {
+    fprintf(stderr, "Error initialising the pipeline!\n");
+    return 1;
+  }
+  if(Pipeline && PL_Start(&BENCH_Gw) != 0)
+  {
+    fprintf(stderr, "Error starting the pipeline threads!\n");
+    return 1;
+  }
+  // Let the status and PULL_DATA of the start pass
+  BENCH_Loop(100000, LoopDelay);
+
+  fprintf(Out, "{\"benchmark\":\"end_to_end\",\"mode\":\"%s\",\"step_seconds\":%d,\"loop_delay_ms\":%d,\"frame_size\":%d,\"steps\":[",
+    Pipeline ? "pipeline" : "main_loop", Seconds, LoopDelay, BENCH_FRAME_SIZE);
+
+  for(s = 0; s < NumRates; s++)
+  {
+    BENCH_Generated = 0;
+    BENCH_MissedOnAir = 0;
+    BENCH_Forwarded = 0;
+    HIST_Reset(&BENCH_Latency);
+    MET_Reset();
+    CpuStart = BENCH_CpuMicros();
+    for(i = 0; i < PL_NUM_STAGES; i++)
+    {
+      BusyStart[i] = PL_GetBusyMicros(i);
+    }
+
+    BENCH_Interval = 1000000 / Rates[s];
+    BENCH_NextDue = OS_GetMicros() + BENCH_Interval;
+    __atomic_store_n(&BENCH_Running, 1, __ATOMIC_RELEASE);
+    BENCH_Loop((uint64_t)Seconds * 1000000, LoopDelay);
+    __atomic_store_n(&BENCH_Running, 0, __ATOMIC_RELEASE);
+    BENCH_Loop(BENCH_DRAIN_MS * 1000, LoopDelay);
+
+    CpuUsed = BENCH_CpuMicros() - CpuStart;
+    Lost = BENCH_Generated - BENCH_Forwarded;
+
+    fprintf(Out, "%s{\"rate\":%d,\"generated\":%u,\"forwarded\":%u,\"lost\":%u,\"lost_on_air\":%u,\"lost_lora_rx_fifo\":%u,"
+      "\"throughput\":%.1f,\"latency_us\":{\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu},"
+      "\"cpu_us_per_uplink\":%.1f,\"max_rss_kb\":%ld,\"stages_us\":{",
+      s ? "," : "", Rates[s], BENCH_Generated, BENCH_Forwarded, Lost, BENCH_MissedOnAir, MET_GetCounter(MET_LORA_RX_DROPPED),
+      (double)BENCH_Forwarded / Seconds,
+      (unsigned long long)HIST_Percentile(&BENCH_Latency, 50), (unsigned long long)HIST_Percentile(&BENCH_Latency, 99),
+      (unsigned long long)HIST_Percentile(&BENCH_Latency, 99.9), (unsigned long long)BENCH_Latency.Max,
+      BENCH_Forwarded ? (double)CpuUsed / BENCH_Forwarded : 0.0, BENCH_MaxRssKb());
+    for(i = 0; i < MET_NUM_LATENCIES; i++)
+    {
+      fprintf(Out, "%s\"%s\":{\"p50\":%llu,\"p99\":%llu}", i ? "," : "", MET_GetLatencyName(i),
+        (unsigned long long)HIST_Percentile(MET_GetLatency(i), 50), (unsigned long long)HIST_Percentile(MET_GetLatency(i), 99));
+    }
+    fprintf(Out, "}");
+    if(Pipeline)
+    {
+      fprintf(Out, ",\"utilisation\":{");
+      for(i = 0; i < PL_NUM_STAGES; i++)
+      {
+        fprintf(Out, "%s\"%s\":%.4f", i ? "," : "", PL_GetStageName(i),
+          (double)(PL_GetBusyMicros(i) - BusyStart[i]) / ((uint64_t)Seconds * 1000000 + BENCH_DRAIN_MS * 1000));
+      }
+      fprintf(Out, "}");
+    }
+    fprintf(Out, "}");
+
+    fprintf(stderr, "bench_e2e: %5d/s generated %6u forwarded %6u lost %5u (on air %u) p50 %6llu us p99 %6llu us p999 %6llu us cpu %.1f us/uplink\n",
+      Rates[s], BENCH_Generated, BENCH_Forwarded, Lost, BENCH_MissedOnAir,
+      (unsigned long long)HIST_Percentile(&BENCH_Latency, 50), (unsigned long long)HIST_Percentile(&BENCH_Latency, 99),
+      (unsigned long long)HIST_Percentile(&BENCH_Latency, 99.9), BENCH_Forwarded ? (double)CpuUsed / BENCH_Forwarded : 0.0);
+
+    if(Lost == 0)
+    {
+      Sustained = Rates[s];
+    }
+    if(Lost * 100 > BENCH_Generated * BENCH_STOP_LOSS)
+    {
+      break;
+    }
+  }
+
+  fprintf(Out, "]");
+  DownlinkFailed = BENCH_DownlinkCheck(Out, LoopDelay);
+
+  PL_Stop();
+  fprintf(Out, ",\"sustained_uplinks_per_second\":%d,\"max_rss_kb\":%ld}\n", Sustained, BENCH_MaxRssKb());
+  fprintf(stderr, "bench_e2e: %s: sustained %d uplinks/s without loss, memory high-water %ld kB\n",
+    Pipeline ? "pipeline" : "main loop", Sustained, BENCH_MaxRssKb());
+  if(Out != stderr)
+  {
+    fclose(Out);
+  }
+  return DownlinkFailed ? 2 : 0;
+}
@@ -0,0 +1,552 @@
+/*******************************************************************************
+ * Microbenchmarks
+ *
+ * Times the kernels on the uplink and downlink path in isolation, so that
+ * every change to them can be justified with numbers:
+ *
+ *   make bench      or      ./bench_micro -o bench_micro.json > /dev/null
+ *
+ * - bin_to_b64 / b64_to_bin over payload sizes 1..255
+ * - GW_SerialiseRxpk, the PUSH_DATA builder of GW_ProcessRX_Lora
+ * - GW_ParseTxpk, the PULL_RESP parse path of GW_ProcessRX_UDP
+ * - enqueue + dequeue of one frame on the HAL and UDP FIFOs
+ * - SPI transactions and calls into the transport per operation of the SX127x
+ *   backend (setup, RX drain, TX load, TX wait, re-arm, retune), on the
+ *   emulated SX1272 and SX1276 with the simulated clock. A call is one
+ *   syscall on a bus with hardware chip select, see HAL_GetSpiCalls.
+ *
+ * Every kernel is calibrated until one run takes at least the minimum run
+ * time, warmed up with one more run and then timed over a number of runs.
+ * Per kernel it reports min/median/mean/stddev/max in ns/op and the heap
+ * allocations and bytes per op, counted by wrapping malloc in this binary.
+ * The kernels print debug output on stdout, which is part of their cost;
+ * send it to /dev/null to keep the terminal out of the numbers.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include <math.h>             // Required for sqrt
+#include <unistd.h>           // used in this module for getopt()
+#include <time.h>             // Required for clock_gettime
+#include "base64.h"
+#include "hal.h"
+#include "udp.h"
+#include "gateway.h"
+#include "metrics.h"
+#include "vradio.h"
+#include "sx127x_emu.h"
+#include "clock.h"
+
+
+#define BENCH_DEFAULT_SIZES       "1,16,23,32,51,64,128,222,255"   // Payload sizes in bytes
+#define BENCH_DEFAULT_RUNS        15        // Timed runs per kernel
+#define BENCH_DEFAULT_RUN_MS      10        // Minimum length of one run
+#define BENCH_MAX_RUNS            101
+#define BENCH_MAX_SIZES           255
+#define BENCH_MAX_ITERATIONS      (1L << 26)
+#define BENCH_HAL_FRAME_SIZE      23        // Typical unconfirmed data up with a few bytes of payload
+#define BENCH_UDP_FRAME_SIZE      300       // PUSH_DATA with one rxpk of a 51 byte frame
+#define BENCH_SPI_RADIO           "freq=868.1:868.3,sf=7,hop=100"  // Two channels, so there is a retune to count
+#define BENCH_SPI_MAX_POLLS       10000000  // Engine runs to wait for a frame or a retune
+
+// Allocation counters, see malloc below
+static uint64_t BENCH_Allocs = 0;
+static uint64_t BENCH_AllocBytes = 0;
+
+// Inputs prepared by BENCH_Setup for the current size
+static uint8_t BENCH_Frame[LORA_TX_MX_FRAME_SIZE];
+static char BENCH_B64[512];
+static int BENCH_B64Len;
+static char BENCH_Json[1024];
+static char BENCH_Datagram[UDP_TX_MX_FRAME_SIZE];
+static volatile int BENCH_Sink;           // Keeps the compiler from dropping results
+
+// Contexts the FIFO and serialisation kernels work on
+static struct HAL_CONTEXT_STRUCT BENCH_Hal;
+static struct UDP_CONTEXT_STRUCT BENCH_Udp;
+static struct GW_CONTEXT_STRUCT BENCH_Gw;
+static struct HAL_CONTEXT_STRUCT BENCH_SpiHal;
+#define BENCH_SPI_CRC_OP          HAL_SPI_NUM_OPS   // The RX drain of a frame with a CRC error, after the operations of the HAL
+static const char *BENCH_SpiOpNames[HAL_SPI_NUM_OPS + 1] = { "setup", "rx_drain", "tx_load", "tx_wait", "tx_rearm", "retune", "rx_drain_crc" };
+// Expected SPI transactions and transport calls per operation, BENCH_HAL_FRAME_SIZE byte frame, BENCH_SPI_RADIO
+static const unsigned int BENCH_SpiSx1272[HAL_SPI_NUM_OPS + 1][2] = { {9, 2}, {3, 2}, {9, 1}, {0, 0}, {4, 1}, {4, 2}, {2, 2} };
+static const unsigned int BENCH_SpiSx1276[HAL_SPI_NUM_OPS + 1][2] = { {11, 3}, {3, 2}, {9, 1}, {0, 0}, {4, 1}, {3, 1}, {2, 2} };
+static const struct GW_RXPK_STRUCT BENCH_Rxpk = { 3512348611U, 0, 0, GW_REPORT_FREQ, HAL_DEFAULT_SF, 7, -60 };
+
+/**
+* Heap allocations are counted by wrapping the allocator of the C library
+*/
+extern "C" void *__libc_malloc( size_t Size );
+extern "C" void *__libc_calloc( size_t Num, size_t Size );
+extern "C" void *__libc_realloc( void *Ptr, size_t Size );
+
+void *malloc( size_t Size ) noexcept
+{
+  BENCH_Allocs++;
+  BENCH_AllocBytes += Size;
+  return __libc_malloc(Size);
+}
+
+void *calloc( size_t Num, size_t Size ) noexcept
+{
+  BENCH_Allocs++;
+  BENCH_AllocBytes += Num * Size;
+  return __libc_calloc(Num, Size);
+}
+
+void *realloc( void *Ptr, size_t Size ) noexcept
+{
+  BENCH_Allocs++;
+  BENCH_AllocBytes += Size;
+  return __libc_realloc(Ptr, Size);
+}
+
+static uint64_t BENCH_Nanos( void )
+{
+  struct timespec Now;
+
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (uint64_t)Now.tv_sec * 1000000000ULL + Now.tv_nsec;
+}
+
+/**
+* __Function__: BENCH_Setup
+*
+* __Description__: Prepare the inputs of all kernels for one payload size
+*
+* __Input__: Payload size in bytes
+*
+* __Output__: Error code: 0 = no error, 1 = A kernel does not round trip
+*
+* __Status__: Completed
+*
+* __Remarks__: Checks every kernel once, so that a broken kernel does not end up as a fast number
+*/
+static int BENCH_Setup( int Size )
+{
+  struct GW_TXPK_STRUCT Txpk;
+  uint8_t Decoded[LORA_TX_MX_FRAME_SIZE];
+  int i;
+
+  for(i = 0; i < Size; i++)
+  {
+    BENCH_Frame[i] = (uint8_t)(i * 7 + 0x40);
+  }
+  BENCH_B64Len = bin_to_b64(BENCH_Frame, Size, BENCH_B64, sizeof(BENCH_B64));
+  if(BENCH_B64Len < 0 || b64_to_bin(BENCH_B64, BENCH_B64Len, Decoded, sizeof(Decoded)) != Size || memcmp(Decoded, BENCH_Frame, Size))
+  {
+    fprintf(stderr, "bench_micro: base64 does not round trip at %d bytes\n", Size);
+    return 1;
+  }
+
+  // PULL_RESP as sent by the network server, see mock_lns.c
+  snprintf(BENCH_Json, sizeof(BENCH_Json), "{\"txpk\":{\"imme\":false,\"tmst\":3512348611,\"freq\":868.1,\"rfch\":0,\"powe\":14,"
+    "\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/5\",\"ipol\":true,\"size\":%d,\"data\":\"%s\"}}", Size, BENCH_B64);
+  if(GW_ParseTxpk(BENCH_Json, 0, &Txpk) != Size && Size > 1)       // A 1 byte downlink is rejected
+  {
+    fprintf(stderr, "bench_micro: txpk parse failed at %d bytes\n", Size);
+    return 1;
+  }
+
+  if(GW_SerialiseRxpk(&BENCH_Gw, BENCH_Datagram, sizeof(BENCH_Datagram), BENCH_Frame, Size, &BENCH_Rxpk, 0x1234) <= 12)
+  {
+    fprintf(stderr, "bench_micro: rxpk serialisation failed at %d bytes\n", Size);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+* Kernels, every one runs Iterations operations on the inputs of BENCH_Setup
+*/
+static void BENCH_B64Encode( int Size, long Iterations )
+{
+  char Out[512];
+
+  while(Iterations--)
+  {
+    BENCH_Sink = bin_to_b64(BENCH_Frame, Size, Out, sizeof(Out));
+  }
+}
+
+static void BENCH_B64Decode( int Size, long Iterations )
+{
+  uint8_t Out[LORA_TX_MX_FRAME_SIZE];
+
+  while(Iterations--)
+  {
+    BENCH_Sink = b64_to_bin(BENCH_B64, BENCH_B64Len, Out, sizeof(Out));
+  }
+}
+
+static void BENCH_RxpkSerialise( int Size, long Iterations )
+{
+  char Out[TX_BUFF_SIZE];
+
+  while(Iterations--)
+  {
+    BENCH_Sink = GW_SerialiseRxpk(&BENCH_Gw, Out, sizeof(Out), BENCH_Frame, Size, &BENCH_Rxpk, (uint16_t)Iterations);
+  }
+}
+
+static void BENCH_TxpkParse( int Size, long Iterations )
+{
+  struct GW_TXPK_STRUCT Txpk;
+
+  while(Iterations--)
+  {
+    BENCH_Sink = GW_ParseTxpk(BENCH_Json, 0, &Txpk);
+  }
+}
+
+static void BENCH_HalRxFifo( int Size, long Iterations )
+{
+  uint8_t Out[LORA_RX_MX_FRAME_SIZE];
+
+  while(Iterations--)
+  {
+    HAL_RX_FIFO_Add(&BENCH_Hal, BENCH_Frame, Size, -60, -100, 7, SF7, 0);
+    BENCH_Sink = HAL_ReceiveFrame(&BENCH_Hal, Out);
+  }
+}
+
+static void BENCH_HalTxFifo( int Size, long Iterations )
+{
+  while(Iterations--)
+  {
+    BENCH_Sink = HAL_TransmitFrame(&BENCH_Hal, BENCH_Frame, Size, NULL);
+    HAL_TX_FIFO_Update(&BENCH_Hal);
+  }
+}
+
+static void BENCH_UdpRxFifo( int Size, long Iterations )
+{
+  char Out[MAXLINE];
+
+  while(Iterations--)
+  {
+    UDP_RX_FIFO_Add(&BENCH_Udp, BENCH_Datagram, Size);
+    BENCH_Sink = UDP_ReceiveUDP(&BENCH_Udp, Out);
+  }
+}
+
+static void BENCH_UdpTxFifo( int Size, long Iterations )
+{
+  while(Iterations--)
+  {
+    BENCH_Sink = UDP_SendUDP(&BENCH_Udp, BENCH_Datagram, Size);
+    UDP_TX_FIFO_Update(&BENCH_Udp);
+  }
+}
+
+/**
+* Benchmark definition
+*/
+struct BENCH_CASE_STRUCT {
+  const char  *Name;
+  void        (*Run)( int Size, long Iterations );
+  int         FixedSize;                  // 0 = run over all payload sizes
+};
+
+static const struct BENCH_CASE_STRUCT BENCH_Cases[] = {
+  { "b64_encode",       BENCH_B64Encode,      0 },
+  { "b64_decode",       BENCH_B64Decode,      0 },
+  { "rxpk_serialise",   BENCH_RxpkSerialise,  0 },
+  { "txpk_parse",       BENCH_TxpkParse,      0 },
+  { "hal_rx_fifo",      BENCH_HalRxFifo,      BENCH_HAL_FRAME_SIZE },
+  { "hal_tx_fifo",      BENCH_HalTxFifo,      BENCH_HAL_FRAME_SIZE },
+  { "udp_rx_fifo",      BENCH_UdpRxFifo,      BENCH_UDP_FRAME_SIZE },
+  { "udp_tx_fifo",      BENCH_UdpTxFifo,      BENCH_UDP_FRAME_SIZE },
+};
+#define BENCH_NUM_CASES   (int)(sizeof(BENCH_Cases) / sizeof(BENCH_Cases[0]))
+
+static int BENCH_Compare( const void *A, const void *B )
+{
+  double a = *(const double *)A, b = *(const double *)B;
+
+  return (a > b) - (a < b);
+}
+
+/**
+* __Function__: BENCH_Measure
+*
+* __Description__: Calibrate, warm up and time one kernel, report the statistics
+*
+* __Input__: Kernel, payload size, number of runs, minimum run time in ns, output for the JSON, first entry
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Iterations double until one run takes the minimum run time, the calibration
+*              runs and one extra run at the final count are the warm-up
+*/
+static void BENCH_Measure( const struct BENCH_CASE_STRUCT *Case, int Size, int Runs, uint64_t MinRunNs, FILE *Out, int First )
+{
+  double Samples[BENCH_MAX_RUNS];
+  double Mean = 0, Var = 0;
+  long Iterations = 1;
+  uint64_t Start, Allocs, AllocBytes;
+  int i;
+
+  for(;;)
+  {
+    Start = BENCH_Nanos();
+    Case->Run(Size, Iterations);
+    if(BENCH_Nanos() - Start >= MinRunNs || Iterations >= BENCH_MAX_ITERATIONS)
+    {
+      break;
+    }
+    Iterations *= 2;
+  }
+  Case->Run(Size, Iterations);
+
+  Allocs = BENCH_Allocs;
+  AllocBytes = BENCH_AllocBytes;
+  for(i = 0; i < Runs; i++)
+  {
+    Start = BENCH_Nanos();
+    Case->Run(Size, Iterations);
+    Samples[i] = (double)(BENCH_Nanos() - Start) / Iterations;
+    Mean += Samples[i];
+  }
+  Allocs = BENCH_Allocs - Allocs;
+  AllocBytes = BENCH_AllocBytes - AllocBytes;
+
+  Mean /= Runs;
+  for(i = 0; i < Runs; i++)
+  {
+    Var += (Samples[i] - Mean) * (Samples[i] - Mean);
+  }
+  Var /= Runs > 1 ? Runs - 1 : 1;
+  qsort(Samples, Runs, sizeof(double), BENCH_Compare);
+
+  fprintf(Out, "%s{\"name\":\"%s\",\"size\":%d,\"iterations\":%ld,\"ns_per_op\":{\"min\":%.1f,\"median\":%.1f,\"mean\":%.1f,\"stddev\":%.1f,\"max\":%.1f},"
+    "\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f}",
+    First ? "" : ",", Case->Name, Size, Iterations, Samples[0], Samples[Runs / 2], Mean, sqrt(Var), Samples[Runs - 1],
+    (double)Allocs / ((double)Iterations * Runs), (double)AllocBytes / ((double)Iterations * Runs));
+
+  fprintf(stderr, "bench_micro: %-16s %4d B  median %10.1f ns/op  min %10.1f  sd %5.1f %%  %6.2f allocs/op %8.1f B/op\n",
+    Case->Name, Size, Samples[Runs / 2], Samples[0], Mean > 0 ? 100 * sqrt(Var) / Mean : 0.0,
+    (double)Allocs / ((double)Iterations * Runs), (double)AllocBytes / ((double)Iterations * Runs));
+}
+
+/**
+* __Function__: BENCH_SpiOps
+*
+* __Description__: Count the SPI transactions and transport calls of every operation of the SX127x backend
+*
+* __Input__: Chip = EMU_VERSION_SX1272 or EMU_VERSION_SX1276, its name, expected transactions and calls per
+*             operation, output for the JSON, first entry
+*
+* __Output__: Error code: 0 = no error, 1 = the emulated radio did not come up, 2 = a count is not the expected one
+*
+* __Status__: Completed
+*
+* __Remarks__: Setup, one BENCH_HAL_FRAME_SIZE byte uplink drained, the same frame sent as downlink, the hop to
+*              the second channel and last the uplink again with a CRC error. Needs the simulated clock. All operations are reported, also after a
+*              mismatch, with "ok" in the JSON.
+*/
+static int BENCH_SpiOps( int Chip, const char *ChipName, const unsigned int Expected[HAL_SPI_NUM_OPS + 1][2], FILE *Out, int First )
+{
+  struct VR_FRAME_STRUCT Uplink;
+  unsigned int Cost[HAL_SPI_NUM_OPS + 1], Calls[HAL_SPI_NUM_OPS + 1];
+  uint32_t NumRx;
+  int Error = 0;
+  int Ok;
+  int i;
+
+  EMU_SetChip(Chip);
+  HAL_InitContext(&BENCH_SpiHal);
+  if(HAL_Configure(&BENCH_SpiHal, BENCH_SPI_RADIO) != 0 || HAL_SetRadio(&BENCH_SpiHal, &HAL_RadioSX127x) != 0 ||
+     HAL_SetSpi(&BENCH_SpiHal, &HAL_SpiEmulator) != 0 || HAL_Init(&BENCH_SpiHal) != 0)
+  {
+    fprintf(stderr, "bench_micro: emulated %s did not come up\n", ChipName);
+    return 1;
+  }
+
+  memset(&Uplink, 0, sizeof(Uplink));
+  memcpy(Uplink.Frame, BENCH_Frame, BENCH_HAL_FRAME_SIZE);
+  Uplink.FrameSize = BENCH_HAL_FRAME_SIZE;
+  Uplink.Rssi = -60;
+  Uplink.Snr = 7;
+  EMU_InjectFrame(&Uplink);
+  for(i = 0; i < BENCH_SPI_MAX_POLLS && HAL_GetRxFifoLevel(&BENCH_SpiHal) == 0; i++)
+  {
+    HAL_Engine(&BENCH_SpiHal);
+  }
+  HAL_TransmitFrame(&BENCH_SpiHal, BENCH_Frame, BENCH_HAL_FRAME_SIZE, NULL);
+  for(i = 0; i < BENCH_SPI_MAX_POLLS && HAL_GetSpiCost(&BENCH_SpiHal, HAL_SPI_OP_RETUNE) == 0; i++)
+  {
+    HAL_Engine(&BENCH_SpiHal);
+  }
+
+  for(i = 0; i < HAL_SPI_NUM_OPS; i++)
+  {
+    Cost[i] = HAL_GetSpiCost(&BENCH_SpiHal, i);
+    Calls[i] = HAL_GetSpiCalls(&BENCH_SpiHal, i);
+  }
+
+  // Last the same uplink with a CRC error, its drain takes the place of the one above
+  NumRx = HAL_GetNumRX(&BENCH_SpiHal);
+  Uplink.CrcError = 1;
+  EMU_InjectFrame(&Uplink);
+  for(i = 0; i < BENCH_SPI_MAX_POLLS && HAL_GetNumRX(&BENCH_SpiHal) == NumRx; i++)
+  {
+    HAL_Engine(&BENCH_SpiHal);
+  }
+  Cost[BENCH_SPI_CRC_OP] = HAL_GetNumRX(&BENCH_SpiHal) != NumRx ? HAL_GetSpiCost(&BENCH_SpiHal, HAL_SPI_OP_RX_DRAIN) : 0;
+  Calls[BENCH_SPI_CRC_OP] = HAL_GetNumRX(&BENCH_SpiHal) != NumRx ? HAL_GetSpiCalls(&BENCH_SpiHal, HAL_SPI_OP_RX_DRAIN) : 0;
+
+  for(i = 0; i <= BENCH_SPI_CRC_OP; i++)
+  {
+    Ok = Cost[i] == Expected[i][0] && Calls[i] == Expected[i][1];
+    fprintf(Out, "%s{\"chip\":\"%s\",\"op\":\"%s\",\"transactions\":%u,\"calls\":%u,\"expected_transactions\":%u,\"expected_calls\":%u,\"ok\":%s}",
+      First && i == 0 ? "" : ",", ChipName, BENCH_SpiOpNames[i], Cost[i], Calls[i], Expected[i][0], Expected[i][1], Ok ? "true" : "false");
+    fprintf(stderr, "bench_micro: spi %-7s %-12s %6u transactions  %6u calls\n", ChipName, BENCH_SpiOpNames[i], Cost[i], Calls[i]);
+    if(!Ok)
+    {
+      fprintf(stderr, "bench_micro: Error: spi %s %s expected %u transactions and %u calls\n", ChipName, BENCH_SpiOpNames[i],
+        Expected[i][0], Expected[i][1]);
+      Error = 2;
+    }
+  }
+  return Error;
+}
+
+static void Usage( const char *Name )
+{
+  printf("Usage: %s [-s sizes | -a] [-r runs] [-t ms] [-f filter] [-o file]\n", Name);
+  printf("  -s sizes    Comma separated payload sizes, default %s\n", BENCH_DEFAULT_SIZES);
+  printf("  -a          All payload sizes 1..255\n");
+  printf("  -r runs     Timed runs per kernel, default %d, max %d\n", BENCH_DEFAULT_RUNS, BENCH_MAX_RUNS);
+  printf("  -t ms       Minimum length of one run, default %d\n", BENCH_DEFAULT_RUN_MS);
+  printf("  -f filter   Only the kernels with filter in their name\n");
+  printf("  -o file     Write the results as JSON to file, default stderr\n");
+  printf("Exit code 2 when the SPI transactions or calls of an operation are not the expected ones\n");
+}
+
+int main( int argc, char *argv[] )
+{
+  char SizeList[1024] = BENCH_DEFAULT_SIZES;
+  int Sizes[BENCH_MAX_SIZES];
+  int NumSizes = 0;
+  int Runs = BENCH_DEFAULT_RUNS;
+  int RunMs = BENCH_DEFAULT_RUN_MS;
+  int All = 0;
+  int First = 1;
+  const char *Filter = NULL;
+  FILE *Out = stderr;
+  char *Token;
+  int SpiError = 0, Sx1276Error;
+  int Option, c, s;
+
+  while((Option = getopt(argc, argv, "s:ar:t:f:o:h")) != -1)
+  {
+    switch(Option)
+    {
+      case 's': snprintf(SizeList, sizeof(SizeList), "%s", optarg); break;
+      case 'a': All = 1; break;
+      case 'r': Runs = atoi(optarg); break;
+      case 't': RunMs = atoi(optarg); break;
+      case 'f': Filter = optarg; break;
+      case 'o':
+        if((Out = fopen(optarg, "w")) == NULL)
+        {
+          fprintf(stderr, "Error opening: %s\n", optarg);
+          return 1;
+        }
+      break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if(Runs < 1 || Runs > BENCH_MAX_RUNS || RunMs < 1)
+  {
+    Usage(argv[0]);
+    return 1;
+  }
+  if(All)
+  {
+    for(s = 1; s <= BENCH_MAX_SIZES; s++)
+    {
+      Sizes[NumSizes++] = s;
+    }
+  }
+  else
+  {
+    for(Token = strtok(SizeList, ","); Token != NULL && NumSizes < BENCH_MAX_SIZES; Token = strtok(NULL, ","))
+    {
+      if(atoi(Token) > 0 && atoi(Token) <= BENCH_MAX_SIZES)
+      {
+        Sizes[NumSizes++] = atoi(Token);
+      }
+    }
+  }
+
+  HAL_InitContext(&BENCH_Hal);
+  UDP_InitContext(&BENCH_Udp);
+  GW_InitContext(&BENCH_Gw, &BENCH_Hal, &BENCH_Udp);
+  MET_Init();
+
+  fprintf(Out, "{\"benchmark\":\"micro\",\"runs\":%d,\"min_run_ms\":%d,\"cases\":[", Runs, RunMs);
+  for(c = 0; c < BENCH_NUM_CASES; c++)
+  {
+    if(Filter != NULL && strstr(BENCH_Cases[c].Name, Filter) == NULL)
+    {
+      continue;
+    }
+    if(BENCH_Cases[c].FixedSize)
+    {
+      if(BENCH_Setup(BENCH_MAX_SIZES) != 0)
+      {
+        return 1;
+      }
+      BENCH_Measure(&BENCH_Cases[c], BENCH_Cases[c].FixedSize, Runs, (uint64_t)RunMs * 1000000, Out, First);
+      First = 0;
+      continue;
+    }
+    for(s = 0; s < NumSizes; s++)
+    {
+      if(BENCH_Setup(Sizes[s]) != 0)
+      {
+        return 1;
+      }
+      BENCH_Measure(&BENCH_Cases[c], Sizes[s], Runs, (uint64_t)RunMs * 1000000, Out, First);
+      First = 0;
+    }
+  }
+  fprintf(Out, "]");
+
+  // Last, the simulated clock stays selected
+  if(Filter == NULL || strstr("spi", Filter) != NULL)
+  {
+    if(BENCH_Setup(BENCH_MAX_SIZES) != 0)
+    {
+      return 1;
+    }
+    CLK_SetClock(&CLK_Simulated);
+    fprintf(Out, ",\"spi\":[");
+    SpiError = BENCH_SpiOps(EMU_VERSION_SX1272, "sx1272", BENCH_SpiSx1272, Out, 1);
+    if(SpiError != 1)
+    {
+      Sx1276Error = BENCH_SpiOps(EMU_VERSION_SX1276, "sx1276", BENCH_SpiSx1276, Out, 0);
+      SpiError = Sx1276Error != 0 ? Sx1276Error : SpiError;
+    }
+    if(SpiError == 1)
+    {
+      return 1;
+    }
+    fprintf(Out, "]");
+  }
+  fprintf(Out, "}\n");
+  if(Out != stderr)
+  {
+    fclose(Out);
+  }
+  return SpiError;     /// 2 = SPI counts not the expected ones
+}
@@ -0,0 +1,473 @@
+/*******************************************************************************
+ * Capture
+ *
+ * Writes every frame the radio received with a good CRC and every frame it
+ * sent to a pcap file with the LoRaTap v1 header (linktype 270), which
+ * Wireshark decodes down to the LoRaWAN MAC:
+ *
+ *   single_chan_pkt_fwd -w lora.pcap -C 10 -W 5
+ *
+ * The HAL only copies the record into a ring buffer (CAP_Frame), it never
+ * waits for the disk. When the ring is full the record is dropped and counted.
+ * CAP_Engine in the main loop writes runs of whole records, at most
+ * CAP_WRITE_MAX bytes per call. The write is a plain write() of a regular file,
+ * O_NONBLOCK has no effect there: when the page cache is full of dirty pages
+ * (a slow SD card) it waits for the disk and stalls the main loop. With -r or
+ * -P the radio runs on a thread of its own and is not held up by it, in the
+ * single main loop the radio is serviced late until the write returns.
+ *
+ * With a maximum file size the file is rotated the way tcpdump -C/-W does:
+ * lora.pcap becomes lora.pcap.1, lora.pcap.1 becomes lora.pcap.2 and so on,
+ * the oldest beyond the maximum number of files is removed.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>            // Required for open
+#include <sys/time.h>
+#include "hal.h"
+#include "clock.h"
+#include "capture.h"
+
+static int CAP_StartFile( void );
+static void CAP_Rotate( void );
+static void CAP_Put( uint32_t Offset, const uint8_t *Data, uint32_t Size );
+static void CAP_Peek( uint32_t Offset, uint8_t *Data, uint32_t Size );
+static int CAP_Chan( struct HAL_CONTEXT_STRUCT *Hal, const struct HAL_TX_PARAMS_STRUCT *Tx );
+
+// Capture Variables
+static int CAP_Fd = -1;                             // -1 = capture off
+static char CAP_FileName[256];
+static uint32_t CAP_MaxFileSize = 0;                // 0 = no rotation
+static int CAP_MaxFiles = 1;
+static uint32_t CAP_FileSize = 0;                   // Bytes written to the current file
+static uint8_t CAP_GatewayId[8];
+
+static uint8_t CAP_Buffer[CAP_BUFFER_SIZE];         // Ring of pcap records
+static uint32_t CAP_Head = 0;                       // Bytes put, wraps around, only moved by CAP_Frame
+static uint32_t CAP_Tail = 0;                       // Bytes written, wraps around, only moved by CAP_Engine
+static uint32_t CAP_RecordLeft = 0;                 // Bytes of the record at CAP_Tail still to write
+static char CAP_PutLock = 0;                        // Held while a radio puts a record, there may be one thread per radio
+
+static uint32_t CAP_NumFrames = 0;
+static uint32_t CAP_NumDropped = 0;
+static uint32_t CAP_NumFiles = 0;
+
+
+/**
+* __Function__: CAP_Open
+*
+* __Description__: Start capturing to a pcap file
+*
+* __Input__: File name, maximum size of a file in bytes (0 = no rotation), number of files to keep
+*
+* __Output__: Error code: 0 = no error, 1 = Name too long, 2 = Cannot create the file
+*
+* __Status__: Completed
+*
+* __Remarks__: An existing file is overwritten
+*/
+int CAP_Open( const char *FileName, uint32_t MaxFileSize, int MaxFiles )
+{
+  if(strlen(FileName) >= sizeof(CAP_FileName))
+  {
+    printf("CAP_Open: Error: file name too long!\n");
+    return 1;       /// Error 1: Name too long
+  }
+  strcpy(CAP_FileName, FileName);
+  CAP_MaxFileSize = MaxFileSize;
+  CAP_MaxFiles = MaxFiles < 1 ? 1 : MaxFiles > CAP_MAX_FILES ? CAP_MAX_FILES : MaxFiles;
+
+  if(CAP_StartFile() != 0)
+  {
+    return 2;       /// Error 2: Cannot create the file
+  }
+  printf("CAP_Open: Capturing to %s", CAP_FileName);
+  if(CAP_MaxFileSize != 0)
+  {
+    printf(", rotating at %u bytes, %d files", CAP_MaxFileSize, CAP_MaxFiles);
+  }
+  printf("\n");
+  return 0;
+}
+
+void CAP_SetGatewayId( const uint8_t *Eui )
+{
+  memcpy(CAP_GatewayId, Eui, sizeof(CAP_GatewayId));
+}
+
+/**
+* __Function__: CAP_Frame
+*
+* __Description__: Buffer a frame as a pcap record with a LoRaTap header
+*
+* __Input__: HAL context of the radio, CAP_UPLINK or CAP_DOWNLINK, frame, size of the frame, SF, RSSI in dBm, SNR in dB,
+*            radio parameters of a downlink, NULL for an uplink
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Called from the HAL, only copies, the record is dropped when the ring is full.
+*              CAP_Engine takes records without a lock, the radios, each of which may run on a thread of
+*              its own, take turns putting them with a spin lock held for the copy
+*/
+void CAP_Frame( struct HAL_CONTEXT_STRUCT *Hal, int Direction, const uint8_t *Frame, int FrameSize, int SF, int Rssi, long int Snr, const struct HAL_TX_PARAMS_STRUCT *Tx )
+{
+  uint8_t Record[16 + CAP_LORATAP_LENGTH];
+  uint8_t *Tap = Record + 16;
+  uint32_t Field[4];
+  struct timeval Now;
+  uint32_t Freq = Tx != NULL ? Tx->Freq : HAL_GetChanFreq(Hal);
+  uint32_t Tmst;
+  int Value;
+
+  if(CAP_Fd < 0)
+  {
+    return;
+  }
+  CLK_GetTimeOfDay(&Now);
+  Tmst = (uint32_t)((uint64_t)Now.tv_sec * 1000000 + Now.tv_usec);    // Same time base as the rxpk tmst
+
+  // pcap record header, host byte order like the file header
+  Field[0] = Now.tv_sec;
+  Field[1] = Now.tv_usec;
+  Field[2] = CAP_LORATAP_LENGTH + FrameSize;
+  Field[3] = CAP_LORATAP_LENGTH + FrameSize;
+  memcpy(Record, Field, 16);
+
+  // LoRaTap v1 header, multi byte fields big endian
+  memset(Tap, 0, CAP_LORATAP_LENGTH);
+  Tap[0] = CAP_LORATAP_VERSION;
+  Tap[2] = CAP_LORATAP_LENGTH >> 8;
+  Tap[3] = CAP_LORATAP_LENGTH & 0xFF;
+  Tap[4] = Freq >> 24;
+  Tap[5] = Freq >> 16;
+  Tap[6] = Freq >> 8;
+  Tap[7] = Freq;
+  Tap[8] = Tx != NULL ? 1 << Tx->BW : 1;                    // Bandwidth in 125 kHz steps
+  Tap[9] = SF;
+  if(Direction == CAP_UPLINK)
+  {
+    Value = Rssi + 139;
+    Tap[10] = Value < 0 ? 0 : Value > 255 ? 255 : Value;    // packet_rssi
+    Tap[11] = 255;                                          // max_rssi, not measured
+    Tap[12] = 255;                                          // current_rssi, not measured
+    Value = Snr * 4;
+    Tap[13] = (uint8_t)(int8_t)(Value < -128 ? -128 : Value > 127 ? 127 : Value);
+  }
+  Tap[14] = CAP_LORATAP_SYNC_PUBLIC;
+  memcpy(Tap + 15, CAP_GatewayId, sizeof(CAP_GatewayId));
+  Tap[23] = Tmst >> 24;
+  Tap[24] = Tmst >> 16;
+  Tap[25] = Tmst >> 8;
+  Tap[26] = Tmst;
+  if(Tx != NULL)
+  {
+    Tap[27] = (Tx->IQ == HAL_IQ_INVERTED ? CAP_FLAG_IQ_INVERTED : 0) | CAP_FLAG_NO_CRC;
+    Tap[28] = 5 + Tx->CR;                                   // Coding rate 4/5 - 4/8
+  }
+  else
+  {
+    Tap[27] = CAP_FLAG_CRC_OK;
+    Tap[28] = 5;
+  }
+  Tap[31] = CAP_Chan(Hal, Tx);                              // if_channel and rf_chain, the rxpk chan and rfch
+  Tap[32] = Hal->Index;
+  // datarate and tag stay 0
+
+  while(__atomic_test_and_set(&CAP_PutLock, __ATOMIC_ACQUIRE))
+  {
+  }
+  if(CAP_BUFFER_SIZE - (CAP_Head - __atomic_load_n(&CAP_Tail, __ATOMIC_ACQUIRE)) < sizeof(Record) + FrameSize)
+  {
+    CAP_NumDropped++;
+  }
+  else
+  {
+    CAP_Put(0, Record, sizeof(Record));
+    CAP_Put(sizeof(Record), Frame, FrameSize);
+    // Publish the whole record at once, CAP_Engine may run on another thread
+    __atomic_store_n(&CAP_Head, CAP_Head + sizeof(Record) + FrameSize, __ATOMIC_RELEASE);
+    CAP_NumFrames++;
+  }
+  __atomic_clear(&CAP_PutLock, __ATOMIC_RELEASE);
+}
+
+/**
+* __Function__: CAP_Engine
+*
+* __Description__: Write buffered records to the file, rotate it when it is full
+*
+* __Input__: void
+*
+* __Output__: Bytes written, -1 = write error
+*
+* __Status__: Completed
+*
+* __Remarks__: What does not fit in CAP_WRITE_MAX is written on the next call. The write may wait for the
+*              disk when the page cache is full, see the top of this file
+*/
+int CAP_Engine( void )
+{
+  uint8_t Header[16];
+  uint32_t Length;
+  uint32_t Chunk;
+  uint32_t Index;
+  int Written = 0;
+  ssize_t Result;
+  uint32_t Head = __atomic_load_n(&CAP_Head, __ATOMIC_ACQUIRE);   // Whole records up to here
+
+  while(CAP_Fd >= 0 && Head != CAP_Tail && Written < CAP_WRITE_MAX)
+  {
+    // At a record boundary, take as many whole records as fit in the file
+    if(CAP_RecordLeft == 0)
+    {
+      CAP_Peek(0, Header, sizeof(Header));
+      memcpy(&Length, Header + 8, sizeof(Length));
+      if(CAP_MaxFileSize != 0 && CAP_FileSize > 24 && CAP_FileSize + sizeof(Header) + Length > CAP_MaxFileSize)
+      {
+        CAP_Rotate();
+        if(CAP_Fd < 0)
+        {
+          return -1;
+        }
+      }
+      do
+      {
+        CAP_RecordLeft += sizeof(Header) + Length;
+        if(Head - CAP_Tail == CAP_RecordLeft || CAP_RecordLeft >= CAP_WRITE_MAX)
+        {
+          break;
+        }
+        CAP_Peek(CAP_RecordLeft, Header, sizeof(Header));
+        memcpy(&Length, Header + 8, sizeof(Length));
+      } while(CAP_MaxFileSize == 0 || CAP_FileSize + CAP_RecordLeft + sizeof(Header) + Length <= CAP_MaxFileSize);
+    }
+
+    Index = CAP_Tail & (CAP_BUFFER_SIZE - 1);
+    Chunk = CAP_BUFFER_SIZE - Index;                        // Up to the end of the ring
+    if(Chunk > CAP_RecordLeft)
+    {
+      Chunk = CAP_RecordLeft;
+    }
+    if(Chunk > (uint32_t)(CAP_WRITE_MAX - Written))
+    {
+      Chunk = CAP_WRITE_MAX - Written;
+    }
+
+    Result = write(CAP_Fd, CAP_Buffer + Index, Chunk);
+    if(Result < 0)
+    {
+      if(errno == EINTR)
+      {
+        break;
+      }
+      printf("CAP_Engine: Error: write failed: %s, capture stopped!\n", strerror(errno));
+      close(CAP_Fd);
+      CAP_Fd = -1;
+      return -1;
+    }
+    __atomic_store_n(&CAP_Tail, CAP_Tail + Result, __ATOMIC_RELEASE);
+    CAP_RecordLeft -= Result;
+    CAP_FileSize += Result;
+    Written += Result;
+    if((uint32_t)Result < Chunk)
+    {
+      break;
+    }
+  }
+  return Written;
+}
+
+/**
+* __Function__: CAP_Close
+*
+* __Description__: Write what is left in the ring and close the file
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void CAP_Close( void )
+{
+  while(CAP_Fd >= 0 && CAP_Head != CAP_Tail)
+  {
+    if(CAP_Engine() <= 0)
+    {
+      break;
+    }
+  }
+  if(CAP_Fd >= 0)
+  {
+    close(CAP_Fd);
+    CAP_Fd = -1;
+    printf("CAP_Close: %u frames captured in %u files, %u dropped\n", CAP_NumFrames, CAP_NumFiles, CAP_NumDropped);
+  }
+}
+
+uint32_t CAP_GetNumFrames( void )
+{
+  return CAP_NumFrames;
+}
+
+uint32_t CAP_GetNumDropped( void )
+{
+  return CAP_NumDropped;
+}
+
+uint32_t CAP_GetNumFiles( void )
+{
+  return CAP_NumFiles;
+}
+
+/**
+* __Function__: CAP_StartFile
+*
+* __Description__: Create the capture file and write the pcap file header
+*
+* __Input__: void
+*
+* __Output__: Error code: 0 = no error, 1 = Cannot create the file
+*
+* __Status__: Completed
+*
+* __Remarks__: Microsecond timestamps in host byte order, the magic number tells the readers which
+*/
+static int CAP_StartFile( void )
+{
+  uint32_t Header[6];
+
+  CAP_Fd = open(CAP_FileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(CAP_Fd < 0)
+  {
+    printf("CAP_StartFile: Error: cannot create %s: %s\n", CAP_FileName, strerror(errno));
+    return 1;       /// Error 1: Cannot create the file
+  }
+  Header[0] = 0xA1B2C3D4;                                   // Magic, microsecond resolution
+  Header[1] = 2 | (4 << 16);                                // Version 2.4
+  Header[2] = 0;                                            // GMT
+  Header[3] = 0;                                            // Accuracy of the timestamps
+  Header[4] = CAP_SNAPLEN;
+  Header[5] = CAP_LINKTYPE_LORATAP;
+  if(write(CAP_Fd, Header, sizeof(Header)) != sizeof(Header))
+  {
+    printf("CAP_StartFile: Error: cannot write %s\n", CAP_FileName);
+    close(CAP_Fd);
+    CAP_Fd = -1;
+    return 1;
+  }
+  CAP_FileSize = sizeof(Header);
+  CAP_NumFiles++;
+  return 0;
+}
+
+/**
+* __Function__: CAP_Rotate
+*
+* __Description__: Shift the older files up one place and start a new file
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: name.N-1 is renamed over name.N, so at most CAP_MaxFiles files are kept
+*/
+static void CAP_Rotate( void )
+{
+  char From[sizeof(CAP_FileName) + 16];
+  char To[sizeof(CAP_FileName) + 16];
+  int i;
+
+  close(CAP_Fd);
+  if(CAP_MaxFiles == 1)
+  {
+    unlink(CAP_FileName);
+  }
+  for(i = CAP_MaxFiles - 1; i >= 1; i--)
+  {
+    if(i == 1)
+    {
+      snprintf(From, sizeof(From), "%s", CAP_FileName);
+    }
+    else
+    {
+      snprintf(From, sizeof(From), "%s.%d", CAP_FileName, i - 1);
+    }
+    snprintf(To, sizeof(To), "%s.%d", CAP_FileName, i);
+    rename(From, To);
+  }
+  CAP_StartFile();
+}
+
+/**
+* Copy into the ring at CAP_Head + Offset, the caller checked there is room and publishes it
+*/
+static void CAP_Put( uint32_t Offset, const uint8_t *Data, uint32_t Size )
+{
+  uint32_t Index = (CAP_Head + Offset) & (CAP_BUFFER_SIZE - 1);
+  uint32_t First = CAP_BUFFER_SIZE - Index;
+
+  if(First > Size)
+  {
+    First = Size;
+  }
+  memcpy(CAP_Buffer + Index, Data, First);
+  memcpy(CAP_Buffer, Data + First, Size - First);
+}
+
+/**
+* Copy out of the ring at CAP_Tail + Offset without taking it out
+*/
+static void CAP_Peek( uint32_t Offset, uint8_t *Data, uint32_t Size )
+{
+  uint32_t Index = (CAP_Tail + Offset) & (CAP_BUFFER_SIZE - 1);
+  uint32_t First = CAP_BUFFER_SIZE - Index;
+
+  if(First > Size)
+  {
+    First = Size;
+  }
+  memcpy(Data, CAP_Buffer + Index, First);
+  memcpy(Data + First, CAP_Buffer, Size - First);
+}
+
+/**
+* __Function__: CAP_Chan
+*
+* __Description__: Channel of a frame the way the rxpk reports it: the hop channel of a hopping radio, else the radio
+*
+* __Input__: HAL context of the radio, radio parameters of a downlink, NULL for an uplink
+*
+* __Output__: Channel
+*
+* __Status__: Completed
+*
+* __Remarks__: An uplink is captured while the radio is still on the channel it was received on. A downlink
+*              on a frequency the radio does not hop over (RX2) gets 255
+*/
+static int CAP_Chan( struct HAL_CONTEXT_STRUCT *Hal, const struct HAL_TX_PARAMS_STRUCT *Tx )
+{
+  int Chan;
+
+  if(Hal->NumChans <= 1)
+  {
+    return Hal->Index;
+  }
+  if(Tx == NULL)
+  {
+    return Hal->Chan;
+  }
+  Chan = HAL_FindChan(Hal, Tx->Freq);
+  return Chan < 0 ? 255 : Chan;
+}
@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * Capture Header file
+ *******************************************************************************/
+
+#ifndef _capture_h_
+#define _capture_h_
+
+#include <stdint.h>           // Required for unint8 etc
+
+struct HAL_CONTEXT_STRUCT;
+struct HAL_TX_PARAMS_STRUCT;
+
+/**
+* Capture Public Functions and Procedures
+*/
+int CAP_Open( const char *FileName, uint32_t MaxFileSize, int MaxFiles );   // Before HAL_Init, MaxFileSize 0 = no rotation
+void CAP_SetGatewayId( const uint8_t *Eui );         // 8 bytes, the source_gw of every record
+int CAP_Engine( void );                              // Write the buffered records, call from the main loop
+void CAP_Close( void );
+
+/**
+* Capture Supporting Functions and Procedures
+*/
+void CAP_Frame( struct HAL_CONTEXT_STRUCT *Hal, int Direction, const uint8_t *Frame, int FrameSize, int SF, int Rssi, long int Snr, const struct HAL_TX_PARAMS_STRUCT *Tx );
+uint32_t CAP_GetNumFrames( void );                   // Records buffered
+uint32_t CAP_GetNumDropped( void );                  // Records dropped, buffer full or write error
+uint32_t CAP_GetNumFiles( void );                    // Files started, 1 + rotations
+
+
+/**
+* Direction of a captured frame
+*/
+enum cap_direction_t {
+  CAP_UPLINK = 0,             // Received frame, CRC ok
+  CAP_DOWNLINK                // Frame sent, inverted IQ
+};
+
+#define CAP_BUFFER_SIZE           (256 * 1024)  // Bytes of records waiting to be written, power of 2
+#define CAP_WRITE_MAX             (16 * 1024)   // Bytes written per call of CAP_Engine at most
+#define CAP_MAX_FILES             100           // Rotated files kept at most
+#define CAP_MAX_FILE_MB           4000          // -C at most, the file size in bytes fits in 32 bit
+#define CAP_SNAPLEN               65535
+
+#define CAP_LINKTYPE_LORATAP      270           // DLT_LORATAP
+#define CAP_LORATAP_VERSION       1
+#define CAP_LORATAP_LENGTH        35            // Bytes of the LoRaTap v1 header
+#define CAP_LORATAP_SYNC_PUBLIC   0x34          // LoRaWAN sync word
+
+// LoRaTap v1 flags
+#define CAP_FLAG_MOD_FSK          0x01
+#define CAP_FLAG_IQ_INVERTED      0x02
+#define CAP_FLAG_IMPLICIT_HDR     0x04
+#define CAP_FLAG_CRC_OK           0x08
+#define CAP_FLAG_CRC_BAD          0x10
+#define CAP_FLAG_NO_CRC           0x20
+
+
+#endif // _capture_h_
@@ -0,0 +1,191 @@
+/*******************************************************************************
+ * Clock
+ *
+ * All timing of the forwarder, OS_GetMicros, OS_Delay, the wall clock of the
+ * gateway timers, rxpk tmst and stat time, goes through the selected clock:
+ *
+ * - CLK_Real, the clocks of the system
+ * - CLK_Simulated, virtual time that only moves when the code waits, so the
+ *   forwarder with the virtual radio or the SX127x emulator runs days of
+ *   traffic in minutes and gives the same result for the same input:
+ *
+ *   single_chan_pkt_fwd -c sim -v traffic:devices=1000,seed=3
+ *
+ *   OS_Delay advances the virtual time and returns at once. Every reading of
+ *   the clock takes CLK_SIM_READ_US, so code that polls the time in a busy
+ *   loop still sees it move. The wall clock starts at CLK_SIM_EPOCH, or the
+ *   epoch given with CLK_SetEpoch, e.g. just before a tmst wrap-around.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <time.h>             // Required for clock_gettime
+#include <sys/time.h>
+#include <unistd.h>           // Required for usleep
+#include "clock.h"
+
+uint64_t CLK_Real_GetMicros( void );
+void CLK_Real_Delay( unsigned int Millis );
+void CLK_Real_GetTimeOfDay( struct timeval *Now );
+uint64_t CLK_Sim_GetMicros( void );
+void CLK_Sim_Delay( unsigned int Millis );
+void CLK_Sim_GetTimeOfDay( struct timeval *Now );
+
+/**
+* The system clocks
+*/
+const struct CLK_CLOCK_STRUCT CLK_Real = {
+  "real",
+  CLK_Real_GetMicros,
+  CLK_Real_Delay,
+  CLK_Real_GetTimeOfDay
+};
+
+/**
+* Virtual time
+*/
+const struct CLK_CLOCK_STRUCT CLK_Simulated = {
+  "simulated",
+  CLK_Sim_GetMicros,
+  CLK_Sim_Delay,
+  CLK_Sim_GetTimeOfDay
+};
+
+// Clock Variables
+const struct CLK_CLOCK_STRUCT *CLK_Clock = &CLK_Real;
+uint64_t CLK_SimMicros = CLK_SIM_START_US;    // Simulated monotonic time
+time_t CLK_SimEpoch = CLK_SIM_EPOCH;          // Simulated wall clock at CLK_SIM_START_US
+
+
+/**
+* __Function__: CLK_SetClock
+*
+* __Description__: Select the clock
+*
+* __Input__: Clock, e.g. &CLK_Real or &CLK_Simulated
+*
+* __Output__: Error code: 0 = no error, 1 = No clock given
+*
+* __Status__: Completed
+*
+* __Remarks__: Switch before any time has been taken, intervals do not carry over between clocks
+*/
+int CLK_SetClock( const struct CLK_CLOCK_STRUCT *Clock )
+{
+  if(Clock == NULL)
+  {
+    return 1;
+  }
+  CLK_Clock = Clock;
+  return 0;
+}
+
+/**
+* __Function__: CLK_SetEpoch
+*
+* __Description__: Set the wall clock the simulated clock starts at
+*
+* __Input__: Seconds since 1970-01-01 00:00:00 UTC
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: The rxpk tmst is the wall clock in micro seconds, it wraps every 2^32 us (71.6 minutes)
+*/
+void CLK_SetEpoch( time_t Epoch )
+{
+  CLK_SimEpoch = Epoch;
+}
+
+const char *CLK_GetName( void )
+{
+  return CLK_Clock->Name;
+}
+
+uint64_t CLK_GetMicros( void )
+{
+  return CLK_Clock->GetMicros();
+}
+
+void CLK_Delay( unsigned int Millis )
+{
+  CLK_Clock->Delay(Millis);
+}
+
+void CLK_GetTimeOfDay( struct timeval *Now )
+{
+  CLK_Clock->GetTimeOfDay(Now);
+}
+
+/**
+* __Function__: CLK_Time
+*
+* __Description__: Wall clock in seconds, replaces time(NULL)
+*
+* __Input__: void
+*
+* __Output__: Seconds since 1970-01-01 00:00:00 UTC
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+time_t CLK_Time( void )
+{
+  struct timeval Now;
+
+  CLK_Clock->GetTimeOfDay(&Now);
+  return Now.tv_sec;
+}
+
+/**
+* __Function__: CLK_Real_GetMicros
+*
+* __Description__: Get a monotonic time stamp in micro seconds
+*
+* __Input__: void
+*
+* __Output__: uint64_t micro seconds since an arbitrary point in the past
+*
+* __Status__: Completed
+*
+* __Remarks__: Not affected by changes of the wall clock, use it to measure intervals
+*/
+uint64_t CLK_Real_GetMicros( void )
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void CLK_Real_Delay( unsigned int Millis )
+{
+  usleep(Millis * 1000);
+}
+
+void CLK_Real_GetTimeOfDay( struct timeval *Now )
+{
+  gettimeofday(Now, NULL);
+}
+
+uint64_t CLK_Sim_GetMicros( void )
+{
+  CLK_SimMicros += CLK_SIM_READ_US;
+  return CLK_SimMicros;
+}
+
+void CLK_Sim_Delay( unsigned int Millis )
+{
+  CLK_SimMicros += (uint64_t)Millis * 1000;
+}
+
+void CLK_Sim_GetTimeOfDay( struct timeval *Now )
+{
+  uint64_t Micros = CLK_Sim_GetMicros() - CLK_SIM_START_US;
+
+  Now->tv_sec = CLK_SimEpoch + Micros / 1000000;
+  Now->tv_usec = Micros % 1000000;
+}
@@ -0,0 +1,46 @@
+/*******************************************************************************
+ * Clock Header file
+ *******************************************************************************/
+
+#ifndef _clock_h_
+#define _clock_h_
+
+#include <stdint.h>           // Required for unint8 etc
+#include <time.h>
+#include <sys/time.h>         // Required for struct timeval
+
+/**
+* Time source, all timing of the forwarder goes through one of these
+*/
+struct CLK_CLOCK_STRUCT {
+  const char  *Name;                                          /**< Name of the clock, for the logs */
+  uint64_t    (*GetMicros)( void );                           /**< Monotonic micro seconds, for intervals */
+  void        (*Delay)( unsigned int Millis );                /**< Wait a number of milli seconds */
+  void        (*GetTimeOfDay)( struct timeval *Now );         /**< Wall clock */
+};
+
+extern const struct CLK_CLOCK_STRUCT CLK_Real;               // The clocks of the system
+extern const struct CLK_CLOCK_STRUCT CLK_Simulated;          // Virtual time, Delay returns at once
+
+/**
+* Clock Public Functions and Procedures, to be called before the other layers are initialised
+*/
+int CLK_SetClock( const struct CLK_CLOCK_STRUCT *Clock );
+void CLK_SetEpoch( time_t Epoch );                   // Wall clock of the simulated clock at its start
+
+/**
+* Clock Supporting Functions and Procedures
+*/
+const char *CLK_GetName( void );
+uint64_t CLK_GetMicros( void );
+void CLK_Delay( unsigned int Millis );
+void CLK_GetTimeOfDay( struct timeval *Now );
+time_t CLK_Time( void );
+
+
+#define CLK_SIM_EPOCH             1577836800    // 2020-01-01 00:00:00 UTC, start of the simulated wall clock
+#define CLK_SIM_START_US          1000000       // Simulated monotonic time at the start
+#define CLK_SIM_READ_US           1             // Every reading of the simulated clock takes this long
+
+
+#endif // _clock_h_
@@ -0,0 +1,264 @@
+/*******************************************************************************
+ * Duplicate suppression
+ *
+ * With several radios on one frequency the same uplink is received more than
+ * once. Before it is serialised the gateway offers every frame to the seen-set
+ * of DUP_TABLE_SIZE entries, keyed on a hash of the payload. The first copy is
+ * held for DUP_HOLD_US, a copy arriving meanwhile replaces its metadata when it
+ * was received with a better SNR (RSSI on a tie), after the hold the best copy
+ * is forwarded. Copies arriving later, up to DUP_WINDOW_US after the first, are
+ * dropped.
+ *
+ * The table uses open addressing with linear probing over at most DUP_MAX_PROBE
+ * entries. An entry expires when its window has passed and nothing is held in
+ * it, expired entries are reused on insert and skipped on lookup, so there is
+ * no clean-up pass. When all probed entries are in use the frame bypasses the
+ * suppression and is forwarded at once: a duplicate may reach the server, an
+ * uplink is never lost.
+ *
+ * Only the gateway stage touches the table, there is no locking.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <cstring>            // Required for memcpy
+#include "dedup.h"
+
+static int DUP_IsLive( struct DUP_ENTRY_STRUCT *Entry, uint64_t Now );
+static int DUP_IsBetter( const struct GW_RXPK_STRUCT *Copy, const struct GW_RXPK_STRUCT *Held );
+
+
+/**
+* __Function__: DUP_InitContext
+*
+* __Description__: Empty the seen-set
+*
+* __Input__: Duplicate suppression context
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void DUP_InitContext( struct DUP_CONTEXT_STRUCT *Dup )
+{
+  memset(Dup, 0, sizeof(struct DUP_CONTEXT_STRUCT));
+}
+
+/**
+* __Function__: DUP_Hash
+*
+* __Description__: 64 bit FNV-1a hash of a payload
+*
+* __Input__: Frame, FrameSize
+*
+* __Output__: Hash, never 0
+*
+* __Status__: Completed
+*
+* __Remarks__: 0 marks an entry that was never used
+*/
+uint64_t DUP_Hash( const uint8_t *Frame, int FrameSize )
+{
+  uint64_t Hash = 14695981039346656037ULL;
+  int i;
+
+  for(i = 0; i < FrameSize; i++)
+  {
+    Hash ^= Frame[i];
+    Hash *= 1099511628211ULL;
+  }
+  return Hash ? Hash : 1;
+}
+
+/**
+* Entry still counts: a copy is held in it or its window has not passed
+*/
+static int DUP_IsLive( struct DUP_ENTRY_STRUCT *Entry, uint64_t Now )
+{
+  return Entry->Hash != 0 && (Entry->Held || Now - Entry->FirstTime < DUP_WINDOW_US);
+}
+
+/**
+* Copy received with a better signal than the one held
+*/
+static int DUP_IsBetter( const struct GW_RXPK_STRUCT *Copy, const struct GW_RXPK_STRUCT *Held )
+{
+  return Copy->Snr > Held->Snr || (Copy->Snr == Held->Snr && Copy->Rssi > Held->Rssi);
+}
+
+/**
+* __Function__: DUP_Offer
+*
+* __Description__: Offer a received frame to the seen-set
+*
+* __Input__: Duplicate suppression context, Frame, FrameSize, metadata of the copy, Now = receive time in micro seconds
+*
+* __Output__: One of dup_offer_t
+*
+* __Status__: Completed
+*
+* __Remarks__: The payload is compared in full, a hash collision is not taken for a duplicate. A later copy
+*              never changes the tmst of the held one, its chan, rfch, freq, SF, SNR and RSSI are taken over.
+*/
+int DUP_Offer( struct DUP_CONTEXT_STRUCT *Dup, const uint8_t *Frame, int FrameSize, const struct GW_RXPK_STRUCT *Rxpk, uint64_t Now )
+{
+  uint64_t Hash = DUP_Hash(Frame, FrameSize);
+  struct DUP_ENTRY_STRUCT *Entry;
+  struct DUP_ENTRY_STRUCT *Free = NULL;
+  uint32_t Tmst;
+  int i;
+
+  for(i = 0; i < DUP_MAX_PROBE; i++)
+  {
+    Entry = &Dup->Table[(Hash + i) & (DUP_TABLE_SIZE - 1)];
+    if(!DUP_IsLive(Entry, Now))
+    {
+      if(Free == NULL)
+      {
+        Free = Entry;
+      }
+      continue;
+    }
+    if(Entry->Hash == Hash && Entry->FrameSize == FrameSize && memcmp(Entry->Frame, Frame, FrameSize) == 0)
+    {
+      if(Entry->Held && DUP_IsBetter(Rxpk, &Entry->Rxpk))
+      {
+        Tmst = Entry->Rxpk.Tmst;
+        Entry->Rxpk = *Rxpk;
+        Entry->Rxpk.Tmst = Tmst;
+      }
+      Dup->NumDuplicates++;
+      return DUP_DUPLICATE;
+    }
+  }
+
+  if(Free == NULL || FrameSize > LORA_RX_MX_FRAME_SIZE)
+  {
+    Dup->NumBypassed++;
+    return DUP_BYPASS;
+  }
+  Free->Hash = Hash;
+  Free->FirstTime = Now;
+  Free->Held = 1;
+  Free->FrameSize = FrameSize;
+  Free->Rxpk = *Rxpk;
+  memcpy(Free->Frame, Frame, FrameSize);
+  Dup->NumHeld++;
+  Dup->NumUnique++;
+  return DUP_HELD;
+}
+
+/**
+* __Function__: DUP_Take
+*
+* __Description__: Take the best copy of the oldest held payload whose hold time has passed
+*
+* __Input__: Duplicate suppression context, Frame buffer of LORA_RX_MX_FRAME_SIZE bytes, metadata to fill, Now in micro seconds
+*
+* __Output__: FrameSize, 0 = nothing due
+*
+* __Status__: Completed
+*
+* __Remarks__: The entry stays in the seen-set until its window has passed, to drop late copies
+*/
+int DUP_Take( struct DUP_CONTEXT_STRUCT *Dup, uint8_t *Frame, struct GW_RXPK_STRUCT *Rxpk, uint64_t Now )
+{
+  struct DUP_ENTRY_STRUCT *Oldest = NULL;
+  struct DUP_ENTRY_STRUCT *Entry;
+  int i;
+
+  if(Dup->NumHeld == 0)
+  {
+    Dup->Flush = 0;
+    return 0;
+  }
+  for(i = 0; i < DUP_TABLE_SIZE; i++)
+  {
+    Entry = &Dup->Table[i];
+    if(Entry->Held && (Dup->Flush || Now - Entry->FirstTime >= DUP_HOLD_US) &&
+       (Oldest == NULL || Entry->FirstTime < Oldest->FirstTime))
+    {
+      Oldest = Entry;
+    }
+  }
+  if(Oldest == NULL)
+  {
+    return 0;
+  }
+  memcpy(Frame, Oldest->Frame, Oldest->FrameSize);
+  *Rxpk = Oldest->Rxpk;
+  Oldest->Held = 0;
+  Dup->NumHeld--;
+  return Oldest->FrameSize;
+}
+
+/**
+* __Function__: DUP_Pending
+*
+* __Description__: Check whether DUP_Take would return a copy now
+*
+* __Input__: Duplicate suppression context, Now in micro seconds
+*
+* __Output__: 1 = a held copy is due, 0 = nothing due
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+int DUP_Pending( struct DUP_CONTEXT_STRUCT *Dup, uint64_t Now )
+{
+  int i;
+
+  if(Dup->NumHeld == 0)
+  {
+    return 0;
+  }
+  if(Dup->Flush)
+  {
+    return 1;
+  }
+  for(i = 0; i < DUP_TABLE_SIZE; i++)
+  {
+    if(Dup->Table[i].Held && Now - Dup->Table[i].FirstTime >= DUP_HOLD_US)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+* __Function__: DUP_Flush
+*
+* __Description__: Make every held copy due at once
+*
+* __Input__: Duplicate suppression context
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Before a shutdown, so the held uplinks are forwarded. Ends when DUP_Take has returned them all.
+*/
+void DUP_Flush( struct DUP_CONTEXT_STRUCT *Dup )
+{
+  Dup->Flush = 1;
+}
+
+int DUP_GetNumHeld( struct DUP_CONTEXT_STRUCT *Dup )
+{
+  return Dup->NumHeld;
+}
+
+uint32_t DUP_GetNumDuplicates( struct DUP_CONTEXT_STRUCT *Dup )
+{
+  return Dup->NumDuplicates;
+}
+
+uint32_t DUP_GetNumBypassed( struct DUP_CONTEXT_STRUCT *Dup )
+{
+  return Dup->NumBypassed;
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * Duplicate suppression Header file
+ *******************************************************************************/
+
+#ifndef _dedup_h_
+#define _dedup_h_
+
+#include <stdint.h>           // Required for unint8 etc
+#include "hal.h"              // LORA_RX_MX_FRAME_SIZE
+#include "gateway.h"          // struct GW_RXPK_STRUCT
+
+#define DUP_TABLE_SIZE            64        // Entries of the seen-set, power of 2
+#define DUP_MAX_PROBE             8         // Entries looked at for one payload at most
+#define DUP_HOLD_US               20000     // The first copy waits this long for better copies from the other radios
+#define DUP_WINDOW_US             200000    // Copies arriving within this time of the first are dropped
+
+/**
+* One payload seen recently, the best copy is held until it is forwarded
+*/
+struct DUP_ENTRY_STRUCT {
+  uint64_t  Hash;                             // FNV-1a hash of the payload, 0 = never used
+  uint64_t  FirstTime;                        // Time the first copy was offered, micro seconds
+  int       Held;                             // 1 = the best copy waits to be forwarded
+  int       FrameSize;
+  struct GW_RXPK_STRUCT Rxpk;                 // Metadata of the best copy
+  uint8_t   Frame[LORA_RX_MX_FRAME_SIZE];
+};
+
+/**
+* Seen-set of one gateway, fixed memory. Set it up with DUP_InitContext.
+*/
+struct DUP_CONTEXT_STRUCT {
+  int       NumHeld;                          // Entries with Held set
+  int       Flush;                            // 1 = forward held copies without waiting, set by DUP_Flush
+  uint32_t  NumUnique;                        // Payloads offered for the first time
+  uint32_t  NumDuplicates;                    // Copies dropped, another copy of the payload is or was forwarded
+  uint32_t  NumBypassed;                      // Payloads forwarded at once, no free entry within DUP_MAX_PROBE
+  struct DUP_ENTRY_STRUCT Table[DUP_TABLE_SIZE];
+};
+
+/**
+* Duplicate suppression Public Functions and Procedures
+*/
+void DUP_InitContext( struct DUP_CONTEXT_STRUCT *Dup );
+int DUP_Offer( struct DUP_CONTEXT_STRUCT *Dup, const uint8_t *Frame, int FrameSize, const struct GW_RXPK_STRUCT *Rxpk, uint64_t Now );
+int DUP_Take( struct DUP_CONTEXT_STRUCT *Dup, uint8_t *Frame, struct GW_RXPK_STRUCT *Rxpk, uint64_t Now );   // Frame LORA_RX_MX_FRAME_SIZE bytes
+int DUP_Pending( struct DUP_CONTEXT_STRUCT *Dup, uint64_t Now );   // 1 = DUP_Take has a copy now
+void DUP_Flush( struct DUP_CONTEXT_STRUCT *Dup );   // Make every held copy due, before a shutdown
+
+/**
+* Duplicate suppression Supporting Functions and Procedures
+*/
+uint64_t DUP_Hash( const uint8_t *Frame, int FrameSize );
+int DUP_GetNumHeld( struct DUP_CONTEXT_STRUCT *Dup );
+uint32_t DUP_GetNumDuplicates( struct DUP_CONTEXT_STRUCT *Dup );
+uint32_t DUP_GetNumBypassed( struct DUP_CONTEXT_STRUCT *Dup );
+
+
+/**
+* Result of DUP_Offer
+*/
+enum dup_offer_t {
+  DUP_HELD = 0,                 // First copy, held until DUP_Take returns it
+  DUP_DUPLICATE,                // Copy of a payload seen within the window, dropped, its metadata may have replaced the held copy
+  DUP_BYPASS                    // No free entry, forward the frame now
+};
+
+
+#endif // _dedup_h_
@@ -32,39 +32,146 @@
 #include "hal.h"
 #include "gateway.h"
 #include "base64.h"
+#include "os.h"
+#include "clock.h"            // Time source
+#include "metrics.h"          // Instrumentation
+#include "trace.h"            // Tracepoints
+#include "capture.h"          // pcap capture
+#include "dedup.h"            // Duplicate suppression
+#include "linkq.h"            // Downlink radio selection
 
 
-// Timers
-uint32_t Status_lasttime;     // Send regular status updated from the GW to the server
-uint32_t PushData_lasttime;   // Send PushData frames to keep channel open
-
-
-// variable to store mac address of gateway
-struct ifreq GW_ifr;
-
 // Informal status fields
 static char platform[24]    = "Single Channel Gateway";  /* platform definition */
 static char email[40]       = "";                        /* used for contact email */
 static char description[64] = "";                        /* used for free form description */
 
-byte currentMode = 0x81;   /// check if this is used
+/**
+* __Function__: GW_InitContext
+*
+* __Description__: Set a gateway context to the defaults and connect it to a radio and an upstream
+*
+* __Input__: GW context, HAL context of the first radio, NULL = none, UDP context of the upstream
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before GW_Init, the EUI is set by GW_Init from the ETH0 MAC address
+*/
+void GW_InitContext( struct GW_CONTEXT_STRUCT *Gw, struct HAL_CONTEXT_STRUCT *Hal, struct UDP_CONTEXT_STRUCT *Udp )
+{
+  memset(Gw, 0, sizeof(*Gw));
+  Gw->Udp = Udp;
+  Gw->ReportFreq = GW_REPORT_FREQ;
+  if(Hal != NULL)
+  {
+    GW_AddRadio(Gw, Hal);
+  }
+}
 
-int SpreadingFactor = 0;           // Spreading Factor
-uint32_t LoraFreq = 0;    // Lora Frequency Used
-/// Little hack to get the TTS to think we are working with 868 modules whilst I only have 433 modules....to be replace soon
-double  freq2 = 868100000; // in Mhz! (868.1)
+/**
+* __Function__: GW_AddRadio
+*
+* __Description__: Add a radio the gateway listens on and transmits with
+*
+* __Input__: GW context, HAL context of the radio
+*
+* __Output__: Error code: 0 = no error, 1 = GW_MAX_RADIOS reached
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before GW_Init, the radio is numbered in the order it is added, its uplinks are
+*              reported with that number as chan and rfch
+*/
+int GW_AddRadio( struct GW_CONTEXT_STRUCT *Gw, struct HAL_CONTEXT_STRUCT *Hal )
+{
+  if(Gw->NumRadios >= GW_MAX_RADIOS)
+  {
+    printf("GW_AddRadio: Error: at most %d radios\n", GW_MAX_RADIOS);
+    return 1;
+  }
+  Hal->Index = Gw->NumRadios;
+  Gw->Hal[Gw->NumRadios++] = Hal;
+  return 0;
+}
+
+/**
+* __Function__: GW_SetDedup
+*
+* __Description__: Suppress duplicate uplinks, the same frame received by more than one radio
+*
+* __Input__: GW context, initialised duplicate suppression context, NULL = off
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before GW_Init. Every uplink is then held for DUP_HOLD_US before it is forwarded.
+*/
+void GW_SetDedup( struct GW_CONTEXT_STRUCT *Gw, struct DUP_CONTEXT_STRUCT *Dup )
+{
+  Gw->Dup = Dup;
+}
 
-// Set location and altitude
-float lat=0;
-float lon=0;
-int   alt=0;
+/**
+* __Function__: GW_SetLinks
+*
+* __Description__: Send every downlink on the radio that heard its device best
+*
+* __Input__: GW context, initialised link quality context, NULL = every downlink on radio 0
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before GW_Init
+*/
+void GW_SetLinks( struct GW_CONTEXT_STRUCT *Gw, struct LQ_CONTEXT_STRUCT *Links )
+{
+  Gw->Links = Links;
+}
+
+/**
+* __Function__: GW_SelectRadio
+*
+* __Description__: Radio a downlink is sent on
+*
+* __Input__: GW context, parsed txpk, size of the decoded frame
+*
+* __Output__: Number of the radio, -1 = the gateway has no radio
+*
+* __Status__: Completed
+*
+* __Remarks__: The radio that heard the device best on its last uplink, radio 0 when the device is not known
+*/
+int GW_SelectRadio( struct GW_CONTEXT_STRUCT *Gw, const struct GW_TXPK_STRUCT *Txpk, int FrameSize )
+{
+  int Radio;
+
+  if(Gw->NumRadios == 0)
+  {
+    return -1;
+  }
+  if(Gw->Links == NULL)
+  {
+    return 0;
+  }
+  Radio = LQ_SelectRadio(Gw->Links, Txpk->Payload, FrameSize, Txpk->HasTmst, Txpk->Tmst);
+  if(Radio < 0 || Radio >= Gw->NumRadios)
+  {
+    MET_Count(MET_DOWNLINKS_UNROUTED);
+    return 0;
+  }
+  return Radio;
+}
 
 /**
 * __Function__: GW_Init
 *
 * __Description__: GW Initialisation procedure
 *
-* __Input__: void
+* __Input__: GW context
 *
 * __Output__: Error code: 0 = no error, -1 = Socket error
 *
@@ -72,36 +179,53 @@ int   alt=0;
 *
 * __Remarks__:
 */
-int GW_Init(void)
+int GW_Init( struct GW_CONTEXT_STRUCT *Gw )
 {
+  struct ifreq Ifr;
+  int i;
 
 
   // get the Eth0 Mac address as this is used for the Gateway EUI
-  UDP_GetEth0Mac(&GW_ifr);
+  UDP_GetEth0Mac(Gw->Udp, &Ifr);
+  // Gateway EUI in the header of every datagram and the source_gw of the capture
+  Gw->Eui[0] = (unsigned char)Ifr.ifr_hwaddr.sa_data[0];
+  Gw->Eui[1] = (unsigned char)Ifr.ifr_hwaddr.sa_data[1];
+  Gw->Eui[2] = (unsigned char)Ifr.ifr_hwaddr.sa_data[2];
+  Gw->Eui[3] = 0xFF;
+  Gw->Eui[4] = 0xFF;
+  Gw->Eui[5] = (unsigned char)Ifr.ifr_hwaddr.sa_data[3];
+  Gw->Eui[6] = (unsigned char)Ifr.ifr_hwaddr.sa_data[4];
+  Gw->Eui[7] = (unsigned char)Ifr.ifr_hwaddr.sa_data[5];
+  CAP_SetGatewayId(Gw->Eui);
 
 
-  // Get the Lora Spreading Factor
-  SpreadingFactor = HAL_GetSF();
-  // Get the Lora Frequency used
-  LoraFreq = HAL_GetFreq();
-
   // Inform the user of the settings of the GW --> later change to Oled
   printf("--------------------------------------------------------\n");
-  printf("Listening at SF%i on %.6lf Mhz.\n", SpreadingFactor,(double)LoraFreq/1000000);
+  for(i = 0; i < Gw->NumRadios; i++)
+  {
+    if(Gw->Hal[i]->NumChans > 1)
+    {
+      printf("Radio %d hopping over %d channels from %.6lf Mhz%s.\n", i, Gw->Hal[i]->NumChans, (double)HAL_GetFreq(Gw->Hal[i])/1000000,
+        Gw->Hal[i]->HopAdapt ? ", time shared by traffic" : "");
+    }
+    if(Gw->Hal[i]->ScanMaxSF != 0)
+    {
+      printf("Radio %d scanning SF%i to SF%i on %.6lf Mhz.\n", i, HAL_GetSF(Gw->Hal[i]), Gw->Hal[i]->ScanMaxSF, (double)HAL_GetFreq(Gw->Hal[i])/1000000);
+    }
+    else
+    {
+      printf("Radio %d listening at SF%i on %.6lf Mhz.\n", i, HAL_GetSF(Gw->Hal[i]), (double)HAL_GetFreq(Gw->Hal[i])/1000000);
+    }
+  }
   printf("--------------------------------------------------------\n");
   printf("Gateway ID: %.2x:%.2x:%.2x:ff:ff:%.2x:%.2x:%.2x\n",
-    (unsigned char)GW_ifr.ifr_hwaddr.sa_data[0],
-    (unsigned char)GW_ifr.ifr_hwaddr.sa_data[1],
-    (unsigned char)GW_ifr.ifr_hwaddr.sa_data[2],
-    (unsigned char)GW_ifr.ifr_hwaddr.sa_data[3],
-    (unsigned char)GW_ifr.ifr_hwaddr.sa_data[4],
-    (unsigned char)GW_ifr.ifr_hwaddr.sa_data[5]);
+    Gw->Eui[0], Gw->Eui[1], Gw->Eui[2], Gw->Eui[5], Gw->Eui[6], Gw->Eui[7]);
   printf("--------------------------------------------------------\n");
 
   // Send status update to the server
-  GW_SendStat();
+  GW_SendStat(Gw);
   // Send pull data request to server
-  GW_SendPullData();
+  GW_SendPullData(Gw);
   // No errors
   return 0;
 }
@@ -111,7 +235,7 @@ int GW_Init(void)
 *
 * __Description__: GW Engine to be called in the main loop to execute Gateway tasks
 *
-* __Input__: void
+* __Input__: GW context
 *
 * __Output__: Error code: 0 = no error, -1 = Socket error
 *
@@ -119,20 +243,20 @@ int GW_Init(void)
 *
 * __Remarks__:
 */
-int GW_Engine(void)
+int GW_Engine( struct GW_CONTEXT_STRUCT *Gw )
 {
 
  // Check on Lora packet received, if yes process and send through UDP_Init
- GW_ProcessRX_Lora();
+ GW_ProcessRX_Lora(Gw);
 
  // Check on UDP Packet received, if yes process and forward to LoRa
- GW_ProcessRX_UDP();
+ GW_ProcessRX_UDP(Gw);
 
  // Send status updated to server
- GW_SendGWStatusUpate();
+ GW_SendGWStatusUpate(Gw);
 
  // Send regular Pull data requests to the server to allow downstream traffic
- GW_SendPullDataTMR();
+ GW_SendPullDataTMR(Gw);
 
  return 0;
 }
@@ -145,7 +269,7 @@ int GW_Engine(void)
 *
 * __Description__: Procedure to send Gatway status updates to the server
 *
-* __Input__: void
+* __Input__: GW context
 *
 * __Output__: Error code: 0 = no error, -1 = Socket error
 *
@@ -153,15 +277,15 @@ int GW_Engine(void)
 *
 * __Remarks__:
 */
-int GW_SendGWStatusUpate(void)
+int GW_SendGWStatusUpate( struct GW_CONTEXT_STRUCT *Gw )
 {
   struct timeval nowtime;
 
-  gettimeofday(&nowtime, NULL);
+  CLK_GetTimeOfDay(&nowtime);
   uint32_t nowseconds = (uint32_t)(nowtime.tv_sec);
-  if (nowseconds - Status_lasttime >= TMR_STAT_TX) {
-      Status_lasttime = nowseconds;
-      GW_SendStat();
+  if (nowseconds - Gw->StatusLastTime >= TMR_STAT_TX) {
+      Gw->StatusLastTime = nowseconds;
+      GW_SendStat(Gw);
   }
   return 0;
 }
@@ -172,7 +296,7 @@ int GW_SendGWStatusUpate(void)
 *
 * __Description__: GW Engine to be called in the main loop to execute Gateway tasks
 *
-* __Input__: void
+* __Input__: GW context
 *
 * __Output__: Error code: 0 = no error, -1 = Socket error
 *
@@ -180,16 +304,16 @@ int GW_SendGWStatusUpate(void)
 *
 * __Remarks__:
 */
-int GW_SendPullDataTMR(void)
+int GW_SendPullDataTMR( struct GW_CONTEXT_STRUCT *Gw )
 {
   struct timeval nowtime;
 
-  gettimeofday(&nowtime, NULL);
+  CLK_GetTimeOfDay(&nowtime);
   uint32_t nowseconds = (uint32_t)(nowtime.tv_sec);
-  if (nowseconds - PushData_lasttime >= TMR_TX_PULL) {
-      PushData_lasttime = nowseconds;
+  if (nowseconds - Gw->PullDataLastTime >= TMR_TX_PULL) {
+      Gw->PullDataLastTime = nowseconds;
       // Send PULL_DATA
-      GW_SendPullData();
+      GW_SendPullData(Gw);
   }
   return 0;
 }
@@ -199,7 +323,7 @@ int GW_SendPullDataTMR(void)
 *
 * __Description__: Gateway Send Stats to server
 *
-* __Input__: void
+* __Input__: GW context
 *
 * __Output__: Error code: 0 = no error, -1 = Socket error
 *
@@ -207,10 +331,10 @@ int GW_SendPullDataTMR(void)
 *
 * __Remarks__: Send a status up date to the server
 */
-void GW_SendStat()
+void GW_SendStat( struct GW_CONTEXT_STRUCT *Gw )
 {
 
-    static char status_report[STATUS_SIZE]; /* status report as a JSON object */
+    char status_report[STATUS_SIZE]; /* status report as a JSON object */
     char stat_timestamp[24];
     time_t t;
     int stat_index=0;
@@ -219,14 +343,7 @@ void GW_SendStat()
     status_report[0] = PROTOCOL_VERSION;
     status_report[3] = PKT_PUSH_DATA;
 
-    status_report[4] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[0];
-    status_report[5] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[1];
-    status_report[6] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[2];
-    status_report[7] = 0xFF;
-    status_report[8] = 0xFF;
-    status_report[9] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[3];
-    status_report[10] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[4];
-    status_report[11] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[5];
+    memcpy(status_report + 4, Gw->Eui, sizeof(Gw->Eui));
 
     /* start composing datagram with the header */
     uint8_t token_h = (uint8_t)rand(); /* random token */
@@ -236,22 +353,22 @@ void GW_SendStat()
     stat_index = 12; /* 12-byte header */
 
     /* get timestamp for statistics */
-    t = time(NULL);
+    t = CLK_Time();
     strftime(stat_timestamp, sizeof stat_timestamp, "%F %T %Z", gmtime(&t));
 
-    uint32_t NumRx = HAL_GetNumRX();
-    uint32_t RxOk = HAL_GetRxOk();
-    uint32_t PktFwd = HAL_GetPktWfd();
+    uint32_t NumRx = GW_GetNumRX(Gw);
+    uint32_t RxOk = GW_GetRxOk(Gw);
+    uint32_t PktFwd = GW_GetPktFwd(Gw);
 
 
-    int j = snprintf((char *)(status_report + stat_index), STATUS_SIZE-stat_index, "{\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"pfrm\":\"%s\",\"mail\":\"%s\",\"desc\":\"%s\"}}", stat_timestamp, lat, lon, (int)alt, NumRx, RxOk, PktFwd, (float)0, 0, 0,platform,email,description);
+    int j = snprintf((char *)(status_report + stat_index), STATUS_SIZE-stat_index, "{\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"pfrm\":\"%s\",\"mail\":\"%s\",\"desc\":\"%s\"}}", stat_timestamp, Gw->Lat, Gw->Lon, Gw->Alt, NumRx, RxOk, PktFwd, (float)0, 0, 0,platform,email,description);
     stat_index += j;
     status_report[stat_index] = 0; /* add string terminator, for safety */
 
     printf("stat update: %s\n", (char *)(status_report+12)); /* DEBUG: display JSON stat */
 
     //send the Gateway status updates to the server
-    if(UDP_SendUDP(status_report, stat_index))
+    if(UDP_SendUDP(Gw->Udp, status_report, stat_index))
     {
       // if not 0 = error
       printf("GW_SendStat: Error sending UDP!");
@@ -263,7 +380,7 @@ void GW_SendStat()
 *
 * __Description__: Gateway Send Pull Data request to the sever to enable down stream comms
 *
-* __Input__: void
+* __Input__: GW context
 *
 * __Output__: Error code: 0 = no error, -1 = Socket error
 *
@@ -278,7 +395,7 @@ void GW_SendStat()
 *  3      | PULL_DATA identifier 0x02
 *  4-11   | Gateway unique identifier (MAC address)
 */
-int GW_SendPullData()
+int GW_SendPullData( struct GW_CONTEXT_STRUCT *Gw )
 {
   char buff_up[PULL_DATA_PKT_LEN]; /* buffer to compose the upstream packet */
   int buff_index=PULL_DATA_PKT_LEN;
@@ -296,17 +413,10 @@ int GW_SendPullData()
   buff_up[3] = PKT_PULL_DATA;
 
   // Add gateway ID (derived from eth0 MAC address)
-  buff_up[4]  = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[0];
-  buff_up[5]  = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[1];
-  buff_up[6]  = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[2];
-  buff_up[7]  = 255;  // 0xff in the middle
-  buff_up[8]  = 255;  // 0xff in the middle
-  buff_up[9]  = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[3];
-  buff_up[10] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[4];
-  buff_up[11] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[5];
+  memcpy(buff_up + 4, Gw->Eui, sizeof(Gw->Eui));
 
   // Send Pull data requests to the server
-  if( UDP_SendUDP(buff_up, buff_index))
+  if( UDP_SendUDP(Gw->Udp, buff_up, buff_index))
   {
     // Error if not 0
     printf("GW_SendPullData: Error sending UDP!\n");
@@ -317,12 +427,154 @@ int GW_SendPullData()
   return 0;
 }
 
+/**
+* __Function__: GW_FreqOffset
+*
+* __Description__: Distance between the reported and the real frequencies of the radios
+*
+* __Input__: GW context
+*
+* __Output__: Offset in Hz, added to the rxpk freq and taken off the txpk freq, 0 = real frequencies reported
+*
+* __Status__: Completed
+*
+* __Remarks__: See ReportFreq
+*/
+static double GW_FreqOffset( struct GW_CONTEXT_STRUCT *Gw )
+{
+  return Gw->ReportFreq != 0 ? Gw->ReportFreq - HAL_GetFreq(Gw->Hal[0]) : 0;
+}
+
+/**
+* __Function__: GW_ParseTxpk
+*
+* __Description__: Parse the JSON object of a PULL_RESP and decode the frame to transmit
+*
+* __Input__: Null terminated JSON object, offset in Hz of the reported frequencies, pointer to the txpk to fill
+*
+* __Output__: Number of bytes decoded, -1 = JSON error, -2 = No txpk, -3 = B64 error, -4 = datr not supported,
+*              -5 = codr not supported, -6 = freq out of the range of the chip
+*
+* __Status__: Completed
+*
+* __Remarks__: Split from GW_ProcessRX_UDP so that it can be benchmarked on its own, bench_micro.c. The radio
+*              parameters not in the txpk are left 0, the radio sends them as it receives, at HAL_DEFAULT_TX_POWER.
+*              The server answers on the frequencies the rxpk reported, FreqOffset is taken off the freq again.
+*/
+int GW_ParseTxpk( const char *Json, double FreqOffset, struct GW_TXPK_STRUCT *Txpk )
+{
+  double Freq;
+  char *RF_B64_Payload_Str;
+  int ResultLen;
+  struct json_object *RF_B64_Payload;
+  struct json_object *RF_Pkt_Len;
+  struct json_object *RF_TX_Pkt;
+  struct json_object *RF_Tmst;
+  struct json_object *RF_Param;
+  struct json_object *PushPacket;
+  int SF, BW, CR;
+
+  // Payload is received as a JSON:
+  // {
+  // 	"txpk": {...}
+  // }
+  if((PushPacket = json_tokener_parse( Json )) == NULL)
+  {
+    return -1;      /// Error -1: not a JSON object
+  }
+
+  // Decode payload (raw payload is b64 encoded)
+  // txpk.data | string | Base64 encoded RF packet payload, padding optional
+  // get raw data from json
+  // Get length of raw data: size | number | RF packet payload size in bytes (unsigned integer)
+  // First get top level JSON entry as the size and data are nested
+  if(!json_object_object_get_ex(PushPacket, "txpk", &RF_TX_Pkt) || !json_object_object_get_ex(RF_TX_Pkt, "data", &RF_B64_Payload))
+  {
+    json_object_put(PushPacket);
+    return -2;      /// Error -2: no txpk or no data in it
+  }
+  // Next get the size object
+  Txpk->Size = 0;
+  if(json_object_object_get_ex(RF_TX_Pkt, "size", &RF_Pkt_Len))
+  {
+    Txpk->Size = json_object_get_int(RF_Pkt_Len);
+  }
+
+  // Time to transmit, same time base as the rxpk tmst
+  Txpk->HasTmst = json_object_object_get_ex(RF_TX_Pkt, "tmst", &RF_Tmst);
+  if(Txpk->HasTmst)
+  {
+    Txpk->Tmst = (uint32_t)json_object_get_int64(RF_Tmst);
+  }
+
+  // Radio parameters, 0 = as the radio receives, see HAL_TransmitFrame
+  memset(&Txpk->Tx, 0, sizeof(Txpk->Tx));
+  Txpk->Tx.Power = HAL_DEFAULT_TX_POWER;
+  // freq | number | TX central frequency in MHz (unsigned float, Hz precision)
+  if(json_object_object_get_ex(RF_TX_Pkt, "freq", &RF_Param))
+  {
+    Freq = json_object_get_double(RF_Param) * 1e6 - FreqOffset;
+    if(Freq < HAL_MIN_FREQ || Freq > HAL_MAX_FREQ)
+    {
+      json_object_put(PushPacket);
+      return -6;    /// Error -6: freq the chip cannot tune to
+    }
+    Txpk->Tx.Freq = (uint32_t)(Freq + 0.5);
+  }
+  // datr | string | LoRa datarate identifier (eg. SF12BW500)
+  if(json_object_object_get_ex(RF_TX_Pkt, "datr", &RF_Param))
+  {
+    if(sscanf(json_object_get_string(RF_Param), "SF%dBW%d", &SF, &BW) != 2 || SF < SF7 || SF > SF12 ||
+       (BW != 125 && BW != 250 && BW != 500))
+    {
+      json_object_put(PushPacket);
+      return -4;    /// Error -4: datr not a LoRa datarate the radio can send, FSK or SF6
+    }
+    Txpk->Tx.SF = SF;
+    Txpk->Tx.BW = BW == 125 ? HAL_BW_125 : BW == 250 ? HAL_BW_250 : HAL_BW_500;
+  }
+  // codr | string | LoRa ECC coding rate identifier
+  if(json_object_object_get_ex(RF_TX_Pkt, "codr", &RF_Param))
+  {
+    if(sscanf(json_object_get_string(RF_Param), "4/%d", &CR) != 1 || CR < 5 || CR > 8)
+    {
+      json_object_put(PushPacket);
+      return -5;    /// Error -5: codr not 4/5 - 4/8
+    }
+    Txpk->Tx.CR = HAL_CR_4_5 + CR - 5;
+  }
+  // powe | number | TX output power in dBm (unsigned integer, dBm precision)
+  if(json_object_object_get_ex(RF_TX_Pkt, "powe", &RF_Param))
+  {
+    Txpk->Tx.Power = json_object_get_int(RF_Param);
+  }
+  // ipol | bool | Lora modulation polarization inversion
+  if(json_object_object_get_ex(RF_TX_Pkt, "ipol", &RF_Param) && json_object_get_boolean(RF_Param))
+  {
+    Txpk->Tx.IQ = HAL_IQ_INVERTED;
+  }
+
+  // Next get the data object = string
+  RF_B64_Payload_Str = (char *) json_object_get_string(RF_B64_Payload);
+
+  // Decode packet, use the length of the b64 sting as a length not the size recovered from the received packet!
+  ResultLen = b64_to_bin(RF_B64_Payload_Str, strlen(RF_B64_Payload_Str), Txpk->Payload, sizeof(Txpk->Payload));
+  // The string belongs to the JSON object, release it only after decoding
+  json_object_put(PushPacket);
+  if(ResultLen <= 1)
+  {
+    return -3;      /// Error -3: B64 error or empty frame
+  }
+  return ResultLen;
+}
+
+
 /**
 * __Function__: GW_ProcessRX_UDP
 *
 * __Description__: Gateway check UDP packages received and process
 *
-* __Input__: void
+* __Input__: GW context
 *
 * __Output__: Error code: 0 = no error, -1 = Socket error
 *
@@ -330,26 +582,25 @@ int GW_SendPullData()
 *
 * __Remarks__: Function to be called from gateway engine
 */
-void GW_ProcessRX_UDP(void)
+void GW_ProcessRX_UDP( struct GW_CONTEXT_STRUCT *Gw )
 {
   char buffer[MAXLINE];  // Receive buffer
   char JsonPayload[MAXLINE];
-  unsigned char RF_Payload[MAXLINE];
-  char *RF_B64_Payload_Str;
+  struct GW_TXPK_STRUCT Txpk;
   //unsigned int len = 0;
-  int RF_Len, ResultLen = 0;
+  int ResultLen = 0;
   int NumBytes = 0;
-
-  struct json_object *RF_B64_Payload;
-  struct json_object *RF_Pkt_Len;
-  struct json_object *RF_TX_Pkt;
-  struct json_object *PushPacket;
+  struct timeval now;
+  uint32_t NowTmst;
+  int32_t Lead;
+  int Radio;
 
   // Change this to get message from UDP FIFO RX Buffer
-  NumBytes = UDP_ReceiveUDP((char *)buffer);
+  NumBytes = UDP_ReceiveUDP(Gw->Udp, (char *)buffer);
 
   if(NumBytes != -1)
   {
+    TRACE_GW_RX_UDP((uint8_t)buffer[3], ((uint8_t)buffer[1] << 8) | (uint8_t)buffer[2], NumBytes, OS_GetMicros());
     // Check what type of package is received, to do that, read the 4th byte, the identifier
     switch (buffer[3])
     {
@@ -379,52 +630,54 @@ void GW_ProcessRX_UDP(void)
 
         // Copy JSON payload in a seperate buffer
         memcpy((void *)JsonPayload, (void *)(buffer + 4 ), NumBytes - 4);
-
-        // Parse JSON package
-        PushPacket = json_tokener_parse( JsonPayload );
+        JsonPayload[NumBytes - 4] = 0;    // The JSON object is not null terminated
 
         /// Debug
-        printf("GW_ProcessRX_UDP: jobj from str:\n---\n%s\n---\n", json_object_to_json_string_ext(PushPacket, JSON_C_TO_STRING_SPACED | JSON_C_TO_STRING_PRETTY));
-
-        // Decode payload (raw payload is b64 encoded)
-        // txpk.data | string | Base64 encoded RF packet payload, padding optional
-        // get raw data from json, ignore the rest for nowtime
-        // Get length of raw data: size | number | RF packet payload size in bytes (unsigned integer)
-        // First get top level JSON entry as the size and data are nested
-        json_object_object_get_ex(PushPacket, "txpk", &RF_TX_Pkt);
-        // Next get the size object
-        json_object_object_get_ex(RF_TX_Pkt, "size", &RF_Pkt_Len);
-
-        RF_Len = json_object_get_int(RF_Pkt_Len);
-        /// Debug
-        printf("GW_ProcessRX_UDP: RF Packet length : %d \n", RF_Len);
-
+        printf("GW_ProcessRX_UDP: JSON payload:\n---\n%s\n---\n", JsonPayload);
 
-        // Next get the data object = string
-        json_object_object_get_ex(RF_TX_Pkt, "data", &RF_B64_Payload);
+        if((ResultLen = GW_ParseTxpk(JsonPayload, GW_FreqOffset(Gw), &Txpk)) < 0)
+        {
+          printf("GW_ProcessRX_UDP: txpk error: %d\n", ResultLen);
+          break;
+        }
+
+        // How far ahead of the requested TX time did the server send the PULL_RESP, same time base as the rxpk tmst
+        if(Txpk.HasTmst)
+        {
+          CLK_GetTimeOfDay(&now);
+          NowTmst = (uint32_t)(now.tv_sec*1000000 + now.tv_usec);
+          Lead = (int32_t)(Txpk.Tmst - NowTmst);
+          if(Lead >= 0)
+          {
+            MET_Latency(MET_LAT_DOWNLINK_LEAD, Lead);
+          }
+          else
+          {
+            MET_Count(MET_DOWNLINKS_LATE);
+          }
+        }
 
-        RF_B64_Payload_Str = (char *) json_object_get_string(RF_B64_Payload);
+        /// Debug
+        printf("GW_ProcessRX_UDP: RF Packet length : %d \n", Txpk.Size);
+        printf("GW_ProcessRX_UDP: B64 to bin length : %d \n", ResultLen );
 
-        // Decode packet, use the length of the b64 sting as a length not the size recovered from the received packet!
-        if(( ResultLen = b64_to_bin(RF_B64_Payload_Str, strlen(RF_B64_Payload_Str), RF_Payload, MAXLINE)) > 1)
-         {
-           /// Debug
-           printf("GW_ProcessRX_UDP: B64 to bin length : %d \n", ResultLen );
-         }
-         else
-         {
-           printf("GW_ProcessRX_UDP: B64 error: %d\n", ResultLen);
-           break;
-         }
-         // Ok now we have the decoded package on RF_B64_Payload_Str and the size in RF_Len
+         // Ok now we have the decoded package in Txpk.Payload
          // Only send when node is listening
          printf("GW_ProcessRX_UDP: FRame handed of to Lora for transmit to node \n");
          printf("GW_ProcessRX_UDP: MAC Header:");
-         OS_PrintBin( (byte)RF_Payload[0]);
+         OS_PrintBin( (byte)Txpk.Payload[0]);
          printf("\n");
 
-         // Send out the frame using LORA
-         HAL_TransmitFrame(RF_Payload, ResultLen);
+         // Send out the frame using LORA, on the radio that heard the device best
+         Radio = GW_SelectRadio(Gw, &Txpk, ResultLen);
+         if(Gw->NumRadios > 1)
+         {
+           printf("GW_ProcessRX_UDP: Downlink on radio %d\n", Radio);
+         }
+         if(Radio >= 0 && HAL_TransmitFrame(Gw->Hal[Radio], Txpk.Payload, ResultLen, &Txpk.Tx) == 0)
+         {
+           MET_Latency(MET_LAT_PULL_RESP_TO_QUEUED, OS_GetMicros() - UDP_GetRxTimestamp(Gw->Udp));
+         }
 
       break;
 
@@ -451,39 +704,207 @@ void GW_ProcessRX_UDP(void)
 }
 
 
+/**
+* __Function__: GW_SerialiseRxpk
+*
+* __Description__: Compose the PUSH_DATA datagram for one frame received over Lora
+*
+* __Input__: GW context, buffer for the datagram and its size, the frame and its size, rxpk fields, token
+*
+* __Output__: Length of the datagram, -1 = Buffer too small
+*
+* __Status__: Completed
+*
+* __Remarks__: Split from GW_ProcessRX_Lora so that it can be benchmarked on its own, bench_micro.c.
+*/
+int GW_SerialiseRxpk( struct GW_CONTEXT_STRUCT *Gw, char *Buffer, int BufferSize, const uint8_t *Frame, int FrameSize, const struct GW_RXPK_STRUCT *Rxpk, uint16_t Token )
+{
+  int buff_index=0;
+  int j;
+
+  /* pre-fill the data buffer with fixed fields */
+  Buffer[0] = PROTOCOL_VERSION;
+  /* start composing datagram with the header */
+  Buffer[1] = (uint8_t)(Token >> 8);
+  Buffer[2] = (uint8_t)Token;
+  // Add PUSH_Data Identifier
+  Buffer[3] = PKT_PUSH_DATA;
+
+  // Add the gateway unique ID
+  memcpy(Buffer + 4, Gw->Eui, sizeof(Gw->Eui));
+  // Pint index to point 12 in the buffer
+  buff_index = 12; /* 12-byte header */
+
+  /* start of JSON structure */
+  memcpy((void *)(Buffer + buff_index), (void *)"{\"rxpk\":[", 9);
+  buff_index += 9;
+  Buffer[buff_index] = '{';
+  ++buff_index;
+  j = snprintf((char *)(Buffer + buff_index), BufferSize-buff_index, "\"tmst\":%u", Rxpk->Tmst);
+  buff_index += j;
+  j = snprintf((char *)(Buffer + buff_index), BufferSize-buff_index, ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf", Rxpk->Chan, Rxpk->Rfch, Rxpk->Freq/1000000);
+  buff_index += j;
+  memcpy((void *)(Buffer + buff_index), (void *)",\"stat\":1", 9);
+  buff_index += 9;
+  memcpy((void *)(Buffer + buff_index), (void *)",\"modu\":\"LORA\"", 14);
+  buff_index += 14;
+  /* Lora datarate & bandwidth, 16-19 useful chars */
+  switch (Rxpk->SF) {
+    case SF7:
+        memcpy((void *)(Buffer + buff_index), (void *)",\"datr\":\"SF7", 12);
+        buff_index += 12;
+        break;
+    case SF8:
+        memcpy((void *)(Buffer + buff_index), (void *)",\"datr\":\"SF8", 12);
+        buff_index += 12;
+        break;
+    case SF9:
+        memcpy((void *)(Buffer + buff_index), (void *)",\"datr\":\"SF9", 12);
+        buff_index += 12;
+        break;
+    case SF10:
+        memcpy((void *)(Buffer + buff_index), (void *)",\"datr\":\"SF10", 13);
+        buff_index += 13;
+        break;
+    case SF11:
+        memcpy((void *)(Buffer + buff_index), (void *)",\"datr\":\"SF11", 13);
+        buff_index += 13;
+        break;
+    case SF12:
+        memcpy((void *)(Buffer + buff_index), (void *)",\"datr\":\"SF12", 13);
+        buff_index += 13;
+        break;
+    default:
+        memcpy((void *)(Buffer + buff_index), (void *)",\"datr\":\"SF?", 12);
+        buff_index += 12;
+  }
+  memcpy((void *)(Buffer + buff_index), (void *)"BW125\"", 6);
+  buff_index += 6;
+  memcpy((void *)(Buffer + buff_index), (void *)",\"codr\":\"4/5\"", 13);
+  buff_index += 13;
+  j = snprintf((char *)(Buffer + buff_index), BufferSize-buff_index, ",\"lsnr\":%li", Rxpk->Snr);
+  buff_index += j;
+  j = snprintf((char *)(Buffer + buff_index), BufferSize-buff_index, ",\"rssi\":%d,\"size\":%u", Rxpk->Rssi, FrameSize);
+  buff_index += j;
+  memcpy((void *)(Buffer + buff_index), (void *)",\"data\":\"", 9);
+  buff_index += 9;
+  j = bin_to_b64(Frame, FrameSize, (char *)(Buffer + buff_index), BufferSize - buff_index - 4);   // Leave room for the closing characters
+  if(j < 0)
+  {
+    return -1;
+  }
+  buff_index += j;
+  Buffer[buff_index] = '"';
+  ++buff_index;
+
+  /* End of packet serialization */
+  Buffer[buff_index] = '}';
+  ++buff_index;
+  Buffer[buff_index] = ']';
+  ++buff_index;
+  /* end of JSON datagram payload */
+  Buffer[buff_index] = '}';
+  ++buff_index;
+  Buffer[buff_index] = 0; /* add string terminator, for safety */
+  return buff_index;
+}
+
+
 /**
 * __Function__: GW_ProcessRX_Lora
 *
 * __Description__: Gateway check Lora packages received and process
 *
-* __Input__: void
+* __Input__: GW context
 *
 * __Output__: Error code: 0 = no error, -1 = Socket error
 *
 * __Status__: Work in Progress
 *
-* __Remarks__: Function to be called from gateway engine
+* __Remarks__: Function to be called from gateway engine. Backpressure: while the UDP TX FIFO is full the
+*              frame is left in the LORA RX FIFO, frames are only dropped at the radio. The LORA RX FIFOs of the
+*              radios are taken round robin, one frame per call, so a busy radio cannot starve the others.
+*              With duplicate suppression the frame is offered to the seen-set first, what is forwarded is the
+*              best copy of a payload whose hold time has passed, if any.
 */
 /// JS Clean this up, call HAL to retreive message from Fifo
-int GW_ProcessRX_Lora()
+int GW_ProcessRX_Lora( struct GW_CONTEXT_STRUCT *Gw )
 {
   uint8_t Lora_RX_Message[LORA_RX_MX_FRAME_SIZE];
-  int RxNumBytes;
+  int RxNumBytes = 0;
   //int BytesProcessed;
   char buff_up[TX_BUFF_SIZE];   /* buffer to compose the upstream packet */
   int buff_index=0;
   struct timeval now;
-  int j;
-  long int snr;
-  int rssicorr;
+  struct GW_RXPK_STRUCT Rxpk;
+  struct HAL_CONTEXT_STRUCT *Hal = NULL;
+  uint64_t DequeueTime;
+  uint64_t Now = 0;
+  int i;
+
+  // No room upstream, leave the frame where it is until the network has caught up
+  if(UDP_GetTxFifoLevel(Gw->Udp) >= UDP_TX_FIFO_DEPTH)
+  {
+    return 0;
+  }
 
-  snr = HAL_GetSNR();
-  rssicorr = HAL_GetRssiCor();
+  // Take the next frame, starting at the radio after the one served last
+  for(i = 0; i < Gw->NumRadios && RxNumBytes <= 0; i++)
+  {
+    Hal = Gw->Hal[Gw->NextRadio];
+    Gw->NextRadio = (Gw->NextRadio + 1) % Gw->NumRadios;
+    RxNumBytes = HAL_ReceiveFrame(Hal, Lora_RX_Message);
+  }
 
   // Check if there is a Lora message in the Lora FIFO
-  if((RxNumBytes = HAL_ReceiveFrame(Lora_RX_Message)) > 0)
+  if(RxNumBytes > 0)
   {
-    printf("GW_ProcessRX_Lora: Package received with: %d bytes \n", RxNumBytes);
+    // Signal quality of the frame just received and the radio it came from
+    Rxpk.Snr = HAL_GetSNR(Hal);
+    Rxpk.Rssi = HAL_GetRSSI(Hal);
+    // A radio hopping over channels reports the channel, else the radio as before
+    Rxpk.Chan = Hal->NumChans > 1 ? HAL_GetRxChan(Hal) : Hal->Index;
+    Rxpk.Rfch = Hal->Index;
+    Rxpk.SF = HAL_GetRxSF(Hal);
+    Rxpk.Freq = HAL_GetRxFreq(Hal) + GW_FreqOffset(Gw);
+    // TODO: tmst can jump is time is (re)set, not good.      /// Check this do not understand what is meant here
+    CLK_GetTimeOfDay(&now);
+    Rxpk.Tmst = (uint32_t)(now.tv_sec*1000000 + now.tv_usec);
+    printf("GW_ProcessRX_Lora: Package received with: %d bytes on radio %d\n", RxNumBytes, Hal->Index);
+
+    if(Gw->Dup != NULL || Gw->Links != NULL)
+    {
+      Now = CLK_GetMicros();
+    }
+    // Every copy counts for the radio selection of the downlinks, also the ones dropped as duplicate
+    if(Gw->Links != NULL)
+    {
+      LQ_Update(Gw->Links, Lora_RX_Message, RxNumBytes, &Rxpk, Now);
+    }
+    if(Gw->Dup != NULL)
+    {
+      switch(DUP_Offer(Gw->Dup, Lora_RX_Message, RxNumBytes, &Rxpk, Now))
+      {
+        case DUP_DUPLICATE:
+          MET_Count(MET_LORA_RX_DUPLICATES);
+          RxNumBytes = 0;
+          break;
+        case DUP_HELD:
+          RxNumBytes = 0;
+          break;
+        default:
+          break;          // Seen-set full, forward it now
+      }
+    }
+  }
+  if(RxNumBytes <= 0 && Gw->Dup != NULL)
+  {
+    RxNumBytes = DUP_Take(Gw->Dup, Lora_RX_Message, &Rxpk, CLK_GetMicros());
+  }
+
+  if(RxNumBytes > 0)
+  {
+    DequeueTime = OS_GetMicros();
     // Message received, convert to B64 message
     //BytesProcessed = bin_to_b64(Lora_RX_Message, RxNumBytes, (char *)(b64), 341);
 
@@ -495,107 +916,29 @@ int GW_ProcessRX_Lora()
     //  4-11   | Gateway unique identifier (MAC address)
     //  12-end | JSON object, starting with {, ending with }, see section 4
 
-    /* pre-fill the data buffer with fixed fields */
-    buff_up[0] = PROTOCOL_VERSION;
-    /* start composing datagram with the header */
-    uint8_t token_h = (uint8_t)rand(); /* random token */
-    uint8_t token_l = (uint8_t)rand(); /* random token */
-    buff_up[1] = token_h;
-    buff_up[2] = token_l;
-    // Add PUSH_Data Identifier
-    buff_up[3] = PKT_PUSH_DATA;
-
-    // Add the gateway unique ID
-    buff_up[4] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[0];
-    buff_up[5] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[1];
-    buff_up[6] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[2];
-    buff_up[7] = 0xFF;
-    buff_up[8] = 0xFF;
-    buff_up[9] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[3];
-    buff_up[10] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[4];
-    buff_up[11] = (unsigned char)GW_ifr.ifr_hwaddr.sa_data[5];
-    // Pint index to point 12 in the buffer
-    buff_index = 12; /* 12-byte header */
+    uint16_t Token = (uint16_t)rand(); /* random token */
 
-    // TODO: tmst can jump is time is (re)set, not good.      /// Check this do not understand what is meant here
-    gettimeofday(&now, NULL);
-    uint32_t tmst = (uint32_t)(now.tv_sec*1000000 + now.tv_usec);
-
-    /* start of JSON structure */
-    memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":[", 9);
-    buff_index += 9;
-    buff_up[buff_index] = '{';
-    ++buff_index;
-    j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, "\"tmst\":%u", tmst);
-    buff_index += j;
-    j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf", 0, 0, freq2/1000000);
-    buff_index += j;
-    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":1", 9);
-    buff_index += 9;
-    memcpy((void *)(buff_up + buff_index), (void *)",\"modu\":\"LORA\"", 14);
-    buff_index += 14;
-    /* Lora datarate & bandwidth, 16-19 useful chars */
-    switch (SpreadingFactor) {
-      case SF7:
-          memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF7", 12);
-          buff_index += 12;
-          break;
-      case SF8:
-          memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF8", 12);
-          buff_index += 12;
-          break;
-      case SF9:
-          memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF9", 12);
-          buff_index += 12;
-          break;
-      case SF10:
-          memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF10", 13);
-          buff_index += 13;
-          break;
-      case SF11:
-          memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF11", 13);
-          buff_index += 13;
-          break;
-      case SF12:
-          memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF12", 13);
-          buff_index += 13;
-          break;
-      default:
-          memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF?", 12);
-          buff_index += 12;
+    if((buff_index = GW_SerialiseRxpk(Gw, buff_up, TX_BUFF_SIZE, Lora_RX_Message, RxNumBytes, &Rxpk, Token)) < 0)
+    {
+      printf("GW_ProcessRX_Lora: Error serialising frame\n");
+      return 0;
     }
-    memcpy((void *)(buff_up + buff_index), (void *)"BW125\"", 6);
-    buff_index += 6;
-    memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/5\"", 13);
-    buff_index += 13;
-    j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"lsnr\":%li", snr);
-    buff_index += j;
-    j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"rssi\":%d,\"size\":%u", HAL_readRegister(0x1A)-rssicorr, RxNumBytes);
-    buff_index += j;
-    memcpy((void *)(buff_up + buff_index), (void *)",\"data\":\"", 9);
-    buff_index += 9;
-    j = bin_to_b64((uint8_t *)Lora_RX_Message, RxNumBytes, (char *)(buff_up + buff_index), TX_BUFF_SIZE);    /// Why 341, check it out
-    buff_index += j;
-    buff_up[buff_index] = '"';
-    ++buff_index;
-
-    /* End of packet serialization */
-    buff_up[buff_index] = '}';
-    ++buff_index;
-    buff_up[buff_index] = ']';
-    ++buff_index;
-    /* end of JSON datagram payload */
-    buff_up[buff_index] = '}';
-    ++buff_index;
-    buff_up[buff_index] = 0; /* add string terminator, for safety */
+    uint64_t SerialisedTime = OS_GetMicros();
+    MET_Latency(MET_LAT_DEQUEUED_TO_SERIALISED, SerialisedTime - DequeueTime);
+    TRACE_GW_RX_LORA(RxNumBytes, Rxpk.Tmst, Token, DequeueTime, SerialisedTime);
 
     printf("GW_ProcessRX_Lora: %s\n", (char *)(buff_up + 12)); /* DEBUG: display JSON payload */
 
     //send the message using UDP
-    if( UDP_SendUDP(buff_up, buff_index))
+    if( UDP_SendUDP(Gw->Udp, buff_up, buff_index))
     {
       printf("GW_ProcessRX_Lora: Error sending UDP \n");
     }
+    else
+    {
+      // rxfw of the radio that heard it, the held copy of a duplicate may come from another radio than Hal
+      HAL_CountForwarded(Gw->Hal[Rxpk.Rfch]);
+    }
 
     printf("GW_ProcessRX_Lora: Package handed over to UDP with Length: %d \n", buff_index);
     fflush(stdout);       /// Why do we need this?
@@ -603,6 +946,55 @@ int GW_ProcessRX_Lora()
   return 0;
 }
 
+/**
+* __Function__: GW_GetNumRX
+*
+* __Description__: Frames received, CRC ok and forwarded, summed over the radios of the gateway
+*
+* __Input__: GW context
+*
+* __Output__: Number of frames
+*
+* __Status__: Completed
+*
+* __Remarks__: The rxnb, rxok and rxfw of the stat
+*/
+uint32_t GW_GetNumRX( struct GW_CONTEXT_STRUCT *Gw )
+{
+  uint32_t Sum = 0;
+  int i;
+
+  for(i = 0; i < Gw->NumRadios; i++)
+  {
+    Sum += HAL_GetNumRX(Gw->Hal[i]);
+  }
+  return Sum;
+}
+
+uint32_t GW_GetRxOk( struct GW_CONTEXT_STRUCT *Gw )
+{
+  uint32_t Sum = 0;
+  int i;
+
+  for(i = 0; i < Gw->NumRadios; i++)
+  {
+    Sum += HAL_GetRxOk(Gw->Hal[i]);
+  }
+  return Sum;
+}
+
+uint32_t GW_GetPktFwd( struct GW_CONTEXT_STRUCT *Gw )
+{
+  uint32_t Sum = 0;
+  int i;
+
+  for(i = 0; i < Gw->NumRadios; i++)
+  {
+    Sum += HAL_GetPktWfd(Gw->Hal[i]);
+  }
+  return Sum;
+}
+
 /**
  * __Function__: OS_PrintBin
  *
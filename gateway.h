@@ -5,15 +5,77 @@
 #ifndef _gateway_h_
 #define _gateway_h_
 
+#include <stdint.h>           // Required for unint8 etc
+
+struct HAL_CONTEXT_STRUCT;
+struct UDP_CONTEXT_STRUCT;
+struct DUP_CONTEXT_STRUCT;
+struct LQ_CONTEXT_STRUCT;
+
+#define GW_MAX_RADIOS     4       // Radios one gateway listens on at most
+
+/**
+* Downlink as parsed from the txpk object of a PULL_RESP
+*/
+struct GW_TXPK_STRUCT {
+  int       HasTmst;                          // 1 = tmst present, transmit at Tmst
+  uint32_t  Tmst;                             // Time to transmit, same time base as the rxpk tmst
+  int       Size;                             // Size as sent by the server, the decoded data is leading
+  uint8_t   Payload[256];                     // Decoded frame, LORA_TX_MX_FRAME_SIZE
+  struct HAL_TX_PARAMS_STRUCT Tx;             // freq, datr, codr, powe and ipol, what is missing is left to the radio
+};
+
+/**
+* Uplink as reported in the rxpk object of a PUSH_DATA
+*/
+struct GW_RXPK_STRUCT {
+  uint32_t  Tmst;                             // Time the frame was received, microseconds
+  int       Chan;                             // IF channel, the number of the radio, or its channel when it hops
+  int       Rfch;                             // RF chain, the number of the radio
+  double    Freq;                             // Frequency in Hz
+  int       SF;                               // Spreading factor, SF7 - SF12
+  long int  Snr;                              // Signal to noise ratio in dB
+  int       Rssi;                             // Packet RSSI in dBm
+};
 
-int GW_Init(void);
-int GW_Engine(void);
-int GW_SendGWStatusUpate(void);
-int GW_SendPullDataTMR(void);
-void GW_SendStat(void);
-int GW_SendPullData(void);
-void GW_ProcessRX_UDP(void);
-int GW_ProcessRX_Lora(void);
+/**
+* One gateway, the radios it listens on and the upstream it forwards to, every GW function works on one of these.
+* Set it up with GW_InitContext, add more radios with GW_AddRadio.
+*/
+struct GW_CONTEXT_STRUCT {
+  struct HAL_CONTEXT_STRUCT *Hal[GW_MAX_RADIOS];  // Radios, Hal[i] reports chan / rfch i
+  int       NumRadios;                        // 0 when the frames do not come from a HAL
+  int       NextRadio;                        // Radio GW_ProcessRX_Lora looks at first, round robin
+  struct UDP_CONTEXT_STRUCT *Udp;             // Upstream to the server
+  struct DUP_CONTEXT_STRUCT *Dup;             // Duplicate suppression of the uplinks, NULL = off
+  struct LQ_CONTEXT_STRUCT *Links;            // Radio each device was heard best on, for the downlinks, NULL = always radio 0
+  uint8_t   Eui[8];                           // Gateway EUI, in the header of every datagram
+  double    ReportFreq;                       // Frequency reported for radio 0 in Hz, the others keep their distance to it, the txpk freq is shifted back, 0 = the real frequency
+  uint32_t  StatusLastTime;                   // Send regular status updated from the GW to the server
+  uint32_t  PullDataLastTime;                 // Send PULL_DATA frames to keep channel open
+  float     Lat;                              // Location and altitude reported in the stat
+  float     Lon;
+  int       Alt;
+};
+
+void GW_InitContext( struct GW_CONTEXT_STRUCT *Gw, struct HAL_CONTEXT_STRUCT *Hal, struct UDP_CONTEXT_STRUCT *Udp );
+int GW_AddRadio( struct GW_CONTEXT_STRUCT *Gw, struct HAL_CONTEXT_STRUCT *Hal );
+void GW_SetDedup( struct GW_CONTEXT_STRUCT *Gw, struct DUP_CONTEXT_STRUCT *Dup );   // Before GW_Init, NULL = off
+void GW_SetLinks( struct GW_CONTEXT_STRUCT *Gw, struct LQ_CONTEXT_STRUCT *Links );  // Before GW_Init, NULL = downlinks on radio 0
+int GW_SelectRadio( struct GW_CONTEXT_STRUCT *Gw, const struct GW_TXPK_STRUCT *Txpk, int FrameSize );
+int GW_Init( struct GW_CONTEXT_STRUCT *Gw );
+int GW_Engine( struct GW_CONTEXT_STRUCT *Gw );
+int GW_SendGWStatusUpate( struct GW_CONTEXT_STRUCT *Gw );
+int GW_SendPullDataTMR( struct GW_CONTEXT_STRUCT *Gw );
+void GW_SendStat( struct GW_CONTEXT_STRUCT *Gw );
+int GW_SendPullData( struct GW_CONTEXT_STRUCT *Gw );
+void GW_ProcessRX_UDP( struct GW_CONTEXT_STRUCT *Gw );
+int GW_ProcessRX_Lora( struct GW_CONTEXT_STRUCT *Gw );
+int GW_SerialiseRxpk( struct GW_CONTEXT_STRUCT *Gw, char *Buffer, int BufferSize, const uint8_t *Frame, int FrameSize, const struct GW_RXPK_STRUCT *Rxpk, uint16_t Token );
+uint32_t GW_GetNumRX( struct GW_CONTEXT_STRUCT *Gw );      // Summed over the radios
+uint32_t GW_GetRxOk( struct GW_CONTEXT_STRUCT *Gw );
+uint32_t GW_GetPktFwd( struct GW_CONTEXT_STRUCT *Gw );
+int GW_ParseTxpk( const char *Json, double FreqOffset, struct GW_TXPK_STRUCT *Txpk );
 
 // Supporting functions
 void OS_PrintBin(byte x);
@@ -44,6 +106,29 @@ enum {
     LEN_JAEXT       = 17+16
 };
 
+enum {
+    // Data frame format
+    OFF_DAT_HDR     = 0,
+    OFF_DAT_ADDR    = 1,    // 4 Octets
+    OFF_DAT_FCT     = 5,
+    OFF_DAT_SEQNO   = 6,    // 2 Octets
+    OFF_DAT_OPTS    = 8,    // FPort, when there are no FOpts
+    OFF_DAT_PAYLOAD = 9,
+    LEN_DAT_MIN     = 8+4   // No FPort and FRMPayload
+};
+
+// MHDR of the frames sent by end devices
+#define MHDR_JOIN_REQUEST        0x00
+#define MHDR_UNCONFIRMED_UP      0x40
+#define MHDR_CONFIRMED_UP        0x80
+
+// MHDR of the frames sent to end devices
+#define MHDR_JOIN_ACCEPT         0x20
+#define MHDR_UNCONFIRMED_DOWN    0x60
+#define MHDR_CONFIRMED_DOWN      0xA0
+
+#define MHDR_MTYPE_MASK          0xE0     // MType, the message type bits of the MHDR
+
 
 
 
@@ -65,4 +150,7 @@ enum {
 
 #define PULL_DATA_PKT_LEN   12
 
+/// Little hack to get the TTS to think we are working with 868 modules whilst I only have 433 modules....to be replace soon
+#define GW_REPORT_FREQ      868100000     // in Hz! (868.1)
+
 #endif // _gateway_h_
@@ -0,0 +1,528 @@
+/*******************************************************************************
+ * Gateway simulator
+ *
+ * One process that impersonates many gateways towards a network server, to
+ * load test it with the Semtech UDP protocol:
+ *
+ *   ./gwsim -s 127.0.0.1 -g 500 -k 3 -v traffic:devices=16000,interval=1,air=0
+ *
+ * Every gateway is an instance (struct GWS_GATEWAY_STRUCT) with its own EUI,
+ * its own UDP socket, so the server sees a separate source port per gateway,
+ * its own tmst counter, tokens, PULL_DATA and stat timers and counters.
+ *
+ * The uplinks come from the traffic generator (traffic.c), one device
+ * population for all gateways. A device is heard by the gateway its DevAddr
+ * (DevEUI for a join request) hashes to and by the next k-1 gateways, every
+ * further one GWS_COPY_LOSS_DB weaker, the way neighbouring gateways pick up
+ * the same frame. Use air=0 in the traffic spec, the single channel air model
+ * of one radio would make most frames of a large population collide.
+ *
+ * The rxpk is built with GW_SerialiseRxpk, the same code as the forwarder, on
+ * a gateway context (struct GW_CONTEXT_STRUCT) per instance. All instances
+ * are driven from one event loop without threads. PUSH_ACK, PULL_ACK and
+ * PULL_RESP are counted per gateway.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>           // used in this module for getopt()
+#include <fcntl.h>            // Required for the nonblocking socket
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "hal.h"
+#include "udp.h"              // SERVER and PORT
+#include "gateway.h"          // Packet types, GW_SerialiseRxpk
+#include "vradio.h"
+#include "traffic.h"
+#include "clock.h"
+#include "os.h"
+
+
+#define GWS_MAX_GATEWAYS          1024      // Gateways in one process
+#define GWS_DEFAULT_GATEWAYS      10
+#define GWS_DEFAULT_EUI           0x00800000A0000000ULL   // EUI of the first gateway
+#define GWS_COPY_LOSS_DB          6         // Every further gateway hears the frame this much weaker
+#define GWS_DATAGRAM_SIZE         2048      // Max size of a datagram
+#define GWS_BURST                 1000      // Uplinks taken from the generator per loop at most
+#define GWS_REPORT_US             10000000  // Print the rates every 10 seconds
+
+/**
+* One simulated gateway
+*/
+struct GWS_GATEWAY_STRUCT {
+  struct GW_CONTEXT_STRUCT Gw;                /**< Gateway EUI and radio settings, for GW_SerialiseRxpk */
+  int       Socket;                           /**< UDP socket connected to the server */
+  uint32_t  TmstOffset;                       /**< Every gateway has its own tmst counter */
+  uint16_t  Token;                            /**< Token of the next datagram */
+  uint64_t  NextPull;                         /**< Time of the next PULL_DATA */
+  uint64_t  NextStat;                         /**< Time of the next stat */
+  uint32_t  RxNb;                             /**< Frames received, for the stat */
+  uint32_t  RxOk;                             /**< Of which CRC ok */
+  uint32_t  PushSent;
+  uint32_t  PushAcked;
+  uint32_t  PullSent;
+  uint32_t  PullAcked;
+  uint32_t  Downlinks;                        /**< PULL_RESP received */
+  uint32_t  SendErrors;                       /**< Datagrams the socket did not take */
+};
+
+// Gateway simulator Variables
+struct GWS_GATEWAY_STRUCT GWS_Gateways[GWS_MAX_GATEWAYS];
+struct pollfd GWS_Poll[GWS_MAX_GATEWAYS];
+int GWS_NumGateways = GWS_DEFAULT_GATEWAYS;
+int GWS_Copies = 1;                         // Gateways that hear every uplink
+volatile sig_atomic_t GWS_Stop = 0;
+
+/**
+* __Function__: GWS_Hash
+*
+* __Description__: Hash of the device that sent a frame, to pick the gateways that hear it
+*
+* __Input__: Frame, size of the frame
+*
+* __Output__: FNV-1a hash of the DevEUI of a join request, the DevAddr of other frames
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static uint32_t GWS_Hash( const uint8_t *Frame, int FrameSize )
+{
+  uint32_t Hash = 2166136261U;
+  int Offset = OFF_DAT_ADDR, Length = 4;
+  int i;
+
+  if((Frame[OFF_JR_HDR] & 0xE0) == MHDR_JOIN_REQUEST)
+  {
+    Offset = OFF_JR_DEVEUI;
+    Length = 8;
+  }
+  for(i = Offset; i < Offset + Length && i < FrameSize; i++)
+  {
+    Hash = (Hash ^ Frame[i]) * 16777619U;
+  }
+  return Hash;
+}
+
+/**
+* __Function__: GWS_Send
+*
+* __Description__: Send a datagram of a gateway to the server
+*
+* __Input__: Gateway, datagram, size of the datagram
+*
+* __Output__: Error code: 0 = no error, 1 = Not sent
+*
+* __Status__: Completed
+*
+* __Remarks__: The socket is non-blocking, a full socket buffer drops the datagram
+*/
+static int GWS_Send( struct GWS_GATEWAY_STRUCT *Gateway, char *Datagram, int Size )
+{
+  if(send(Gateway->Socket, Datagram, Size, 0) != Size)
+  {
+    Gateway->SendErrors++;
+    return 1;
+  }
+  return 0;
+}
+
+// Protocol header with the token, type and EUI of a gateway
+static void GWS_Header( struct GWS_GATEWAY_STRUCT *Gateway, char *Datagram, uint8_t Type )
+{
+  Gateway->Token++;
+  Datagram[0] = PROTOCOL_VERSION;
+  Datagram[1] = (uint8_t)(Gateway->Token >> 8);
+  Datagram[2] = (uint8_t)Gateway->Token;
+  Datagram[3] = Type;
+  memcpy(Datagram + 4, Gateway->Gw.Eui, sizeof(Gateway->Gw.Eui));
+}
+
+/**
+* __Function__: GWS_Uplink
+*
+* __Description__: Forward an uplink of the population from every gateway that hears it
+*
+* __Input__: Uplink from the traffic generator
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Uplinks with a CRC error are counted in the stat only, like the forwarder does
+*/
+static void GWS_Uplink( struct VR_FRAME_STRUCT *Uplink )
+{
+  char Datagram[GWS_DATAGRAM_SIZE];
+  struct GWS_GATEWAY_STRUCT *Gateway;
+  struct timeval Now;
+  uint32_t First = GWS_Hash(Uplink->Frame, Uplink->FrameSize) % GWS_NumGateways;
+  uint32_t Micros;
+  struct GW_RXPK_STRUCT Rxpk = { 0, 0, 0, 0, 0, 0, 0 };   // Single channel
+  int Size;
+  int i;
+
+  CLK_GetTimeOfDay(&Now);
+  Micros = (uint32_t)((uint64_t)Now.tv_sec * 1000000 + Now.tv_usec);
+  Rxpk.SF = Uplink->SF ? Uplink->SF : HAL_DEFAULT_SF;       // 0 = the modulation the traffic generator uses by default
+
+  for(i = 0; i < GWS_Copies; i++)
+  {
+    Gateway = &GWS_Gateways[(First + i) % GWS_NumGateways];
+    Gateway->RxNb++;
+    if(Uplink->CrcError)
+    {
+      continue;
+    }
+    Gateway->RxOk++;
+    Gateway->Token++;
+    Rxpk.Tmst = Micros + Gateway->TmstOffset;
+    Rxpk.Freq = Gateway->Gw.ReportFreq;
+    Rxpk.Snr = Uplink->Snr - i * GWS_COPY_LOSS_DB;
+    Rxpk.Rssi = Uplink->Rssi - i * GWS_COPY_LOSS_DB;
+    Size = GW_SerialiseRxpk(&Gateway->Gw, Datagram, sizeof(Datagram), Uplink->Frame, Uplink->FrameSize, &Rxpk, Gateway->Token);
+    if(Size <= 0)
+    {
+      continue;
+    }
+    if(GWS_Send(Gateway, Datagram, Size) == 0)
+    {
+      Gateway->PushSent++;
+    }
+  }
+}
+
+/**
+* __Function__: GWS_Timers
+*
+* __Description__: Send the PULL_DATA and stat of the gateways that are due
+*
+* __Input__: Time in micro seconds (OS_GetMicros)
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Same intervals as the forwarder, TMR_TX_PULL and TMR_STAT_TX
+*/
+static void GWS_Timers( uint64_t Now )
+{
+  char Datagram[GWS_DATAGRAM_SIZE];
+  char Timestamp[24];
+  struct GWS_GATEWAY_STRUCT *Gateway;
+  time_t t;
+  int Size;
+  int i;
+
+  for(i = 0; i < GWS_NumGateways; i++)
+  {
+    Gateway = &GWS_Gateways[i];
+    if(Now >= Gateway->NextPull)
+    {
+      GWS_Header(Gateway, Datagram, PKT_PULL_DATA);
+      if(GWS_Send(Gateway, Datagram, PULL_DATA_PKT_LEN) == 0)
+      {
+        Gateway->PullSent++;
+      }
+      Gateway->NextPull = Now + TMR_TX_PULL * 1000000ULL;
+    }
+    if(Now >= Gateway->NextStat)
+    {
+      t = CLK_Time();
+      strftime(Timestamp, sizeof(Timestamp), "%F %T %Z", gmtime(&t));
+      GWS_Header(Gateway, Datagram, PKT_PUSH_DATA);
+      Size = 12 + snprintf(Datagram + 12, sizeof(Datagram) - 12,
+        "{\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":0}}",
+        Timestamp, Gateway->RxNb, Gateway->RxOk, Gateway->PushSent,
+        Gateway->PushSent ? 100.0 * Gateway->PushAcked / Gateway->PushSent : 0.0, Gateway->Downlinks);
+      GWS_Send(Gateway, Datagram, Size);
+      Gateway->NextStat = Now + TMR_STAT_TX * 1000000ULL;
+    }
+  }
+}
+
+/**
+* __Function__: GWS_Receive
+*
+* __Description__: Take the datagrams from the server off the sockets of all gateways
+*
+* __Input__: void
+*
+* __Output__: Number of datagrams received
+*
+* __Status__: Completed
+*
+* __Remarks__: One poll over all sockets, the downlinks are counted, not transmitted
+*/
+static int GWS_Receive( void )
+{
+  uint8_t Datagram[GWS_DATAGRAM_SIZE];
+  struct GWS_GATEWAY_STRUCT *Gateway;
+  int Received = 0;
+  int NumBytes;
+  int i;
+
+  if(poll(GWS_Poll, GWS_NumGateways, 0) <= 0)
+  {
+    return 0;
+  }
+  for(i = 0; i < GWS_NumGateways; i++)
+  {
+    if(!(GWS_Poll[i].revents & POLLIN))
+    {
+      continue;
+    }
+    Gateway = &GWS_Gateways[i];
+    while((NumBytes = recv(Gateway->Socket, Datagram, sizeof(Datagram), MSG_DONTWAIT)) >= 4)
+    {
+      Received++;
+      switch(Datagram[3])
+      {
+        case PKT_PUSH_ACK:
+          Gateway->PushAcked++;
+        break;
+        case PKT_PULL_ACK:
+          Gateway->PullAcked++;
+        break;
+        case PKT_PULL_RESP:
+          Gateway->Downlinks++;
+        break;
+        default:
+        break;
+      }
+    }
+  }
+  return Received;
+}
+
+/**
+* __Function__: GWS_Open
+*
+* __Description__: Create the gateways, one socket each, connected to the server
+*
+* __Input__: Server address, port, EUI of the first gateway
+*
+* __Output__: Error code: 0 = no error, 1 = Invalid address, 2 = Socket error
+*
+* __Status__: Completed
+*
+* __Remarks__: The timers are spread over the intervals so the gateways do not send at the same time
+*/
+static int GWS_Open( const char *Server, int Port, uint64_t EuiBase )
+{
+  struct sockaddr_in Addr;
+  struct GWS_GATEWAY_STRUCT *Gateway;
+  uint64_t Now = OS_GetMicros();
+  uint64_t Eui;
+  int i, j;
+
+  memset((char *) &Addr, 0, sizeof(Addr));
+  Addr.sin_family = AF_INET;
+  Addr.sin_port = htons(Port);
+  if(inet_aton(Server, &Addr.sin_addr) == 0)
+  {
+    printf("GWS_Open: Invalid server address: %s\n", Server);
+    return 1;
+  }
+
+  for(i = 0; i < GWS_NumGateways; i++)
+  {
+    Gateway = &GWS_Gateways[i];
+    memset(Gateway, 0, sizeof(*Gateway));
+    // No radio and no UDP context, the gateway only serialises
+    GW_InitContext(&Gateway->Gw, NULL, NULL);
+    Eui = EuiBase + i;
+    for(j = 0; j < 8; j++)
+    {
+      Gateway->Gw.Eui[j] = (uint8_t)(Eui >> (56 - 8 * j));
+    }
+    Gateway->TmstOffset = (uint32_t)rand() * 2654435761U;
+    Gateway->Token = (uint16_t)rand();
+    Gateway->NextPull = Now + (uint64_t)TMR_TX_PULL * 1000000 * i / GWS_NumGateways;
+    Gateway->NextStat = Now + (uint64_t)TMR_STAT_TX * 1000000 * i / GWS_NumGateways;
+
+    if((Gateway->Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1
+      || connect(Gateway->Socket, (struct sockaddr *) &Addr, sizeof(Addr)) == -1)
+    {
+      printf("GWS_Open: Error creating the socket of gateway %d: %s\n", i, strerror(errno));
+      return 2;
+    }
+    // Change the socket into non-blocking state
+    fcntl(Gateway->Socket, F_SETFL, O_NONBLOCK);
+    GWS_Poll[i].fd = Gateway->Socket;
+    GWS_Poll[i].events = POLLIN;
+  }
+  printf("GWS_Open: %d gateways %016llx..%016llx sending to %s:%d, every uplink heard by %d\n", GWS_NumGateways,
+    (unsigned long long)EuiBase, (unsigned long long)(EuiBase + GWS_NumGateways - 1), Server, Port, GWS_Copies);
+  return 0;
+}
+
+/**
+* __Function__: GWS_Report
+*
+* __Description__: Print the totals of all gateways
+*
+* __Input__: Label of the line, seconds the totals are over
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void GWS_Report( const char *Label, double Seconds )
+{
+  uint32_t Push = 0, PushAcked = 0, Pull = 0, PullAcked = 0, Downlinks = 0, Errors = 0;
+  int i;
+
+  for(i = 0; i < GWS_NumGateways; i++)
+  {
+    Push += GWS_Gateways[i].PushSent;
+    PushAcked += GWS_Gateways[i].PushAcked;
+    Pull += GWS_Gateways[i].PullSent;
+    PullAcked += GWS_Gateways[i].PullAcked;
+    Downlinks += GWS_Gateways[i].Downlinks;
+    Errors += GWS_Gateways[i].SendErrors;
+  }
+  printf("%s: %.1f s, uplinks %u, PUSH_DATA %u (%.1f/s) acked %u, PULL_DATA %u acked %u, downlinks %u, send errors %u\n",
+    Label, Seconds, TG_GetNumGenerated(), Push, Seconds > 0 ? Push / Seconds : 0.0, PushAcked, Pull, PullAcked, Downlinks, Errors);
+}
+
+static void GWS_Signal( int Signal )
+{
+  GWS_Stop = 1;
+}
+
+static void Usage( const char *Name )
+{
+  printf("Usage: %s [-s server[:port]] [-g gateways] [-k copies] [-e eui] [-v traffic:spec] [-c clock] [-t seconds] [-x seed]\n", Name);
+  printf("  -s server  Network server, default %s:%d\n", SERVER, PORT);
+  printf("  -g n       Number of gateways, 1..%d, default %d\n", GWS_MAX_GATEWAYS, GWS_DEFAULT_GATEWAYS);
+  printf("  -k n       Number of gateways that hear every uplink, default 1\n");
+  printf("  -e eui     EUI of the first gateway in hex, the others count up, default %016llx\n", (unsigned long long)GWS_DEFAULT_EUI);
+  printf("  -v traffic:<spec> Device population, see traffic.c, default traffic:air=0\n");
+  printf("  -c clock   real, or sim[:epoch] for virtual time\n");
+  printf("  -t seconds Stop after this long on the clock, default run until Ctrl-C\n");
+  printf("  -x seed    Seed of the tokens and tmst counters\n");
+}
+
+int main( int argc, char *argv[] )
+{
+  struct VR_FRAME_STRUCT Uplink;
+  char Server[64] = SERVER;
+  int Port = PORT;
+  uint64_t EuiBase = GWS_DEFAULT_EUI;
+  uint64_t RunTime = 0;       // 0 = run until Ctrl-C
+  uint64_t StartTime, LastReport, Now;
+  int Configured = 0;
+  char *Colon;
+  int Option, Busy;
+
+  srand(1);
+  while((Option = getopt(argc, argv, "s:g:k:e:v:c:t:x:h")) != -1)
+  {
+    switch(Option)
+    {
+      case 's':
+        snprintf(Server, sizeof(Server), "%s", optarg);
+        if((Colon = strchr(Server, ':')) != NULL)
+        {
+          *Colon++ = 0;
+          Port = atoi(Colon);
+        }
+      break;
+      case 'g': GWS_NumGateways = atoi(optarg); break;
+      case 'k': GWS_Copies = atoi(optarg); break;
+      case 'e': EuiBase = strtoull(optarg, NULL, 16); break;
+      case 'v':
+        if(strncmp(optarg, "traffic:", 8) != 0 || TG_Configure(optarg + 8) != 0)
+        {
+          Usage(argv[0]);
+          return 1;
+        }
+        Configured = 1;
+      break;
+      case 'c':
+        if(strcmp(optarg, "real") == 0)
+        {
+          CLK_SetClock(&CLK_Real);
+        }
+        else if(strncmp(optarg, "sim", 3) == 0 && (optarg[3] == 0 || optarg[3] == ':'))
+        {
+          CLK_SetClock(&CLK_Simulated);
+          if(optarg[3] == ':')
+          {
+            CLK_SetEpoch(strtoll(optarg + 4, NULL, 10));
+          }
+        }
+        else
+        {
+          Usage(argv[0]);
+          return 1;
+        }
+      break;
+      case 't': RunTime = strtoull(optarg, NULL, 10) * 1000000; break;
+      case 'x': srand(strtoul(optarg, NULL, 10)); break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if(GWS_NumGateways < 1 || GWS_NumGateways > GWS_MAX_GATEWAYS || GWS_Copies < 1 || GWS_Copies > GWS_NumGateways)
+  {
+    Usage(argv[0]);
+    return 1;
+  }
+  if(!Configured)
+  {
+    TG_Configure("air=0");
+  }
+
+  if(GWS_Open(Server, Port, EuiBase) != 0)
+  {
+    return 1;
+  }
+
+  signal(SIGINT, GWS_Signal);
+  signal(SIGTERM, GWS_Signal);
+
+  StartTime = LastReport = OS_GetMicros();
+  while(!GWS_Stop)
+  {
+    Now = OS_GetMicros();
+    if(RunTime != 0 && Now - StartTime >= RunTime)
+    {
+      break;
+    }
+
+    // Uplinks of the population, in bursts so the sockets are read in between
+    for(Busy = 0; Busy < GWS_BURST && TG_Generate(NULL, &Uplink); Busy++)
+    {
+      GWS_Uplink(&Uplink);
+    }
+    GWS_Timers(Now);
+    Busy += GWS_Receive();
+
+    if(Now - LastReport >= GWS_REPORT_US)
+    {
+      GWS_Report("gwsim", (Now - StartTime) / 1e6);
+      LastReport = Now;
+    }
+    // Only wait when there was nothing to do
+    if(Busy == 0)
+    {
+      OS_Delay(1);
+    }
+  }
+
+  GWS_Report("gwsim: Stopped", (OS_GetMicros() - StartTime) / 1e6);
+  return 0;
+}
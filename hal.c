@@ -1,10 +1,24 @@
 /*******************************************************************************
  * hardware Abstraction Layer (HAL)
  *
+ * Holds the LORA RX and TX FIFOs and the functions used by the application,
+ * the radio itself is driven by a radio backend (struct HAL_RADIO_STRUCT):
+ * HAL_RadioSX127x for the real chip or HAL_RadioVirtual for running without
+ * hardware. Select it with HAL_SetRadio before calling HAL_Init.
+ *
+ * All state of a radio, its settings, FIFOs and counters, is in a HAL context
+ * (struct HAL_CONTEXT_STRUCT) that every function takes, so that several
+ * radios can be driven side by side.
+ *
+ * HAL_Engine runs in the main loop, or with HAL_StartThread on a thread of its
+ * own, optionally SCHED_FIFO and pinned to a CPU, so that JSON work and network
+ * syscalls never delay draining the chip or keying TX. The LORA RX and TX FIFOs
+ * are lock-free single producer single consumer queues (spsc.h), the only thing
+ * the radio shares with the gateway.
+ *
  * Used base source code from other authors, see credits below but I have
  * modified it to suit my own needs.
  *
- * Dependencies: wiringPi
  *
  *******************************************************************************/
 
@@ -20,114 +34,225 @@
  *******************************************************************************/
 #include <stdio.h>
 #include <stdint.h>           // Required for unint8 etc
-#include <wiringPi.h>         // Required for using wiringPi
-#include <wiringPiSPI.h>      // Required for using SPI
 #include <cstring>            // Required for memcpy
+#include <stdlib.h>           // Required for atoi
+#include <pthread.h>          // Required for the radio thread
 #include "hal.h"              // The header file for this
 #include "os.h"
+#include "metrics.h"          // Instrumentation
+#include "trace.h"            // Tracepoints
+#include "capture.h"          // pcap capture
+
+
 /**
+* __Function__: HAL_InitContext
+*
+* __Description__: Set a HAL context to the defaults, HAL_DEFAULT_FREQ, HAL_DEFAULT_SF and the default pins
+*
+* __Input__: HAL context
 *
-* User defined variables below!
+* __Output__: void
+*
+* __Status__: Completed
 *
+* __Remarks__: To be called before any other HAL function, change the settings before HAL_Init
 */
-uint32_t  freq = 433175000;     /// in Mhz! (433.175) = 433Mhz channel 1
-//uint32_t  freq = 868100000;   /// in Mhz! (868.1) = 868Mhz channel 1
-
-/// Set spreading factor (SF7 - SF12)
-sf_t sf = SF7;
-
-// End of user defined variables!
-
-
-// HAL Variables
-
-bool sx1272 = true;
-
-// SX1272 - Raspberry connections
-int ssPin = 24;           // Chip Select pin
-int dio0  = 7;            // DIO0 Interrupt pin
-int RST   = 15;            // Reset pin
-
-// B64 Message buffer
-char b64[LORA_RX_MX_FRAME_SIZE];
-
-uint32_t cp_nb_rx_rcv = 0;        // Received Packages
-uint32_t cp_nb_rx_ok = 0;
-uint32_t cp_nb_rx_bad = 0;
-uint32_t cp_nb_rx_nocrc = 0;      // Number of CRC errors
-uint32_t cp_up_pkt_fwd = 0;
+void HAL_InitContext( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  int i;
 
-/**
-* Lora TX_Buffer structure
-*/
-struct LORA_TX_BUFFER_STRUCT {
- uint8_t   LORA_TX_FRAME[LORA_TX_MX_FRAME_SIZE];      /**< LORA TX Frame */
- byte      LORA_TX_FRAME_SIZE;                       /**< Size of frame to transmit */
- uint8_t   LORA_TX_FLAG;                             /**< TX_FLAG: 0 = No frame to send, 1 = Frame to send */
- /// Maybe add other data, flags etc?
-};
-/**
-* LORA TX FIFO Buffer
-*/
-struct LORA_TX_BUFFER_STRUCT LORA_TX_FIFO_Buffer[LORA_TX_FIFO_DEPTH];
-/**
-* TXFifo index
-*/
-uint8_t LORA_TX_FIFO_Idx = 0;
+  memset(Hal, 0, sizeof(*Hal));
+  Hal->Freq = HAL_DEFAULT_FREQ;
+  Hal->SF = HAL_DEFAULT_SF;
+  Hal->Sx1272 = 1;
+  Hal->SpiChannel = CHANNEL;
+  Hal->PinNss = HAL_DEFAULT_PIN_NSS;
+  Hal->PinDio0 = HAL_DEFAULT_PIN_DIO0;
+  Hal->PinDio1 = HAL_DEFAULT_PIN_DIO1;
+  Hal->PinReset = HAL_DEFAULT_PIN_RESET;
+  Hal->ThreadCpu = -1;
+  for(i = 0; i < HAL_NUM_SF; i++)
+  {
+    Hal->ScanDwell[i] = HAL_DEFAULT_SCAN_DWELL;
+  }
+  Hal->NumChans = 1;
+  Hal->ChanFreq[0] = Hal->Freq;
+  for(i = 0; i < HAL_MAX_CHANS; i++)
+  {
+    Hal->HopDwell[i] = HAL_DEFAULT_HOP_DWELL_MS * 1000;
+  }
+  SPSC_Reset(&Hal->RxQueue);
+  SPSC_Reset(&Hal->TxQueue);
+}
 
 /**
-* LORA RX_Buffer structure
-*/
-struct LORA_RX_BUFFER_STRUCT {
- uint8_t    LORA_RX_FRAME[LORA_RX_MX_FRAME_SIZE];      /**< RX Frame */
- byte       LORA_RX_FRAME_SIZE;                       /**< Size of frame received */
- uint8_t    LORA_RX_FLAG;                             /**< RX_FLAG: 0 = No frame received, 1 = Frame received */
- byte       LORA_RX_RSSI;
- byte       LORA_RX_PACKET_RSSI;
- long int   LORA_RX_SNR;
- /// Maybe add other data, flags etc?
-};
-/**
-* LORA RX FIFO Buffer
-*/
-struct LORA_RX_BUFFER_STRUCT LORA_RX_FIFO_Buffer[LORA_RX_FIFO_DEPTH];
-/**
-* RX Fifo index
+* __Function__: HAL_Configure
+*
+* __Description__: Set the frequency, spreading factor, pins and SPI channel of a radio from a spec
+*
+* __Input__: HAL context, Spec = key=value[,key=value...]:
+*            freq=MHZ[:MHZ...]  frequency, default HAL_DEFAULT_FREQ, or up to HAL_MAX_CHANS channels to hop over
+*                               (SX127x backend), reported as chan 0, 1, ... in the order given
+*            hop=MS[:MS...]     hopping: time per visit of a channel, one for all or one per channel, default
+*                               HAL_DEFAULT_HOP_DWELL_MS. A frame being received is finished first.
+*            adapt=0|1          hopping: 1 = share the total of the hop times by the frames seen per channel
+*            sf=N | MIN-MAX     spreading factor 7..12, default HAL_DEFAULT_SF, or scan the SFs MIN to MAX with CAD
+*                               and receive on the one a preamble is detected on (SX127x backend)
+*            dwell=N[:N...]     SF scan: aim for a CAD every N symbols of the SF, one N for all or one per SF from
+*                               MIN up, default HAL_DEFAULT_SCAN_DWELL. The SFs share the time in proportion to 1/N,
+*                               a larger N gives the SF less time
+*            nss=PIN dio0=PIN dio1=PIN reset=PIN   pins in wiringPi numbering, also with the spidev transport,
+*                               default HAL_DEFAULT_PIN_NSS etc. nss=-1 = the hardware chip select (CE0 / CE1) of
+*                               the SPI channel, dio1=-1 = DIO1 not wired
+*            spi=N              SPI channel 0 or 1, default CHANNEL
+*            pa=boost|rfo       output pin the module has wired to the antenna, default rfo as the chip resets to.
+*                               Downlinks go out at up to 20 dBm on PA_BOOST, up to 14 dBm on RFO
+*
+* __Output__: Error code: 0 = no error, 1 = Unknown key or invalid value
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before HAL_Init, keys not in the spec keep their value
 */
-uint8_t LORA_RX_FIFO_Idx = 0;
-
-
-long int SNR;
-int rssicorr;
-
+int HAL_Configure( struct HAL_CONTEXT_STRUCT *Hal, const char *Spec )
+{
+  char Buffer[256];
+  char *Token, *Save, *Value;
+  char *Item, *SaveItem;
+  int Error, MaxSF, i;
+  uint32_t Freq;
+
+  snprintf(Buffer, sizeof(Buffer), "%s", Spec);
+  for(Token = strtok_r(Buffer, ",", &Save); Token != NULL; Token = strtok_r(NULL, ",", &Save))
+  {
+    if((Value = strchr(Token, '=')) == NULL)
+    {
+      printf("HAL_Configure: Expected key=value: %s\n", Token);
+      return 1;
+    }
+    *Value++ = 0;
+    Error = 0;
 
+    if(strcmp(Token, "freq") == 0)
+    {
+      for(i = 0, Item = strtok_r(Value, ":", &SaveItem); Item != NULL && i < HAL_MAX_CHANS; Item = strtok_r(NULL, ":", &SaveItem), i++)
+      {
+        Freq = (uint32_t)(atof(Item) * 1000000 + 0.5);
+        Error |= Freq < HAL_MIN_FREQ || Freq > HAL_MAX_FREQ;
+        Hal->ChanFreq[i] = Freq;
+      }
+      Error |= i == 0 || Item != NULL;
+      Hal->NumChans = i;
+      Hal->Freq = Hal->ChanFreq[0];
+    }
+    else if(strcmp(Token, "hop") == 0)
+    {
+      for(i = 0, Item = strtok_r(Value, ":", &SaveItem); Item != NULL && i < HAL_MAX_CHANS; Item = strtok_r(NULL, ":", &SaveItem), i++)
+      {
+        Error |= atoi(Item) < 1 || atoi(Item) > 60000;
+        Hal->HopDwell[i] = atoi(Item) * 1000;
+      }
+      Error |= i == 0 || Item != NULL;
+      // One value for all channels
+      if(i == 1)
+      {
+        for(i = 1; i < HAL_MAX_CHANS; i++)
+        {
+          Hal->HopDwell[i] = Hal->HopDwell[0];
+        }
+      }
+    }
+    else if(strcmp(Token, "adapt") == 0)
+    {
+      Hal->HopAdapt = atoi(Value);
+      Error = strcmp(Value, "0") != 0 && strcmp(Value, "1") != 0;
+    }
+    else if(strcmp(Token, "sf") == 0)
+    {
+      MaxSF = 0;
+      Error = sscanf(Value, "%d-%d", &Hal->SF, &MaxSF) < 1;
+      Hal->ScanMaxSF = MaxSF;
+      Error |= Hal->SF < SF7 || Hal->SF > SF12 || (MaxSF != 0 && (MaxSF <= Hal->SF || MaxSF > SF12));
+    }
+    else if(strcmp(Token, "dwell") == 0)
+    {
+      for(i = 0, Item = strtok_r(Value, ":", &SaveItem); Item != NULL && i < HAL_NUM_SF; Item = strtok_r(NULL, ":", &SaveItem), i++)
+      {
+        Error |= atoi(Item) < 1 || atoi(Item) > 255;
+        Hal->ScanDwell[i] = atoi(Item);
+      }
+      Error |= i == 0 || Item != NULL;
+      // One value for all SFs
+      if(i == 1)
+      {
+        memset(Hal->ScanDwell, Hal->ScanDwell[0], sizeof(Hal->ScanDwell));
+      }
+    }
+    else if(strcmp(Token, "nss") == 0)
+    {
+      Hal->PinNss = atoi(Value);
+    }
+    else if(strcmp(Token, "dio0") == 0)
+    {
+      Hal->PinDio0 = atoi(Value);
+    }
+    else if(strcmp(Token, "dio1") == 0)
+    {
+      Hal->PinDio1 = atoi(Value);
+    }
+    else if(strcmp(Token, "reset") == 0)
+    {
+      Hal->PinReset = atoi(Value);
+    }
+    else if(strcmp(Token, "spi") == 0)
+    {
+      Hal->SpiChannel = atoi(Value);
+      Error = Hal->SpiChannel < 0 || Hal->SpiChannel > 1;
+    }
+    else if(strcmp(Token, "pa") == 0)
+    {
+      Hal->PaBoost = strcmp(Value, "boost") == 0;
+      Error = !Hal->PaBoost && strcmp(Value, "rfo") != 0;
+    }
+    else
+    {
+      printf("HAL_Configure: Unknown key: %s\n", Token);
+      return 1;
+    }
+    if(Error)
+    {
+      printf("HAL_Configure: Invalid value for %s: %s\n", Token, Value);
+      return 1;
+    }
+  }
+  return 0;
+}
 
 /**
 * __Function__: HAL_Init
 *
 * __Description__: Initalise Hardware Abstraction Layer (HAL)
 *
-* __Input__: void
+* __Input__: HAL context
 *
-* __Output__: Error code: 0 = no error, 1 =
+* __Output__: Error code: 0 = no error, 1 = Error initialising the radio, 2 = No radio selected
 *
 * __Status__: Work in Progress
 *
-* __Remarks__:
+* __Remarks__: Select the radio backend with HAL_SetRadio first
 */
-int HAL_Init( void )
+int HAL_Init( struct HAL_CONTEXT_STRUCT *Hal )
 {
   printf("HAL_Init: Started!\n");
 
-  // Initialise wiringpi
-  wiringPiSetup ();
-  pinMode(ssPin, OUTPUT);
-  pinMode(dio0, INPUT);
-  pinMode(RST, OUTPUT);
-
-  wiringPiSPISetup(CHANNEL, 500000);
+  if(Hal->Radio == NULL)
+  {
+    printf("HAL_Init: No radio selected!\n");
+    return 2;
+  }
+  printf("HAL_Init: Using radio: %s\n", Hal->Radio->Name);
 
-  if( HAL_SetupLoRa() != 0)
+  if( Hal->Radio->Init(Hal) != 0)
   {
     // ERROR
     printf("HAL_Init: Error in setting up Lora!\n");
@@ -137,12 +262,31 @@ int HAL_Init( void )
   return 0;
 }
 
+/**
+* __Function__: HAL_SetRadio
+*
+* __Description__: Select the radio backend, to be called before HAL_Init
+*
+* __Input__: HAL context, pointer to the radio backend, e.g. &HAL_RadioSX127x or &HAL_RadioVirtual
+*
+* __Output__: Error code: 0 = no error
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+int HAL_SetRadio( struct HAL_CONTEXT_STRUCT *Hal, const struct HAL_RADIO_STRUCT *Radio )
+{
+  Hal->Radio = Radio;
+  return 0;
+}
+
 /**
 * __Function__: HAL_Engine
 *
 * __Description__: HAL procedures to be called in the main loop
 *
-* __Input__: void
+* __Input__: HAL context
 *
 * __Output__: Error code: 0 = no error, 1 =
 *
@@ -150,266 +294,136 @@ int HAL_Init( void )
 *
 * __Remarks__:
 */
-int HAL_Engine(void)
+int HAL_Engine( struct HAL_CONTEXT_STRUCT *Hal )
 {
   // Execute HAL tasks
   // Checking for received RF Packets and put them into the FIFO buffer, the GW layer to process the received messages
-  HAL_Process_RX();
+  HAL_Process_RX(Hal);
 
   /// TODO: check TX to node, does it need to be in lockstep with node availability?
   /// Keep track of Node RX windows ?
   // Check for TX message waiting in the TX Fifo and send them if required
-  HAL_Process_TX();
+  HAL_Process_TX(Hal);
 
 
   return 0;
 }
 
-
-
 /**
-* __Function__: HAL_writeRegister
+* __Function__: HAL_Thread
 *
-* __Description__: Writes a byte to the specificed register in the lora chip
+* __Description__: Body of the radio thread, runs HAL_Engine until HAL_StopThread
 *
-* __Input__: byte addr = register address, byte vale = value to be written to the register
+* __Input__: HAL context
 *
-* __Output__: void
+* __Output__: NULL
 *
 * __Status__: Completed
 *
-* __Remarks__:
+* __Remarks__: The priority and affinity are set from the thread itself, a failure is logged and the thread runs on as it is
 */
-void HAL_writeRegister(byte addr, byte value)
+static void *HAL_Thread( void *Arg )
 {
-    unsigned char spibuf[2];
-    spibuf[0] = addr | 0x80;
-    spibuf[1] = value;
+  struct HAL_CONTEXT_STRUCT *Hal = (struct HAL_CONTEXT_STRUCT *)Arg;
 
-    HAL_selectreceiver();
-    wiringPiSPIDataRW(CHANNEL, spibuf, 2);
-    HAL_unselectreceiver();
+  OS_SetRealtime(Hal->ThreadPriority, Hal->ThreadCpu);
+  while(__atomic_load_n(&Hal->ThreadStop, __ATOMIC_ACQUIRE) == 0)
+  {
+    HAL_Engine(Hal);
+    OS_Delay(HAL_THREAD_POLL_MS);
+  }
+  return NULL;
 }
 
 /**
-* __Function__: HAL_readRegister
+* __Function__: HAL_StartThread
 *
-* __Description__: Reads a specific register from the Lora chip
+* __Description__: Run HAL_Engine on a thread of its own instead of in the main loop
 *
-* __Input__: byte = register address
+* __Input__: HAL context, Priority = SCHED_FIFO priority 1..99, 0 = normal scheduling, Cpu = CPU to pin the thread to, -1 = any
 *
-* __Output__: contents of the register selected
+* __Output__: Error code: 0 = no error, 1 = thread not created
 *
 * __Status__: Completed
 *
-* __Remarks__:
+* __Remarks__: To be called after HAL_Init, the main loop then no longer calls HAL_Engine. The thread only
+*              talks to the gateway through the LORA RX and TX FIFOs. Needs the real clock, the simulated
+*              clock is not thread safe
 */
-byte HAL_readRegister(byte addr)
+int HAL_StartThread( struct HAL_CONTEXT_STRUCT *Hal, int Priority, int Cpu )
 {
-    unsigned char spibuf[2];
+  int Result;
 
-    HAL_selectreceiver();
-    spibuf[0] = addr & 0x7F;
-    spibuf[1] = 0x00;
-    wiringPiSPIDataRW(CHANNEL, spibuf, 2);
-    HAL_unselectreceiver();
-    // Return the contents of the register
-    return spibuf[1];
+  Hal->ThreadPriority = Priority;
+  Hal->ThreadCpu = Cpu;
+  Hal->ThreadStop = 0;
+  Result = pthread_create(&Hal->Thread, NULL, HAL_Thread, Hal);
+  if(Result != 0)
+  {
+    printf("HAL_StartThread: Error: thread not created: %s\n", strerror(Result));
+    return 1;
+  }
+  Hal->ThreadRunning = 1;
+  printf("HAL_StartThread: Radio %d thread started, priority %d, cpu %d\n", Hal->Index, Priority, Cpu);
+  return 0;
 }
 
 /**
-* __Function__: HAL_selectreceiver
+* __Function__: HAL_StopThread
 *
-* __Description__: Pulls the Chip select pin low so that the SPI device (Lora Module) is selected
+* __Description__: Stop the radio thread and wait for it
 *
-* __Input__: void
+* __Input__: HAL context
 *
 * __Output__: void
 *
 * __Status__: Completed
 *
-* __Remarks__:
+* __Remarks__: Returns after the running HAL_Engine has finished, a frame being sent is sent completely
 */
-void HAL_selectreceiver()
+void HAL_StopThread( struct HAL_CONTEXT_STRUCT *Hal )
 {
-    digitalWrite(ssPin, LOW);
+  if(Hal->ThreadRunning)
+  {
+    __atomic_store_n(&Hal->ThreadStop, 1, __ATOMIC_RELEASE);
+    pthread_join(Hal->Thread, NULL);
+    Hal->ThreadRunning = 0;
+  }
 }
 
-/**
-* __Function__: HAL_unselectreceiver
-*
-* __Description__: Puts the Chip select pin high so that the SPI device (Lora Module) is unsselected
-*
-* __Input__: void
-*
-* __Output__: void
-*
-* __Status__: Completed
-*
-* __Remarks__:
-*/
-void HAL_unselectreceiver()
-{
-    digitalWrite(ssPin, HIGH);
-}
+
 
 /**
-* __Function__: HAL_SetupLoRa
+* __Function__: HAL_SendFrame
 *
-* __Description__: Setup the Lora radio
+* __Description__: Send a frame using the Lora radio
 *
-* __Input__: void
+* __Input__: HAL context, pointer to the frame buffer, Buffer length, frequency, modem and power to send it with
 *
-* __Output__: Error code: 0 = no error, 1 =
+* __Output__: Error code: 0 = no error, else error code of the radio backend
 *
 * __Status__: Work in Progress
 *
-* __Remarks__:
+* __Remarks__: Called by HAL_Process_TX, the radio backend keys TX and returns when done
 */
-int HAL_SetupLoRa( void )
-{
-    digitalWrite(RST, HIGH);
-    delay(100);
-    digitalWrite(RST, LOW);
-    delay(100);
-
-    byte version = HAL_readRegister(REG_VERSION);
-
-    if (version == 0x22) {
-        // sx1272
-        printf("HAL_SetupLoRa: SX1272 detected, starting.\n");
-        sx1272 = true;
-    } else {
-        // sx1276?
-        digitalWrite(RST, LOW);
-        delay(100);
-        digitalWrite(RST, HIGH);
-        delay(100);
-        version = HAL_readRegister(REG_VERSION);
-        if (version == 0x12) {
-            // sx1276
-            printf("HAL_SetupLoRa: SX1276 detected, starting.\n");
-            sx1272 = false;
-        } else {
-            printf("HAL_SetupLoRa: Unrecognized transceiver.\n");
-            printf("HAL_SetupLoRa: Version: 0x%x\n",version);
-            return 1;
-        }
-    }
-
-    HAL_writeRegister(REG_OPMODE, SX72_MODE_SLEEP);
-
-    // set frequency
-    uint64_t frf = ((uint64_t)freq << 19) / 32000000;
-    HAL_writeRegister(REG_FRF_MSB, (uint8_t)(frf>>16) );
-    HAL_writeRegister(REG_FRF_MID, (uint8_t)(frf>> 8) );
-    HAL_writeRegister(REG_FRF_LSB, (uint8_t)(frf>> 0) );
-
-    HAL_writeRegister(REG_SYNC_WORD, 0x34); // LoRaWAN public sync word
-
-    if (sx1272) {
-        if (sf == SF11 || sf == SF12) {
-            HAL_writeRegister(REG_MODEM_CONFIG,0x0B);
-        } else {
-            HAL_writeRegister(REG_MODEM_CONFIG,0x0A);
-        }
-        HAL_writeRegister(REG_MODEM_CONFIG2,(sf<<4) | 0x04);
-    } else {
-        if (sf == SF11 || sf == SF12) {
-            HAL_writeRegister(REG_MODEM_CONFIG3,0x0C);
-        } else {
-            HAL_writeRegister(REG_MODEM_CONFIG3,0x04);
-        }
-        HAL_writeRegister(REG_MODEM_CONFIG,0x72);
-        HAL_writeRegister(REG_MODEM_CONFIG2,(sf<<4) | 0x04);
-    }
-
-    if (sf == SF10 || sf == SF11 || sf == SF12) {
-        HAL_writeRegister(REG_SYMB_TIMEOUT_LSB,0x05);
-    } else {
-        HAL_writeRegister(REG_SYMB_TIMEOUT_LSB,0x08);
-    }
-    HAL_writeRegister(REG_MAX_PAYLOAD_LENGTH,0x80);
-    HAL_writeRegister(REG_PAYLOAD_LENGTH,PAYLOAD_LENGTH);
-    HAL_writeRegister(REG_HOP_PERIOD,0xFF);
-    HAL_writeRegister(REG_FIFO_ADDR_PTR, HAL_readRegister(REG_FIFO_RX_BASE_AD));
-
-
-    HAL_writeRegister(REG_LNA, LNA_MAX_GAIN);  // max lna gain
-
-    // Set Continous Receive Mode
-    HAL_writeRegister(REG_OPMODE, SX72_MODE_RX_CONTINUOS);
-
-    // No errors
-    return 0;
-}
-
- /**
- * __Function__: HAL_SendFrame
- *
- * __Description__: Send a frame using the Lora radio
- *
- * __Input__: Pointer to the frame buffer, Buffer length
- *
- * __Output__: Error code: 0 = no error, 1 = TX Buffer full, 2 = FrameSize to big
- *
- * __Status__: Work in Progress
- *
- * __Remarks__:
- */
- // Change this to add to TX FIFO, send to be done by HAL_Process_TX
-int HAL_SendFrame( uint8_t *TxFrame, byte FrameSize )
+int HAL_SendFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *TxFrame, byte FrameSize, const struct HAL_TX_PARAMS_STRUCT *Tx )
 {
-  /// Debug
-  printf("HAL_SendFrame: Sending frame, frame Size: %d\n", FrameSize);
-  // OS_PrintFrame( TxFrame, FrameSize);
+  HAL_DEBUG("HAL_SendFrame: Sending frame, frame Size: %d\n", FrameSize);
+#ifdef HAL_VERBOSE
   printf("Frame looks like this:\n");
   OS_PrintFrame((uint8_t *)TxFrame, FrameSize);
+#endif
+  CAP_Frame(Hal, CAP_DOWNLINK, TxFrame, FrameSize, Tx->SF, 0, 0, Tx);
 
-  // clear TxDone IRQ
-  HAL_writeRegister(REG_IRQ_FLAGS, 0x8);
-
-  // Setup operation mode to standby to allow to send data
-	HAL_writeRegister(REG_OPMODE, SX72_MODE_STANDBY);
-
-  // TX Init
-	HAL_writeRegister(REG_FIFO_TX_BASE_AD, 0);
-	HAL_writeRegister(REG_FIFO_ADDR_PTR, 0);
-	HAL_writeRegister(REG_PAYLOAD_LENGTH, FrameSize);   //now manually set to 12.....
-
-  // Write data to FIFO
-  for(int i = 0; i < FrameSize; i++)
-  {
-    HAL_writeRegister(REG_FIFO, TxFrame[i]);        /// double check size of FIFO buffer in SX
-  }
-  //Mode Request TX
-  HAL_writeRegister(REG_OPMODE, SX72_MODE_TX);          /// need to check this, was expecting send to happen but does not seem the case, only when standby
-
-  // Get IRQ flags
-  int irqflags = HAL_readRegister(REG_IRQ_FLAGS);
-	//Check of TXDone flag is set
-	while(( irqflags & 0x8 ) != 0x8)
-	{
-    irqflags = HAL_readRegister(REG_IRQ_FLAGS);
-	}
-
-  printf("HAL_SendFrame : TxDone flag is set, reset flag\n");
-  // clear TxDone IRQ
-  HAL_writeRegister(REG_IRQ_FLAGS, 0x8);
-  // Go back to listening
-  printf("HAL_SendFrame : Go back to listening\n");
-  HAL_writeRegister(REG_OPMODE, SX72_MODE_RX_CONTINUOS);
-
-  return 0;
+  return Hal->Radio->SendFrame(Hal, TxFrame, FrameSize, Tx);
 }
 
-
 /**
 * __Function__: HAL_Process_TX
 *
 * __Description__: Send a frame using the Lora radio if one is in the FIFO
 *
-* __Input__: void
+* __Input__: HAL context
 *
 * __Output__: void
 *
@@ -417,18 +431,21 @@ int HAL_SendFrame( uint8_t *TxFrame, byte FrameSize )
 *
 * __Remarks__: Check if there is a frame to send in the FIFO , if there is, use
 */
-int HAL_Process_TX()
+int HAL_Process_TX( struct HAL_CONTEXT_STRUCT *Hal )
 {
+  int Slot;
+
   // Check LORA TX fifo
-  if( LORA_TX_FIFO_Buffer[0].LORA_TX_FLAG != 0)
+  Slot = SPSC_ReadSlot(&Hal->TxQueue, LORA_TX_FIFO_DEPTH);
+  if( Slot >= 0)
   {
     // Send the first message in the Fifo
-    printf("HAL_Process_TX: There is something to send!\n");    /// Debug
-    HAL_SendFrame( LORA_TX_FIFO_Buffer[0].LORA_TX_FRAME, LORA_TX_FIFO_Buffer[0].LORA_TX_FRAME_SIZE );
+    HAL_DEBUG("HAL_Process_TX: There is something to send!\n");
+    Hal->TxQueuedTime = Hal->TxFifo[Slot].LORA_TX_QUEUED_TIME;
+    HAL_SendFrame(Hal, Hal->TxFifo[Slot].LORA_TX_FRAME, Hal->TxFifo[Slot].LORA_TX_FRAME_SIZE, &Hal->TxFifo[Slot].LORA_TX_PARAMS);
 
-    printf("HAL_Process_TX: TX Frame processed\n");   /// Debug
-    LORA_TX_FIFO_Buffer[0].LORA_TX_FLAG = 0;          // Set flag to 0 to indicate frame has been processed
-    HAL_TX_FIFO_Update();                           // Shift frames fown the FIFO if applicable
+    HAL_DEBUG("HAL_Process_TX: TX Frame processed\n");
+    HAL_TX_FIFO_Update(Hal);                           // Give the slot back to HAL_TransmitFrame
     return 0;
   }
   else
@@ -443,103 +460,157 @@ int HAL_Process_TX()
 *
 * __Description__: Check for packets receieved from the RF radio
 *
-* __Input__: void
+* __Input__: HAL context
 *
-* __Output__: Error code:
+* __Output__: Error code: 0 = no error, else error code of the radio backend
 *
 * __Status__: Work in Progress
 *
-* __Remarks__: If packet received put in FIFO, Application layer to process received LORA packages
+* __Remarks__: The radio backend puts received packets in the FIFO with HAL_RX_FIFO_Add
 */
-int HAL_Process_RX()
+int HAL_Process_RX( struct HAL_CONTEXT_STRUCT *Hal )
 {
-    byte Lora_RX_Message[LORA_RX_MX_FRAME_SIZE];
-
-    // Check DIO0 if there is a package received, if so process if not move on
-    if(digitalRead(dio0) == 1)
-    {
-      // Received something so increase counter
-      cp_nb_rx_rcv++;
-      // Check on CRC errors, read IRG flags
-      int irqflags = HAL_readRegister(REG_IRQ_FLAGS);
+  return Hal->Radio->ProcessRX(Hal);
+}
 
-      //  payload crc: 0x20
-      if((irqflags & 0x20) == 0x20)
-      {
-        printf("HAL_Process_RX: CRC error\n");
-        cp_nb_rx_nocrc++;
-        // Reset CRC Flag ??
-        HAL_writeRegister(REG_IRQ_FLAGS, 0x20);
-        // Reset Receive Flag ??, does this reset DIO0 ???
-        HAL_writeRegister(REG_IRQ_FLAGS, 0x40);
-        //return 0;
-      }
-      else
-      {
-        // No CRC, read data
-        // Increase number of non CRC error packages
-        cp_nb_rx_ok++;
+/**
+* Count a frame on the channel the radio is tuned to, for HAL_GetChanFrames and the adaptive hop times
+*/
+static void HAL_ChanHeard( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  uint32_t Total = 0;
+  int i;
 
-        byte currentAddr = HAL_readRegister(REG_FIFO_RX_CURRENT_ADDR);
-        byte receivedCount = HAL_readRegister(REG_RX_NB_BYTES);
+  __atomic_fetch_add(&Hal->ChanFrames[Hal->Chan], 1, __ATOMIC_RELAXED);
+  Hal->HopWeight[Hal->Chan]++;
+  for(i = 0; i < Hal->NumChans; i++)
+  {
+    Total += Hal->HopWeight[i];
+  }
+  if(Total >= HAL_HOP_ADAPT_WINDOW)
+  {
+    // Forget the past slowly, the share follows the traffic
+    for(i = 0; i < Hal->NumChans; i++)
+    {
+      Hal->HopWeight[i] /= 2;
+    }
+  }
+}
 
-        printf("HAL_Process_RX: Bytes Received %d\n", receivedCount);
-        printf("HAL_Process_RX: Current Address %d\n", currentAddr);
+/**
+* __Function__: HAL_RX_FIFO_Add
+*
+* __Description__: Add a frame received by the radio backend to the LORA RX FIFO
+*
+* __Input__: HAL context, pointer to the frame, frame size, packet RSSI, RSSI, SNR, SF it was received on,
+*            time DIO0 was seen (OS_GetMicros)
+*
+* __Output__: Error code: 0 = no error, 1 = LORA RX FIFO full, frame dropped
+*
+* __Status__: Completed
+*
+* __Remarks__: RSSI values are in dBm, the radio backend applies any chip specific correction
+*/
+int HAL_RX_FIFO_Add( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *RxFrame, int FrameSize, int PacketRssi, int Rssi, long int Snr, int SF, uint64_t Dio0Time )
+{
+  uint64_t DrainedTime = OS_GetMicros();
+  int Slot;
+
+  // Received something so increase counter
+  __atomic_fetch_add(&Hal->NumRx, 1, __ATOMIC_RELAXED);
+  // Increase number of non CRC error packages
+  __atomic_fetch_add(&Hal->RxOk, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&Hal->SFStats[SF - SF7].Frames, 1, __ATOMIC_RELAXED);
+  HAL_ChanHeard(Hal);
+  MET_RadioLatency(Hal->Index, MET_LAT_DIO0_TO_DRAINED, DrainedTime - Dio0Time);
+  MET_Count(MET_LORA_RX_FRAMES);
+  TRACE_HAL_RX(FrameSize, PacketRssi, Snr, Dio0Time, DrainedTime);
+  CAP_Frame(Hal, CAP_UPLINK, RxFrame, FrameSize, SF, PacketRssi, Snr, NULL);
+
+  Slot = SPSC_WriteSlot(&Hal->RxQueue, LORA_RX_FIFO_DEPTH);
+  if(Slot < 0)
+  {
+    printf("HAL_RX_FIFO_Add: Buffer full, frame dropped!\n");
+    MET_Count(MET_LORA_RX_DROPPED);
+    return 1;       /// Error 1: RX Buffer full
+  }
 
-        HAL_writeRegister(REG_FIFO_ADDR_PTR, currentAddr);
+  memcpy(Hal->RxFifo[Slot].LORA_RX_FRAME, RxFrame, FrameSize);
+  Hal->RxFifo[Slot].LORA_RX_FRAME_SIZE = FrameSize;       // Add frame size
+  Hal->RxFifo[Slot].LORA_RX_PACKET_RSSI = PacketRssi;     // Store Packet RSSI
+  Hal->RxFifo[Slot].LORA_RX_RSSI = Rssi;                  // Store RSSI
+  Hal->RxFifo[Slot].LORA_RX_SNR = Snr;                    // Store Singal to Noise Ratio
+  Hal->RxFifo[Slot].LORA_RX_SF = SF;                      // Store the SF, it differs from frame to frame with the SF scan
+  Hal->RxFifo[Slot].LORA_RX_CHAN = Hal->Chan;             // Store the channel, it differs from frame to frame when hopping
+  Hal->RxFifo[Slot].LORA_RX_TIME = DrainedTime;           // Store time the frame left the chip
+  HAL_DEBUG("HAL_RX_FIFO_Add: Lora Frame added to buffer at position: %d in FIFO\n", Slot );
+  // Hand the frame to HAL_ReceiveFrame
+  SPSC_Publish(&Hal->RxQueue, LORA_RX_FIFO_DEPTH);
+  return 0;
+}
 
-        // Read data from Chip and store in Buffer
-        for(int i = 0; i < receivedCount; i++)
-        {
-            Lora_RX_Message[i] = HAL_readRegister(REG_FIFO);
-            printf("HAL_Process_RX: Payload: %d = %d\n", i, Lora_RX_Message[i]);
-        }
+/**
+* __Function__: HAL_RX_CrcError
+*
+* __Description__: Count a frame the radio backend received with a CRC error
+*
+* __Input__: HAL context, SF it was received on, time DIO0 was seen (OS_GetMicros)
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void HAL_RX_CrcError( struct HAL_CONTEXT_STRUCT *Hal, int SF, uint64_t Dio0Time )
+{
+  __atomic_fetch_add(&Hal->NumRx, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&Hal->RxNoCrc, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&Hal->SFStats[SF - SF7].Frames, 1, __ATOMIC_RELAXED);
+  HAL_ChanHeard(Hal);
+  TRACE_HAL_RX_CRC(Dio0Time);
+}
 
-        /// Now do other stuff, like getting the SNR and RSSI values, not really requred but is stored along with the package
-        byte value = HAL_readRegister(REG_PKT_SNR_VALUE);     /// Check on what the SNR value is = Signal to Noice Ratio
-        if( value & 0x80 ) // The SNR sign bit is 1
-        {
-            // Invert and divide by 4
-            value = ( ( ~value + 1 ) & 0xFF ) >> 2;
-            SNR = -value;
-        }
-        else
-        {
-            // Divide by 4
-            SNR = ( value & 0xFF ) >> 2;
-        }
+/**
+* __Function__: HAL_TX_Keyed
+*
+* __Description__: To be called by the radio backend the moment TX is keyed
+*
+* __Input__: HAL context, size of the frame
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void HAL_TX_Keyed( struct HAL_CONTEXT_STRUCT *Hal, int FrameSize )
+{
+  Hal->TxKeyedTime = OS_GetMicros();
+  MET_Count(MET_DOWNLINKS);
+  MET_RadioLatency(Hal->Index, MET_LAT_DOWNLINK_LAG, Hal->TxKeyedTime - Hal->TxQueuedTime);
+  TRACE_HAL_TX_KEYED(FrameSize, Hal->TxKeyedTime);
+}
 
-        if (sx1272) {
-            rssicorr = 139;
-        } else {
-            rssicorr = 157;
-        }
+/**
+* __Function__: HAL_TX_Done
+*
+* __Description__: To be called by the radio backend when the radio reports TxDone
+*
+* __Input__: HAL context, size of the frame
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void HAL_TX_Done( struct HAL_CONTEXT_STRUCT *Hal, int FrameSize )
+{
+  uint64_t TxDoneTime = OS_GetMicros();
 
-        ///Debug, remove when done
-        printf("HAL_Process_RX: Packet RSSI: %d, \n",HAL_readRegister(0x1A)-rssicorr);
-        printf("HAL_Process_RX: RSSI: %d, \n",HAL_readRegister(0x1B)-rssicorr);
-        printf("HAL_Process_RX: SNR: %li, \n",SNR);
-        printf("HAL_Process_RX: Length: %d \n", receivedCount );
-
-        // message contains package, length in receivedCount
-        // Add to LORA FIFO buffer
-        memcpy(LORA_RX_FIFO_Buffer[LORA_RX_FIFO_Idx].LORA_RX_FRAME, Lora_RX_Message, receivedCount);
-        // set send flag
-        LORA_RX_FIFO_Buffer[LORA_RX_FIFO_Idx].LORA_RX_FLAG = 1;                                       // Set flag to one to indicate there is a frame to be send
-        LORA_RX_FIFO_Buffer[LORA_RX_FIFO_Idx].LORA_RX_FRAME_SIZE = receivedCount;                     // Add frame size
-        LORA_RX_FIFO_Buffer[LORA_RX_FIFO_Idx].LORA_RX_PACKET_RSSI = HAL_readRegister(0x1A)-rssicorr;  // Store Packet RSSI
-        LORA_RX_FIFO_Buffer[LORA_RX_FIFO_Idx].LORA_RX_RSSI = HAL_readRegister(0x1B)-rssicorr;         // Store RSSI
-        LORA_RX_FIFO_Buffer[LORA_RX_FIFO_Idx].LORA_RX_SNR = SNR;                                      // Store Singal to Noise Ratio
-        printf("HAL_Process_RX: Lora Frame added to buffer at position: %d in FIFO\n", LORA_RX_FIFO_Idx );
-        //Increase the fifo index
-        LORA_RX_FIFO_Idx++;
-
-      } // CRC error
-
-      /// Debug, not sure why but chip seems to freeze up so reset after every received package
-      HAL_SetupLoRa();
-    } // dio0=1
-    return 0;
+  MET_RadioLatency(Hal->Index, MET_LAT_KEYED_TO_TXDONE, TxDoneTime - Hal->TxKeyedTime);
+  TRACE_HAL_TX_DONE(FrameSize, Hal->TxKeyedTime, TxDoneTime);
 }
 
 
@@ -548,7 +619,7 @@ int HAL_Process_RX()
 *
 * __Description__: In case outer layers, such as LORA need to understand the spreading factor the RF is using
 *
-* __Input__: int -1 = Error else SF
+* __Input__: HAL context
 *
 * __Output__: uint32_t Frequency
 *
@@ -556,10 +627,10 @@ int HAL_Process_RX()
 *
 * __Remarks__:
 */
-int HAL_GetSF( void )
+int HAL_GetSF( struct HAL_CONTEXT_STRUCT *Hal )
 {
   int SpreadingFactor;
-  switch (sf) {
+  switch (Hal->SF) {
     case SF7:
       SpreadingFactor = 7;
     break;
@@ -586,12 +657,76 @@ int HAL_GetSF( void )
 }
 
 
+/**
+* __Function__: HAL_GetRxSF
+*
+* __Description__: Spreading factor of the frame last returned by HAL_ReceiveFrame
+*
+* __Input__: HAL context
+*
+* __Output__: SF 7..12
+*
+* __Status__: Completed
+*
+* __Remarks__: With the SF scan it is the SF the preamble was detected on, else the one of HAL_GetSF
+*/
+int HAL_GetRxSF( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return Hal->RxSF;
+}
+
+/**
+* __Function__: HAL_ListensOn
+*
+* __Description__: Check if the radio receives frames of a spreading factor
+*
+* __Input__: HAL context, SF 7..12
+*
+* __Output__: 1 = the configured SF or one of the SF scan, 0 = not received
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+int HAL_ListensOn( struct HAL_CONTEXT_STRUCT *Hal, int SF )
+{
+  if(Hal->ScanMaxSF != 0)
+  {
+    return SF >= Hal->SF && SF <= Hal->ScanMaxSF;
+  }
+  return SF == Hal->SF;
+}
+
+/**
+* __Function__: HAL_GetSFStats
+*
+* __Description__: Get the receive counters of a spreading factor
+*
+* __Input__: HAL context, SF 7..12, pointer to the counters to fill
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Frames counts for every radio, CADs, hits and misses only with the SF scan
+*/
+void HAL_GetSFStats( struct HAL_CONTEXT_STRUCT *Hal, int SF, struct HAL_SF_STATS_STRUCT *Stats )
+{
+  struct HAL_SF_STATS_STRUCT *Counters = &Hal->SFStats[SF - SF7];
+
+  Stats->Cads = __atomic_load_n(&Counters->Cads, __ATOMIC_RELAXED);
+  Stats->Hits = __atomic_load_n(&Counters->Hits, __ATOMIC_RELAXED);
+  Stats->Misses = __atomic_load_n(&Counters->Misses, __ATOMIC_RELAXED);
+  Stats->Frames = __atomic_load_n(&Counters->Frames, __ATOMIC_RELAXED);
+}
+
+
 /**
 * __Function__: HAL_GetFreq
 *
 * __Description__: In case outer layers, such as LORA need to understand the frequency the RF is listening to
 *
-* __Input__: void
+* __Input__: HAL context
 *
 * __Output__: uint32_t Frequency
 *
@@ -599,9 +734,151 @@ int HAL_GetSF( void )
 *
 * __Remarks__:
 */
-uint32_t HAL_GetFreq( void )
+uint32_t HAL_GetFreq( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  return freq;
+  return Hal->Freq;
+}
+
+/**
+* __Function__: HAL_GetChanFreq
+*
+* __Description__: Frequency the radio is tuned to now
+*
+* __Input__: HAL context
+*
+* __Output__: uint32_t Frequency in Hz
+*
+* __Status__: Completed
+*
+* __Remarks__: HAL_GetFreq unless the radio hops over channels
+*/
+uint32_t HAL_GetChanFreq( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return Hal->ChanFreq[Hal->Chan];
+}
+
+/**
+* __Function__: HAL_GetRxFreq
+*
+* __Description__: Frequency of the frame last returned by HAL_ReceiveFrame
+*
+* __Input__: HAL context
+*
+* __Output__: uint32_t Frequency in Hz
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+uint32_t HAL_GetRxFreq( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return Hal->ChanFreq[Hal->RxChan];
+}
+
+int HAL_GetRxChan( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return Hal->RxChan;
+}
+
+uint32_t HAL_GetChanFrames( struct HAL_CONTEXT_STRUCT *Hal, int Chan )
+{
+  return __atomic_load_n(&Hal->ChanFrames[Chan], __ATOMIC_RELAXED);
+}
+
+/**
+* __Function__: HAL_FindChan
+*
+* __Description__: Find the channel of the radio on a frequency
+*
+* __Input__: HAL context, Freq in Hz
+*
+* __Output__: Channel, -1 = the radio does not listen on Freq
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+int HAL_FindChan( struct HAL_CONTEXT_STRUCT *Hal, uint32_t Freq )
+{
+  int i;
+
+  for(i = 0; i < Hal->NumChans; i++)
+  {
+    if(Hal->ChanFreq[i] == Freq)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+* __Function__: HAL_GetHopDwell
+*
+* __Description__: Time the radio stays on a channel when it tunes to it now
+*
+* __Input__: HAL context, Chan
+*
+* __Output__: Time in micro seconds
+*
+* __Status__: Completed
+*
+* __Remarks__: With adapt=1 the hop times of all channels are added up and shared out by the frames seen per
+*              channel, every channel one more so a quiet one is still visited, and never less than 1 /
+*              HAL_HOP_MIN_SHARE of an equal share
+*/
+uint32_t HAL_GetHopDwell( struct HAL_CONTEXT_STRUCT *Hal, int Chan )
+{
+  uint64_t Budget = 0;
+  uint64_t Dwell;
+  uint32_t Total = 0;
+  int i;
+
+  if(!Hal->HopAdapt)
+  {
+    return Hal->HopDwell[Chan];
+  }
+  for(i = 0; i < Hal->NumChans; i++)
+  {
+    Budget += Hal->HopDwell[i];
+    Total += Hal->HopWeight[i] + 1;
+  }
+  Dwell = Budget * (Hal->HopWeight[Chan] + 1) / Total;
+  if(Dwell < Budget / (Hal->NumChans * HAL_HOP_MIN_SHARE))
+  {
+    Dwell = Budget / (Hal->NumChans * HAL_HOP_MIN_SHARE);
+  }
+  return (uint32_t)Dwell;
+}
+
+/**
+* __Function__: HAL_AirtimeUs
+*
+* __Description__: Time on air of a LoRa frame
+*
+* __Input__: SF = 6..12, Bandwidth in Hz, CodingRate = 1..4 for 4/5..4/8, size of the payload in bytes,
+*            preamble length in symbols, Crc = 1 when a payload CRC is sent, ImplicitHeader = 1 without an explicit header,
+*            LowDataRate = 1 when low data rate optimisation is on
+*
+* __Output__: Time on air in micro seconds
+*
+* __Status__: Completed
+*
+* __Remarks__: See the SX1272 / SX1276 datasheet, section 4.1.1.7 Time on air
+*/
+uint32_t HAL_AirtimeUs( int SF, uint32_t Bandwidth, int CodingRate, int PayloadSize, int PreambleLength, int Crc, int ImplicitHeader, int LowDataRate )
+{
+  uint64_t SymbolTime = ((uint64_t)1000000 << SF) / Bandwidth;          // micro seconds
+  int Numerator = 8 * PayloadSize - 4 * SF + 28 + 16 * Crc - 20 * ImplicitHeader;
+  int Denominator = 4 * (SF - 2 * LowDataRate);
+  int PayloadSymbols = 8;
+
+  if(Numerator > 0)
+  {
+    PayloadSymbols += ((Numerator + Denominator - 1) / Denominator) * (CodingRate + 4);
+  }
+  // Preamble plus 4.25 symbols of sync word, plus the header and payload
+  return (uint32_t)(SymbolTime * (4 * PreambleLength + 17) / 4 + SymbolTime * PayloadSymbols);
 }
 
 
@@ -614,26 +891,33 @@ uint32_t HAL_GetFreq( void )
 *
 * __Description__: Function to be called from application layer to get received package out of FIFO if available
 *
-* __Input__: Pointer to buffer where frame can be stored
+* __Input__: HAL context, pointer to buffer where frame can be stored
 *
 * __Output__: Error code: -1 = No Package available else Number of bytes received
 *
 * __Status__: Work in Progress
 *
-* __Remarks__:
+* __Remarks__: Consumer of the LORA RX FIFO, one thread only
 */
-int HAL_ReceiveFrame(uint8_t *RxFrame)
+int HAL_ReceiveFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *RxFrame )
 {
   int BytesReceived;
+  int Slot;
   // Check for message in FIFO, if not available return -1
-  if( LORA_RX_FIFO_Buffer[0].LORA_RX_FLAG != 0)
+  Slot = SPSC_ReadSlot(&Hal->RxQueue, LORA_RX_FIFO_DEPTH);
+  if( Slot >= 0)
   {
     // Copy the frame from the FIFO in the application buffer
-    memcpy( RxFrame, LORA_RX_FIFO_Buffer[0].LORA_RX_FRAME, LORA_RX_FIFO_Buffer[0].LORA_RX_FRAME_SIZE);
-    BytesReceived = LORA_RX_FIFO_Buffer[0].LORA_RX_FRAME_SIZE;
-    printf("HAL_ReceiveFrame: RX Frame processed with size: %d\n", LORA_RX_FIFO_Buffer[0].LORA_RX_FRAME_SIZE);           /// Debug
-        LORA_RX_FIFO_Buffer[0].LORA_RX_FLAG = 0;                    // Set flag to 0 to indicate frame has been processed
-    HAL_RX_FIFO_Update();                                           // Move received frames down the LORA RX FIFO
+    memcpy( RxFrame, Hal->RxFifo[Slot].LORA_RX_FRAME, Hal->RxFifo[Slot].LORA_RX_FRAME_SIZE);
+    BytesReceived = Hal->RxFifo[Slot].LORA_RX_FRAME_SIZE;
+    Hal->RxFrameTime = Hal->RxFifo[Slot].LORA_RX_TIME;
+    Hal->Snr = Hal->RxFifo[Slot].LORA_RX_SNR;
+    Hal->Rssi = Hal->RxFifo[Slot].LORA_RX_PACKET_RSSI;
+    Hal->RxSF = Hal->RxFifo[Slot].LORA_RX_SF;
+    Hal->RxChan = Hal->RxFifo[Slot].LORA_RX_CHAN;
+    MET_Latency(MET_LAT_DRAINED_TO_DEQUEUED, OS_GetMicros() - Hal->RxFrameTime);
+    printf("HAL_ReceiveFrame: RX Frame processed with size: %d\n", BytesReceived);           /// Debug
+    HAL_RX_FIFO_Update(Hal);                                           // Give the slot back to the radio side
     /// Not returning the other information stores such as RSSI, might need this in the future
     return BytesReceived;                                           // Return number of bytes received
   }
@@ -650,31 +934,52 @@ int HAL_ReceiveFrame(uint8_t *RxFrame)
 *
 * __Description__: Function to be called by application layer to send frames using Lora
 *
-* __Input__: void
+* __Input__: HAL context, pointer to the frame, frame size, radio parameters of the txpk, NULL = the RX configuration
 *
-* __Output__: uint32_t Frequency
+* __Output__: Error code: 0 = no error, 1 = TX Buffer full, 2 = FrameSize to big
 *
 * __Status__: Work in Progress
 *
-* __Remarks__:
+* __Remarks__: Producer of the LORA TX FIFO, one thread only. A frequency or SF of 0 is replaced by the first
+*              channel and the SF of the radio, without parameters the frame goes out at HAL_DEFAULT_TX_POWER.
 */
-int HAL_TransmitFrame(uint8_t *TxFrame,int FrameSize)
+int HAL_TransmitFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *TxFrame, int FrameSize, const struct HAL_TX_PARAMS_STRUCT *Tx )
 {
+  struct HAL_TX_PARAMS_STRUCT *Params;
+  int Slot;
+
   /// __Incode Comments:__
   // check for space in HAL TX FIFO
-  // Buffer Index runs from 0 to HAL_FIFO_DEPTH - 1
-  if(LORA_TX_FIFO_Idx < (LORA_TX_FIFO_DEPTH))
+  Slot = SPSC_WriteSlot(&Hal->TxQueue, LORA_TX_FIFO_DEPTH);
+  if(Slot >= 0)
   {
     if(FrameSize <= LORA_TX_MX_FRAME_SIZE)
     {
       // Copy frame in buffer
-      memcpy(LORA_TX_FIFO_Buffer[LORA_TX_FIFO_Idx].LORA_TX_FRAME, TxFrame, FrameSize);
-      // set send flag
-      LORA_TX_FIFO_Buffer[LORA_TX_FIFO_Idx].LORA_TX_FLAG = 1;                 // Set flag to one to indicate there is a frame to be send
-      LORA_TX_FIFO_Buffer[LORA_TX_FIFO_Idx].LORA_TX_FRAME_SIZE = FrameSize;   // Add frame size
+      memcpy(Hal->TxFifo[Slot].LORA_TX_FRAME, TxFrame, FrameSize);
+      Hal->TxFifo[Slot].LORA_TX_FRAME_SIZE = FrameSize;   // Add frame size
+      Hal->TxFifo[Slot].LORA_TX_QUEUED_TIME = OS_GetMicros();
+      Params = &Hal->TxFifo[Slot].LORA_TX_PARAMS;
+      if(Tx != NULL)
+      {
+        *Params = *Tx;
+      }
+      else
+      {
+        memset(Params, 0, sizeof(struct HAL_TX_PARAMS_STRUCT));
+        Params->Power = HAL_DEFAULT_TX_POWER;
+      }
+      if(Params->Freq == 0)
+      {
+        Params->Freq = Hal->ChanFreq[0];
+      }
+      if(Params->SF == 0)
+      {
+        Params->SF = Hal->SF;
+      }
       //printf("LW_AddFrameToTXBuffer: Frame added to buffer at position: %d\n", HAL_TX_FIFO_Idx );
-      //Increase the fifo index
-      LORA_TX_FIFO_Idx++;
+      // Hand the frame to HAL_Process_TX
+      SPSC_Publish(&Hal->TxQueue, LORA_TX_FIFO_DEPTH);
       // No error, return
       /// The sending of the frame from the HAL TX Fifo is handled in HAL_Engine (HAL_Process_TX)
       return 0;
@@ -695,86 +1000,44 @@ int HAL_TransmitFrame(uint8_t *TxFrame,int FrameSize)
 }
 
 /**
- * __Function__: LORA_RX_FIFO_Update
+ * __Function__: HAL_RX_FIFO_Update
  *
- * __Description__: Move frames down the fifo
+ * __Description__: Take the oldest frame out of the LORA RX FIFO
  *
- * __Input__: Void
+ * __Input__: HAL context
  *
  * __Output__: void
  *
  * __Status__: Completed
  *
- * __Remarks__: none
+ * __Remarks__: Consumer side, O(1), the frames are no longer moved down the FIFO
  */
-void HAL_RX_FIFO_Update( void )
+void HAL_RX_FIFO_Update( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  int i;
-
-  // printf("LW_FIFO_Update: index : %d \n", LW_TX_FIFO_Idx);
-
-  if(LORA_RX_FIFO_Idx)
+  if(SPSC_ReadSlot(&Hal->RxQueue, LORA_RX_FIFO_DEPTH) >= 0)
   {
-    // update FIFO if Required
-    for(i=0; i < (LORA_RX_FIFO_DEPTH - 1); ++i)
-    {
-      // Move frames down
-      LORA_RX_FIFO_Buffer[i] = LORA_RX_FIFO_Buffer[i+1];
-      // printf("LW_FIFO_Update: Move queue position : %d to : %d \n", i+1, i);
-    }
-    //Decrease the fifo index
-    LORA_RX_FIFO_Idx--;
-    // Make sure the flag is set to 0 to indicate there is space in the buffer
-    LORA_RX_FIFO_Buffer[LORA_RX_FIFO_DEPTH - 1].LORA_RX_FLAG = 0;
-    // printf("LW_FIFO_Update: Updating position : %d to indicate free space!\n", LW_FIFO_DEPTH - 1 );
-    // printf("LW_FIFO_Update: New FIFO Idx: %d\n", LW_TX_FIFO_Idx );
-  }
-  else
-  {
-    // Nothing to do, IDX at 0
-    // printf("LW_FIFO_Update: Nothing to do, idx at : 0\n");
+    SPSC_Release(&Hal->RxQueue, LORA_RX_FIFO_DEPTH);
   }
 }
 
 /**
  * __Function__: HAL_TX_FIFO_Update
  *
- * __Description__: Move frames down the fifo
+ * __Description__: Take the oldest frame out of the LORA TX FIFO
  *
- * __Input__: Void
+ * __Input__: HAL context
  *
  * __Output__: void
  *
  * __Status__: Completed
  *
- * __Remarks__: none
+ * __Remarks__: Consumer side, O(1), the frames are no longer moved down the FIFO
  */
- void HAL_TX_FIFO_Update( void )
+void HAL_TX_FIFO_Update( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  int i;
-
-  // printf("LW_FIFO_Update: index : %d \n", LW_TX_FIFO_Idx);
-
-  if(LORA_TX_FIFO_Idx)
+  if(SPSC_ReadSlot(&Hal->TxQueue, LORA_TX_FIFO_DEPTH) >= 0)
   {
-    // update FIFO if Required
-    for(i=0; i < (LORA_TX_FIFO_DEPTH - 1); ++i)
-    {
-      // Move frames down
-      LORA_TX_FIFO_Buffer[i] = LORA_TX_FIFO_Buffer[i+1];
-      // printf("LW_FIFO_Update: Move queue position : %d to : %d \n", i+1, i);
-    }
-    //Decrease the fifo index
-    LORA_TX_FIFO_Idx--;
-    // Make sure the flag is set to 0 to indicate there is space in the buffer
-    LORA_TX_FIFO_Buffer[LORA_TX_FIFO_DEPTH - 1].LORA_TX_FLAG = 0;
-    // printf("LW_FIFO_Update: Updating position : %d to indicate free space!\n", LW_FIFO_DEPTH - 1 );
-    // printf("LW_FIFO_Update: New FIFO Idx: %d\n", LW_TX_FIFO_Idx );
-  }
-  else
-  {
-    // Nothing to do, IDX at 0
-    // printf("LW_FIFO_Update: Nothing to do, idx at : 0\n");
+    SPSC_Release(&Hal->TxQueue, LORA_TX_FIFO_DEPTH);
   }
 }
 
@@ -782,9 +1045,9 @@ void HAL_RX_FIFO_Update( void )
 /**
  * __Function__: HAL_GetSNR
  *
- * __Description__: Get the signa to noice ratio
+ * __Description__: Get the signa to noice ratio of the frame last returned by HAL_ReceiveFrame
  *
- * __Input__: Void
+ * __Input__: HAL context
  *
  * __Output__: void
  *
@@ -792,52 +1055,124 @@ void HAL_RX_FIFO_Update( void )
  *
  * __Remarks__: none
  */
-long int HAL_GetSNR(void)
+long int HAL_GetSNR( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  return SNR;
+  return Hal->Snr;
 }
 
 /**
- * __Function__: HAL_GetRssiCor
+ * __Function__: HAL_GetRSSI
  *
- * __Description__: Get the RSSI Correction based upon used chip
+ * __Description__: Get the packet RSSI of the frame last returned by HAL_ReceiveFrame
  *
- * __Input__: Void
+ * __Input__: HAL context
  *
- * __Output__: void
+ * __Output__: RSSI in dBm
  *
  * __Status__: Completed
  *
  * __Remarks__: none
  */
-int HAL_GetRssiCor(void)
+int HAL_GetRSSI( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return Hal->Rssi;
+}
+
+
+uint32_t HAL_GetNumRX( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  return rssicorr;
+  return __atomic_load_n(&Hal->NumRx, __ATOMIC_RELAXED);
 }
 
 
-uint32_t HAL_GetNumRX(void)
+uint32_t HAL_GetRxOk( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  return cp_nb_rx_rcv;
+  return __atomic_load_n(&Hal->RxOk, __ATOMIC_RELAXED);
 }
 
+uint32_t HAL_GetRxBad( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return __atomic_load_n(&Hal->RxBad, __ATOMIC_RELAXED);
+}
 
-uint32_t HAL_GetRxOk(void)
+uint32_t HAL_GetRxNoCRC( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return __atomic_load_n(&Hal->RxNoCrc, __ATOMIC_RELAXED);
+}
+
+uint32_t HAL_GetPktWfd( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return __atomic_load_n(&Hal->PktFwd, __ATOMIC_RELAXED);
+}
+
+/**
+ * __Function__: HAL_CountForwarded
+ *
+ * __Description__: Count a frame of the radio that was queued to the server
+ *
+ * __Input__: HAL context of the radio the frame was received on
+ *
+ * __Output__: void
+ *
+ * __Status__: Completed
+ *
+ * __Remarks__: Called by the gateway once the PUSH_DATA is in the UDP TX FIFO, read with HAL_GetPktWfd
+ */
+void HAL_CountForwarded( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  return cp_nb_rx_ok;
+  __atomic_fetch_add(&Hal->PktFwd, 1, __ATOMIC_RELAXED);
 }
 
-uint32_t HAL_GetRxBad(void)
+/**
+ * __Function__: HAL_GetRxTimestamp
+ *
+ * __Description__: Get the time the frame last returned by HAL_ReceiveFrame was drained from the chip
+ *
+ * __Input__: HAL context
+ *
+ * __Output__: uint64_t micro seconds, see OS_GetMicros
+ *
+ * __Status__: Completed
+ *
+ * __Remarks__: none
+ */
+uint64_t HAL_GetRxTimestamp( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  return cp_nb_rx_bad;
+  return Hal->RxFrameTime;
 }
 
-uint32_t HAL_GetRxNoCRC(void)
+/**
+ * __Function__: HAL_GetRxFifoLevel
+ *
+ * __Description__: Get the number of frames waiting in the LORA RX FIFO
+ *
+ * __Input__: HAL context
+ *
+ * __Output__: Number of frames
+ *
+ * __Status__: Completed
+ *
+ * __Remarks__: none
+ */
+int HAL_GetRxFifoLevel( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  return cp_nb_rx_nocrc;
+  return SPSC_Level(&Hal->RxQueue, LORA_RX_FIFO_DEPTH);
 }
 
-uint32_t HAL_GetPktWfd(void)
+/**
+ * __Function__: HAL_GetTxFifoLevel
+ *
+ * __Description__: Get the number of frames waiting in the LORA TX FIFO
+ *
+ * __Input__: HAL context
+ *
+ * __Output__: Number of frames
+ *
+ * __Status__: Completed
+ *
+ * __Remarks__: none
+ */
+int HAL_GetTxFifoLevel( struct HAL_CONTEXT_STRUCT *Hal )
 {
-  return cp_up_pkt_fwd;
+  return SPSC_Level(&Hal->TxQueue, LORA_TX_FIFO_DEPTH);
 }
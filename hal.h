@@ -6,48 +6,324 @@
 #define _hal_hpp_
 
 #include <stdint.h>           // Required for unint8 etc
+#include <pthread.h>          // Required for the radio thread
+#include "spsc.h"             // Lock-free FIFOs between the radio and the gateway
 
 typedef unsigned char byte;
 
+/**
+* Debug prints on the radio path. Stdout delays the DIO0 service and the TX deadline of the radio thread,
+* so they are only built with make VERBOSE=1
+*/
+#ifdef HAL_VERBOSE
+#include <stdio.h>
+#define HAL_DEBUG(...)             printf(__VA_ARGS__)
+#else
+#define HAL_DEBUG(...)
+#endif
+
+struct HAL_CONTEXT_STRUCT;
+struct HAL_TX_PARAMS_STRUCT;
+struct HAL_SPI_XFER_STRUCT;
+
+/**
+* Radio backend, the HAL FIFOs and public functions sit on top of one of these
+*/
+struct HAL_RADIO_STRUCT {
+  const char  *Name;                                          /**< Name of the radio, for the logs */
+  int         (*Init)( struct HAL_CONTEXT_STRUCT *Hal );      /**< Initialise the radio, 0 = no error */
+  int         (*ProcessRX)( struct HAL_CONTEXT_STRUCT *Hal ); /**< Check for received frames, add them with HAL_RX_FIFO_Add */
+  int         (*SendFrame)( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *TxFrame, byte FrameSize, const struct HAL_TX_PARAMS_STRUCT *Tx );  /**< Transmit a frame, return when done */
+};
+
+extern const struct HAL_RADIO_STRUCT HAL_RadioSX127x;        // SX1272 / SX1276 on the SPI bus, hal_sx127x.c
+extern const struct HAL_RADIO_STRUCT HAL_RadioVirtual;       // Virtual radio without hardware, vradio.c
+
+/**
+* SPI / GPIO transport below the SX127x backend, everything HAL_RadioSX127x needs to talk to the chip
+*/
+struct HAL_SPI_STRUCT {
+  const char  *Name;                                          /**< Name of the transport, for the logs */
+  int         (*Init)( struct HAL_CONTEXT_STRUCT *Hal );      /**< Set up the SPI bus and the pins of the context, 0 = no error */
+  void        (*Transfer)( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *Buffer, int Length );  /**< Full duplex transfer with chip select asserted, the reply overwrites Buffer */
+  int         (*TransferBatch)( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_XFER_STRUCT *Xfers, int Count );  /**< Transfers in order, chip select released between them, return the calls into the kernel it took */
+  int         (*ReadDIO0)( struct HAL_CONTEXT_STRUCT *Hal );  /**< Level of the DIO0 pin */
+  int         (*ReadDIO1)( struct HAL_CONTEXT_STRUCT *Hal );  /**< Level of the DIO1 pin, -1 = not wired (PinDio1 < 0) */
+  void        (*WriteReset)( struct HAL_CONTEXT_STRUCT *Hal, int Level );  /**< Drive the reset pin */
+  void        (*Delay)( unsigned int Millis );                /**< Wait, e.g. for the chip to come out of reset */
+};
+
+extern const struct HAL_SPI_STRUCT HAL_SpiSpidev;            // SPI bus through /dev/spidevB.C and GPIO through /dev/gpiochipN, hal_spi_spidev.c
+extern const struct HAL_SPI_STRUCT HAL_SpiWiringPi;          // Raspberry Pi SPI bus and GPIO through wiringPi, hal_spi_wiringpi.c
+extern const struct HAL_SPI_STRUCT HAL_SpiEmulator;          // Register level model of the SX1272 / SX1276, sx127x_emu.c
+
+/**
+* Operations of the SX127x backend, HAL_GetSpiCost returns the SPI transactions the last one of each took,
+* HAL_GetSpiCalls the calls into the transport, the SPI syscalls on a bus with hardware chip select
+*/
+enum hal_spi_op_t {
+  HAL_SPI_OP_SETUP = 0,         // Reset and configure the chip, HAL_SetupLoRa
+  HAL_SPI_OP_RX_DRAIN,          // Read a received frame, SNR and RSSI from the chip
+  HAL_SPI_OP_TX_LOAD,           // Write a frame in the chip FIFO and key TX
+  HAL_SPI_OP_TX_WAIT,           // Wait for TxDone on DIO0, no SPI
+  HAL_SPI_OP_TX_REARM,          // Clear TxDone and go back to receive
+  HAL_SPI_OP_RETUNE,            // Hop to the next channel in RX continuous
+  HAL_SPI_NUM_OPS
+};
+
+#define LORA_TX_MX_FRAME_SIZE      256   // Maximum TX frame length = 256 bytes in the chip FIFO buffer
+#define LORA_TX_FIFO_DEPTH         10   // Max 10 frames in lora TX buffer
+
+#define LORA_RX_MX_FRAME_SIZE      256   // Maximum TX frame length = 256 bytes in the chip FIFO buffer
+#define LORA_RX_FIFO_DEPTH         10   // Max 10 frames in lora  TX buffer
+
+#define HAL_NUM_SF                 6    // SF7 - SF12, per SF arrays are indexed with SF - SF7
+#define HAL_MAX_CHANS              8    // Channels one radio hops over, e.g. the 8 uplink channels of EU868
+#define HAL_NUM_BW                 3    // Bandwidths of the modem images, see hal_bw_t
+#define HAL_NUM_CR                 4    // Coding rates of the modem images, see hal_cr_t
+#define HAL_NUM_IQ                 2    // IQ polarities of the modem images, see hal_iq_t
+
+/**
+* Bandwidth, coding rate and IQ polarity of a modem image, HAL_SX127x_SetModem
+*/
+enum hal_bw_t { HAL_BW_125 = 0, HAL_BW_250, HAL_BW_500 };
+enum hal_cr_t { HAL_CR_4_5 = 0, HAL_CR_4_6, HAL_CR_4_7, HAL_CR_4_8 };
+enum hal_iq_t {
+  HAL_IQ_NORMAL = 0,            // Uplinks
+  HAL_IQ_INVERTED               // Downlinks, ipol true
+};
+
+/**
+* Modem registers of one SF, BW, CR and IQ polarity for the chip found, written by HAL_SX127x_SetModem
+*/
+struct HAL_MODEM_IMAGE_STRUCT {
+  uint8_t   Config[3];                                /**< REG_MODEM_CONFIG, REG_MODEM_CONFIG2, REG_SYMB_TIMEOUT_LSB, consecutive, one burst */
+  uint8_t   Config3;                                  /**< REG_MODEM_CONFIG3, SX1276 only: low data rate optimisation, AGC */
+  uint8_t   InvertIQ;                                 /**< REG_INVERTIQ */
+  uint8_t   InvertIQ2;                                /**< REG_INVERTIQ2 */
+};
+
+/**
+* Radio parameters of a downlink, from the txpk. HAL_TransmitFrame without them sends on the RX configuration
+*/
+struct HAL_TX_PARAMS_STRUCT {
+  uint32_t  Freq;                                     /**< Frequency in Hz, 0 = the first channel of the radio */
+  int8_t    SF;                                       /**< SF7 - SF12, 0 = the SF of the radio */
+  int8_t    BW;                                       /**< One of hal_bw_t */
+  int8_t    CR;                                       /**< One of hal_cr_t */
+  int8_t    IQ;                                       /**< One of hal_iq_t, HAL_IQ_INVERTED for ipol true */
+  int8_t    Power;                                    /**< Output power in dBm */
+};
+
+/**
+* One SPI transaction of a batch, see HAL_SPI_STRUCT TransferBatch
+*/
+struct HAL_SPI_XFER_STRUCT {
+  uint8_t   *Buffer;                                  /**< Address byte and data, the reply overwrites it */
+  int       Length;                                   /**< Bytes with chip select asserted */
+};
+
+#define HAL_SPI_MAX_XFERS          24                           // Transactions in one batch
+#define HAL_SPI_BATCH_BYTES        (LORA_TX_MX_FRAME_SIZE + 96)  // Bytes of all transactions of a batch, a full FIFO and the registers around it
+
+/**
+* Register reads and writes queued by HAL_BatchWrite etc., submitted to the transport at once by HAL_BatchSubmit
+*/
+struct HAL_SPI_BATCH_STRUCT {
+  int       NumXfers;
+  int       NumBytes;
+  struct HAL_SPI_XFER_STRUCT Xfers[HAL_SPI_MAX_XFERS];
+  uint8_t   Data[HAL_SPI_BATCH_BYTES];                /**< Buffers of the transactions, one after the other */
+};
+
+/**
+* State of the SF scan of the SX127x backend, see HAL_Configure sf=MIN-MAX
+*/
+enum hal_scan_t {
+  HAL_SCAN_IDLE = 0,            // Nothing running, after the setup or a TX
+  HAL_SCAN_CAD,                 // CAD running on ScanSF, DIO0 = CadDone
+  HAL_SCAN_RX,                  // Preamble detected, RX single on ScanSF until a header or RxTimeout
+  HAL_SCAN_RX_LOCKED            // No RxTimeout, the chip has locked on a frame, DIO0 = RxDone
+};
+
+/**
+* Receive counters of one spreading factor, to tune the dwell times of the SF scan
+*/
+struct HAL_SF_STATS_STRUCT {
+  uint32_t  Cads;                                     /**< CADs run on the SF */
+  uint32_t  Hits;                                     /**< Of which detected a preamble, the radio locked on the SF */
+  uint32_t  Misses;                                   /**< Hits that ended in RxTimeout, no frame */
+  uint32_t  Frames;                                   /**< Frames received on the SF, CRC errors included */
+};
+
+/**
+* Lora TX_Buffer structure
+*/
+struct LORA_TX_BUFFER_STRUCT {
+ uint8_t   LORA_TX_FRAME[LORA_TX_MX_FRAME_SIZE];      /**< LORA TX Frame */
+ byte      LORA_TX_FRAME_SIZE;                       /**< Size of frame to transmit */
+ uint64_t  LORA_TX_QUEUED_TIME;                      /**< Time the frame was queued in micro seconds */
+ struct HAL_TX_PARAMS_STRUCT LORA_TX_PARAMS;         /**< Frequency, modem and power to send it with */
+ /// Maybe add other data, flags etc?
+};
+
+/**
+* Lora RX_Buffer structure
+*/
+struct LORA_RX_BUFFER_STRUCT {
+ uint8_t    LORA_RX_FRAME[LORA_RX_MX_FRAME_SIZE];      /**< RX Frame */
+ byte       LORA_RX_FRAME_SIZE;                       /**< Size of frame received */
+ int        LORA_RX_RSSI;                             /**< RSSI in dBm */
+ int        LORA_RX_PACKET_RSSI;                      /**< Packet RSSI in dBm */
+ long int   LORA_RX_SNR;
+ int        LORA_RX_SF;                               /**< Spreading factor the frame was received on */
+ int        LORA_RX_CHAN;                             /**< Channel the frame was received on, index in ChanFreq */
+ uint64_t   LORA_RX_TIME;                             /**< Time the frame was drained from the chip in micro seconds */
+ /// Maybe add other data, flags etc?
+};
+
+/**
+* One radio with its FIFOs, every HAL function works on one of these. Set it up with HAL_InitContext,
+* change the settings before HAL_Init. The small, often used fields come first, the FIFOs last.
+* The FIFOs are single producer single consumer queues: RxFifo is filled by the radio side (HAL_Engine)
+* and emptied by the gateway (HAL_ReceiveFrame), TxFifo the other way round, so HAL_Engine can run
+* on a thread of its own, see HAL_StartThread. The counters are updated atomically for the same reason.
+*/
+struct HAL_CONTEXT_STRUCT {
+  const struct HAL_RADIO_STRUCT *Radio;               /**< Radio backend, HAL_SetRadio */
+  const struct HAL_SPI_STRUCT   *Spi;                 /**< Transport of the SX127x backend, HAL_SetSpi */
+  int       Sx1272;                                   /**< 1 = SX1272, 0 = SX1276, set by HAL_SetupLoRa */
+  uint32_t  Freq;                                     /**< Frequency in Hz, the first channel when hopping */
+  int       SF;                                       /**< Spreading factor, SF7 - SF12, the lowest one scanned with ScanMaxSF */
+  int       ScanMaxSF;                                /**< Highest SF of the SF scan, 0 = no scan, receive on SF only */
+  uint32_t  SpiCount;                                 /**< SPI transactions since start */
+  uint32_t  SpiCalls;                                 /**< Calls into the transport since start, one per batch when it is submitted at once */
+  long int  Snr;                                      /**< SNR of the frame last returned by HAL_ReceiveFrame */
+  int       Rssi;                                     /**< Packet RSSI of the frame last returned by HAL_ReceiveFrame */
+  uint64_t  RxFrameTime;                              /**< Drain time of the frame last returned by HAL_ReceiveFrame */
+  int       RxSF;                                     /**< Spreading factor of the frame last returned by HAL_ReceiveFrame */
+  int       RxChan;                                   /**< Channel of the frame last returned by HAL_ReceiveFrame */
+  uint64_t  TxQueuedTime;                             /**< Time the frame being sent was queued */
+  uint64_t  TxKeyedTime;                              /**< Time TX was keyed for the last frame sent */
+  uint32_t  NumRx;                                    /**< Received packages */
+  uint32_t  RxOk;                                     /**< Of which CRC ok */
+  uint32_t  RxBad;
+  uint32_t  RxNoCrc;                                  /**< Number of CRC errors */
+  uint32_t  PktFwd;                                   /**< Of which queued to the server as a PUSH_DATA, HAL_CountForwarded */
+  int       SpiChannel;                               /**< SPI channel of the chip */
+  int       PinNss;                                   /**< Chip select pin, -1 = the hardware chip select of SpiChannel */
+  int       PinDio0;                                  /**< DIO0 interrupt pin */
+  int       PinDio1;                                  /**< DIO1 interrupt pin, RxTimeout of the SF scan, -1 = not wired */
+  int       PinReset;                                 /**< Reset pin */
+  int       Index;                                    /**< Number of the radio in its gateway, the rxpk chan and rfch, GW_AddRadio */
+  uint32_t  SpiCost[HAL_SPI_NUM_OPS];                 /**< SPI transactions taken by the last operation of each kind */
+  uint32_t  SpiCallCost[HAL_SPI_NUM_OPS];             /**< Calls into the transport taken by the last operation of each kind */
+  int       ScanState;                                /**< One of hal_scan_t */
+  int       ScanSF;                                   /**< SF of the CAD or RX running */
+  uint64_t  ScanTime;                                 /**< Time the CAD or RX running was started */
+  uint64_t  ScanPass[HAL_NUM_SF];                     /**< Per SF, virtual time of its next CAD, the lowest one runs next */
+  uint8_t   ScanDwell[HAL_NUM_SF];                    /**< From SF up, aim for a CAD every this many symbols of the SF, HAL_Configure dwell */
+  struct HAL_SF_STATS_STRUCT SFStats[HAL_NUM_SF];     /**< Per SF receive counters */
+  int       NumChans;                                 /**< Channels in ChanFreq, more than 1 = hop over them */
+  int       Chan;                                     /**< Channel the radio is tuned to */
+  int       HopAdapt;                                 /**< 1 = share the hop time by the traffic seen per channel, HAL_Configure adapt */
+  uint64_t  HopEnd;                                   /**< Time to tune to the next channel */
+  uint32_t  ChanFreq[HAL_MAX_CHANS];                  /**< Frequencies of the channels in Hz, ChanFreq[0] = Freq */
+  uint8_t   ChanFrf[HAL_MAX_CHANS][3];                /**< FRF MSB, MID, LSB of the channels, computed once by HAL_Init */
+  uint32_t  HopDwell[HAL_MAX_CHANS];                  /**< Time per visit of a channel in micro seconds, HAL_Configure hop */
+  uint32_t  HopWeight[HAL_MAX_CHANS];                 /**< Frames per channel, halved every HAL_HOP_ADAPT_WINDOW frames */
+  uint32_t  ChanFrames[HAL_MAX_CHANS];                /**< Frames received per channel, CRC errors included */
+  int       ImagesChip;                               /**< Chip Images was built for, REG_VERSION, 0 = not built yet */
+  const struct HAL_MODEM_IMAGE_STRUCT *Modem;         /**< Image in the chip, NULL = reset values */
+  int       PaPower;                                  /**< Output power the PA registers are set to, HAL_PA_UNKNOWN = reset values */
+  int       PaBoost;                                  /**< 1 = the module has the PA_BOOST pin wired, 0 = the RFO pin, HAL_Configure pa */
+  struct HAL_MODEM_IMAGE_STRUCT Images[HAL_NUM_SF][HAL_NUM_BW][HAL_NUM_CR][HAL_NUM_IQ];   /**< Built once by HAL_SetupLoRa */
+  pthread_t Thread;                                   /**< Thread running HAL_Engine, HAL_StartThread */
+  int       ThreadRunning;                            /**< 1 = HAL_Engine runs on Thread, not in the main loop */
+  int       ThreadStop;                               /**< Set by HAL_StopThread */
+  int       ThreadPriority;                           /**< SCHED_FIFO priority of Thread, 0 = normal scheduling */
+  int       ThreadCpu;                                /**< CPU Thread is pinned to, -1 = any */
+  struct SPSC_STRUCT RxQueue;                         /**< Indices of RxFifo */
+  struct SPSC_STRUCT TxQueue;                         /**< Indices of TxFifo */
+  struct LORA_RX_BUFFER_STRUCT RxFifo[LORA_RX_FIFO_DEPTH];
+  struct LORA_TX_BUFFER_STRUCT TxFifo[LORA_TX_FIFO_DEPTH];
+};
+
 /**
 * HAL Public Functions and Procedures
 */
-int HAL_Init( void );
-int HAL_Engine(void);
-int HAL_ReceiveFrame(uint8_t *RxFrame);
-int HAL_TransmitFrame(uint8_t *txFrame,int FrameSize);
+void HAL_InitContext( struct HAL_CONTEXT_STRUCT *Hal );     // Defaults, to be called first
+int HAL_Configure( struct HAL_CONTEXT_STRUCT *Hal, const char *Spec );   // Frequency, SF or SF scan, pins and SPI channel from key=value[,...]
+int HAL_SetRadio( struct HAL_CONTEXT_STRUCT *Hal, const struct HAL_RADIO_STRUCT *Radio );
+int HAL_SetSpi( struct HAL_CONTEXT_STRUCT *Hal, const struct HAL_SPI_STRUCT *Spi );   // Transport for HAL_RadioSX127x
+int HAL_Init( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_Engine( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_ReceiveFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *RxFrame );
+int HAL_TransmitFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *txFrame, int FrameSize, const struct HAL_TX_PARAMS_STRUCT *Tx );   // Tx NULL = the RX configuration
+int HAL_StartThread( struct HAL_CONTEXT_STRUCT *Hal, int Priority, int Cpu );   // After HAL_Init, HAL_Engine then runs on its own thread
+void HAL_StopThread( struct HAL_CONTEXT_STRUCT *Hal );
 
 /**
 * HAL Supporting Functions and Procedures
 */
-int HAL_GetSF( void );
-uint32_t HAL_GetFreq( void );
-long int HAL_GetSNR(void);
-int HAL_GetRssiCor(void);
-uint32_t HAL_GetNumRX(void);
-uint32_t HAL_GetRxOk(void);
-uint32_t HAL_GetRxBad(void);
-uint32_t HAL_GetRxNoCRC(void);
-uint32_t HAL_GetPktWfd(void);
+int HAL_GetSF( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_GetRxSF( struct HAL_CONTEXT_STRUCT *Hal );          // SF of the frame last returned by HAL_ReceiveFrame
+int HAL_ListensOn( struct HAL_CONTEXT_STRUCT *Hal, int SF );   // 1 = SF is received, the configured one or one scanned
+void HAL_GetSFStats( struct HAL_CONTEXT_STRUCT *Hal, int SF, struct HAL_SF_STATS_STRUCT *Stats );
+uint32_t HAL_GetFreq( struct HAL_CONTEXT_STRUCT *Hal );
+uint32_t HAL_GetChanFreq( struct HAL_CONTEXT_STRUCT *Hal );     // Frequency the radio is tuned to now
+uint32_t HAL_GetRxFreq( struct HAL_CONTEXT_STRUCT *Hal );       // Frequency of the frame last returned by HAL_ReceiveFrame
+int HAL_GetRxChan( struct HAL_CONTEXT_STRUCT *Hal );            // Channel of the frame last returned by HAL_ReceiveFrame
+int HAL_FindChan( struct HAL_CONTEXT_STRUCT *Hal, uint32_t Freq );   // Channel on Freq, -1 = none
+uint32_t HAL_GetChanFrames( struct HAL_CONTEXT_STRUCT *Hal, int Chan );
+long int HAL_GetSNR( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_GetRSSI( struct HAL_CONTEXT_STRUCT *Hal );
+uint32_t HAL_GetNumRX( struct HAL_CONTEXT_STRUCT *Hal );
+uint32_t HAL_GetRxOk( struct HAL_CONTEXT_STRUCT *Hal );
+uint32_t HAL_GetRxBad( struct HAL_CONTEXT_STRUCT *Hal );
+uint32_t HAL_GetRxNoCRC( struct HAL_CONTEXT_STRUCT *Hal );
+uint32_t HAL_GetPktWfd( struct HAL_CONTEXT_STRUCT *Hal );
+void HAL_CountForwarded( struct HAL_CONTEXT_STRUCT *Hal );         // A frame of the radio was queued to the server, rxfw
+uint64_t HAL_GetRxTimestamp( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_GetRxFifoLevel( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_GetTxFifoLevel( struct HAL_CONTEXT_STRUCT *Hal );
+uint32_t HAL_GetSpiCost( struct HAL_CONTEXT_STRUCT *Hal, int Op );
+uint32_t HAL_GetSpiCalls( struct HAL_CONTEXT_STRUCT *Hal, int Op );
+uint32_t HAL_AirtimeUs( int SF, uint32_t Bandwidth, int CodingRate, int PayloadSize, int PreambleLength, int Crc, int ImplicitHeader, int LowDataRate );
+
 
+/**
+* HAL Functions for the radio backends
+*/
+int HAL_RX_FIFO_Add( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *RxFrame, int FrameSize, int PacketRssi, int Rssi, long int Snr, int SF, uint64_t Dio0Time );
+void HAL_RX_CrcError( struct HAL_CONTEXT_STRUCT *Hal, int SF, uint64_t Dio0Time );
+void HAL_TX_Keyed( struct HAL_CONTEXT_STRUCT *Hal, int FrameSize );
+void HAL_TX_Done( struct HAL_CONTEXT_STRUCT *Hal, int FrameSize );
+uint32_t HAL_GetHopDwell( struct HAL_CONTEXT_STRUCT *Hal, int Chan );   // Time of the next visit of a channel in micro seconds
 
 /**
 * HAL Private Functions and Procedures
 */
-int HAL_Process_RX(void);        // Processing Lora receive packages
-int HAL_Process_TX(void);       // Processing Lora Transmit packages
+int HAL_Process_RX( struct HAL_CONTEXT_STRUCT *Hal );       // Processing Lora receive packages
+int HAL_Process_TX( struct HAL_CONTEXT_STRUCT *Hal );       // Processing Lora Transmit packages
 
-int HAL_SendFrame( uint8_t *TxFrame, byte FrameSize );
-int HAL_SetupLoRa( void );
-byte HAL_readRegister(byte addr);
-void HAL_writeRegister(byte addr, byte value);
-void HAL_selectreceiver(void);
-void HAL_unselectreceiver(void);
-void HAL_packagesend(void);
-void HAL_ReceivePacket(void);
-void HAL_TX_FIFO_Update( void );
-void HAL_RX_FIFO_Update( void );
+int HAL_SendFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *TxFrame, byte FrameSize, const struct HAL_TX_PARAMS_STRUCT *Tx );
 
+/**
+* SX127x Private Functions and Procedures
+*/
+int HAL_SetupLoRa( struct HAL_CONTEXT_STRUCT *Hal );
+byte HAL_readRegister( struct HAL_CONTEXT_STRUCT *Hal, byte addr );
+void HAL_writeRegister( struct HAL_CONTEXT_STRUCT *Hal, byte addr, byte value );
+void HAL_writeBurst( struct HAL_CONTEXT_STRUCT *Hal, byte addr, const byte *values, int count );   // Consecutive registers, or the FIFO, in one SPI transaction
+void HAL_BatchInit( struct HAL_SPI_BATCH_STRUCT *Batch );
+void HAL_BatchWrite( struct HAL_SPI_BATCH_STRUCT *Batch, byte addr, byte value );
+void HAL_BatchWriteBurst( struct HAL_SPI_BATCH_STRUCT *Batch, byte addr, const byte *values, int count );
+int HAL_BatchRead( struct HAL_SPI_BATCH_STRUCT *Batch, byte addr, int count );    // Handle for HAL_BatchResult
+const byte *HAL_BatchResult( struct HAL_SPI_BATCH_STRUCT *Batch, int Handle );    // After HAL_BatchSubmit
+void HAL_BatchSubmit( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch );
+void HAL_TX_FIFO_Update( struct HAL_CONTEXT_STRUCT *Hal );
+void HAL_RX_FIFO_Update( struct HAL_CONTEXT_STRUCT *Hal );
 
 
 
@@ -64,12 +340,19 @@ void HAL_RX_FIFO_Update( void );
 #define REG_MODEM_CONFIG            0x1D
 #define REG_MODEM_CONFIG2           0x1E
 #define REG_MODEM_CONFIG3           0x26
+#define REG_MODEM_STAT              0x18
 #define REG_SYMB_TIMEOUT_LSB  		  0x1F
 #define REG_PKT_SNR_VALUE			      0x19
+#define REG_PKT_RSSI_VALUE          0x1A
+#define REG_RSSI_VALUE              0x1B
+#define REG_PREAMBLE_MSB            0x20
+#define REG_PREAMBLE_LSB            0x21
 #define REG_PAYLOAD_LENGTH          0x22
 #define REG_IRQ_FLAGS_MASK          0x11
 #define REG_MAX_PAYLOAD_LENGTH 		  0x23
 #define REG_HOP_PERIOD              0x24
+#define REG_INVERTIQ                0x33
+#define REG_INVERTIQ2               0x3B
 #define REG_SYNC_WORD				        0x39
 #define REG_VERSION	  				      0x42
 
@@ -77,9 +360,52 @@ void HAL_RX_FIFO_Update( void );
 #define SX72_MODE_TX                0x83
 #define SX72_MODE_SLEEP             0x80
 #define SX72_MODE_STANDBY           0x81
+#define SX72_MODE_RX_SINGLE         0x86
+#define SX72_MODE_CAD               0x87
+
+// IRQ flags
+#define IRQ_RX_TIMEOUT              0x80
+#define IRQ_RX_DONE                 0x40
+#define IRQ_PAYLOAD_CRC_ERROR       0x20
+#define IRQ_VALID_HEADER            0x10
+#define IRQ_TX_DONE                 0x08
+#define IRQ_CAD_DONE                0x04
+#define IRQ_FHSS_CHANGE_CHANNEL     0x02
+#define IRQ_CAD_DETECTED            0x01
+
+// Modem status
+#define MODEM_STAT_SIGNAL_DETECTED  0x01
+#define MODEM_STAT_SIGNAL_SYNC      0x02
+#define MODEM_STAT_RX_ONGOING       0x04
+#define MODEM_STAT_HEADER_VALID     0x08
+#define MODEM_STAT_CLEAR            0x10
+
+// IQ polarity, REG_INVERTIQ and REG_INVERTIQ2
+#define INVERTIQ_NORMAL             0x27
+#define INVERTIQ_INVERTED           0x66        // RX and TX inverted
+#define INVERTIQ2_NORMAL            0x1D
+#define INVERTIQ2_INVERTED          0x19
 
 #define PAYLOAD_LENGTH              0x40
 
+// POWER AMPLIFIER, the PA_BOOST pin: 2 - 17 dBm, up to 20 dBm with the high power DAC. The RFO pin: 0 - 14 dBm
+#define REG_PA_CONFIG               0x09
+#define REG_OCP                     0x0B
+#define REG_PA_DAC_SX1272           0x5A
+#define REG_PA_DAC_SX1276           0x4D
+#define PA_BOOST                    0xF0        // PaSelect PA_BOOST, MaxPower 7 on the SX1276
+#define PA_DAC_NORMAL               0x84
+#define PA_DAC_HIGH_POWER           0x87        // +3 dB, 18 - 20 dBm
+#define OCP_NORMAL                  0x2B        // 100 mA, the reset value
+#define OCP_HIGH_POWER              0x3B        // 240 mA for 20 dBm
+#define PA_MIN_POWER                2
+#define PA_MAX_POWER                20
+#define PA_MAX_NORMAL_POWER         17
+#define PA_RFO_SX1276               0x70        // PaSelect RFO, MaxPower 7: Pout = OutputPower on the SX1276
+#define PA_MIN_RFO_POWER            0
+#define PA_MAX_RFO_POWER            14          // RFO limit of the SX1272, 15 on the SX1276
+#define HAL_PA_UNKNOWN              -128
+
 // FRF
 #define REG_FRF_MSB                 0x06
 #define REG_FRF_MID                 0x07
@@ -106,11 +432,26 @@ static const int CHANNEL = 0;
 enum sf_t { SF7=7, SF8, SF9, SF10, SF11, SF12 };
 
 
-#define LORA_TX_MX_FRAME_SIZE      256   // Maximum TX frame length = 256 bytes in the chip FIFO buffer
-#define LORA_TX_FIFO_DEPTH         10   // Max 10 frames in lora TX buffer
+/**
+* Defaults of HAL_InitContext, the radio on SPI channel CHANNEL wired as below
+*/
+#define HAL_DEFAULT_FREQ           433175000    // in Hz (433.175 Mhz) = 433Mhz channel 1, 868100000 for 868Mhz channel 1
+#define HAL_DEFAULT_SF             SF7
+#define HAL_MIN_FREQ               137000000    // in Hz, range of the SX1276
+#define HAL_MAX_FREQ               1020000000
+#define HAL_DEFAULT_PIN_NSS        24           // Chip Select pin
+#define HAL_DEFAULT_PIN_DIO0       7            // DIO0 Interrupt pin
+#define HAL_DEFAULT_PIN_DIO1       -1           // DIO1 Interrupt pin, not wired
+#define HAL_DEFAULT_PIN_RESET      15           // Reset pin
+#define HAL_DEFAULT_SCAN_DWELL     3            // SF scan: a CAD every 3 symbols of an SF catches an 8 symbol preamble in time to lock
+#define HAL_DEFAULT_TX_POWER       14           // Downlink output power in dBm when the txpk has no powe
+#define HAL_DEFAULT_HOP_DWELL_MS   50           // Hopping: time per channel, a few SF7 preambles
+#define HAL_HOP_ADAPT_WINDOW       64           // Adaptive hopping: the frame counts per channel are halved when they add up to this
+#define HAL_HOP_MIN_SHARE          4            // Adaptive hopping: a channel gets at least 1/4 of its fair share of the time
 
-#define LORA_RX_MX_FRAME_SIZE      256   // Maximum TX frame length = 256 bytes in the chip FIFO buffer
-#define LORA_RX_FIFO_DEPTH         10   // Max 10 frames in lora  TX buffer
+#define HAL_THREAD_POLL_MS         1            // Radio thread: wait between two runs of HAL_Engine
+#define HAL_TX_POLL_MS             1            // TX: wait between two reads of DIO0 for TxDone
+#define HAL_TX_TIMEOUT_MARGIN_MS   100          // TX: reset the radio without TxDone this long after twice the airtime
 
 
 #endif // _hal_hpp_
@@ -0,0 +1,527 @@
+/*******************************************************************************
+ * hardware Abstraction Layer (HAL), spidev SPI / GPIO character device transport
+ *
+ * Connects the SX127x backend to a chip on the SPI bus of the Raspberry Pi
+ * through the interfaces of the kernel itself, see HAL_SpiSpidev, so it needs
+ * no wiringPi and runs on the Raspberry Pi OS releases without it (Pi 5
+ * included). HAL_SpiWiringPi stays available as the fallback.
+ *
+ * The SPI channel is /dev/spidev0.<channel>. With PinNss = -1 the kernel
+ * drives the chip select CE0 / CE1 of the channel: a transaction is one
+ * SPI_IOC_MESSAGE ioctl, a batch as well. With a GPIO chip select every
+ * transaction also takes the two ioctls that drive the pin.
+ *
+ * The pins are requested from the GPIO character device of the header
+ * (/dev/gpiochipN, found by its label), in wiringPi numbering like the
+ * wiringPi transport so the same -R nss=,dio0=,reset= work with both. DIO0
+ * and DIO1 are one line request with edge events: reading a level reads the
+ * pending edges, non-blocking, the level is only asked for again when an
+ * edge was lost. NSS and reset are outputs.
+ *
+ * Several radios may share an SPI channel, each with its own chip select pin.
+ * The channel is opened once and a transfer holds the lock of the channel.
+ *
+ * Dependencies: Linux spidev and GPIO character device (uAPI v2, Linux 5.10+)
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>           // Required for memset
+#include <errno.h>
+#include <fcntl.h>            // Required for open
+#include <unistd.h>           // Required for read, close
+#include <pthread.h>          // Required for the lock of the SPI channel
+#include <time.h>             // Required for nanosleep
+#include <sys/ioctl.h>        // Required for ioctl
+#include <linux/spi/spidev.h> // Required for SPI_IOC_MESSAGE
+#include <linux/gpio.h>       // Required for the GPIO line requests
+#include "hal.h"
+
+int HAL_Spidev_Init( struct HAL_CONTEXT_STRUCT *Hal );
+void HAL_Spidev_Transfer( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *Buffer, int Length );
+int HAL_Spidev_TransferBatch( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_XFER_STRUCT *Xfers, int Count );
+int HAL_Spidev_ReadDIO0( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_Spidev_ReadDIO1( struct HAL_CONTEXT_STRUCT *Hal );
+void HAL_Spidev_WriteReset( struct HAL_CONTEXT_STRUCT *Hal, int Level );
+void HAL_Spidev_Delay( unsigned int Millis );
+
+/**
+* The spidev transport
+*/
+const struct HAL_SPI_STRUCT HAL_SpiSpidev = {
+  "spidev",
+  HAL_Spidev_Init,
+  HAL_Spidev_Transfer,
+  HAL_Spidev_TransferBatch,
+  HAL_Spidev_ReadDIO0,
+  HAL_Spidev_ReadDIO1,
+  HAL_Spidev_WriteReset,
+  HAL_Spidev_Delay
+};
+
+#define HAL_SPIDEV_CHANNELS        2            // SPI channels of the Raspberry Pi, CE0 and CE1
+#define HAL_SPIDEV_PATH            "/dev/spidev0.%d"
+#define HAL_SPIDEV_SPEED_HZ        500000       // Same clock as the wiringPi transport
+#define HAL_SPIDEV_MAX_RADIOS      4            // Radios with their pins requested, GW_MAX_RADIOS
+#define HAL_SPIDEV_MAX_GPIOCHIPS   16           // /dev/gpiochipN looked at for the header pins
+#define HAL_SPIDEV_CONSUMER        "single_chan_pkt_fwd"
+#define HAL_SPIDEV_PINS            32           // wiringPi pins 0..31
+
+/**
+* Pins of one radio, requested by HAL_Spidev_Init
+*/
+struct HAL_SPIDEV_RADIO_STRUCT {
+  struct HAL_CONTEXT_STRUCT *Hal;               // Radio, NULL = free
+  int       NssFd;                              // Line request of the chip select, -1 = hardware chip select
+  int       ResetFd;                            // Line request of the reset pin
+  int       DioFd;                              // Line request of DIO0 and DIO1, with edge events
+  uint32_t  DioLines[2];                        // Line offsets of DIO0 and DIO1, in the order of the request
+  int       NumDio;                             // 1 = DIO1 not wired
+  int       Level[2];                           // Level of DIO0 and DIO1 after the last edge read
+  uint32_t  Seqno;                              // Sequence number of the last edge read, a gap means edges were lost
+};
+
+/**
+* BCM GPIO of every wiringPi pin, 40 pin header
+*/
+static const uint8_t HAL_Spidev_Bcm[HAL_SPIDEV_PINS] = {
+  17, 18, 27, 22, 23, 24, 25, 4, 2, 3, 8, 7, 10, 9, 11, 14,
+  15, 28, 29, 30, 31, 5, 6, 13, 19, 26, 12, 16, 20, 21, 0, 1
+};
+
+/**
+* Labels of the GPIO chip of the header: Pi 1-3 and Zero, Pi 4, Pi 5
+*/
+static const char *HAL_Spidev_ChipLabels[] = { "pinctrl-bcm2835", "pinctrl-bcm2711", "pinctrl-rp1" };
+
+// spidev transport Variables
+static int HAL_Spidev_Fd[HAL_SPIDEV_CHANNELS] = { -1, -1 };         // Open /dev/spidev0.N
+static pthread_mutex_t HAL_Spidev_Bus[HAL_SPIDEV_CHANNELS] = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER };
+static int HAL_Spidev_Chip = -1;                                    // Open GPIO chip of the header
+static struct HAL_SPIDEV_RADIO_STRUCT HAL_Spidev_Radios[HAL_SPIDEV_MAX_RADIOS];
+
+
+/**
+* Pins of a radio, NULL when HAL_Spidev_Init did not set it up
+*/
+static struct HAL_SPIDEV_RADIO_STRUCT *HAL_Spidev_Radio( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  int i;
+
+  for(i = 0; i < HAL_SPIDEV_MAX_RADIOS; i++)
+  {
+    if(HAL_Spidev_Radios[i].Hal == Hal)
+    {
+      return &HAL_Spidev_Radios[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+* __Function__: HAL_Spidev_OpenChip
+*
+* __Description__: Find and open the GPIO chip of the header pins
+*
+* __Input__: void
+*
+* __Output__: Error code: 0 = no error, 1 = No GPIO chip with a known label
+*
+* __Status__: Completed
+*
+* __Remarks__: Opened once, for all radios
+*/
+static int HAL_Spidev_OpenChip( void )
+{
+  struct gpiochip_info Info;
+  char Path[32];
+  int Fd, i, l;
+
+  for(i = 0; i < HAL_SPIDEV_MAX_GPIOCHIPS && HAL_Spidev_Chip < 0; i++)
+  {
+    snprintf(Path, sizeof(Path), "/dev/gpiochip%d", i);
+    if((Fd = open(Path, O_RDWR | O_CLOEXEC)) < 0)
+    {
+      continue;
+    }
+    memset(&Info, 0, sizeof(Info));
+    if(ioctl(Fd, GPIO_GET_CHIPINFO_IOCTL, &Info) == 0)
+    {
+      for(l = 0; l < (int)(sizeof(HAL_Spidev_ChipLabels) / sizeof(HAL_Spidev_ChipLabels[0])); l++)
+      {
+        if(strcmp(Info.label, HAL_Spidev_ChipLabels[l]) == 0)
+        {
+          printf("HAL_Spidev_OpenChip: Header pins on %s (%s)\n", Path, Info.label);
+          HAL_Spidev_Chip = Fd;
+          break;
+        }
+      }
+    }
+    if(HAL_Spidev_Chip != Fd)
+    {
+      close(Fd);
+    }
+  }
+  if(HAL_Spidev_Chip < 0)
+  {
+    printf("HAL_Spidev_OpenChip: Error: no GPIO chip of the Raspberry Pi header found!\n");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+* __Function__: HAL_Spidev_RequestLines
+*
+* __Description__: Request GPIO lines of the header
+*
+* __Input__: wiringPi pins, number of pins, Flags = GPIO_V2_LINE_FLAG_..., Value = initial level of an output
+*
+* __Output__: File descriptor of the line request, -1 = error
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static int HAL_Spidev_RequestLines( const int *Pins, int NumPins, uint64_t Flags, int Value )
+{
+  struct gpio_v2_line_request Request;
+  int i;
+
+  memset(&Request, 0, sizeof(Request));
+  for(i = 0; i < NumPins; i++)
+  {
+    if(Pins[i] < 0 || Pins[i] >= HAL_SPIDEV_PINS)
+    {
+      printf("HAL_Spidev_RequestLines: No such pin %d!\n", Pins[i]);
+      return -1;
+    }
+    Request.offsets[i] = HAL_Spidev_Bcm[Pins[i]];
+  }
+  snprintf(Request.consumer, sizeof(Request.consumer), "%s", HAL_SPIDEV_CONSUMER);
+  Request.num_lines = NumPins;
+  Request.config.flags = Flags;
+  if(Flags & GPIO_V2_LINE_FLAG_OUTPUT)
+  {
+    Request.config.num_attrs = 1;
+    Request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    Request.config.attrs[0].attr.values = Value ? 1 : 0;
+    Request.config.attrs[0].mask = 1;
+  }
+  if(ioctl(HAL_Spidev_Chip, GPIO_V2_GET_LINE_IOCTL, &Request) < 0)
+  {
+    printf("HAL_Spidev_RequestLines: Error requesting pin %d: %s\n", Pins[0], strerror(errno));
+    return -1;
+  }
+  return Request.fd;
+}
+
+/**
+* __Function__: HAL_Spidev_Init
+*
+* __Description__: Open the SPI channel and request the pins of the radio
+*
+* __Input__: HAL context, the pins and SPI channel are taken from it
+*
+* __Output__: Error code: 0 = no error, 1 = Error opening the SPI bus or requesting a pin
+*
+* __Status__: Completed
+*
+* __Remarks__: The SPI channel is opened by the first radio on it. With a GPIO chip select the channel is set to
+*              SPI_NO_CS where the controller allows it, so CE0 / CE1 stay free.
+*/
+int HAL_Spidev_Init( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  struct HAL_SPIDEV_RADIO_STRUCT *Radio = HAL_Spidev_Radio(Hal);
+  struct gpio_v2_line_values Values;
+  char Path[32];
+  uint8_t Mode = SPI_MODE_0;
+  uint32_t Speed = HAL_SPIDEV_SPEED_HZ;
+  int Pins[2];
+  int Fd, i;
+
+  if(Hal->SpiChannel < 0 || Hal->SpiChannel >= HAL_SPIDEV_CHANNELS)
+  {
+    printf("HAL_Spidev_Init: No such SPI channel %d!\n", Hal->SpiChannel);
+    return 1;
+  }
+  if(HAL_Spidev_Fd[Hal->SpiChannel] < 0)
+  {
+    snprintf(Path, sizeof(Path), HAL_SPIDEV_PATH, Hal->SpiChannel);
+    if((Fd = open(Path, O_RDWR | O_CLOEXEC)) < 0)
+    {
+      printf("HAL_Spidev_Init: Error opening %s: %s\n", Path, strerror(errno));
+      return 1;
+    }
+    if(ioctl(Fd, SPI_IOC_WR_MAX_SPEED_HZ, &Speed) < 0)
+    {
+      printf("HAL_Spidev_Init: Error setting the SPI clock of %s: %s\n", Path, strerror(errno));
+      close(Fd);
+      return 1;
+    }
+    if(Hal->PinNss >= 0)
+    {
+      Mode |= SPI_NO_CS;
+    }
+    if(ioctl(Fd, SPI_IOC_WR_MODE, &Mode) < 0)
+    {
+      printf("HAL_Spidev_Init: %s cannot leave CE%d alone, it is driven as well\n", Path, Hal->SpiChannel);
+      Mode = SPI_MODE_0;
+      ioctl(Fd, SPI_IOC_WR_MODE, &Mode);
+    }
+    HAL_Spidev_Fd[Hal->SpiChannel] = Fd;
+  }
+
+  if(HAL_Spidev_Chip < 0 && HAL_Spidev_OpenChip() != 0)
+  {
+    return 1;
+  }
+  if(Radio == NULL)
+  {
+    for(i = 0; i < HAL_SPIDEV_MAX_RADIOS && Radio == NULL; i++)
+    {
+      if(HAL_Spidev_Radios[i].Hal == NULL)
+      {
+        Radio = &HAL_Spidev_Radios[i];
+      }
+    }
+    if(Radio == NULL)
+    {
+      printf("HAL_Spidev_Init: Error: more than %d radios!\n", HAL_SPIDEV_MAX_RADIOS);
+      return 1;
+    }
+  }
+  else
+  {
+    // Set up again, give the pins back first
+    close(Radio->ResetFd);
+    close(Radio->DioFd);
+    if(Radio->NssFd >= 0)
+    {
+      close(Radio->NssFd);
+    }
+  }
+  memset(Radio, 0, sizeof(struct HAL_SPIDEV_RADIO_STRUCT));
+  Radio->NssFd = -1;
+  Radio->ResetFd = -1;
+  Radio->DioFd = -1;
+
+  // Not selected, other radios may share the channel
+  if(Hal->PinNss >= 0 && (Radio->NssFd = HAL_Spidev_RequestLines(&Hal->PinNss, 1, GPIO_V2_LINE_FLAG_OUTPUT, 1)) < 0)
+  {
+    return 1;
+  }
+  if((Radio->ResetFd = HAL_Spidev_RequestLines(&Hal->PinReset, 1, GPIO_V2_LINE_FLAG_OUTPUT, 0)) < 0)
+  {
+    return 1;
+  }
+
+  // DIO0 and DIO1 with their edges, read without blocking
+  Pins[0] = Hal->PinDio0;
+  Pins[1] = Hal->PinDio1;
+  Radio->NumDio = Hal->PinDio1 >= 0 ? 2 : 1;
+  Radio->DioFd = HAL_Spidev_RequestLines(Pins, Radio->NumDio,
+    GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING, 0);
+  if(Radio->DioFd < 0 || fcntl(Radio->DioFd, F_SETFL, O_NONBLOCK) < 0)
+  {
+    return 1;
+  }
+  for(i = 0; i < Radio->NumDio; i++)
+  {
+    Radio->DioLines[i] = HAL_Spidev_Bcm[Pins[i]];
+  }
+  Values.mask = (1 << Radio->NumDio) - 1;
+  Values.bits = 0;
+  ioctl(Radio->DioFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &Values);
+  Radio->Level[0] = Values.bits & 1;
+  Radio->Level[1] = (Values.bits >> 1) & 1;
+  Radio->Hal = Hal;
+  return 0;
+}
+
+/**
+* Drive the chip select pin, nothing to do with the hardware chip select
+*/
+static void HAL_Spidev_Select( struct HAL_SPIDEV_RADIO_STRUCT *Radio, int Level )
+{
+  struct gpio_v2_line_values Values;
+
+  if(Radio->NssFd >= 0)
+  {
+    Values.bits = Level;
+    Values.mask = 1;
+    ioctl(Radio->NssFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &Values);
+  }
+}
+
+/**
+* __Function__: HAL_Spidev_Transfer
+*
+* __Description__: One SPI transaction with the chip selected
+*
+* __Input__: HAL context, buffer with the bytes to send, number of bytes
+*
+* __Output__: void, the bytes received overwrite Buffer
+*
+* __Status__: Completed
+*
+* __Remarks__: Holds the lock of the SPI channel
+*/
+void HAL_Spidev_Transfer( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *Buffer, int Length )
+{
+  struct HAL_SPI_XFER_STRUCT Xfer = { Buffer, Length };
+
+  HAL_Spidev_TransferBatch(Hal, &Xfer, 1);
+}
+
+/**
+* __Function__: HAL_Spidev_TransferBatch
+*
+* __Description__: SPI transactions in order, the chip deselected between them
+*
+* __Input__: HAL context, the transactions, number of transactions
+*
+* __Output__: SPI calls into the kernel: 1 with the hardware chip select, 1 per transaction with a GPIO one
+*
+* __Status__: Completed
+*
+* __Remarks__: Holds the lock of the SPI channel for the whole batch
+*/
+int HAL_Spidev_TransferBatch( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_XFER_STRUCT *Xfers, int Count )
+{
+  struct HAL_SPIDEV_RADIO_STRUCT *Radio = HAL_Spidev_Radio(Hal);
+  struct spi_ioc_transfer Tr[HAL_SPI_MAX_XFERS];
+  int Fd = HAL_Spidev_Fd[Hal->SpiChannel];
+  int Calls = 0;
+  int i, n;
+
+  if(Radio == NULL || Count > HAL_SPI_MAX_XFERS)
+  {
+    printf("HAL_Spidev_TransferBatch: Error: radio not set up or %d transfers!\n", Count);
+    return 0;
+  }
+
+  memset(Tr, 0, sizeof(Tr));
+  for(i = 0; i < Count; i++)
+  {
+    Tr[i].tx_buf = (unsigned long)Xfers[i].Buffer;
+    Tr[i].rx_buf = (unsigned long)Xfers[i].Buffer;
+    Tr[i].len = Xfers[i].Length;
+    Tr[i].cs_change = i < Count - 1;
+  }
+
+  pthread_mutex_lock(&HAL_Spidev_Bus[Hal->SpiChannel]);
+  if(Radio->NssFd < 0)
+  {
+    // One message, the kernel releases the chip select after every transfer but the last
+    n = ioctl(Fd, SPI_IOC_MESSAGE(Count), Tr);
+    Calls = 1;
+  }
+  else
+  {
+    for(i = 0, n = 0; i < Count && n >= 0; i++)
+    {
+      Tr[i].cs_change = 0;
+      HAL_Spidev_Select(Radio, 0);
+      n = ioctl(Fd, SPI_IOC_MESSAGE(1), &Tr[i]);
+      HAL_Spidev_Select(Radio, 1);
+      Calls++;
+    }
+  }
+  pthread_mutex_unlock(&HAL_Spidev_Bus[Hal->SpiChannel]);
+
+  if(n < 0)
+  {
+    printf("HAL_Spidev_TransferBatch: Error: SPI_IOC_MESSAGE of %d transfers failed: %s\n", Count, strerror(errno));
+  }
+  return Calls;
+}
+
+/**
+* __Function__: HAL_Spidev_ReadDio
+*
+* __Description__: Level of DIO0 or DIO1 after the edges seen since the last read
+*
+* __Input__: HAL context, Dio = 0 or 1
+*
+* __Output__: 1 = high, 0 = low, -1 = not wired
+*
+* __Status__: Completed
+*
+* __Remarks__: One read of the edge events that does not block, the level is only asked for when the sequence
+*              numbers show edges were lost
+*/
+static int HAL_Spidev_ReadDio( struct HAL_CONTEXT_STRUCT *Hal, int Dio )
+{
+  struct HAL_SPIDEV_RADIO_STRUCT *Radio = HAL_Spidev_Radio(Hal);
+  struct gpio_v2_line_event Events[16];
+  struct gpio_v2_line_values Values;
+  int Lost = 0;
+  int n, i, d;
+
+  if(Radio == NULL || Dio >= Radio->NumDio)
+  {
+    return -1;
+  }
+  while((n = read(Radio->DioFd, Events, sizeof(Events))) > 0)
+  {
+    for(i = 0; i < n / (int)sizeof(struct gpio_v2_line_event); i++)
+    {
+      Lost |= Events[i].seqno != Radio->Seqno + 1;
+      Radio->Seqno = Events[i].seqno;
+      for(d = 0; d < Radio->NumDio; d++)
+      {
+        if(Events[i].offset == Radio->DioLines[d])
+        {
+          Radio->Level[d] = Events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+        }
+      }
+    }
+  }
+  if(Lost)
+  {
+    Values.mask = (1 << Radio->NumDio) - 1;
+    if(ioctl(Radio->DioFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &Values) == 0)
+    {
+      Radio->Level[0] = Values.bits & 1;
+      Radio->Level[1] = (Values.bits >> 1) & 1;
+    }
+  }
+  return Radio->Level[Dio];
+}
+
+int HAL_Spidev_ReadDIO0( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return HAL_Spidev_ReadDio(Hal, 0);
+}
+
+int HAL_Spidev_ReadDIO1( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return HAL_Spidev_ReadDio(Hal, 1);
+}
+
+void HAL_Spidev_WriteReset( struct HAL_CONTEXT_STRUCT *Hal, int Level )
+{
+  struct HAL_SPIDEV_RADIO_STRUCT *Radio = HAL_Spidev_Radio(Hal);
+  struct gpio_v2_line_values Values;
+
+  if(Radio != NULL)
+  {
+    Values.bits = Level ? 1 : 0;
+    Values.mask = 1;
+    ioctl(Radio->ResetFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &Values);
+  }
+}
+
+void HAL_Spidev_Delay( unsigned int Millis )
+{
+  struct timespec Wait;
+
+  // Real time like delay() of wiringPi, not OS_Delay which follows the simulated clock
+  Wait.tv_sec = Millis / 1000;
+  Wait.tv_nsec = (long)(Millis % 1000) * 1000000;
+  while(nanosleep(&Wait, &Wait) == -1 && errno == EINTR)
+  {
+  }
+}
@@ -0,0 +1,248 @@
+/*******************************************************************************
+ * hardware Abstraction Layer (HAL), wiringPi SPI / GPIO transport
+ *
+ * Connects the SX127x backend to a chip on the SPI bus of the Raspberry Pi,
+ * see HAL_SpiWiringPi. The pins and SPI channel are those of the HAL context,
+ * HAL_DEFAULT_PIN_NSS etc. unless changed before HAL_Init.
+ *
+ * Several radios may share an SPI channel, each with its own chip select pin.
+ * The channel is opened once and a transfer holds the lock of the channel, so
+ * that radios on threads of their own never select two chips at once.
+ *
+ * A batch of transactions holds the lock once. With the chip select on a GPIO
+ * pin every transaction is still a call of its own, with the hardware chip
+ * select of the channel (PinNss = -1) the kernel toggles it between the
+ * transactions and the whole batch is one SPI_IOC_MESSAGE ioctl.
+ *
+ * Dependencies: wiringPi
+ *
+ *******************************************************************************/
+
+ /*******************************************************************************
+ *
+ * Copyright (c) 2015 Thomas Telkamp
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <wiringPi.h>         // Required for using wiringPi
+#include <wiringPiSPI.h>      // Required for using SPI
+#include <pthread.h>          // Required for the lock of the SPI channel
+#include <string.h>           // Required for memset
+#include <sys/ioctl.h>        // Required for ioctl
+#include <linux/spi/spidev.h> // Required for SPI_IOC_MESSAGE
+#include "hal.h"
+
+int HAL_WiringPi_Init( struct HAL_CONTEXT_STRUCT *Hal );
+void HAL_WiringPi_Transfer( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *Buffer, int Length );
+int HAL_WiringPi_TransferBatch( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_XFER_STRUCT *Xfers, int Count );
+int HAL_WiringPi_ReadDIO0( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_WiringPi_ReadDIO1( struct HAL_CONTEXT_STRUCT *Hal );
+void HAL_WiringPi_WriteReset( struct HAL_CONTEXT_STRUCT *Hal, int Level );
+void HAL_WiringPi_Delay( unsigned int Millis );
+
+/**
+* The wiringPi transport
+*/
+const struct HAL_SPI_STRUCT HAL_SpiWiringPi = {
+  "wiringpi",
+  HAL_WiringPi_Init,
+  HAL_WiringPi_Transfer,
+  HAL_WiringPi_TransferBatch,
+  HAL_WiringPi_ReadDIO0,
+  HAL_WiringPi_ReadDIO1,
+  HAL_WiringPi_WriteReset,
+  HAL_WiringPi_Delay
+};
+
+#define HAL_WIRINGPI_CHANNELS      2            // SPI channels of the Raspberry Pi, CE0 and CE1
+
+// wiringPi transport Variables
+static int HAL_WiringPi_Open[HAL_WIRINGPI_CHANNELS];                 // 1 = wiringPiSPISetup done for the channel
+static pthread_mutex_t HAL_WiringPi_Bus[HAL_WIRINGPI_CHANNELS] = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER };
+
+
+/**
+* __Function__: HAL_WiringPi_Init
+*
+* __Description__: Initialise wiringPi, the pins and the SPI bus
+*
+* __Input__: HAL context, the pins and SPI channel are taken from it
+*
+* __Output__: Error code: 0 = no error, 1 = Error opening the SPI bus
+*
+* __Status__: Completed
+*
+* __Remarks__: The SPI channel is opened by the first radio on it
+*/
+int HAL_WiringPi_Init( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  // Initialise wiringpi
+  wiringPiSetup ();
+  if(Hal->PinNss >= 0)
+  {
+    pinMode(Hal->PinNss, OUTPUT);
+    digitalWrite(Hal->PinNss, HIGH);    // Not selected, other radios may share the channel
+  }
+  pinMode(Hal->PinDio0, INPUT);
+  if(Hal->PinDio1 >= 0)
+  {
+    pinMode(Hal->PinDio1, INPUT);
+  }
+  pinMode(Hal->PinReset, OUTPUT);
+
+  if(Hal->SpiChannel < 0 || Hal->SpiChannel >= HAL_WIRINGPI_CHANNELS)
+  {
+    printf("HAL_WiringPi_Init: No such SPI channel %d!\n", Hal->SpiChannel);
+    return 1;
+  }
+  if(!HAL_WiringPi_Open[Hal->SpiChannel])
+  {
+    if(wiringPiSPISetup(Hal->SpiChannel, 500000) < 0)
+    {
+      printf("HAL_WiringPi_Init: Error opening SPI channel %d!\n", Hal->SpiChannel);
+      return 1;
+    }
+    HAL_WiringPi_Open[Hal->SpiChannel] = 1;
+  }
+  return 0;
+}
+
+/**
+* __Function__: HAL_selectreceiver
+*
+* __Description__: Pulls the Chip select pin low so that the SPI device (Lora Module) is selected
+*
+* __Input__: HAL context
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Nothing to do with the hardware chip select
+*/
+static void HAL_selectreceiver( struct HAL_CONTEXT_STRUCT *Hal )
+{
+    if(Hal->PinNss >= 0)
+    {
+      digitalWrite(Hal->PinNss, LOW);
+    }
+}
+
+/**
+* __Function__: HAL_unselectreceiver
+*
+* __Description__: Puts the Chip select pin high so that the SPI device (Lora Module) is unsselected
+*
+* __Input__: HAL context
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Nothing to do with the hardware chip select
+*/
+static void HAL_unselectreceiver( struct HAL_CONTEXT_STRUCT *Hal )
+{
+    if(Hal->PinNss >= 0)
+    {
+      digitalWrite(Hal->PinNss, HIGH);
+    }
+}
+
+/**
+* __Function__: HAL_WiringPi_Transfer
+*
+* __Description__: One SPI transaction with the chip selected
+*
+* __Input__: HAL context, buffer with the bytes to send, number of bytes
+*
+* __Output__: void, the bytes received overwrite Buffer
+*
+* __Status__: Completed
+*
+* __Remarks__: Holds the lock of the SPI channel
+*/
+void HAL_WiringPi_Transfer( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *Buffer, int Length )
+{
+    pthread_mutex_lock(&HAL_WiringPi_Bus[Hal->SpiChannel]);
+    HAL_selectreceiver(Hal);
+    wiringPiSPIDataRW(Hal->SpiChannel, Buffer, Length);
+    HAL_unselectreceiver(Hal);
+    pthread_mutex_unlock(&HAL_WiringPi_Bus[Hal->SpiChannel]);
+}
+
+/**
+* __Function__: HAL_WiringPi_TransferBatch
+*
+* __Description__: SPI transactions in order, the chip deselected between them
+*
+* __Input__: HAL context, the transactions, number of transactions
+*
+* __Output__: Calls into the kernel: 1 with the hardware chip select, Count with a GPIO one
+*
+* __Status__: Completed
+*
+* __Remarks__: Holds the lock of the SPI channel for the whole batch
+*/
+int HAL_WiringPi_TransferBatch( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_XFER_STRUCT *Xfers, int Count )
+{
+    struct spi_ioc_transfer Tr[HAL_SPI_MAX_XFERS];
+    int Calls = Count;
+    int i;
+
+    pthread_mutex_lock(&HAL_WiringPi_Bus[Hal->SpiChannel]);
+    if(Hal->PinNss < 0 && Count <= HAL_SPI_MAX_XFERS)
+    {
+      // One message, the kernel releases the chip select after every transfer but the last
+      memset(Tr, 0, sizeof(Tr));
+      for(i = 0; i < Count; i++)
+      {
+        Tr[i].tx_buf = (unsigned long)Xfers[i].Buffer;
+        Tr[i].rx_buf = (unsigned long)Xfers[i].Buffer;
+        Tr[i].len = Xfers[i].Length;
+        Tr[i].cs_change = i < Count - 1;
+      }
+      if(ioctl(wiringPiSPIGetFd(Hal->SpiChannel), SPI_IOC_MESSAGE(Count), Tr) < 0)
+      {
+        printf("HAL_WiringPi_TransferBatch: Error: SPI_IOC_MESSAGE of %d transfers failed!\n", Count);
+      }
+      Calls = 1;
+    }
+    else
+    {
+      for(i = 0; i < Count; i++)
+      {
+        HAL_selectreceiver(Hal);
+        wiringPiSPIDataRW(Hal->SpiChannel, Xfers[i].Buffer, Xfers[i].Length);
+        HAL_unselectreceiver(Hal);
+      }
+    }
+    pthread_mutex_unlock(&HAL_WiringPi_Bus[Hal->SpiChannel]);
+    return Calls;
+}
+
+int HAL_WiringPi_ReadDIO0( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return digitalRead(Hal->PinDio0);
+}
+
+int HAL_WiringPi_ReadDIO1( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  return Hal->PinDio1 >= 0 ? digitalRead(Hal->PinDio1) : -1;
+}
+
+void HAL_WiringPi_WriteReset( struct HAL_CONTEXT_STRUCT *Hal, int Level )
+{
+  digitalWrite(Hal->PinReset, Level ? HIGH : LOW);
+}
+
+void HAL_WiringPi_Delay( unsigned int Millis )
+{
+  delay(Millis);
+}
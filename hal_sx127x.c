@@ -0,0 +1,1092 @@
+/*******************************************************************************
+ * hardware Abstraction Layer (HAL), SX1272 / SX1276 radio
+ *
+ * The radio backend for a Semtech SX1272 (HopeRF RFM92W) or SX1276 (HopeRF
+ * RFM95W), see HAL_RadioSX127x. The chip is reached through a SPI / GPIO
+ * transport (struct HAL_SPI_STRUCT): HAL_SpiSpidev or HAL_SpiWiringPi for the
+ * SPI bus of the Raspberry Pi or HAL_SpiEmulator for a register level model of
+ * the chip. Select it with HAL_SetSpi before calling HAL_Init, the chip found
+ * and the SPI transaction counts are kept in the HAL context.
+ *
+ * The operations that touch many registers, setup, TX, re-arm, retune and the
+ * RX drain, queue their register reads and writes in a batch
+ * (struct HAL_SPI_BATCH_STRUCT) and hand it to the transport at once, on a bus
+ * with hardware chip select that is one SPI_IOC_MESSAGE ioctl. Registers that
+ * are next to each other go in one burst transaction. Polling, DIO0 and the
+ * IRQ flags while waiting for TxDone, stays one register at a time.
+ *
+ * With an SF range (HAL_Configure sf=MIN-MAX) the chip does not sit in RX
+ * continuous on one SF but runs CAD after CAD over the SFs of the range. When
+ * a CAD detects a preamble it stays on that SF in RX single, the frame is
+ * reported with it. The SFs take turns by stride scheduling: every CAD moves
+ * the SF on by its dwell time in its own symbols and the SF furthest behind
+ * runs next, so the time is shared in proportion to 1/dwell whatever the SF.
+ * A short dwell lets the CADs of an SF come close enough together to catch a
+ * preamble in time to lock on it. The per SF CAD, hit and miss counters show
+ * where to change the dwell times.
+ *
+ * Used base source code from other authors, see credits below but I have
+ * modified it to suit my own needs.
+ *
+ *
+ *******************************************************************************/
+
+ /*******************************************************************************
+ *
+ * Copyright (c) 2015 Thomas Telkamp
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>           // Required for memcpy
+#include "hal.h"              // The header file for this
+#include "os.h"
+#include "metrics.h"          // Instrumentation
+
+int HAL_SX127x_Init( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_SX127x_ProcessRX( struct HAL_CONTEXT_STRUCT *Hal );
+int HAL_SX127x_SendFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *TxFrame, byte FrameSize, const struct HAL_TX_PARAMS_STRUCT *Tx );
+static void HAL_SX127x_BuildImages( struct HAL_CONTEXT_STRUCT *Hal, int Version );
+static void HAL_SX127x_SetModem( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch, int sf, int bw, int cr, int iq );
+static void HAL_SX127x_SetPower( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch, int Power );
+static void HAL_SX127x_Frf( uint32_t Freq, uint8_t *Frf );
+static int HAL_SX127x_SymbTimeout( int sf );
+static void HAL_SX127x_Drain( struct HAL_CONTEXT_STRUCT *Hal, int SF, uint64_t Dio0Time );
+static void HAL_SX127x_StartCad( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch, uint64_t Now );
+static int HAL_SX127x_Scan( struct HAL_CONTEXT_STRUCT *Hal );
+static void HAL_SX127x_Tune( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch, int Chan, uint64_t Now );
+static void HAL_SX127x_Hop( struct HAL_CONTEXT_STRUCT *Hal, uint64_t Now );
+static void HAL_SX127x_Charge( struct HAL_CONTEXT_STRUCT *Hal, int Op, uint32_t *Mark );
+static uint8_t *HAL_BatchAdd( struct HAL_SPI_BATCH_STRUCT *Batch, int Length );
+
+// SX127x Variables
+static const byte HAL_BatchNone[LORA_RX_MX_FRAME_SIZE] = { 0 };     // Result of a read that did not fit in its batch
+
+/**
+* The SX127x radio backend
+*/
+const struct HAL_RADIO_STRUCT HAL_RadioSX127x = {
+  "sx127x",
+  HAL_SX127x_Init,
+  HAL_SX127x_ProcessRX,
+  HAL_SX127x_SendFrame
+};
+
+
+/**
+* __Function__: HAL_SX127x_Init
+*
+* __Description__: Initalise the SX127x radio
+*
+* __Input__: HAL context
+*
+* __Output__: Error code: 0 = no error, 1 = Lora chip not found, 2 = No or failing SPI transport
+*
+* __Status__: Work in Progress
+*
+* __Remarks__: Select the transport with HAL_SetSpi first
+*/
+int HAL_SX127x_Init( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  if(Hal->Spi == NULL)
+  {
+    printf("HAL_SX127x_Init: No SPI transport selected!\n");
+    return 2;
+  }
+  printf("HAL_SX127x_Init: Using SPI transport: %s\n", Hal->Spi->Name);
+
+  if(Hal->Spi->Init(Hal) != 0)
+  {
+    printf("HAL_SX127x_Init: Error in setting up the SPI transport!\n");
+    return 2;
+  }
+
+  // FRF of every channel, retuning is then three register writes
+  for(int i = 0; i < Hal->NumChans; i++)
+  {
+    HAL_SX127x_Frf(Hal->ChanFreq[i], Hal->ChanFrf[i]);
+  }
+  Hal->Chan = 0;
+  if(Hal->NumChans > 1)
+  {
+    Hal->HopEnd = OS_GetMicros() + HAL_GetHopDwell(Hal, 0);
+  }
+
+  if( HAL_SetupLoRa(Hal) != 0)
+  {
+    // ERROR
+    printf("HAL_SX127x_Init: Error in setting up Lora!\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+* __Function__: HAL_SetSpi
+*
+* __Description__: Select the SPI / GPIO transport of the SX127x backend, to be called before HAL_Init
+*
+* __Input__: HAL context, pointer to the transport, e.g. &HAL_SpiSpidev, &HAL_SpiWiringPi or &HAL_SpiEmulator
+*
+* __Output__: Error code: 0 = no error
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+int HAL_SetSpi( struct HAL_CONTEXT_STRUCT *Hal, const struct HAL_SPI_STRUCT *Spi )
+{
+  Hal->Spi = Spi;
+  return 0;
+}
+
+/**
+* __Function__: HAL_GetSpiCost
+*
+* __Description__: Get the number of SPI transactions the last operation of a kind took
+*
+* __Input__: HAL context, Op = one of hal_spi_op_t
+*
+* __Output__: Number of SPI transactions, 0 when the operation did not run yet
+*
+* __Status__: Completed
+*
+* __Remarks__: Every register read or write is one transaction
+*/
+uint32_t HAL_GetSpiCost( struct HAL_CONTEXT_STRUCT *Hal, int Op )
+{
+  return __atomic_load_n(&Hal->SpiCost[Op], __ATOMIC_RELAXED);
+}
+
+uint32_t HAL_GetSpiCalls( struct HAL_CONTEXT_STRUCT *Hal, int Op )
+{
+  return __atomic_load_n(&Hal->SpiCallCost[Op], __ATOMIC_RELAXED);
+}
+
+/**
+* Charge the SPI transactions and transport calls since Mark to an operation and move Mark on, Mark = { SpiCount, SpiCalls }
+*/
+static void HAL_SX127x_Charge( struct HAL_CONTEXT_STRUCT *Hal, int Op, uint32_t *Mark )
+{
+  Hal->SpiCost[Op] = Hal->SpiCount - Mark[0];
+  Hal->SpiCallCost[Op] = Hal->SpiCalls - Mark[1];
+  Mark[0] = Hal->SpiCount;
+  Mark[1] = Hal->SpiCalls;
+}
+
+/**
+* __Function__: HAL_writeRegister
+*
+* __Description__: Writes a byte to the specificed register in the lora chip
+*
+* __Input__: HAL context, byte addr = register address, byte vale = value to be written to the register
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void HAL_writeRegister( struct HAL_CONTEXT_STRUCT *Hal, byte addr, byte value )
+{
+    unsigned char spibuf[2];
+    spibuf[0] = addr | 0x80;
+    spibuf[1] = value;
+
+    MET_Count(MET_SPI_TRANSACTIONS);
+    Hal->SpiCount++;
+    Hal->SpiCalls++;
+    Hal->Spi->Transfer(Hal, spibuf, 2);
+}
+
+/**
+* __Function__: HAL_writeBurst
+*
+* __Description__: Writes consecutive registers, or bytes to the FIFO, in one SPI transaction
+*
+* __Input__: HAL context, byte addr = first register address, values to be written, count = number of values
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: The chip moves on to the next address after every byte, except for REG_FIFO. At most
+*              LORA_TX_MX_FRAME_SIZE values.
+*/
+void HAL_writeBurst( struct HAL_CONTEXT_STRUCT *Hal, byte addr, const byte *values, int count )
+{
+    unsigned char spibuf[LORA_TX_MX_FRAME_SIZE + 1];
+    spibuf[0] = addr | 0x80;
+    memcpy(spibuf + 1, values, count);
+
+    MET_Count(MET_SPI_TRANSACTIONS);
+    Hal->SpiCount++;
+    Hal->SpiCalls++;
+    Hal->Spi->Transfer(Hal, spibuf, count + 1);
+}
+
+/**
+* __Function__: HAL_readRegister
+*
+* __Description__: Reads a specific register from the Lora chip
+*
+* __Input__: HAL context, byte = register address
+*
+* __Output__: contents of the register selected
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+byte HAL_readRegister( struct HAL_CONTEXT_STRUCT *Hal, byte addr )
+{
+    unsigned char spibuf[2];
+
+    MET_Count(MET_SPI_TRANSACTIONS);
+    Hal->SpiCount++;
+    Hal->SpiCalls++;
+    spibuf[0] = addr & 0x7F;
+    spibuf[1] = 0x00;
+    Hal->Spi->Transfer(Hal, spibuf, 2);
+    // Return the contents of the register
+    return spibuf[1];
+}
+
+/**
+* __Function__: HAL_BatchInit
+*
+* __Description__: Start an empty batch of register reads and writes
+*
+* __Input__: Batch
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: HAL_BatchSubmit empties the batch again, it can be reused right away
+*/
+void HAL_BatchInit( struct HAL_SPI_BATCH_STRUCT *Batch )
+{
+    Batch->NumXfers = 0;
+    Batch->NumBytes = 0;
+}
+
+/**
+* Append a transaction of Length bytes to a batch, NULL = batch full
+*/
+static uint8_t *HAL_BatchAdd( struct HAL_SPI_BATCH_STRUCT *Batch, int Length )
+{
+    struct HAL_SPI_XFER_STRUCT *Xfer;
+
+    if(Batch->NumXfers >= HAL_SPI_MAX_XFERS || Batch->NumBytes + Length > HAL_SPI_BATCH_BYTES)
+    {
+        printf("HAL_BatchAdd: Error: batch full, transaction dropped!\n");
+        return NULL;
+    }
+    Xfer = &Batch->Xfers[Batch->NumXfers++];
+    Xfer->Buffer = Batch->Data + Batch->NumBytes;
+    Xfer->Length = Length;
+    Batch->NumBytes += Length;
+    return Xfer->Buffer;
+}
+
+/**
+* __Function__: HAL_BatchWriteBurst
+*
+* __Description__: Queue a write of consecutive registers, or bytes to the FIFO, as one transaction
+*
+* __Input__: Batch, byte addr = first register address, values to be written, count = number of values
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: The values are copied, see HAL_writeBurst
+*/
+void HAL_BatchWriteBurst( struct HAL_SPI_BATCH_STRUCT *Batch, byte addr, const byte *values, int count )
+{
+    uint8_t *Buffer = HAL_BatchAdd(Batch, count + 1);
+
+    if(Buffer != NULL)
+    {
+        Buffer[0] = addr | 0x80;
+        memcpy(Buffer + 1, values, count);
+    }
+}
+
+void HAL_BatchWrite( struct HAL_SPI_BATCH_STRUCT *Batch, byte addr, byte value )
+{
+    HAL_BatchWriteBurst(Batch, addr, &value, 1);
+}
+
+/**
+* __Function__: HAL_BatchRead
+*
+* __Description__: Queue a read of consecutive registers, or bytes from the FIFO, as one transaction
+*
+* __Input__: Batch, byte addr = first register address, count = number of registers
+*
+* __Output__: Handle of the result for HAL_BatchResult, -1 = batch full
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+int HAL_BatchRead( struct HAL_SPI_BATCH_STRUCT *Batch, byte addr, int count )
+{
+    uint8_t *Buffer = HAL_BatchAdd(Batch, count + 1);
+
+    if(Buffer == NULL)
+    {
+        return -1;
+    }
+    Buffer[0] = addr & 0x7F;
+    memset(Buffer + 1, 0, count);
+    return Buffer + 1 - Batch->Data;
+}
+
+/**
+* __Function__: HAL_BatchResult
+*
+* __Description__: Registers read by a submitted batch
+*
+* __Input__: Batch, Handle returned by HAL_BatchRead
+*
+* __Output__: The registers in the order of their addresses, zeros when the read did not fit in the batch
+*
+* __Status__: Completed
+*
+* __Remarks__: Valid until the next transaction is queued in the batch
+*/
+const byte *HAL_BatchResult( struct HAL_SPI_BATCH_STRUCT *Batch, int Handle )
+{
+    return Handle >= 0 ? Batch->Data + Handle : HAL_BatchNone;
+}
+
+/**
+* __Function__: HAL_BatchSubmit
+*
+* __Description__: Run the transactions of a batch in order and empty it
+*
+* __Input__: HAL context, Batch
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: One call into the transport, which takes the bus once for all of them. Nothing happens for an
+*              empty batch.
+*/
+void HAL_BatchSubmit( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch )
+{
+    int i;
+
+    if(Batch->NumXfers == 0)
+    {
+        return;
+    }
+    for(i = 0; i < Batch->NumXfers; i++)
+    {
+        MET_Count(MET_SPI_TRANSACTIONS);
+    }
+    Hal->SpiCount += Batch->NumXfers;
+    Hal->SpiCalls += Hal->Spi->TransferBatch(Hal, Batch->Xfers, Batch->NumXfers);
+    HAL_BatchInit(Batch);
+}
+
+/**
+* __Function__: HAL_SetupLoRa
+*
+* __Description__: Setup the Lora radio
+*
+* __Input__: HAL context
+*
+* __Output__: Error code: 0 = no error, 1 =
+*
+* __Status__: Work in Progress
+*
+* __Remarks__:
+*/
+int HAL_SetupLoRa( struct HAL_CONTEXT_STRUCT *Hal )
+{
+    int sf = HAL_GetSF(Hal);
+    uint32_t Mark[2] = { Hal->SpiCount, Hal->SpiCalls };
+    struct HAL_SPI_BATCH_STRUCT Batch;
+    const byte Lengths[3] = { PAYLOAD_LENGTH, 0x80, 0xFF };
+
+    Hal->Spi->WriteReset(Hal, 1);
+    Hal->Spi->Delay(100);
+    Hal->Spi->WriteReset(Hal, 0);
+    Hal->Spi->Delay(100);
+
+    byte version = HAL_readRegister(Hal, REG_VERSION);
+
+    if (version == 0x22) {
+        // sx1272
+        printf("HAL_SetupLoRa: SX1272 detected, starting.\n");
+        Hal->Sx1272 = 1;
+    } else {
+        // sx1276?
+        Hal->Spi->WriteReset(Hal, 0);
+        Hal->Spi->Delay(100);
+        Hal->Spi->WriteReset(Hal, 1);
+        Hal->Spi->Delay(100);
+        version = HAL_readRegister(Hal, REG_VERSION);
+        if (version == 0x12) {
+            // sx1276
+            printf("HAL_SetupLoRa: SX1276 detected, starting.\n");
+            Hal->Sx1272 = 0;
+        } else {
+            printf("HAL_SetupLoRa: Unrecognized transceiver.\n");
+            printf("HAL_SetupLoRa: Version: 0x%x\n",version);
+            return 1;
+        }
+    }
+    // The modem registers of every configuration, once for the chip found. The reset put the chip back to the defaults
+    if (Hal->ImagesChip != version) {
+        HAL_SX127x_BuildImages(Hal, version);
+    }
+    Hal->Modem = NULL;
+    Hal->PaPower = HAL_PA_UNKNOWN;
+
+    // The rest of the setup in one batch
+    HAL_BatchInit(&Batch);
+    HAL_BatchWrite(&Batch, REG_OPMODE, SX72_MODE_SLEEP);
+
+    // set frequency, the channel tuned to, FRF computed by HAL_SX127x_Init
+    HAL_BatchWriteBurst(&Batch, REG_FRF_MSB, Hal->ChanFrf[Hal->Chan], 3);
+
+    HAL_BatchWrite(&Batch, REG_SYNC_WORD, 0x34); // LoRaWAN public sync word
+
+    HAL_SX127x_SetModem(Hal, &Batch, sf, HAL_BW_125, HAL_CR_4_5, HAL_IQ_NORMAL);
+    // REG_PAYLOAD_LENGTH, REG_MAX_PAYLOAD_LENGTH and REG_HOP_PERIOD are consecutive
+    HAL_BatchWriteBurst(&Batch, REG_PAYLOAD_LENGTH, Lengths, 3);
+    // REG_FIFO_RX_BASE_AD is 0 after the reset
+    HAL_BatchWrite(&Batch, REG_FIFO_ADDR_PTR, 0x00);
+
+
+    HAL_BatchWrite(&Batch, REG_LNA, LNA_MAX_GAIN);  // max lna gain
+
+    if (Hal->ScanMaxSF) {
+        // Start the SF scan on the SF just set
+        Hal->ScanSF = sf;
+        Hal->ScanState = HAL_SCAN_IDLE;
+        HAL_SX127x_StartCad(Hal, &Batch, OS_GetMicros());
+    } else {
+        // Set Continous Receive Mode
+        HAL_BatchWrite(&Batch, REG_OPMODE, SX72_MODE_RX_CONTINUOS);
+    }
+    HAL_BatchSubmit(Hal, &Batch);
+
+    HAL_SX127x_Charge(Hal, HAL_SPI_OP_SETUP, Mark);
+    // No errors
+    return 0;
+}
+
+
+/**
+* __Function__: HAL_SX127x_BuildImages
+*
+* __Description__: Compute the modem registers of every SF, BW, CR and IQ polarity for a chip
+*
+* __Input__: HAL context, Version = REG_VERSION of the chip, 0x22 = SX1272, else SX1276
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Explicit header, payload CRC on. Low data rate optimisation when a symbol takes 16 ms or more,
+*              SF11 and SF12 at 125 kHz, SF12 at 250 kHz.
+*/
+static void HAL_SX127x_BuildImages( struct HAL_CONTEXT_STRUCT *Hal, int Version )
+{
+    struct HAL_MODEM_IMAGE_STRUCT *Image;
+    int sf, bw, cr, iq, ldro;
+
+    for (sf = SF7; sf <= SF12; sf++) {
+        for (bw = 0; bw < HAL_NUM_BW; bw++) {
+            ldro = (sf - bw) >= SF11;
+            for (cr = 0; cr < HAL_NUM_CR; cr++) {
+                for (iq = 0; iq < HAL_NUM_IQ; iq++) {
+                    Image = &Hal->Images[sf - SF7][bw][cr][iq];
+                    if (Version == 0x22) {
+                        // sx1272: BW 7-6, CR 5-3, CRC on, LDRO 0. AGC auto on in CONFIG2
+                        Image->Config[0] = (bw << 6) | ((cr + 1) << 3) | 0x02 | ldro;
+                        Image->Config3 = 0;
+                    } else {
+                        // sx1276: BW 7-4, CR 3-1. CRC on in CONFIG2, LDRO and AGC auto on in CONFIG3
+                        Image->Config[0] = ((7 + bw) << 4) | ((cr + 1) << 1);
+                        Image->Config3 = (ldro << 3) | 0x04;
+                    }
+                    Image->Config[1] = (sf << 4) | 0x04;
+                    Image->Config[2] = HAL_SX127x_SymbTimeout(sf);
+                    Image->InvertIQ = iq == HAL_IQ_INVERTED ? INVERTIQ_INVERTED : INVERTIQ_NORMAL;
+                    Image->InvertIQ2 = iq == HAL_IQ_INVERTED ? INVERTIQ2_INVERTED : INVERTIQ2_NORMAL;
+                }
+            }
+        }
+    }
+    Hal->ImagesChip = Version;
+}
+
+/**
+* __Function__: HAL_SX127x_SetModem
+*
+* __Description__: Put the modem image of an SF, BW, CR and IQ polarity in the chip
+*
+* __Input__: HAL context, Batch to queue the writes in, sf = SF7 .. SF12, bw = one of hal_bw_t, cr = one of hal_cr_t,
+*            iq = one of hal_iq_t
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Nothing is written when the image is in the chip already, the IQ registers only when the polarity
+*              changes. At most 4 SPI transactions. The chip must be in sleep or standby mode when the batch runs.
+*/
+static void HAL_SX127x_SetModem( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch, int sf, int bw, int cr, int iq )
+{
+    const struct HAL_MODEM_IMAGE_STRUCT *Image = &Hal->Images[sf - SF7][bw][cr][iq];
+    uint8_t InvertIQ = Hal->Modem != NULL ? Hal->Modem->InvertIQ : INVERTIQ_NORMAL;
+
+    if (Image == Hal->Modem) {
+        return;
+    }
+    if (!Hal->Sx1272) {
+        HAL_BatchWrite(Batch, REG_MODEM_CONFIG3, Image->Config3);
+    }
+    HAL_BatchWriteBurst(Batch, REG_MODEM_CONFIG, Image->Config, 3);
+    if (Image->InvertIQ != InvertIQ) {
+        HAL_BatchWrite(Batch, REG_INVERTIQ, Image->InvertIQ);
+        HAL_BatchWrite(Batch, REG_INVERTIQ2, Image->InvertIQ2);
+    }
+    Hal->Modem = Image;
+}
+
+/**
+* __Function__: HAL_SX127x_SetPower
+*
+* __Description__: Set the output power on the PA_BOOST or the RFO pin, HAL_Configure pa
+*
+* __Input__: HAL context, Batch to queue the writes in, Power in dBm, PA_MIN_POWER .. PA_MAX_POWER on PA_BOOST,
+*            PA_MIN_RFO_POWER .. PA_MAX_RFO_POWER on RFO, outside it is clipped
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: One register write when the power changes, the high power DAC and the current limit only when
+*              crossing PA_MAX_NORMAL_POWER on PA_BOOST. The reset values are those of the normal range.
+*/
+static void HAL_SX127x_SetPower( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch, int Power )
+{
+    int High;
+
+    if (!Hal->PaBoost) {
+        Power = Power < PA_MIN_RFO_POWER ? PA_MIN_RFO_POWER : Power > PA_MAX_RFO_POWER ? PA_MAX_RFO_POWER : Power;
+        if (Power == Hal->PaPower) {
+            return;
+        }
+        // SX1272: Pout = -1 + OutputPower, SX1276 with MaxPower 7: Pout = OutputPower
+        HAL_BatchWrite(Batch, REG_PA_CONFIG, Hal->Sx1272 ? Power + 1 : PA_RFO_SX1276 | Power);
+        Hal->PaPower = Power;
+        return;
+    }
+
+    Power = Power < PA_MIN_POWER ? PA_MIN_POWER : Power > PA_MAX_POWER ? PA_MAX_POWER : Power;
+    if (Power == Hal->PaPower) {
+        return;
+    }
+    High = Power > PA_MAX_NORMAL_POWER;
+    if (High != (Hal->PaPower > PA_MAX_NORMAL_POWER)) {
+        HAL_BatchWrite(Batch, Hal->Sx1272 ? REG_PA_DAC_SX1272 : REG_PA_DAC_SX1276, High ? PA_DAC_HIGH_POWER : PA_DAC_NORMAL);
+        HAL_BatchWrite(Batch, REG_OCP, High ? OCP_HIGH_POWER : OCP_NORMAL);
+    }
+    // Pout = 2 + OutputPower, 5 + OutputPower with the high power DAC
+    HAL_BatchWrite(Batch, REG_PA_CONFIG, PA_BOOST | (Power - (High ? 5 : 2)));
+    Hal->PaPower = Power;
+}
+
+/**
+* FRF register triplet of a frequency in Hz, 61.035 Hz steps of the 32 MHz crystal
+*/
+static void HAL_SX127x_Frf( uint32_t Freq, uint8_t *Frf )
+{
+    uint64_t frf = ((uint64_t)Freq << 19) / 32000000;
+
+    Frf[0] = (uint8_t)(frf>>16);
+    Frf[1] = (uint8_t)(frf>> 8);
+    Frf[2] = (uint8_t)(frf>> 0);
+}
+
+/**
+* Symbols RX single waits for a preamble on an SF before RxTimeout
+*/
+static int HAL_SX127x_SymbTimeout( int sf )
+{
+    return (sf == SF10 || sf == SF11 || sf == SF12) ? 0x05 : 0x08;
+}
+
+/**
+* Length of a symbol of an SF at BW 125 kHz in micro seconds
+*/
+static uint64_t HAL_SX127x_SymbolUs( int sf )
+{
+    return ((uint64_t)1000000 << sf) / 125000;
+}
+
+ /**
+ * __Function__: HAL_SX127x_SendFrame
+ *
+ * __Description__: Send a frame using the Lora radio
+ *
+ * __Input__: HAL context, pointer to the frame buffer, Buffer length, frequency, modem and power to send it with
+ *
+ * __Output__: Error code: 0 = no error, 1 = no TxDone in time, the radio was reset
+ *
+ * __Status__: Work in Progress
+ *
+ * __Remarks__: Returns when the chip reports TxDone on DIO0, polled every HAL_TX_POLL_MS without SPI. The chip
+ *              is then put back on the channel and modem it received with, without a reset, only the registers
+ *              the TX changed are written. Without TxDone after twice the airtime and HAL_TX_TIMEOUT_MARGIN_MS
+ *              the chip is reset and set up for receiving again.
+ */
+int HAL_SX127x_SendFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *TxFrame, byte FrameSize, const struct HAL_TX_PARAMS_STRUCT *Tx )
+{
+  uint32_t Mark[2] = { Hal->SpiCount, Hal->SpiCalls };
+  struct HAL_SPI_BATCH_STRUCT Batch;
+  const byte FifoPtrs[2] = { 0, 0 };
+  uint8_t TxFrf[3];
+  uint64_t Airtime, Timeout;
+  int Retuned;
+
+  HAL_BatchInit(&Batch);
+  // clear TxDone IRQ
+  HAL_BatchWrite(&Batch, REG_IRQ_FLAGS, 0x8);
+
+  // Setup operation mode to standby to allow to send data
+  HAL_BatchWrite(&Batch, REG_OPMODE, SX72_MODE_STANDBY);
+
+  // Frequency, modem and power of the txpk, no SPI for what the chip has already. RX2 is usually not a channel
+  HAL_SX127x_Frf(Tx->Freq, TxFrf);
+  Retuned = memcmp(TxFrf, Hal->ChanFrf[Hal->Chan], 3) != 0;
+  if(Retuned)
+  {
+    HAL_BatchWriteBurst(&Batch, REG_FRF_MSB, TxFrf, 3);
+  }
+  HAL_SX127x_SetModem(Hal, &Batch, Tx->SF, Tx->BW, Tx->CR, Tx->IQ);
+  HAL_SX127x_SetPower(Hal, &Batch, Tx->Power);
+
+  // TX Init, REG_FIFO_ADDR_PTR and REG_FIFO_TX_BASE_AD are consecutive
+  HAL_BatchWriteBurst(&Batch, REG_FIFO_ADDR_PTR, FifoPtrs, 2);
+  HAL_BatchWrite(&Batch, REG_PAYLOAD_LENGTH, FrameSize);
+
+  // Write data to FIFO, one burst, the FIFO address does not move on but the FIFO pointer does
+  HAL_BatchWriteBurst(&Batch, REG_FIFO, TxFrame, FrameSize);
+  // DIO0 = TxDone
+  HAL_BatchWrite(&Batch, REG_DIO_MAPPING_1, 0x40);
+  //Mode Request TX
+  HAL_BatchWrite(&Batch, REG_OPMODE, SX72_MODE_TX);
+  HAL_BatchSubmit(Hal, &Batch);
+  HAL_TX_Keyed(Hal, FrameSize);
+  HAL_SX127x_Charge(Hal, HAL_SPI_OP_TX_LOAD, Mark);
+
+  // Wait for TxDone on DIO0, no SPI while the frame is on the air. Low data rate optimisation as HAL_SX127x_SetModem
+  Airtime = HAL_AirtimeUs(Tx->SF, 125000 << Tx->BW, Tx->CR + 1, FrameSize, 8, 1, 0,
+                          ((uint64_t)1000 << Tx->SF) / (125 << Tx->BW) >= 16000);
+  Timeout = OS_GetMicros() + 2 * Airtime + HAL_TX_TIMEOUT_MARGIN_MS * 1000;
+  while(Hal->Spi->ReadDIO0(Hal) != 1)
+  {
+    if(OS_GetMicros() >= Timeout)
+    {
+      printf("HAL_SX127x_SendFrame: Error: no TxDone after %llu ms, resetting the radio!\n", (unsigned long long)(2 * Airtime / 1000 + HAL_TX_TIMEOUT_MARGIN_MS));
+      MET_Count(MET_TX_TIMEOUTS);
+      HAL_SX127x_Charge(Hal, HAL_SPI_OP_TX_WAIT, Mark);
+      HAL_SetupLoRa(Hal);
+      return 1;     /// Error 1: no TxDone in time
+    }
+    Hal->Spi->Delay(HAL_TX_POLL_MS);
+  }
+
+  HAL_TX_Done(Hal, FrameSize);
+  HAL_SX127x_Charge(Hal, HAL_SPI_OP_TX_WAIT, Mark);
+  HAL_DEBUG("HAL_SX127x_SendFrame : TxDone flag is set, reset flag\n");
+  // clear TxDone IRQ
+  HAL_BatchWrite(&Batch, REG_IRQ_FLAGS, 0x8);
+  // Go back to listening, on the channel and modem of before the TX
+  HAL_DEBUG("HAL_SX127x_SendFrame : Go back to listening\n");
+  if(Retuned)
+  {
+    HAL_BatchWriteBurst(&Batch, REG_FRF_MSB, Hal->ChanFrf[Hal->Chan], 3);
+  }
+  if(Hal->ScanMaxSF)
+  {
+    Hal->ScanState = HAL_SCAN_IDLE;
+    HAL_SX127x_StartCad(Hal, &Batch, OS_GetMicros());
+  }
+  else
+  {
+    HAL_SX127x_SetModem(Hal, &Batch, Hal->SF, HAL_BW_125, HAL_CR_4_5, HAL_IQ_NORMAL);
+    // DIO0 = RxDone, the CAD of the scan maps it itself
+    HAL_BatchWrite(&Batch, REG_DIO_MAPPING_1, 0x00);
+    HAL_BatchWrite(&Batch, REG_OPMODE, SX72_MODE_RX_CONTINUOS);
+  }
+  HAL_BatchSubmit(Hal, &Batch);
+  HAL_SX127x_Charge(Hal, HAL_SPI_OP_TX_REARM, Mark);
+
+  return 0;
+}
+
+/**
+* __Function__: HAL_SX127x_Drain
+*
+* __Description__: Read the frame that raised RxDone from the chip and put it in the LORA RX FIFO
+*
+* __Input__: HAL context, SF the frame was received on, time DIO0 was seen (OS_GetMicros)
+*
+* __Output__: void
+*
+* __Status__: Work in Progress
+*
+* __Remarks__: A frame with a CRC error is only counted
+*/
+static void HAL_SX127x_Drain( struct HAL_CONTEXT_STRUCT *Hal, int SF, uint64_t Dio0Time )
+{
+    byte Lora_RX_Message[LORA_RX_MX_FRAME_SIZE];
+    uint32_t Mark[2] = { Hal->SpiCount, Hal->SpiCalls };
+    struct HAL_SPI_BATCH_STRUCT Batch;
+    const byte *Regs;
+    int Handle;
+    long int SNR;
+    int rssicorr;             // RSSI correction, depends on the chip used
+
+      // Status of the frame, REG_FIFO_RX_CURRENT_ADDR up to REG_RSSI_VALUE in one burst read
+      HAL_BatchInit(&Batch);
+      Handle = HAL_BatchRead(&Batch, REG_FIFO_RX_CURRENT_ADDR, REG_RSSI_VALUE - REG_FIFO_RX_CURRENT_ADDR + 1);
+      HAL_BatchSubmit(Hal, &Batch);
+      Regs = HAL_BatchResult(&Batch, Handle);
+
+      // Check on CRC errors, read IRG flags
+      int irqflags = Regs[REG_IRQ_FLAGS - REG_FIFO_RX_CURRENT_ADDR];
+
+      //  payload crc: 0x20
+      if((irqflags & 0x20) == 0x20)
+      {
+        HAL_DEBUG("HAL_SX127x_ProcessRX: CRC error\n");
+        // Reset CRC Flag and Receive Flag
+        HAL_BatchWrite(&Batch, REG_IRQ_FLAGS, 0x20 | 0x40);
+        HAL_BatchSubmit(Hal, &Batch);
+        HAL_SX127x_Charge(Hal, HAL_SPI_OP_RX_DRAIN, Mark);
+        HAL_RX_CrcError(Hal, SF, Dio0Time);
+        //return 0;
+      }
+      else
+      {
+        // No CRC, read data
+        byte currentAddr = Regs[REG_FIFO_RX_CURRENT_ADDR - REG_FIFO_RX_CURRENT_ADDR];
+        byte receivedCount = Regs[REG_RX_NB_BYTES - REG_FIFO_RX_CURRENT_ADDR];
+        byte value = Regs[REG_PKT_SNR_VALUE - REG_FIFO_RX_CURRENT_ADDR];     /// Check on what the SNR value is = Signal to Noice Ratio
+        byte PacketRssiValue = Regs[REG_PKT_RSSI_VALUE - REG_FIFO_RX_CURRENT_ADDR];
+        byte RssiValue = Regs[REG_RSSI_VALUE - REG_FIFO_RX_CURRENT_ADDR];
+
+        HAL_DEBUG("HAL_SX127x_ProcessRX: Bytes Received %d\n", receivedCount);
+        HAL_DEBUG("HAL_SX127x_ProcessRX: Current Address %d\n", currentAddr);
+
+        // Read data from Chip and store in Buffer, one burst read of the FIFO
+        HAL_BatchWrite(&Batch, REG_FIFO_ADDR_PTR, currentAddr);
+        Handle = HAL_BatchRead(&Batch, REG_FIFO, receivedCount);
+        HAL_BatchSubmit(Hal, &Batch);
+        memcpy(Lora_RX_Message, HAL_BatchResult(&Batch, Handle), receivedCount);
+#ifdef HAL_VERBOSE
+        for(int i = 0; i < receivedCount; i++)
+        {
+            printf("HAL_SX127x_ProcessRX: Payload: %d = %d\n", i, Lora_RX_Message[i]);
+        }
+#endif
+
+        /// Now do other stuff, like getting the SNR and RSSI values, not really requred but is stored along with the package
+        if( value & 0x80 ) // The SNR sign bit is 1
+        {
+            // Invert and divide by 4
+            value = ( ( ~value + 1 ) & 0xFF ) >> 2;
+            SNR = -value;
+        }
+        else
+        {
+            // Divide by 4
+            SNR = ( value & 0xFF ) >> 2;
+        }
+
+        if (Hal->Sx1272) {
+            rssicorr = 139;
+        } else {
+            rssicorr = 157;
+        }
+
+        int PacketRssi = PacketRssiValue - rssicorr;
+        int Rssi = RssiValue - rssicorr;
+
+        HAL_DEBUG("HAL_SX127x_ProcessRX: Packet RSSI: %d, \n",PacketRssi);
+        HAL_DEBUG("HAL_SX127x_ProcessRX: RSSI: %d, \n",Rssi);
+        HAL_DEBUG("HAL_SX127x_ProcessRX: SNR: %li, \n",SNR);
+        HAL_DEBUG("HAL_SX127x_ProcessRX: Length: %d \n", receivedCount );
+
+        // message contains package, length in receivedCount
+        // Add to LORA FIFO buffer
+        HAL_SX127x_Charge(Hal, HAL_SPI_OP_RX_DRAIN, Mark);
+        HAL_RX_FIFO_Add(Hal, Lora_RX_Message, receivedCount, PacketRssi, Rssi, SNR, SF, Dio0Time);
+
+      } // CRC error
+}
+
+/**
+* __Function__: HAL_SX127x_ProcessRX
+*
+* __Description__: Check for packets receieved from the RF radio
+*
+* __Input__: HAL context
+*
+* __Output__: Error code: 0 = no error
+*
+* __Status__: Work in Progress
+*
+* __Remarks__: If packet received put in FIFO, Application layer to process received LORA packages.
+*              With an SF range one step of the SF scan, see HAL_SX127x_Scan.
+*/
+int HAL_SX127x_ProcessRX( struct HAL_CONTEXT_STRUCT *Hal )
+{
+    if(Hal->ScanMaxSF)
+    {
+      return HAL_SX127x_Scan(Hal);
+    }
+
+    // Check DIO0 if there is a package received, if so process if not move on
+    if(Hal->Spi->ReadDIO0(Hal) == 1)
+    {
+      HAL_SX127x_Drain(Hal, HAL_GetSF(Hal), OS_GetMicros());
+
+      /// Debug, not sure why but chip seems to freeze up so reset after every received package
+      HAL_SetupLoRa(Hal);
+    } // dio0=1
+    else if(Hal->NumChans > 1)
+    {
+      HAL_SX127x_Hop(Hal, OS_GetMicros());
+    }
+    return 0;
+}
+
+/**
+* __Function__: HAL_SX127x_StartCad
+*
+* __Description__: Start a CAD on the SF of the scan whose turn it is
+*
+* __Input__: HAL context, batch to add the register writes to, Now = current time in micro seconds (OS_GetMicros)
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: The caller submits the batch. Stride scheduling: the SF with the lowest pass runs, ties go to the lower SF, and its pass moves
+*              on by its dwell in its own symbols. The chip must be in sleep or standby mode.
+*/
+static void HAL_SX127x_StartCad( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch, uint64_t Now )
+{
+    int Next = Hal->SF;
+    int sf;
+
+    // Between two CADs is the moment to change channel
+    if(Hal->NumChans > 1 && Now >= Hal->HopEnd)
+    {
+      HAL_SX127x_Tune(Hal, Batch, (Hal->Chan + 1) % Hal->NumChans, Now);
+    }
+    for(sf = Hal->SF + 1; sf <= Hal->ScanMaxSF; sf++)
+    {
+      if(Hal->ScanPass[sf - SF7] < Hal->ScanPass[Next - SF7])
+      {
+        Next = sf;
+      }
+    }
+    Hal->ScanPass[Next - SF7] += Hal->ScanDwell[Next - Hal->SF] * HAL_SX127x_SymbolUs(Next);
+
+    // No SPI when the chip has the image already, a TX may have left another one
+    HAL_SX127x_SetModem(Hal, Batch, Next, HAL_BW_125, HAL_CR_4_5, HAL_IQ_NORMAL);
+    Hal->ScanSF = Next;
+    if(Hal->ScanState != HAL_SCAN_CAD)
+    {
+      // DIO0 = CadDone
+      HAL_BatchWrite(Batch, REG_DIO_MAPPING_1, 0x80);
+    }
+    HAL_BatchWrite(Batch, REG_OPMODE, SX72_MODE_CAD);
+    Hal->ScanState = HAL_SCAN_CAD;
+    Hal->ScanTime = Now;
+}
+
+/**
+* __Function__: HAL_SX127x_Scan
+*
+* __Description__: One step of the SF scan: follow up on the CAD or RX running
+*
+* __Input__: HAL context
+*
+* __Output__: Error code: 0 = no error
+*
+* __Status__: Completed
+*
+* __Remarks__: RxTimeout is seen on DIO1 when it is wired, else it is read from the IRQ flags once the symbol
+*              timeout has passed. The chip is not reset after a frame, it goes on with the next CAD.
+*/
+static int HAL_SX127x_Scan( struct HAL_CONTEXT_STRUCT *Hal )
+{
+    struct HAL_SF_STATS_STRUCT *Stats = &Hal->SFStats[Hal->ScanSF - SF7];
+    struct HAL_SPI_BATCH_STRUCT Batch;
+    uint64_t Now = OS_GetMicros();
+    int irqflags;
+    int Dio1;
+
+    HAL_BatchInit(&Batch);
+    switch(Hal->ScanState)
+    {
+      case HAL_SCAN_IDLE:
+        HAL_SX127x_StartCad(Hal, &Batch, Now);
+        HAL_BatchSubmit(Hal, &Batch);
+        return 0;
+
+      case HAL_SCAN_CAD:
+        if(Hal->Spi->ReadDIO0(Hal) != 1)
+        {
+          return 0;
+        }
+        irqflags = HAL_readRegister(Hal, REG_IRQ_FLAGS);
+        HAL_BatchWrite(&Batch, REG_IRQ_FLAGS, IRQ_CAD_DONE | IRQ_CAD_DETECTED);
+        __atomic_fetch_add(&Stats->Cads, 1, __ATOMIC_RELAXED);
+        if(irqflags & IRQ_CAD_DETECTED)
+        {
+          // Preamble on the air, stay on this SF. DIO0 = RxDone
+          __atomic_fetch_add(&Stats->Hits, 1, __ATOMIC_RELAXED);
+          HAL_BatchWrite(&Batch, REG_DIO_MAPPING_1, 0x00);
+          HAL_BatchWrite(&Batch, REG_OPMODE, SX72_MODE_RX_SINGLE);
+          Hal->ScanState = HAL_SCAN_RX;
+          Hal->ScanTime = Now;
+        }
+        else
+        {
+          HAL_SX127x_StartCad(Hal, &Batch, Now);
+        }
+        HAL_BatchSubmit(Hal, &Batch);
+        return 0;
+
+      case HAL_SCAN_RX:
+        if(Hal->Spi->ReadDIO0(Hal) == 1)
+        {
+          break;
+        }
+        // DIO1 = RxTimeout, with the DIO mapping of RX single
+        Dio1 = Hal->Spi->ReadDIO1(Hal);
+        if(Dio1 != 1 && Now < Hal->ScanTime + (HAL_SX127x_SymbTimeout(Hal->ScanSF) + 1) * HAL_SX127x_SymbolUs(Hal->ScanSF))
+        {
+          return 0;
+        }
+        if(Dio1 == 1 || (Dio1 < 0 && (HAL_readRegister(Hal, REG_IRQ_FLAGS) & IRQ_RX_TIMEOUT)))
+        {
+          // The chip has given up and is in standby
+          HAL_BatchWrite(&Batch, REG_IRQ_FLAGS, 0xFF);
+          __atomic_fetch_add(&Stats->Misses, 1, __ATOMIC_RELAXED);
+          HAL_SX127x_StartCad(Hal, &Batch, Now);
+          HAL_BatchSubmit(Hal, &Batch);
+        }
+        else
+        {
+          Hal->ScanState = HAL_SCAN_RX_LOCKED;
+        }
+        return 0;
+
+      case HAL_SCAN_RX_LOCKED:
+        if(Hal->Spi->ReadDIO0(Hal) == 1)
+        {
+          break;
+        }
+        if(Now >= Hal->ScanTime + HAL_AirtimeUs(Hal->ScanSF, 125000, 1, 255, 8, 1, 0, Hal->ScanSF >= SF11))
+        {
+          // Longer than the longest frame, the lock was lost without RxDone
+          __atomic_fetch_add(&Stats->Misses, 1, __ATOMIC_RELAXED);
+          HAL_BatchWrite(&Batch, REG_OPMODE, SX72_MODE_STANDBY);
+          HAL_BatchWrite(&Batch, REG_IRQ_FLAGS, 0xFF);
+          HAL_SX127x_StartCad(Hal, &Batch, Now);
+          HAL_BatchSubmit(Hal, &Batch);
+        }
+        return 0;
+    }
+
+    // RxDone, RX single has put the chip in standby
+    HAL_SX127x_Drain(Hal, Hal->ScanSF, Now);
+    HAL_BatchWrite(&Batch, REG_IRQ_FLAGS, 0xFF);
+    HAL_SX127x_StartCad(Hal, &Batch, OS_GetMicros());
+    HAL_BatchSubmit(Hal, &Batch);
+    return 0;
+}
+
+/**
+* __Function__: HAL_SX127x_Tune
+*
+* __Description__: Tune to a channel of the hop list
+*
+* __Input__: HAL context, batch to add the register write to, Chan, Now = current time in micro seconds (OS_GetMicros)
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Adds the FRF triplet HAL_SX127x_Init computed, one SPI transaction. The chip must be in sleep or
+*              standby mode when the batch is submitted.
+*/
+static void HAL_SX127x_Tune( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_BATCH_STRUCT *Batch, int Chan, uint64_t Now )
+{
+    HAL_BatchWriteBurst(Batch, REG_FRF_MSB, Hal->ChanFrf[Chan], 3);
+    Hal->Chan = Chan;
+    Hal->HopEnd = Now + HAL_GetHopDwell(Hal, Chan);
+}
+
+/**
+* __Function__: HAL_SX127x_Hop
+*
+* __Description__: Move RX continuous on to the next channel once the time on this one has passed
+*
+* __Input__: HAL context, Now = current time in micro seconds (OS_GetMicros)
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: While the modem is synchronised on a frame it stays, up to the airtime of the longest frame.
+*              The retune is one batch: standby, FRF and RX continuous.
+*/
+static void HAL_SX127x_Hop( struct HAL_CONTEXT_STRUCT *Hal, uint64_t Now )
+{
+    int sf = HAL_GetSF(Hal);
+    uint32_t Mark[2];
+    struct HAL_SPI_BATCH_STRUCT Batch;
+
+    if(Now < Hal->HopEnd)
+    {
+      return;
+    }
+    Mark[0] = Hal->SpiCount;
+    Mark[1] = Hal->SpiCalls;
+    if(Now < Hal->HopEnd + HAL_AirtimeUs(sf, 125000, 1, 255, 8, 1, 0, sf >= SF11) &&
+       (HAL_readRegister(Hal, REG_MODEM_STAT) & (MODEM_STAT_SIGNAL_SYNC | MODEM_STAT_HEADER_VALID)))
+    {
+      return;
+    }
+    HAL_BatchInit(&Batch);
+    HAL_BatchWrite(&Batch, REG_OPMODE, SX72_MODE_STANDBY);
+    HAL_SX127x_Tune(Hal, &Batch, (Hal->Chan + 1) % Hal->NumChans, Now);
+    HAL_BatchWrite(&Batch, REG_OPMODE, SX72_MODE_RX_CONTINUOS);
+    HAL_BatchSubmit(Hal, &Batch);
+    HAL_SX127x_Charge(Hal, HAL_SPI_OP_RETUNE, Mark);
+}
@@ -0,0 +1,167 @@
+/*******************************************************************************
+ * High dynamic range latency histogram
+ *
+ * Recording is inline in hist.h, this file holds the queries on a histogram.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <cstring>            // Required for memset
+#include "hist.h"
+
+
+/**
+* __Function__: HIST_Reset
+*
+* __Description__: Clear a histogram
+*
+* __Input__: Pointer to the histogram
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void HIST_Reset( struct HIST_STRUCT *Hist )
+{
+  memset(Hist, 0, sizeof(struct HIST_STRUCT));
+  Hist->Min = UINT64_MAX;
+}
+
+/**
+* __Function__: HIST_BucketValue
+*
+* __Description__: Get the highest value that is counted in a bucket
+*
+* __Input__: Bucket index
+*
+* __Output__: Value in micro seconds
+*
+* __Status__: Completed
+*
+* __Remarks__: The highest value is reported so percentiles never under state a latency
+*/
+uint64_t HIST_BucketValue( int Index )
+{
+  int Shift, Sub;
+
+  if(Index < HIST_SUB_BUCKETS)
+  {
+    return Index;
+  }
+  Shift = (Index >> HIST_SUB_BUCKET_BITS) - 1;
+  Sub = Index & (HIST_SUB_BUCKETS - 1);
+  return (((uint64_t)(HIST_SUB_BUCKETS + Sub)) << Shift) + (((uint64_t)1) << Shift) - 1;
+}
+
+/**
+* __Function__: HIST_Percentile
+*
+* __Description__: Get the value below which a percentage of the samples fall
+*
+* __Input__: Pointer to the histogram, Percentile (0 - 100)
+*
+* __Output__: Value in micro seconds, 0 when the histogram is empty
+*
+* __Status__: Completed
+*
+* __Remarks__: The result is never larger than the largest sample
+*/
+uint64_t HIST_Percentile( const struct HIST_STRUCT *Hist, double Percentile )
+{
+  uint64_t Target, Seen = 0;
+  uint64_t Value;
+  int i;
+
+  if(Hist->Total == 0)
+  {
+    return 0;
+  }
+  if(Percentile > 100)
+  {
+    Percentile = 100;
+  }
+  // Number of samples that have to be at or below the value, at least one
+  Target = (uint64_t)((Percentile / 100) * Hist->Total + 0.5);
+  if(Target < 1)
+  {
+    Target = 1;
+  }
+
+  for(i = 0; i < HIST_NUM_BUCKETS; i++)
+  {
+    Seen += Hist->Counts[i];
+    if(Seen >= Target)
+    {
+      Value = HIST_BucketValue(i);
+      return (Value > Hist->Max) ? Hist->Max : Value;
+    }
+  }
+  return Hist->Max;
+}
+
+/**
+* __Function__: HIST_Merge
+*
+* __Description__: Add all samples of one histogram to another
+*
+* __Input__: Pointer to the destination histogram, pointer to the source histogram
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void HIST_Merge( struct HIST_STRUCT *Dest, const struct HIST_STRUCT *Src )
+{
+  int i;
+
+  for(i = 0; i < HIST_NUM_BUCKETS; i++)
+  {
+    Dest->Counts[i] += Src->Counts[i];
+  }
+  Dest->Total += Src->Total;
+  Dest->Sum += Src->Sum;
+  if(Src->Min < Dest->Min)
+  {
+    Dest->Min = Src->Min;
+  }
+  if(Src->Max > Dest->Max)
+  {
+    Dest->Max = Src->Max;
+  }
+}
+
+/**
+* __Function__: HIST_Print
+*
+* __Description__: Print a one line summary of a histogram
+*
+* __Input__: Name of the histogram, pointer to the histogram
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: All values in micro seconds
+*/
+void HIST_Print( const char *Name, const struct HIST_STRUCT *Hist )
+{
+  if(Hist->Total == 0)
+  {
+    printf("%-28s n=0\n", Name);
+    return;
+  }
+  printf("%-28s n=%llu min=%llu avg=%llu p50=%llu p90=%llu p99=%llu p99.9=%llu max=%llu\n", Name,
+    (unsigned long long)Hist->Total,
+    (unsigned long long)Hist->Min,
+    (unsigned long long)(Hist->Sum / Hist->Total),
+    (unsigned long long)HIST_Percentile(Hist, 50),
+    (unsigned long long)HIST_Percentile(Hist, 90),
+    (unsigned long long)HIST_Percentile(Hist, 99),
+    (unsigned long long)HIST_Percentile(Hist, 99.9),
+    (unsigned long long)Hist->Max);
+}
@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * Histogram Header file
+ *
+ * High dynamic range (HDR) latency histogram with micro second resolution and
+ * a fixed memory footprint. Values are stored in log-linear buckets: below
+ * HIST_SUB_BUCKETS every value has its own bucket, above that every power of
+ * two is split in HIST_SUB_BUCKETS equal buckets, so the relative error of a
+ * recorded value is at most 1 / HIST_SUB_BUCKETS.
+ *******************************************************************************/
+
+#ifndef _hist_h_
+#define _hist_h_
+
+#include <stdint.h>           // Required for unint8 etc
+
+#define HIST_SUB_BUCKET_BITS    6                               // 64 buckets per power of two, max error 1.6%
+#define HIST_SUB_BUCKETS        (1 << HIST_SUB_BUCKET_BITS)
+#define HIST_MAX_BITS           32                              // Values up to 2^32 us (71 minutes)
+#define HIST_NUM_BUCKETS        ((HIST_MAX_BITS - HIST_SUB_BUCKET_BITS + 1) * HIST_SUB_BUCKETS)
+#define HIST_MAX_VALUE          ((((uint64_t)1) << HIST_MAX_BITS) - 1)
+
+/**
+* Histogram structure, clear it with HIST_Reset before use
+*/
+struct HIST_STRUCT {
+  uint32_t  Counts[HIST_NUM_BUCKETS];   /**< Number of samples per bucket */
+  uint64_t  Total;                      /**< Number of samples */
+  uint64_t  Sum;                        /**< Sum of all samples, for the average */
+  uint64_t  Min;                        /**< Smallest sample */
+  uint64_t  Max;                        /**< Largest sample */
+};
+
+/**
+* Histogram Public Functions and Procedures
+*/
+void HIST_Reset( struct HIST_STRUCT *Hist );
+uint64_t HIST_Percentile( const struct HIST_STRUCT *Hist, double Percentile );
+uint64_t HIST_BucketValue( int Index );
+void HIST_Merge( struct HIST_STRUCT *Dest, const struct HIST_STRUCT *Src );
+void HIST_Print( const char *Name, const struct HIST_STRUCT *Hist );
+
+/**
+* __Function__: HIST_BucketIndex
+*
+* __Description__: Get the bucket a value is counted in
+*
+* __Input__: Value in micro seconds
+*
+* __Output__: Bucket index
+*
+* __Status__: Completed
+*
+* __Remarks__: Inline, recording sits on the packet path and has to cost a few ns
+*/
+static inline int HIST_BucketIndex( uint64_t Value )
+{
+  int Msb, Shift;
+
+  if(Value < HIST_SUB_BUCKETS)
+  {
+    return (int)Value;
+  }
+  if(Value > HIST_MAX_VALUE)
+  {
+    Value = HIST_MAX_VALUE;
+  }
+  Msb = 63 - __builtin_clzll(Value);
+  Shift = Msb - HIST_SUB_BUCKET_BITS;
+  return ((Shift + 1) << HIST_SUB_BUCKET_BITS) + (int)((Value >> Shift) - HIST_SUB_BUCKETS);
+}
+
+/**
+* __Function__: HIST_Record
+*
+* __Description__: Add a sample to a histogram
+*
+* __Input__: Pointer to the histogram, value in micro seconds
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Inline, recording sits on the packet path and has to cost a few ns
+*/
+static inline void HIST_Record( struct HIST_STRUCT *Hist, uint64_t Value )
+{
+  Hist->Counts[HIST_BucketIndex(Value)]++;
+  Hist->Total++;
+  Hist->Sum += Value;
+  if(Value < Hist->Min)
+  {
+    Hist->Min = Value;
+  }
+  if(Value > Hist->Max)
+  {
+    Hist->Max = Value;
+  }
+}
+
+
+#endif // _hist_h_
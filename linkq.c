@@ -0,0 +1,244 @@
+/*******************************************************************************
+ * Link quality
+ *
+ * With several radios a downlink should go out on the radio that heard the
+ * device best. Every uplink received, every copy when several radios heard it,
+ * updates the entry of its device: the DevAddr of a data uplink, the DevEUI of
+ * a join request. Copies of one uplink, within LQ_SAME_UPLINK_US of each
+ * other, keep the radio with the best SNR (RSSI on a tie), a later uplink
+ * starts over, so the entry follows the last-heard link quality.
+ *
+ * A data downlink is sent on the radio of its DevAddr. A join accept is
+ * encrypted, it is matched on its tmst instead: the join request it answers
+ * was received JOIN_ACCEPT_DELAY1 or 2 before it.
+ *
+ * The table uses open addressing with linear probing over at most
+ * LQ_MAX_PROBE entries. Every update and lookup stamps the entry, when all
+ * probed entries are taken by other devices the least recently used of them
+ * is evicted. Entries are never deleted otherwise, so there are no tombstones
+ * and the memory stays at LQ_TABLE_SIZE entries whatever the number of devices.
+ *
+ * Only the gateway stage touches the table, there is no locking.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <cstring>            // Required for memset
+#include "linkq.h"
+
+static uint64_t LQ_Hash( int Kind, uint64_t Key );
+static uint64_t LQ_GetKey( const uint8_t *Frame, int Offset, int Length );
+static struct LQ_ENTRY_STRUCT *LQ_Find( struct LQ_CONTEXT_STRUCT *Lq, int Kind, uint64_t Key, int Insert );
+
+
+/**
+* __Function__: LQ_InitContext
+*
+* __Description__: Forget all devices
+*
+* __Input__: Link quality context
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void LQ_InitContext( struct LQ_CONTEXT_STRUCT *Lq )
+{
+  memset(Lq, 0, sizeof(struct LQ_CONTEXT_STRUCT));
+}
+
+/**
+* Spread a key over the table, the finaliser of splitmix64
+*/
+static uint64_t LQ_Hash( int Kind, uint64_t Key )
+{
+  Key ^= (uint64_t)Kind << 62;
+  Key = (Key ^ (Key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  Key = (Key ^ (Key >> 27)) * 0x94d049bb133111ebULL;
+  return Key ^ (Key >> 31);
+}
+
+/**
+* Little endian field of a frame
+*/
+static uint64_t LQ_GetKey( const uint8_t *Frame, int Offset, int Length )
+{
+  uint64_t Key = 0;
+  int i;
+
+  for(i = Length - 1; i >= 0; i--)
+  {
+    Key = (Key << 8) | Frame[Offset + i];
+  }
+  return Key;
+}
+
+/**
+* __Function__: LQ_Find
+*
+* __Description__: Find the entry of a device
+*
+* __Input__: Link quality context, one of lq_kind_t, DevAddr or DevEUI, Insert = 1 to add the device when not found
+*
+* __Output__: Entry, NULL = not found
+*
+* __Status__: Completed
+*
+* __Remarks__: A new entry takes a free one of the probed entries, else the least recently used of them
+*/
+static struct LQ_ENTRY_STRUCT *LQ_Find( struct LQ_CONTEXT_STRUCT *Lq, int Kind, uint64_t Key, int Insert )
+{
+  uint64_t Hash = LQ_Hash(Kind, Key);
+  struct LQ_ENTRY_STRUCT *Entry;
+  struct LQ_ENTRY_STRUCT *Victim = NULL;
+  int i;
+
+  for(i = 0; i < LQ_MAX_PROBE; i++)
+  {
+    Entry = &Lq->Table[(Hash + i) & (LQ_TABLE_SIZE - 1)];
+    if(Entry->Kind == Kind && Entry->Key == Key)
+    {
+      Entry->LastUsed = ++Lq->Stamp;
+      return Entry;
+    }
+    if(Victim == NULL || (Victim->Kind != LQ_KIND_NONE &&
+       (Entry->Kind == LQ_KIND_NONE || Lq->Stamp - Entry->LastUsed > Lq->Stamp - Victim->LastUsed)))
+    {
+      Victim = Entry;
+    }
+  }
+  if(!Insert)
+  {
+    return NULL;
+  }
+
+  if(Victim->Kind == LQ_KIND_NONE)
+  {
+    Lq->NumDevices++;
+  }
+  else
+  {
+    Lq->NumEvicted++;
+  }
+  memset(Victim, 0, sizeof(struct LQ_ENTRY_STRUCT));
+  Victim->Kind = Kind;
+  Victim->Key = Key;
+  Victim->Radio = -1;
+  Victim->LastUsed = ++Lq->Stamp;
+  return Victim;
+}
+
+/**
+* __Function__: LQ_Update
+*
+* __Description__: Record the radio an uplink was received on and how well
+*
+* __Input__: Link quality context, Frame, FrameSize, metadata of the copy, Now = receive time in micro seconds
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called for every copy, also the ones the duplicate suppression drops. Frames that are
+*              neither a join request nor a data uplink are ignored.
+*/
+void LQ_Update( struct LQ_CONTEXT_STRUCT *Lq, const uint8_t *Frame, int FrameSize, const struct GW_RXPK_STRUCT *Rxpk, uint64_t Now )
+{
+  struct LQ_ENTRY_STRUCT *Entry;
+
+  switch(FrameSize > 0 ? Frame[OFF_JR_HDR] & MHDR_MTYPE_MASK : -1)
+  {
+    case MHDR_JOIN_REQUEST:
+      if(FrameSize < LEN_JR)
+      {
+        return;
+      }
+      Entry = LQ_Find(Lq, LQ_KIND_DEVEUI, LQ_GetKey(Frame, OFF_JR_DEVEUI, 8), 1);
+      break;
+    case MHDR_UNCONFIRMED_UP:
+    case MHDR_CONFIRMED_UP:
+      if(FrameSize < LEN_DAT_MIN)
+      {
+        return;
+      }
+      Entry = LQ_Find(Lq, LQ_KIND_DEVADDR, LQ_GetKey(Frame, OFF_DAT_ADDR, 4), 1);
+      break;
+    default:
+      return;
+  }
+
+  // Another copy of the uplink last heard only counts when it is better
+  if(Entry->Radio >= 0 && Now - Entry->HeardTime < LQ_SAME_UPLINK_US &&
+     (Rxpk->Snr < Entry->Snr || (Rxpk->Snr == Entry->Snr && Rxpk->Rssi <= Entry->Rssi)))
+  {
+    return;
+  }
+  if(Entry->Radio < 0 || Now - Entry->HeardTime >= LQ_SAME_UPLINK_US)
+  {
+    Entry->HeardTime = Now;
+    Entry->Tmst = Rxpk->Tmst;
+  }
+  Entry->Radio = Rxpk->Rfch;
+  Entry->Snr = Rxpk->Snr;
+  Entry->Rssi = Rxpk->Rssi;
+}
+
+/**
+* __Function__: LQ_SelectRadio
+*
+* __Description__: Radio to send a downlink on, the one that heard its device best
+*
+* __Input__: Link quality context, Frame, FrameSize, HasTmst = 1 when Tmst is the requested TX time of the txpk
+*
+* __Output__: Radio, -1 = the device has not been heard, or not since it was evicted
+*
+* __Status__: Completed
+*
+* __Remarks__: A join accept is found through the tmst of its join request, a scan of the table, join accepts
+*              are rare. Without tmst a join accept cannot be matched.
+*/
+int LQ_SelectRadio( struct LQ_CONTEXT_STRUCT *Lq, const uint8_t *Frame, int FrameSize, int HasTmst, uint32_t Tmst )
+{
+  struct LQ_ENTRY_STRUCT *Entry;
+  uint32_t Delay;
+  int i;
+
+  switch(FrameSize > 0 ? Frame[OFF_JA_HDR] & MHDR_MTYPE_MASK : -1)
+  {
+    case MHDR_JOIN_ACCEPT:
+      for(i = 0; i < LQ_TABLE_SIZE && HasTmst; i++)
+      {
+        Entry = &Lq->Table[i];
+        Delay = Tmst - Entry->Tmst;
+        if(Entry->Kind == LQ_KIND_DEVEUI && (Delay == LQ_JOIN_DELAY1_US || Delay == LQ_JOIN_DELAY2_US))
+        {
+          Entry->LastUsed = ++Lq->Stamp;
+          return Entry->Radio;
+        }
+      }
+      return -1;
+    case MHDR_UNCONFIRMED_DOWN:
+    case MHDR_CONFIRMED_DOWN:
+      if(FrameSize < LEN_DAT_MIN)
+      {
+        return -1;
+      }
+      Entry = LQ_Find(Lq, LQ_KIND_DEVADDR, LQ_GetKey(Frame, OFF_DAT_ADDR, 4), 0);
+      return Entry != NULL ? Entry->Radio : -1;
+    default:
+      return -1;
+  }
+}
+
+uint32_t LQ_GetNumDevices( struct LQ_CONTEXT_STRUCT *Lq )
+{
+  return Lq->NumDevices;
+}
+
+uint32_t LQ_GetNumEvicted( struct LQ_CONTEXT_STRUCT *Lq )
+{
+  return Lq->NumEvicted;
+}
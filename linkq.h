@@ -0,0 +1,65 @@
+/*******************************************************************************
+ * Link quality Header file
+ *******************************************************************************/
+
+#ifndef _linkq_h_
+#define _linkq_h_
+
+#include <stdint.h>           // Required for unint8 etc
+#include "hal.h"              // byte, used in gateway.h
+#include "gateway.h"          // struct GW_RXPK_STRUCT
+
+#define LQ_TABLE_SIZE             1024      // Devices remembered, power of 2
+#define LQ_MAX_PROBE              8         // Entries looked at for one device at most, the LRU one of them is evicted
+#define LQ_SAME_UPLINK_US         200000    // Copies of one uplink from several radios arrive within this time
+#define LQ_JOIN_DELAY1_US         5000000   // JOIN_ACCEPT_DELAY1, RX1 of a join accept after the join request
+#define LQ_JOIN_DELAY2_US         6000000   // JOIN_ACCEPT_DELAY2, RX2
+
+/**
+* Kind of key of an entry
+*/
+enum lq_kind_t {
+  LQ_KIND_NONE = 0,             // Free entry
+  LQ_KIND_DEVADDR,              // Data uplinks, keyed on the DevAddr
+  LQ_KIND_DEVEUI                // Join requests, keyed on the DevEUI
+};
+
+/**
+* Last uplink heard from one device, 32 bytes
+*/
+struct LQ_ENTRY_STRUCT {
+  uint64_t  Key;                              // DevAddr or DevEUI
+  uint64_t  HeardTime;                        // Time the last uplink was received, micro seconds
+  uint32_t  Tmst;                             // rxpk tmst of the last uplink, to find the join request a join accept answers
+  uint32_t  LastUsed;                         // Stamp of the last update or lookup, for the LRU eviction
+  int8_t    Kind;                             // One of lq_kind_t
+  int8_t    Radio;                            // Radio that heard the last uplink best
+  int8_t    Snr;                              // Its SNR in dB
+  int16_t   Rssi;                             // Its RSSI in dBm
+};
+
+/**
+* Radio each device was heard best on, fixed memory. Set it up with LQ_InitContext.
+*/
+struct LQ_CONTEXT_STRUCT {
+  uint32_t  Stamp;                            // Increased on every update and lookup
+  uint32_t  NumDevices;                       // Entries in use
+  uint32_t  NumEvicted;                       // Devices forgotten to make room for another
+  struct LQ_ENTRY_STRUCT Table[LQ_TABLE_SIZE];
+};
+
+/**
+* Link quality Public Functions and Procedures
+*/
+void LQ_InitContext( struct LQ_CONTEXT_STRUCT *Lq );
+void LQ_Update( struct LQ_CONTEXT_STRUCT *Lq, const uint8_t *Frame, int FrameSize, const struct GW_RXPK_STRUCT *Rxpk, uint64_t Now );
+int LQ_SelectRadio( struct LQ_CONTEXT_STRUCT *Lq, const uint8_t *Frame, int FrameSize, int HasTmst, uint32_t Tmst );   // Radio, -1 = device not known
+
+/**
+* Link quality Supporting Functions and Procedures
+*/
+uint32_t LQ_GetNumDevices( struct LQ_CONTEXT_STRUCT *Lq );
+uint32_t LQ_GetNumEvicted( struct LQ_CONTEXT_STRUCT *Lq );
+
+
+#endif // _linkq_h_
@@ -15,38 +15,525 @@
  *
  *******************************************************************************/
  #include <stdio.h>
- #include <wiringPi.h>    // used in this module for the function delay()
+ #include <string.h>
+ #include <stdlib.h>      // used in this module for atoi()
+ #include <unistd.h>      // used in this module for getopt()
+ #include <signal.h>      // Stop cleanly on SIGINT / SIGTERM
  #include "hal.h"         // Hardware abstraction layer (lora)
  #include "udp.h"         // UDP Layer definitions
  #include "gateway.h"     // Application Layer = Gateway definitions
+ #include "metrics.h"     // Metrics endpoint
+ #include "vradio.h"      // Virtual radio
+ #include "sx127x_emu.h"  // SX127x emulator
+ #include "traffic.h"     // Traffic generator
+ #include "clock.h"       // Real or simulated time
+ #include "capture.h"     // pcap capture
+ #include "replay.h"      // pcap replay
+ #include "pipeline.h"    // Radio, gateway and network on threads of their own
+ #include "dedup.h"       // Duplicate suppression
+ #include "linkq.h"       // Downlink radio selection
+ #include "os.h"          // used in this module for the function OS_Delay()
+
+ /**
+ * __Function__: Usage
+ *
+ * __Description__: Print the command line options
+ *
+ * __Input__: Name of the programme
+ *
+ * __Output__: void
+ *
+ * __Status__: Completed
+ *
+ * __Remarks__:
+ */
+ static void Usage(const char *Name)
+ {
+     printf("Usage: %s [-s server[:port]] [-T transport] [-v source] [-e chip] [-d file] [-c clock] [-x seed] [-t seconds] [-w file [-C MB] [-W files]] [-r prio[:cpu]] [-P cpus] [-M] [-m port] [-R radio]...\n", Name);
+     printf("  -s server  Forward to server[:port] instead of SERVER:PORT in udp.h, e.g. 127.0.0.1 for mock_lns\n");
+     printf("  -T transport SPI / GPIO transport of the SX127x: spidev (default), /dev/spidev0.N and /dev/gpiochipN\n");
+ #ifdef HAVE_WIRINGPI
+     printf("             or wiringpi, the fallback for kernels without GPIO character device uAPI v2\n");
+ #endif
+     printf("  -v source  Use the virtual radio instead of the SX127x, source is one of:\n");
+     printf("             file:<name>  uplinks from a file, one per line: <delay ms> <rssi> <snr> <hex payload>\n");
+     printf("             udp:<port>   uplinks from datagrams on localhost: <int8 rssi> <int8 snr> <payload>\n");
+     printf("             traffic:<spec> uplinks of a simulated device population, spec is key=value[,key=value...]:\n");
+     printf("                          devices, devaddr, deveui, joineui, schedule=poisson|periodic, interval=s,\n");
+     printf("                          size=n|min-max|mean/sd, confirmed=%%, fport, sf=n|min-max, bw=kHz, cr, joinstorm=at:%%:window,\n");
+     printf("                          noise=bursts/s, rssi=min:max, fade=dB, capture=dB, air=0|1, freq=MHz:MHz..., seed (see traffic.c)\n");
+     printf("             replay:<spec> uplinks from a LoRaTap pcap, e.g. one written with -w, spec is key=value[,...]:\n");
+     printf("                          file, speed=n|max, loop=n (see replay.c), stops when the file has been played\n");
+     printf("             none         no uplinks, only record downlinks\n");
+     printf("  -e chip    Run the SX127x code on an emulated sx1272 or sx1276, uplinks from the -v source\n");
+     printf("  -d file    Virtual radio or emulator: record downlinks in file\n");
+     printf("  -c clock   real, or sim[:epoch] for virtual time that only moves when the forwarder waits,\n");
+     printf("             with the virtual radio or emulator it runs days of traffic in minutes, repeatably,\n");
+     printf("             only with -v or -e, a real SX127x keeps real time\n");
+     printf("  -x seed    Seed of the random tokens, for repeatable runs\n");
+     printf("  -t seconds Stop after this long on the clock, default run forever\n");
+     printf("  -w file    Capture all frames received and sent to a pcap file (LoRaTap), for Wireshark\n");
+     printf("  -C MB      Capture: start a new file when the file reaches this size (1..%d), keep the old as file.1 etc.\n", CAP_MAX_FILE_MB);
+     printf("  -W files   Capture: number of files kept when rotating (1..%d), default 1\n", CAP_MAX_FILES);
+     printf("  -r prio[:cpu] Run the radio on a thread of its own, SCHED_FIFO priority 1..99 (0 = normal scheduling),\n");
+     printf("             pinned to cpu when given, needs the real clock\n");
+     printf("  -P cpus    Run the radio, gateway and network as a pipeline of three threads instead of the main loop,\n");
+     printf("             cpus is any or radio,gateway,network CPUs, e.g. 1,2,3. -r sets the radio priority, needs the real clock\n");
+     printf("  -M         Lock all memory in RAM (mlockall), no page faults on the radio path\n");
+     printf("  -m port    Serve the metrics on http://%s:port/metrics, default %d, 0 = off\n", METRICS_HTTP_ADDR, METRICS_HTTP_PORT);
+     printf("  -R radio   Add a radio, up to %d, radio is key=value[,key=value...]: freq=MHz, sf, nss, dio0, dio1, reset, spi, pa=rfo|boost,\n", GW_MAX_RADIOS);
+     printf("             sf=min-max to scan an SF range with CAD, dwell=symbols[:symbols...] per SF of the scan,\n");
+     printf("             freq=MHz:MHz... to hop over up to %d channels, reported as chan, hop=ms[:ms...] per channel,\n", HAL_MAX_CHANS);
+     printf("             adapt=1 to share the hop time by the traffic per channel\n");
+     printf("             (see HAL_Configure), each is serviced on its own and reported as chan / rfch 0, 1, ... in the\n");
+     printf("             order given, default one radio on the pins in hal.h. With -r every radio gets a thread of its own.\n");
+     printf("             An uplink received by more than one radio is forwarded once, the copy with the best SNR,\n");
+     printf("             a downlink goes out on the radio that heard its device best\n");
+ }
+
+ /**
+ * Set by the signal handler, the main loop stops and everything is shut down cleanly
+ */
+ static volatile sig_atomic_t MainStop = 0;
+
+ static void Stop(int Signal)
+ {
+     MainStop = 1;
+ }
 
  // Main programme with loop the loop
- int main ()
+ int main (int argc, char *argv[])
  {
-     // Initialise the Hardware Abstraction Layer (HAL)
-     HAL_Init();
+     int Option;
+     int Emulate = 0;
+     int Replay = 0;
+     char *Port;
+     uint64_t RunTime = 0;       // 0 = run forever
+     uint64_t StartTime;
+     char *CaptureFile = NULL;
+     uint32_t CaptureSize = 0;    // 0 = no rotation
+     uint64_t CaptureMB;
+     long CaptureCount;
+     long MetricsPort;
+     char *End;
+     int CaptureFiles = 1;
+     int SimClock = 0;
+     int RadioThread = 0;        // 1 = HAL_Engine on its own thread
+     int RadioPriority = 0;
+     int RadioCpu = -1;
+     int LockMemory = 0;
+     int Pipeline = 0;           // 1 = every engine on its own thread, pipeline.c
+     int StageCpu[PL_NUM_STAGES] = { -1, -1, -1 };
+     int NumRadios = 0;          // Radios added with -R
+     int i, j;
+     struct HAL_SF_STATS_STRUCT SFStats;
+     static struct HAL_CONTEXT_STRUCT Hal[GW_MAX_RADIOS];   // The radios
+     static struct UDP_CONTEXT_STRUCT Udp;      // The upstream to the server
+     static struct GW_CONTEXT_STRUCT Gw;        // The gateway between the two
+     static struct DUP_CONTEXT_STRUCT Dup;      // Seen-set of the uplinks, with more than one radio
+     static struct LQ_CONTEXT_STRUCT Links;     // Radio each device was heard best on, with more than one radio
+
+     for(i = 0; i < GW_MAX_RADIOS; i++)
+     {
+         HAL_InitContext(&Hal[i]);
+     }
+     UDP_InitContext(&Udp);
+     GW_InitContext(&Gw, NULL, &Udp);
+
+     // Select the radio, the SX127x through spidev unless asked otherwise
+     const struct HAL_RADIO_STRUCT *Radio = &HAL_RadioSX127x;
+     const struct HAL_SPI_STRUCT *Spi = &HAL_SpiSpidev;
+
+     while((Option = getopt(argc, argv, "s:T:v:e:d:c:x:t:w:C:W:r:P:Mm:R:h")) != -1)
+     {
+         switch(Option)
+         {
+             case 's':
+                 Port = strchr(optarg, ':');
+                 if(Port != NULL)
+                 {
+                     *Port++ = 0;
+                 }
+                 if(UDP_SetServer(&Udp, optarg, Port != NULL ? atoi(Port) : PORT) != 0)
+                 {
+                     return 1;
+                 }
+             break;
+
+             case 'v':
+                 Radio = &HAL_RadioVirtual;
+                 if(strncmp(optarg, "file:", 5) == 0)
+                 {
+                     VR_SetSource(VR_SOURCE_FILE, optarg + 5);
+                 }
+                 else if(strncmp(optarg, "udp:", 4) == 0)
+                 {
+                     VR_SetSource(VR_SOURCE_SOCKET, optarg + 4);
+                 }
+                 else if(strncmp(optarg, "traffic:", 8) == 0)
+                 {
+                     if(TG_Configure(optarg + 8) != 0)
+                     {
+                         return 1;
+                     }
+                     VR_SetGenerator(TG_Generate);
+                 }
+                 else if(strncmp(optarg, "replay:", 7) == 0)
+                 {
+                     if(RPL_Configure(optarg + 7) != 0)
+                     {
+                         return 1;
+                     }
+                     VR_SetGenerator(RPL_Generate);
+                     Replay = 1;
+                 }
+                 else if(strcmp(optarg, "none") == 0)
+                 {
+                     VR_SetSource(VR_SOURCE_NONE, NULL);
+                 }
+                 else
+                 {
+                     Usage(argv[0]);
+                     return 1;
+                 }
+             break;
+
+             case 'T':
+                 if(strcmp(optarg, "spidev") == 0)
+                 {
+                     Spi = &HAL_SpiSpidev;
+                 }
+ #ifdef HAVE_WIRINGPI
+                 else if(strcmp(optarg, "wiringpi") == 0)
+                 {
+                     Spi = &HAL_SpiWiringPi;
+                 }
+ #endif
+                 else
+                 {
+                     Usage(argv[0]);
+                     return 1;
+                 }
+             break;
+
+             case 'e':
+                 if(strcmp(optarg, "sx1272") == 0)
+                 {
+                     EMU_SetChip(EMU_VERSION_SX1272);
+                 }
+                 else if(strcmp(optarg, "sx1276") == 0)
+                 {
+                     EMU_SetChip(EMU_VERSION_SX1276);
+                 }
+                 else
+                 {
+                     Usage(argv[0]);
+                     return 1;
+                 }
+                 Emulate = 1;
+             break;
+
+             case 'd':
+                 VR_SetDownlinkLog(optarg);
+             break;
+
+             case 'c':
+                 if(strcmp(optarg, "real") == 0)
+                 {
+                     CLK_SetClock(&CLK_Real);
+                     SimClock = 0;
+                 }
+                 else if(strncmp(optarg, "sim", 3) == 0 && (optarg[3] == 0 || optarg[3] == ':'))
+                 {
+                     CLK_SetClock(&CLK_Simulated);
+                     SimClock = 1;
+                     if(optarg[3] == ':')
+                     {
+                         CLK_SetEpoch(strtoll(optarg + 4, NULL, 10));
+                     }
+                 }
+                 else
+                 {
+                     Usage(argv[0]);
+                     return 1;
+                 }
+             break;
+
+             case 'x':
+                 srand(strtoul(optarg, NULL, 10));
+             break;
+
+             case 't':
+                 RunTime = strtoull(optarg, NULL, 10) * 1000000;
+             break;
+
+             case 'w':
+                 CaptureFile = optarg;
+             break;
+
+             case 'C':
+                 CaptureMB = strtoull(optarg, &End, 10);
+                 if(End == optarg || *End != 0 || CaptureMB == 0 || CaptureMB > CAP_MAX_FILE_MB)
+                 {
+                     printf("main: Error: -C takes 1..%d MB\n", CAP_MAX_FILE_MB);
+                     Usage(argv[0]);
+                     return 1;
+                 }
+                 CaptureSize = (uint32_t)(CaptureMB * 1000000);
+             break;
+
+             case 'W':
+                 CaptureCount = strtol(optarg, &End, 10);
+                 if(End == optarg || *End != 0 || CaptureCount < 1 || CaptureCount > CAP_MAX_FILES)
+                 {
+                     printf("main: Error: -W takes 1..%d files\n", CAP_MAX_FILES);
+                     Usage(argv[0]);
+                     return 1;
+                 }
+                 CaptureFiles = (int)CaptureCount;
+             break;
+
+             case 'r':
+                 Port = strchr(optarg, ':');
+                 if(Port != NULL)
+                 {
+                     *Port++ = 0;
+                     RadioCpu = atoi(Port);
+                 }
+                 RadioPriority = atoi(optarg);
+                 RadioThread = 1;
+             break;
+
+             case 'P':
+                 if(strcmp(optarg, "any") != 0)
+                 {
+                     if(sscanf(optarg, "%d,%d,%d", &StageCpu[PL_STAGE_RADIO], &StageCpu[PL_STAGE_GATEWAY], &StageCpu[PL_STAGE_NETWORK]) != PL_NUM_STAGES)
+                     {
+                         Usage(argv[0]);
+                         return 1;
+                     }
+                 }
+                 Pipeline = 1;
+             break;
+
+             case 'M':
+                 LockMemory = 1;
+             break;
+
+             case 'm':
+                 MetricsPort = strtol(optarg, &End, 10);
+                 if(End == optarg || *End != 0 || MetricsPort < 0 || MetricsPort > 65535)
+                 {
+                     printf("main: Error: -m takes a port 0..65535\n");
+                     Usage(argv[0]);
+                     return 1;
+                 }
+                 MET_SetPort((int)MetricsPort);
+             break;
+
+             case 'R':
+                 if(NumRadios >= GW_MAX_RADIOS)
+                 {
+                     printf("main: Error: at most %d radios\n", GW_MAX_RADIOS);
+                     return 1;
+                 }
+                 if(HAL_Configure(&Hal[NumRadios], optarg) != 0)
+                 {
+                     return 1;
+                 }
+                 NumRadios++;
+             break;
+
+             default:
+                 Usage(argv[0]);
+                 return 1;
+         }
+     }
+
+     if((RadioThread || Pipeline) && SimClock)
+     {
+         printf("main: Error: threads need the real clock, -r and -P cannot be used with -c sim\n");
+         return 1;
+     }
+
+     if(Emulate)
+     {
+         if(NumRadios > 1)
+         {
+             printf("main: Error: the emulator models one chip, -e cannot be used with more than one radio\n");
+             return 1;
+         }
+         Radio = &HAL_RadioSX127x;
+         Spi = &HAL_SpiEmulator;
+     }
+
+     // The chip on the SPI bus runs in real time, the reset pulse and the TX airtime do not follow a simulated clock
+     if(SimClock && Radio == &HAL_RadioSX127x && Spi != &HAL_SpiEmulator)
+     {
+         printf("main: Error: -c sim only works with the virtual radio (-v) or the emulator (-e), not with the %s transport\n", Spi->Name);
+         return 1;
+     }
+
+     // One radio on the default pins unless given with -R, all of the same kind
+     if(NumRadios == 0)
+     {
+         NumRadios = 1;
+     }
+     for(i = 0; i < NumRadios; i++)
+     {
+         HAL_SetRadio(&Hal[i], Radio);
+         HAL_SetSpi(&Hal[i], Spi);
+         GW_AddRadio(&Gw, &Hal[i]);
+     }
+
+     // Radios on one frequency hear the same uplink, forward only the best copy, answer on the radio that heard it best
+     if(NumRadios > 1)
+     {
+         DUP_InitContext(&Dup);
+         GW_SetDedup(&Gw, &Dup);
+         LQ_InitContext(&Links);
+         GW_SetLinks(&Gw, &Links);
+     }
+
+     // Start the capture before the radio receives anything
+     if(CaptureFile != NULL && CAP_Open(CaptureFile, CaptureSize, CaptureFiles) != 0)
+     {
+         return 1;
+     }
+
+     // Initialise the metrics first, the other layers report to it
+     MET_Init();
+     for(i = 0; i < NumRadios; i++)
+     {
+         MET_Watch(&Hal[i], &Udp);
+     }
+
+     // Initialise the Hardware Abstraction Layer (HAL), every radio
+     for(i = 0; i < NumRadios; i++)
+     {
+         HAL_Init(&Hal[i]);
+     }
 
      // Initalise the UDP Packet forwarder
-     UDP_Init();
+     UDP_Init(&Udp);
 
      // Initialise the application, in this case the Gateway
-     GW_Init();
+     GW_Init(&Gw);
+
+     // All memory is in place, keep it in RAM
+     if(LockMemory)
+     {
+         OS_LockMemory();
+     }
+
+     // Take the radio out of the main loop, JSON work and syscalls can no longer delay it
+     if(Pipeline)
+     {
+         for(i = 0; i < PL_NUM_STAGES; i++)
+         {
+             PL_SetStage(i, i == PL_STAGE_RADIO ? RadioPriority : 0, (i == PL_STAGE_RADIO && RadioCpu >= 0) ? RadioCpu : StageCpu[i]);
+         }
+         if(PL_Start(&Gw) != 0)
+         {
+             return 1;
+         }
+     }
+     else if(RadioThread)
+     {
+         // A thread per radio, a busy radio does not delay the others
+         for(i = 0; i < NumRadios; i++)
+         {
+             if(HAL_StartThread(&Hal[i], RadioPriority, RadioCpu) != 0)
+             {
+                 return 1;
+             }
+         }
+     }
+
+     signal(SIGINT, Stop);
+     signal(SIGTERM, Stop);
 
      // Loop the loop, should do exit when there is an error
-     while(1) {
-         // Execute the HAL engine in the main loop
-         HAL_Engine();
+     StartTime = OS_GetMicros();
+     while(!MainStop && (RunTime == 0 || OS_GetMicros() - StartTime < RunTime)) {
+         // Execute the HAL engine in the main loop, unless it has a thread of its own
+         if(!RadioThread && !Pipeline)
+         {
+             for(i = 0; i < NumRadios; i++)
+             {
+                 HAL_Engine(&Hal[i]);
+             }
+         }
+
+         if(!Pipeline)
+         {
+             // Execute the UDP engine in the main loop
+             UDP_Engine(&Udp);
+
+             // Execute the Gateway engine in the main Loop
+             GW_Engine(&Gw);
+         }
 
-         // Execute the UDP engine in the main loop
-         UDP_Engine();
+         // Serve the metrics endpoint
+         MET_Engine();
 
-         // Execute the Gateway engine in the main Loop
-         GW_Engine();
+         // Write the captured frames
+         CAP_Engine();
+
+         // Give the pipeline time to drain once the replay has played the file
+         if(Replay && RPL_Done())
+         {
+             RunTime = OS_GetMicros() - StartTime + RPL_DRAIN_US;
+             Replay = 0;
+         }
 
          // not to go crasy with the calls
-         delay(1);
+         OS_Delay(1);
+     }
+     for(i = 0; i < NumRadios; i++)
+     {
+         HAL_StopThread(&Hal[i]);
+     }
+     if(Pipeline)
+     {
+         PL_Stop();
+         PL_Report();
+     }
+     if(MainStop)
+     {
+         RunTime = OS_GetMicros() - StartTime;
+     }
+     printf("main: Stopped after %llu s on the %s clock, received %u, CRC ok %u, forwarded %u\n",
+         (unsigned long long)(RunTime / 1000000), CLK_GetName(), GW_GetNumRX(&Gw), GW_GetRxOk(&Gw), GW_GetPktFwd(&Gw));
+     if(VR_GetNumUnheard() != 0)
+     {
+         printf("main: %u uplinks on a frequency or SF no radio listens on\n", VR_GetNumUnheard());
+     }
+     for(i = 0; i < NumRadios; i++)
+     {
+         for(j = HAL_GetSF(&Hal[i]); Hal[i].ScanMaxSF && j <= Hal[i].ScanMaxSF; j++)
+         {
+             HAL_GetSFStats(&Hal[i], j, &SFStats);
+             printf("main: radio %d SF%d: %u CADs, %u hits, %u misses, %u frames\n", i, j, SFStats.Cads, SFStats.Hits, SFStats.Misses, SFStats.Frames);
+         }
+         for(j = 0; Hal[i].NumChans > 1 && j < Hal[i].NumChans; j++)
+         {
+             printf("main: radio %d channel %d on %.6lf Mhz: %u frames, next dwell %u ms\n", i, j, (double)Hal[i].ChanFreq[j]/1000000,
+                 HAL_GetChanFrames(&Hal[i], j), HAL_GetHopDwell(&Hal[i], j) / 1000);
+         }
+     }
+     if(Gw.Dup != NULL)
+     {
+         printf("main: %u duplicate uplinks suppressed, %u uplinks forwarded unchecked, the seen-set was full\n",
+             DUP_GetNumDuplicates(&Dup), DUP_GetNumBypassed(&Dup));
+         printf("main: %u devices in the link table, %u evicted, %u downlinks on radio 0 for a device not heard\n",
+             LQ_GetNumDevices(&Links), LQ_GetNumEvicted(&Links), MET_GetCounter(MET_DOWNLINKS_UNROUTED));
+     }
+     if(RPL_GetNumReplayed() != 0)
+     {
+         RPL_Report(GW_GetNumRX(&Gw), GW_GetRxOk(&Gw));
      }
-     // never get to here if all is well
+     CAP_Close();
      return (0);
 
  }
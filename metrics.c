@@ -0,0 +1,727 @@
+/*******************************************************************************
+ * Metrics layer
+ *
+ * Keeps per stage counters and latencies of the packet forwarder and serves
+ * them in the OpenMetrics text format on a small embedded HTTP listener, so a
+ * Prometheus server can scrape the gateway.
+ *
+ * The listener is non-blocking and is serviced from MET_Engine in the main
+ * loop, a slow or silent client never stalls the radio.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>            // Required for the nonblocking socket
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "hal.h"
+#include "udp.h"
+#include "gateway.h"
+#include "pipeline.h"
+#include "os.h"
+#include "metrics.h"
+
+/**
+* Names of the counters and latency stages as exposed to Prometheus
+*/
+static const char *MET_CounterNames[MET_NUM_COUNTERS] = {
+  "scpf_spi_transactions",
+  "scpf_lora_rx_frames",
+  "scpf_lora_rx_dropped",
+  "scpf_udp_tx_frames",
+  "scpf_udp_tx_dropped",
+  "scpf_udp_rx_frames",
+  "scpf_downlinks",
+  "scpf_downlinks_late",
+  "scpf_acks_unmatched",
+  "scpf_lora_rx_duplicates",
+  "scpf_downlinks_unrouted",
+  "scpf_tx_timeouts"
+};
+
+static const char *MET_SpiOpNames[HAL_SPI_NUM_OPS] = {
+  "setup",
+  "rx_drain",
+  "tx_load",
+  "tx_wait",
+  "tx_rearm",
+  "retune"
+};
+
+static const char *MET_SFCounterNames[] = {
+  "cads",
+  "hits",
+  "misses",
+  "frames"
+};
+
+static const char *MET_LatencyNames[MET_NUM_LATENCIES] = {
+  "scpf_dio0_to_drained_seconds",
+  "scpf_drained_to_dequeued_seconds",
+  "scpf_dequeued_to_serialised_seconds",
+  "scpf_serialised_to_sent_seconds",
+  "scpf_udp_rtt_seconds",
+  "scpf_downlink_lead_seconds",
+  "scpf_pull_resp_to_queued_seconds",
+  "scpf_downlink_lag_seconds",
+  "scpf_keyed_to_txdone_seconds"
+};
+
+/**
+* Quantiles reported for every latency stage
+*/
+static const double MET_Quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+/**
+* PUSH_DATA / PULL_DATA waiting for an ACK, used for the UDP round trip time
+*/
+struct MET_PENDING_STRUCT {
+  uint8_t   Type;           /**< PKT_PUSH_DATA or PKT_PULL_DATA */
+  uint8_t   TokenH;         /**< Token of the request */
+  uint8_t   TokenL;
+  uint8_t   Used;           /**< 0 = Free slot, 1 = waiting for an ACK */
+  uint64_t  SentTime;       /**< Time the request was sent in micro seconds */
+};
+
+uint32_t MET_Counters[MET_NUM_COUNTERS];
+struct HIST_STRUCT MET_Latencies[MET_NUM_LATENCIES];
+struct HIST_STRUCT MET_RadioLatencies[GW_MAX_RADIOS][MET_NUM_LATENCIES];  // Stages recorded on the radio threads, one set per radio
+struct HIST_STRUCT MET_Merged;  // Scratch for MET_MergeLatency
+uint64_t MET_LastDump;          // Time of the last latency dump in micro seconds
+struct MET_PENDING_STRUCT MET_Pending[METRICS_MAX_PENDING];
+uint8_t MET_PendingIdx = 0;     // Next slot to be overwritten when all slots are in use
+
+int MET_ListenSocket = -1;      // Socket of the HTTP listener
+int MET_Port = METRICS_HTTP_PORT;   // Port of the HTTP listener, 0 = none
+int MET_ClientSocket = -1;      // Socket of the client currently being served
+uint64_t MET_ClientTime;        // Time the client connected in micro seconds
+char MET_Request[METRICS_REQUEST_SIZE];
+int MET_RequestLen = 0;
+char MET_Page[METRICS_RENDER_SIZE];
+
+struct HAL_CONTEXT_STRUCT *MET_Hal[GW_MAX_RADIOS];   // Radios the queue and SPI gauges are sampled from, MET_Watch
+int MET_NumHal = 0;
+struct UDP_CONTEXT_STRUCT *MET_Udp = NULL;    // Upstream the queue gauges are sampled from, MET_Watch
+
+
+/**
+* __Function__: MET_SetPort
+*
+* __Description__: Select the port of the HTTP listener
+*
+* __Input__: Port, 0 = no listener
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Before MET_Init, default METRICS_HTTP_PORT
+*/
+void MET_SetPort( int Port )
+{
+  MET_Port = Port;
+}
+
+/**
+* __Function__: MET_Init
+*
+* __Description__: Initialise the metrics and open the HTTP listener
+*
+* __Input__: void
+*
+* __Output__: Error code: 0 = no error, -1 = Socket error
+*
+* __Status__: Completed
+*
+* __Remarks__: A failing listener is not fatal, the forwarder runs without the endpoint
+*/
+int MET_Init( void )
+{
+  struct sockaddr_in ListenAddr;
+  int Reuse = 1;
+
+  MET_Reset();
+
+  if(!METRICS_HTTP_ENABLED || MET_Port == 0)
+  {
+    return 0;
+  }
+
+  if((MET_ListenSocket = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+  {
+    printf("MET_Init: Error creating a socket!\n");
+    return -1;     /// Error code: -1 = socket error
+  }
+  setsockopt(MET_ListenSocket, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof(Reuse));
+
+  memset((char *) &ListenAddr, 0, sizeof(ListenAddr));
+  ListenAddr.sin_family = AF_INET;
+  ListenAddr.sin_port = htons(MET_Port);
+  inet_aton(METRICS_HTTP_ADDR, &ListenAddr.sin_addr);
+
+  if(bind(MET_ListenSocket, (struct sockaddr *) &ListenAddr, sizeof(ListenAddr)) == -1 || listen(MET_ListenSocket, 4) == -1)
+  {
+    printf("MET_Init: Error listening on %s:%d, metrics endpoint disabled!\n", METRICS_HTTP_ADDR, MET_Port);
+    close(MET_ListenSocket);
+    MET_ListenSocket = -1;
+    return -1;     /// Error code: -1 = socket error
+  }
+  // Change the socket into non-blocking state
+  fcntl(MET_ListenSocket, F_SETFL, O_NONBLOCK);
+
+  printf("MET_Init: Serving metrics on http://%s:%d/metrics\n", METRICS_HTTP_ADDR, MET_Port);
+  return 0;
+}
+
+/**
+* __Function__: MET_Watch
+*
+* __Description__: Add a radio and select the upstream the gauges are sampled from
+*
+* __Input__: HAL context, NULL = none, UDP context, NULL = report 0
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: The counters and latencies are shared by all contexts. Called once per radio, the queue gauges are
+*              summed over the radios, the SPI gauges are of the first
+*/
+void MET_Watch( struct HAL_CONTEXT_STRUCT *Hal, struct UDP_CONTEXT_STRUCT *Udp )
+{
+  if(Hal != NULL && MET_NumHal < GW_MAX_RADIOS)
+  {
+    MET_Hal[MET_NumHal++] = Hal;
+  }
+  MET_Udp = Udp;
+}
+
+/**
+* __Function__: MET_CloseClient
+*
+* __Description__: Close the connection to the current HTTP client
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void MET_CloseClient( void )
+{
+  close(MET_ClientSocket);
+  MET_ClientSocket = -1;
+  MET_RequestLen = 0;
+}
+
+/**
+* __Function__: MET_Engine
+*
+* __Description__: Serve the HTTP listener, to be called in the main loop
+*
+* __Input__: void
+*
+* __Output__: Error code: 0 = no error
+*
+* __Status__: Completed
+*
+* __Remarks__: Only one client is served at a time, every call does at most one
+* non-blocking accept, recv and send so the main loop is never blocked
+*/
+int MET_Engine( void )
+{
+  char Header[160];
+  int NumBytes, PageLen, HeaderLen;
+  const char *Status;
+
+  // Periodic dump of the latency percentiles
+  if(METRICS_DUMP_INTERVAL && OS_GetMicros() - MET_LastDump >= (uint64_t)METRICS_DUMP_INTERVAL * 1000000)
+  {
+    MET_LastDump = OS_GetMicros();
+    MET_PrintLatencies();
+  }
+
+  if(MET_ListenSocket == -1)
+  {
+    return 0;
+  }
+
+  // Pick up a new client if we are not serving one already
+  if(MET_ClientSocket == -1)
+  {
+    if((MET_ClientSocket = accept(MET_ListenSocket, NULL, NULL)) == -1)
+    {
+      return 0;   // Nobody waiting
+    }
+    fcntl(MET_ClientSocket, F_SETFL, O_NONBLOCK);
+    MET_ClientTime = OS_GetMicros();
+    MET_RequestLen = 0;
+  }
+
+  // Read what has arrived of the request so far
+  NumBytes = recv(MET_ClientSocket, MET_Request + MET_RequestLen, METRICS_REQUEST_SIZE - 1 - MET_RequestLen, MSG_DONTWAIT);
+  if(NumBytes == 0 || (NumBytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+  {
+    // Client went away
+    MET_CloseClient();
+    return 0;
+  }
+  if(NumBytes > 0)
+  {
+    MET_RequestLen += NumBytes;
+  }
+  MET_Request[MET_RequestLen] = 0;
+
+  if(strstr(MET_Request, "\r\n\r\n") == NULL && MET_RequestLen < METRICS_REQUEST_SIZE - 1)
+  {
+    // Request not complete yet, drop the client if it takes too long
+    if(OS_GetMicros() - MET_ClientTime > METRICS_CLIENT_TIMEOUT)
+    {
+      MET_CloseClient();
+    }
+    return 0;
+  }
+
+  if(strncmp(MET_Request, "GET /metrics", 12) == 0)
+  {
+    Status = "200 OK";
+    PageLen = MET_Render(MET_Page, METRICS_RENDER_SIZE);
+  }
+  else
+  {
+    Status = "404 Not Found";
+    PageLen = snprintf(MET_Page, METRICS_RENDER_SIZE, "Not found, try /metrics\n");
+  }
+
+  HeaderLen = snprintf(Header, sizeof(Header), "HTTP/1.0 %s\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", Status, PageLen);
+  // The page is small, if the socket buffer cannot take it the scrape is simply lost
+  send(MET_ClientSocket, Header, HeaderLen, MSG_DONTWAIT | MSG_NOSIGNAL);
+  send(MET_ClientSocket, MET_Page, PageLen, MSG_DONTWAIT | MSG_NOSIGNAL);
+  MET_CloseClient();
+
+  return 0;
+}
+
+/**
+* __Function__: MET_Reset
+*
+* __Description__: Clear all counters and latencies
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: e.g. between the steps of a benchmark
+*/
+void MET_Reset( void )
+{
+  int i;
+
+  memset(MET_Counters, 0, sizeof(MET_Counters));
+  for(i = 0; i < MET_NUM_LATENCIES; i++)
+  {
+    HIST_Reset(&MET_Latencies[i]);
+  }
+  for(i = 0; i < GW_MAX_RADIOS * MET_NUM_LATENCIES; i++)
+  {
+    HIST_Reset(&MET_RadioLatencies[i / MET_NUM_LATENCIES][i % MET_NUM_LATENCIES]);
+  }
+  memset(MET_Pending, 0, sizeof(MET_Pending));
+  MET_LastDump = OS_GetMicros();
+}
+
+/**
+* __Function__: MET_Count
+*
+* __Description__: Increase a counter by one
+*
+* __Input__: Counter = one of met_counter_t
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Atomic, the radio may run on a thread of its own
+*/
+void MET_Count( int Counter )
+{
+  __atomic_fetch_add(&MET_Counters[Counter], 1, __ATOMIC_RELAXED);
+}
+
+/**
+* __Function__: MET_Latency
+*
+* __Description__: Add a latency sample to a stage
+*
+* __Input__: Stage = one of met_latency_t, Micros = latency in micro seconds
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Recorded in a HDR histogram, costs a few ns. Not atomic, only for the stages recorded by the
+*               gateway and network threads. The radio threads use MET_RadioLatency
+*/
+void MET_Latency( int Stage, uint64_t Micros )
+{
+  HIST_Record(&MET_Latencies[Stage], Micros);
+}
+
+/**
+* __Function__: MET_RadioLatency
+*
+* __Description__: Add a latency sample of a radio to a stage
+*
+* __Input__: Radio = Hal->Index, Stage = one of met_latency_t, Micros = latency in micro seconds
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: With -r every radio runs on a thread of its own, so every radio records into a histogram set
+*               of its own. The sets are merged when they are read, MET_MergeLatency
+*/
+void MET_RadioLatency( int Radio, int Stage, uint64_t Micros )
+{
+  if(Radio < 0 || Radio >= GW_MAX_RADIOS)
+  {
+    Radio = 0;
+  }
+  HIST_Record(&MET_RadioLatencies[Radio][Stage], Micros);
+}
+
+/**
+* __Function__: MET_MergeLatency
+*
+* __Description__: Merge the samples of a stage recorded by the gateway and by every radio
+*
+* __Input__: Stage = one of met_latency_t
+*
+* __Output__: Pointer to the merged histogram
+*
+* __Status__: Completed
+*
+* __Remarks__: Returns a scratch buffer that is overwritten by the next call
+*/
+static const struct HIST_STRUCT *MET_MergeLatency( int Stage )
+{
+  int i;
+
+  MET_Merged = MET_Latencies[Stage];
+  for(i = 0; i < GW_MAX_RADIOS; i++)
+  {
+    HIST_Merge(&MET_Merged, &MET_RadioLatencies[i][Stage]);
+  }
+  return &MET_Merged;
+}
+
+/**
+* __Function__: MET_TrackRequest
+*
+* __Description__: Remember the token of a PUSH_DATA or PULL_DATA that has just been sent
+*
+* __Input__: Pointer to the datagram, size of the datagram
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Other datagrams are ignored, when all slots are in use the oldest one is overwritten
+*/
+void MET_TrackRequest( const uint8_t *Frame, int FrameSize )
+{
+  int i;
+
+  if(FrameSize < 4 || (Frame[3] != PKT_PUSH_DATA && Frame[3] != PKT_PULL_DATA))
+  {
+    return;
+  }
+
+  // Find a free slot, else overwrite the oldest
+  for(i = 0; i < METRICS_MAX_PENDING; i++)
+  {
+    if(!MET_Pending[i].Used)
+    {
+      break;
+    }
+  }
+  if(i == METRICS_MAX_PENDING)
+  {
+    i = MET_PendingIdx;
+    MET_PendingIdx = (MET_PendingIdx + 1) % METRICS_MAX_PENDING;
+  }
+
+  MET_Pending[i].Type = Frame[3];
+  MET_Pending[i].TokenH = Frame[1];
+  MET_Pending[i].TokenL = Frame[2];
+  MET_Pending[i].SentTime = OS_GetMicros();
+  MET_Pending[i].Used = 1;
+}
+
+/**
+* __Function__: MET_TrackAck
+*
+* __Description__: Match a received PUSH_ACK or PULL_ACK against the requests sent
+*
+* __Input__: Pointer to the datagram, size of the datagram
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Adds a sample to the UDP round trip time when the token matches
+*/
+void MET_TrackAck( const uint8_t *Frame, int FrameSize )
+{
+  int i;
+  uint8_t Type;
+
+  if(FrameSize < 4)
+  {
+    return;
+  }
+
+  // ACK type to request type
+  switch(Frame[3])
+  {
+    case PKT_PUSH_ACK:
+      Type = PKT_PUSH_DATA;
+    break;
+    case PKT_PULL_ACK:
+      Type = PKT_PULL_DATA;
+    break;
+    default:
+      return;
+  }
+
+  for(i = 0; i < METRICS_MAX_PENDING; i++)
+  {
+    if(MET_Pending[i].Used && MET_Pending[i].Type == Type && MET_Pending[i].TokenH == Frame[1] && MET_Pending[i].TokenL == Frame[2])
+    {
+      MET_Latency(MET_LAT_UDP_RTT, OS_GetMicros() - MET_Pending[i].SentTime);
+      MET_Pending[i].Used = 0;
+      return;
+    }
+  }
+  MET_Count(MET_ACKS_UNMATCHED);
+}
+
+/**
+* __Function__: MET_GetCounter
+*
+* __Description__: Get the value of a counter
+*
+* __Input__: Counter = one of met_counter_t
+*
+* __Output__: Value of the counter
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+uint32_t MET_GetCounter( int Counter )
+{
+  return __atomic_load_n(&MET_Counters[Counter], __ATOMIC_RELAXED);
+}
+
+/**
+* __Function__: MET_GetLatency
+*
+* __Description__: Get the latency histogram of a stage
+*
+* __Input__: Stage = one of met_latency_t
+*
+* __Output__: Pointer to the histogram
+*
+* __Status__: Completed
+*
+* __Remarks__: Use HIST_Percentile to query it. Merged over the radios, valid until the next call
+*/
+const struct HIST_STRUCT *MET_GetLatency( int Stage )
+{
+  return MET_MergeLatency(Stage);
+}
+
+const char *MET_GetLatencyName( int Stage )
+{
+  return MET_LatencyNames[Stage];
+}
+
+/**
+* __Function__: MET_PrintLatencies
+*
+* __Description__: Print the percentiles of every latency stage
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: All values in micro seconds
+*/
+void MET_PrintLatencies( void )
+{
+  int i;
+
+  printf("MET_PrintLatencies: Latencies in micro seconds\n");
+  for(i = 0; i < MET_NUM_LATENCIES; i++)
+  {
+    // Skip the "scpf_" prefix and "_seconds" postfix of the name
+    char Name[48];
+    snprintf(Name, sizeof(Name), "%.*s", (int)strlen(MET_LatencyNames[i]) - 13, MET_LatencyNames[i] + 5);
+    HIST_Print(Name, MET_MergeLatency(i));
+  }
+  fflush(stdout);
+}
+
+/**
+* Receive counter of an SF summed over the watched radios, Counter = index in MET_SFCounterNames
+*/
+static uint32_t MET_GetSFCounter( int Counter, int SF )
+{
+  struct HAL_SF_STATS_STRUCT Stats;
+  uint32_t Total = 0;
+  int i;
+
+  for(i = 0; i < MET_NumHal; i++)
+  {
+    HAL_GetSFStats(MET_Hal[i], SF, &Stats);
+    Total += Counter == 0 ? Stats.Cads : Counter == 1 ? Stats.Hits : Counter == 2 ? Stats.Misses : Stats.Frames;
+  }
+  return Total;
+}
+
+/**
+* __Function__: MET_Render
+*
+* __Description__: Render all metrics in the OpenMetrics text format
+*
+* __Input__: Pointer to a buffer, size of the buffer
+*
+* __Output__: Number of characters written to the buffer
+*
+* __Status__: Completed
+*
+* __Remarks__: Queue occupancy is sampled from the HAL and UDP contexts of MET_Watch at the time of rendering,
+*              stage utilisation from the pipeline when it runs
+*/
+int MET_Render( char *Buffer, int BufferSize )
+{
+  int i, q;
+  int Len = 0;
+  int RxLevel = 0;
+  int TxLevel = 0;
+
+  for(i = 0; i < MET_NUM_COUNTERS && Len < BufferSize; i++)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len, "# TYPE %s counter\n%s_total %u\n", MET_CounterNames[i], MET_CounterNames[i], MET_GetCounter(i));
+  }
+
+  for(i = 0; i < MET_NUM_LATENCIES && Len < BufferSize; i++)
+  {
+    const struct HIST_STRUCT *Hist = MET_MergeLatency(i);
+
+    Len += snprintf(Buffer + Len, BufferSize - Len, "# TYPE %s summary\n# UNIT %s seconds\n", MET_LatencyNames[i], MET_LatencyNames[i]);
+    for(q = 0; q < (int)(sizeof(MET_Quantiles) / sizeof(MET_Quantiles[0])) && Len < BufferSize; q++)
+    {
+      Len += snprintf(Buffer + Len, BufferSize - Len, "%s{quantile=\"%g\"} %.6f\n", MET_LatencyNames[i], MET_Quantiles[q],
+        (double)HIST_Percentile(Hist, MET_Quantiles[q] * 100) / 1000000);
+    }
+    if(Len < BufferSize)
+    {
+      Len += snprintf(Buffer + Len, BufferSize - Len, "%s_sum %.6f\n%s_count %llu\n",
+        MET_LatencyNames[i], (double)Hist->Sum / 1000000,
+        MET_LatencyNames[i], (unsigned long long)Hist->Total);
+    }
+  }
+
+  if(Len < BufferSize)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len, "# TYPE scpf_latency_max_seconds gauge\n");
+  }
+  for(i = 0; i < MET_NUM_LATENCIES && Len < BufferSize; i++)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len, "scpf_latency_max_seconds{stage=\"%s\"} %.6f\n", MET_LatencyNames[i], (double)MET_MergeLatency(i)->Max / 1000000);
+  }
+
+  if(Len < BufferSize)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len, "# TYPE scpf_spi_transactions_per_op gauge\n");
+  }
+  for(i = 0; i < HAL_SPI_NUM_OPS && Len < BufferSize; i++)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len, "scpf_spi_transactions_per_op{op=\"%s\"} %u\n", MET_SpiOpNames[i], MET_NumHal ? HAL_GetSpiCost(MET_Hal[0], i) : 0);
+  }
+  if(Len < BufferSize)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len, "# TYPE scpf_spi_calls_per_op gauge\n");
+  }
+  for(i = 0; i < HAL_SPI_NUM_OPS && Len < BufferSize; i++)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len, "scpf_spi_calls_per_op{op=\"%s\"} %u\n", MET_SpiOpNames[i], MET_NumHal ? HAL_GetSpiCalls(MET_Hal[0], i) : 0);
+  }
+
+  // Receive counters per SF, summed over the radios
+  for(i = 0; i < (int)(sizeof(MET_SFCounterNames) / sizeof(MET_SFCounterNames[0])) && Len < BufferSize; i++)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len, "# TYPE scpf_sf_%s counter\n", MET_SFCounterNames[i]);
+    for(q = 0; q < HAL_NUM_SF && Len < BufferSize; q++)
+    {
+      Len += snprintf(Buffer + Len, BufferSize - Len, "scpf_sf_%s_total{sf=\"%d\"} %u\n", MET_SFCounterNames[i], SF7 + q, MET_GetSFCounter(i, SF7 + q));
+    }
+  }
+
+  // Threads of the pipeline, when it runs instead of the main loop
+  if(PL_Running() && Len < BufferSize)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len, "# TYPE scpf_stage_busy_seconds counter\n");
+    for(i = 0; i < PL_NUM_STAGES && Len < BufferSize; i++)
+    {
+      Len += snprintf(Buffer + Len, BufferSize - Len, "scpf_stage_busy_seconds_total{stage=\"%s\"} %.6f\n", PL_GetStageName(i), PL_GetBusyMicros(i) / 1e6);
+    }
+    if(Len < BufferSize)
+    {
+      Len += snprintf(Buffer + Len, BufferSize - Len, "# TYPE scpf_stage_utilisation gauge\n");
+    }
+    for(i = 0; i < PL_NUM_STAGES && Len < BufferSize; i++)
+    {
+      Len += snprintf(Buffer + Len, BufferSize - Len, "scpf_stage_utilisation{stage=\"%s\"} %.4f\n", PL_GetStageName(i), PL_GetUtilisation(i));
+    }
+  }
+
+  for(i = 0; i < MET_NumHal; i++)
+  {
+    RxLevel += HAL_GetRxFifoLevel(MET_Hal[i]);
+    TxLevel += HAL_GetTxFifoLevel(MET_Hal[i]);
+  }
+  if(Len < BufferSize)
+  {
+    Len += snprintf(Buffer + Len, BufferSize - Len,
+      "# TYPE scpf_queue_occupancy gauge\n"
+      "scpf_queue_occupancy{queue=\"lora_rx\"} %d\n"
+      "scpf_queue_occupancy{queue=\"lora_tx\"} %d\n"
+      "scpf_queue_occupancy{queue=\"udp_rx\"} %d\n"
+      "scpf_queue_occupancy{queue=\"udp_tx\"} %d\n"
+      "# EOF\n",
+      RxLevel, TxLevel,
+      MET_Udp ? UDP_GetRxFifoLevel(MET_Udp) : 0, MET_Udp ? UDP_GetTxFifoLevel(MET_Udp) : 0);
+  }
+
+  if(Len >= BufferSize)
+  {
+    // Truncated, should not happen with METRICS_RENDER_SIZE
+    Len = BufferSize - 1;
+  }
+  return Len;
+}
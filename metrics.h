@@ -0,0 +1,91 @@
+/*******************************************************************************
+ * Metrics Header file
+ *******************************************************************************/
+
+#ifndef _metrics_h_
+#define _metrics_h_
+
+#include <stdint.h>           // Required for unint8 etc
+#include "hist.h"             // Latency histograms
+
+struct HAL_CONTEXT_STRUCT;
+struct UDP_CONTEXT_STRUCT;
+
+/**
+* Metrics Public Functions and Procedures
+*/
+void MET_SetPort( int Port );                       // Before MET_Init, 0 = no HTTP listener
+int MET_Init( void );                               // To be called in the init phase
+int MET_Engine( void );                             // To be called in the main programme loop
+void MET_Watch( struct HAL_CONTEXT_STRUCT *Hal, struct UDP_CONTEXT_STRUCT *Udp );   // Once per radio, radios and upstream of the queue and SPI gauges
+
+/**
+* Instrumentation points, to be called from the HAL, UDP and GW layers
+*/
+void MET_Count( int Counter );                      // Increase a counter by one
+void MET_Latency( int Stage, uint64_t Micros );     // Add a latency sample (micro seconds) to a stage
+void MET_RadioLatency( int Radio, int Stage, uint64_t Micros );   // Same, for the stages recorded on a radio thread
+void MET_TrackRequest( const uint8_t *Frame, int FrameSize );   // PUSH_DATA / PULL_DATA has been sent
+void MET_TrackAck( const uint8_t *Frame, int FrameSize );       // PUSH_ACK / PULL_ACK has been received
+
+/**
+* Metrics Supporting Functions and Procedures
+*/
+void MET_Reset( void );                             // Clear all counters and latencies
+uint32_t MET_GetCounter( int Counter );
+const struct HIST_STRUCT *MET_GetLatency( int Stage );
+const char *MET_GetLatencyName( int Stage );         // Name as exposed to Prometheus
+void MET_PrintLatencies( void );                    // Dump the percentiles of every stage
+int MET_Render( char *Buffer, int BufferSize );     // Render all metrics as OpenMetrics text
+
+
+/**
+* Counters
+*/
+enum met_counter_t {
+  MET_SPI_TRANSACTIONS = 0,     // Every register read or write on the SPI bus
+  MET_LORA_RX_FRAMES,           // Frames drained from the radio FIFO
+  MET_LORA_RX_DROPPED,          // Frames dropped because the LORA RX FIFO was full
+  MET_UDP_TX_FRAMES,            // Datagrams handed to sendto()
+  MET_UDP_TX_DROPPED,           // Datagrams dropped because the UDP TX FIFO was full
+  MET_UDP_RX_FRAMES,            // Datagrams received from the server
+  MET_DOWNLINKS,                // Downlinks keyed on the radio
+  MET_DOWNLINKS_LATE,           // PULL_RESP received after the requested tmst
+  MET_ACKS_UNMATCHED,           // ACK received for a token we are not waiting for
+  MET_LORA_RX_DUPLICATES,       // Copies of an uplink dropped by the duplicate suppression
+  MET_DOWNLINKS_UNROUTED,       // Downlinks for a device no radio heard, sent on radio 0
+  MET_TX_TIMEOUTS,              // Downlinks without TxDone in time, the radio was reset
+  MET_NUM_COUNTERS
+};
+
+/**
+* Latency stages, all in micro seconds. Uplink stage boundaries are: DIO0 edge, FIFO drained,
+* HAL_ReceiveFrame dequeue, JSON built, datagram sent. Downlink stage boundaries are:
+* PULL_RESP received, queued in the HAL, TX keyed, TxDone.
+*/
+enum met_latency_t {
+  MET_LAT_DIO0_TO_DRAINED = 0,  // DIO0 seen high until the radio FIFO has been read
+  MET_LAT_DRAINED_TO_DEQUEUED,  // Radio FIFO read until the gateway takes the frame from the LORA RX FIFO
+  MET_LAT_DEQUEUED_TO_SERIALISED,// Frame taken from the LORA RX FIFO until the PUSH_DATA JSON has been built
+  MET_LAT_SERIALISED_TO_SENT,   // PUSH_DATA handed to UDP until sendto()
+  MET_LAT_UDP_RTT,              // sendto() of PUSH_DATA / PULL_DATA until the matching ACK
+  MET_LAT_DOWNLINK_LEAD,        // PULL_RESP received until the requested txpk tmst
+  MET_LAT_PULL_RESP_TO_QUEUED,  // PULL_RESP received until the downlink is queued in the HAL
+  MET_LAT_DOWNLINK_LAG,         // Downlink queued in the HAL until TX is keyed
+  MET_LAT_KEYED_TO_TXDONE,      // TX keyed until the TxDone IRQ
+  MET_NUM_LATENCIES
+};
+
+
+#define METRICS_HTTP_ENABLED      1       // Set to 0 to disable the embedded HTTP listener
+#define METRICS_HTTP_ADDR         "127.0.0.1"   // Only listen on localhost
+#define METRICS_HTTP_PORT         9753    // Port to scrape, http://127.0.0.1:9753/metrics, -m port, 9100 is node_exporter
+
+#define METRICS_RENDER_SIZE       8192    // Buffer for the rendered metrics page
+#define METRICS_REQUEST_SIZE      1024    // Buffer for the HTTP request
+#define METRICS_CLIENT_TIMEOUT    1000000 // Drop a client that did not send a request within 1 second (us)
+#define METRICS_MAX_PENDING       8       // Max number of PUSH_DATA / PULL_DATA waiting for an ACK
+#define METRICS_DUMP_INTERVAL     60      // Print the latency percentiles every 60 seconds, 0 = never
+
+
+#endif // _metrics_h_
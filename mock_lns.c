@@ -0,0 +1,645 @@
+/*******************************************************************************
+ * Mock LNS
+ *
+ * A stand-in for the network server, speaking the Semtech UDP protocol on
+ * port 1700 so the forwarder can be benchmarked on a laptop:
+ *
+ *   ./mock_lns -w lns.log &
+ *   ./single_chan_pkt_fwd -s 127.0.0.1 -v file:uplinks.txt -d downlinks.txt
+ *
+ * PUSH_DATA is answered with PUSH_ACK and PULL_DATA with PULL_ACK. Downlinks
+ * (PULL_RESP) are sent to the address of the last PULL_DATA, either random
+ * (-D) or scripted per uplink (-S), for the uplink tmst plus the RX delay and
+ * sent a configurable lead before that time. Every datagram sent can be
+ * delayed (-l, -j), lost (-L) or held back to reorder it (-o), datagrams
+ * received can be lost as well (-L). Everything seen and sent is recorded,
+ * one line per datagram:
+ *
+ *   <time us> <rx|tx|lost> <type> <token> <size> <json>
+ *
+ * A summary is printed on Ctrl-C.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>           // used in this module for getopt()
+#include <fcntl.h>            // Required for the nonblocking socket
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <json-c/json.h>      // Required for parsing the rxpk
+#include "base64.h"
+#include "hal.h"
+#include "gateway.h"          // Packet types
+#include "os.h"
+
+
+#define MOCK_DEFAULT_PORT         1700      // Same as PORT in udp.h
+#define MOCK_DATAGRAM_SIZE        2048      // Max size of a datagram
+#define MOCK_MAX_QUEUED           64        // Max datagrams waiting for their send time
+#define MOCK_MAX_SCRIPT           256       // Max lines in the downlink script
+#define MOCK_DEFAULT_RX_DELAY     1000000   // RX1 delay of LoRaWAN, 1 second (us)
+#define MOCK_DEFAULT_LEAD         300000    // Send the PULL_RESP 300 ms before the requested tmst (us)
+#define MOCK_REORDER_DELAY        50000     // Datagrams held back for reordering wait an extra 50 ms (us)
+#define MOCK_RANDOM_MAX_SIZE      64        // Max size of a random downlink
+
+/**
+* Datagram waiting for its send time
+*/
+struct MOCK_DATAGRAM_STRUCT {
+  uint8_t             Data[MOCK_DATAGRAM_SIZE];   /**< Datagram */
+  int                 Size;                       /**< Size of the datagram */
+  uint64_t            Due;                        /**< Send time in micro seconds (OS_GetMicros) */
+  struct sockaddr_in  To;                         /**< Destination */
+  int                 Used;                       /**< 1 = slot in use */
+};
+
+/**
+* Scripted downlink
+*/
+struct MOCK_SCRIPT_STRUCT {
+  uint32_t  Uplink;                               /**< Answer the n-th uplink, counting from 1 */
+  uint32_t  Delay;                                /**< tmst of the downlink = tmst of the uplink + Delay (us) */
+  uint8_t   Frame[LORA_TX_MX_FRAME_SIZE];         /**< Frame to send */
+  int       FrameSize;                            /**< Size of the frame */
+};
+
+// Mock LNS Variables
+int MOCK_Socket = -1;
+FILE *MOCK_Log = NULL;                    // Record of every datagram
+struct MOCK_DATAGRAM_STRUCT MOCK_Queue[MOCK_MAX_QUEUED];
+struct MOCK_SCRIPT_STRUCT MOCK_Script[MOCK_MAX_SCRIPT];
+int MOCK_ScriptLen = 0;
+
+struct sockaddr_in MOCK_PullAddr;         // Where the downlinks go, from the last PULL_DATA
+int MOCK_PullAddrValid = 0;
+
+// Settings
+uint32_t MOCK_Latency = 0;                // Added to every datagram sent (us)
+uint32_t MOCK_Jitter = 0;                 // Random 0..Jitter added to every datagram sent (us)
+int MOCK_Loss = 0;                        // Percentage of datagrams lost, both ways
+int MOCK_Reorder = 0;                     // Percentage of datagrams sent held back
+int MOCK_DownlinkRate = 0;                // Percentage of uplinks answered with a random downlink
+uint32_t MOCK_RxDelay = MOCK_DEFAULT_RX_DELAY;
+uint32_t MOCK_Lead = MOCK_DEFAULT_LEAD;
+
+// Statistics
+uint32_t MOCK_NumRx[PKT_TX_ACK + 1];      // Received per packet type
+uint32_t MOCK_NumTx[PKT_TX_ACK + 1];      // Sent per packet type
+uint32_t MOCK_NumRxLost = 0;
+uint32_t MOCK_NumTxLost = 0;
+uint32_t MOCK_NumUplinks = 0;             // rxpk objects seen
+uint32_t MOCK_NumNoRoute = 0;             // Downlinks not sent, no PULL_DATA seen yet
+uint32_t MOCK_NumQueueFull = 0;
+
+volatile sig_atomic_t MOCK_Stop = 0;
+
+static const char *MOCK_TypeNames[PKT_TX_ACK + 1] = {
+  "PUSH_DATA", "PUSH_ACK", "PULL_DATA", "PULL_RESP", "PULL_ACK", "TX_ACK"
+};
+
+
+/**
+* __Function__: MOCK_Record
+*
+* __Description__: Record a datagram in the log
+*
+* __Input__: Direction = "rx", "tx" or "lost", pointer to the datagram, size of the datagram
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: The JSON object follows the 4 byte header (12 bytes for PUSH_DATA, PULL_DATA and TX_ACK)
+*/
+static void MOCK_Record( const char *Direction, const uint8_t *Data, int Size )
+{
+  int Header = 4;
+
+  if(MOCK_Log == NULL || Size < 4)
+  {
+    return;
+  }
+  if(Data[3] == PKT_PUSH_DATA || Data[3] == PKT_PULL_DATA || Data[3] == PKT_TX_ACK)
+  {
+    Header = 12;
+  }
+  fprintf(MOCK_Log, "%llu %s %s %u %d ", (unsigned long long)OS_GetMicros(), Direction,
+    Data[3] <= PKT_TX_ACK ? MOCK_TypeNames[Data[3]] : "UNKNOWN", (Data[1] << 8) | Data[2], Size);
+  if(Size > Header)
+  {
+    fwrite(Data + Header, 1, Size - Header, MOCK_Log);
+  }
+  fprintf(MOCK_Log, "\n");
+  fflush(MOCK_Log);
+}
+
+/**
+* __Function__: MOCK_Chance
+*
+* __Description__: Random event
+*
+* __Input__: Percentage
+*
+* __Output__: 1 = happens, 0 = does not happen
+*
+* __Status__: Completed
+*
+* __Remarks__: Seed with srand for repeatable runs
+*/
+static int MOCK_Chance( int Percentage )
+{
+  return Percentage > 0 && (rand() % 100) < Percentage;
+}
+
+/**
+* __Function__: MOCK_Queue_Add
+*
+* __Description__: Queue a datagram to be sent at a time, with the configured latency, jitter, loss and reordering
+*
+* __Input__: Pointer to the datagram, size of the datagram, send time (OS_GetMicros), destination
+*
+* __Output__: Error code: 0 = no error, 1 = Queue full
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static int MOCK_Queue_Add( const uint8_t *Data, int Size, uint64_t Due, const struct sockaddr_in *To )
+{
+  int i;
+
+  if(MOCK_Chance(MOCK_Loss))
+  {
+    MOCK_NumTxLost++;
+    MOCK_Record("lost", Data, Size);
+    return 0;
+  }
+
+  for(i = 0; i < MOCK_MAX_QUEUED; i++)
+  {
+    if(!MOCK_Queue[i].Used)
+    {
+      break;
+    }
+  }
+  if(i == MOCK_MAX_QUEUED)
+  {
+    printf("MOCK_Queue_Add: Queue full, datagram dropped!\n");
+    MOCK_NumQueueFull++;
+    return 1;
+  }
+
+  Due += MOCK_Latency;
+  if(MOCK_Jitter)
+  {
+    Due += rand() % (MOCK_Jitter + 1);
+  }
+  if(MOCK_Chance(MOCK_Reorder))
+  {
+    Due += MOCK_REORDER_DELAY;
+  }
+
+  memcpy(MOCK_Queue[i].Data, Data, Size);
+  MOCK_Queue[i].Size = Size;
+  MOCK_Queue[i].Due = Due;
+  MOCK_Queue[i].To = *To;
+  MOCK_Queue[i].Used = 1;
+  return 0;
+}
+
+/**
+* __Function__: MOCK_Queue_Send
+*
+* __Description__: Send every queued datagram that is due, oldest due time first
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void MOCK_Queue_Send( void )
+{
+  uint64_t Now = OS_GetMicros();
+  int i, First;
+
+  do
+  {
+    First = -1;
+    for(i = 0; i < MOCK_MAX_QUEUED; i++)
+    {
+      if(MOCK_Queue[i].Used && MOCK_Queue[i].Due <= Now && (First == -1 || MOCK_Queue[i].Due < MOCK_Queue[First].Due))
+      {
+        First = i;
+      }
+    }
+    if(First != -1)
+    {
+      sendto(MOCK_Socket, MOCK_Queue[First].Data, MOCK_Queue[First].Size, 0, (struct sockaddr *)&MOCK_Queue[First].To, sizeof(MOCK_Queue[First].To));
+      MOCK_NumTx[MOCK_Queue[First].Data[3]]++;
+      MOCK_Record("tx", MOCK_Queue[First].Data, MOCK_Queue[First].Size);
+      MOCK_Queue[First].Used = 0;
+    }
+  } while(First != -1);
+}
+
+/**
+* __Function__: MOCK_SendAck
+*
+* __Description__: Answer a PUSH_DATA or PULL_DATA
+*
+* __Input__: Pointer to the request, ACK type, address of the gateway
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void MOCK_SendAck( const uint8_t *Request, uint8_t Type, const struct sockaddr_in *To )
+{
+  uint8_t Ack[4];
+
+  Ack[0] = PROTOCOL_VERSION;
+  Ack[1] = Request[1];
+  Ack[2] = Request[2];
+  Ack[3] = Type;
+  MOCK_Queue_Add(Ack, sizeof(Ack), OS_GetMicros(), To);
+}
+
+/**
+* __Function__: MOCK_SendDownlink
+*
+* __Description__: Queue a PULL_RESP for an uplink
+*
+* __Input__: Frame, size of the frame, tmst to send it at, frequency and data rate of the uplink
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Sent MOCK_Lead before tmst, assuming the gateway tmst is now the tmst of the uplink
+*/
+static void MOCK_SendDownlink( const uint8_t *Frame, int FrameSize, uint32_t UplinkTmst, uint32_t Delay, double Freq, const char *Datr )
+{
+  uint8_t Datagram[MOCK_DATAGRAM_SIZE];
+  char B64[2 * LORA_TX_MX_FRAME_SIZE];
+  uint64_t Due;
+  int Len;
+
+  if(!MOCK_PullAddrValid)
+  {
+    MOCK_NumNoRoute++;
+    return;
+  }
+  if(bin_to_b64(Frame, FrameSize, B64, sizeof(B64)) < 0)
+  {
+    return;
+  }
+
+  Datagram[0] = PROTOCOL_VERSION;
+  Datagram[1] = (uint8_t)rand();
+  Datagram[2] = (uint8_t)rand();
+  Datagram[3] = PKT_PULL_RESP;
+  Len = 4 + snprintf((char *)Datagram + 4, sizeof(Datagram) - 4,
+    "{\"txpk\":{\"imme\":false,\"tmst\":%u,\"freq\":%.6f,\"rfch\":0,\"powe\":14,\"modu\":\"LORA\",\"datr\":\"%s\",\"codr\":\"4/5\",\"ipol\":true,\"size\":%d,\"data\":\"%s\"}}",
+    UplinkTmst + Delay, Freq, Datr, FrameSize, B64);
+
+  Due = OS_GetMicros();
+  if(Delay > MOCK_Lead)
+  {
+    Due += Delay - MOCK_Lead;
+  }
+  MOCK_Queue_Add(Datagram, Len, Due, &MOCK_PullAddr);
+}
+
+/**
+* __Function__: MOCK_ProcessUplink
+*
+* __Description__: Answer an rxpk with a scripted or random downlink, if any
+*
+* __Input__: The rxpk object
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void MOCK_ProcessUplink( struct json_object *Rxpk )
+{
+  struct json_object *Obj;
+  uint32_t Tmst = 0;
+  double Freq = 868.1;
+  const char *Datr = "SF7BW125";
+  uint8_t Frame[MOCK_RANDOM_MAX_SIZE];
+  uint8_t Uplink[256];
+  int UplinkSize = 0;
+  int i, Size;
+
+  MOCK_NumUplinks++;
+
+  if(json_object_object_get_ex(Rxpk, "tmst", &Obj))
+  {
+    Tmst = (uint32_t)json_object_get_int64(Obj);
+  }
+  if(json_object_object_get_ex(Rxpk, "freq", &Obj))
+  {
+    Freq = json_object_get_double(Obj);
+  }
+  if(json_object_object_get_ex(Rxpk, "datr", &Obj))
+  {
+    Datr = json_object_get_string(Obj);
+  }
+  if(json_object_object_get_ex(Rxpk, "data", &Obj))
+  {
+    UplinkSize = b64_to_bin(json_object_get_string(Obj), strlen(json_object_get_string(Obj)), Uplink, sizeof(Uplink));
+  }
+
+  for(i = 0; i < MOCK_ScriptLen; i++)
+  {
+    if(MOCK_Script[i].Uplink == MOCK_NumUplinks)
+    {
+      MOCK_SendDownlink(MOCK_Script[i].Frame, MOCK_Script[i].FrameSize, Tmst, MOCK_Script[i].Delay, Freq, Datr);
+    }
+  }
+
+  if(MOCK_Chance(MOCK_DownlinkRate))
+  {
+    // Unconfirmed data down with a random payload
+    Size = 12 + rand() % (MOCK_RANDOM_MAX_SIZE - 11);
+    Frame[0] = 0x60;
+    for(i = 1; i < Size; i++)
+    {
+      Frame[i] = (uint8_t)rand();
+    }
+    // To the device of a data uplink, so the gateway can pick the radio that heard it
+    if(UplinkSize >= LEN_DAT_MIN && ((Uplink[OFF_DAT_HDR] & MHDR_MTYPE_MASK) == MHDR_UNCONFIRMED_UP || (Uplink[OFF_DAT_HDR] & MHDR_MTYPE_MASK) == MHDR_CONFIRMED_UP))
+    {
+      memcpy(Frame + OFF_DAT_ADDR, Uplink + OFF_DAT_ADDR, 4);
+    }
+    MOCK_SendDownlink(Frame, Size, Tmst, MOCK_RxDelay, Freq, Datr);
+  }
+}
+
+/**
+* __Function__: MOCK_ProcessDatagram
+*
+* __Description__: Process a datagram received from the gateway
+*
+* __Input__: Pointer to the datagram, size of the datagram, address of the gateway
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void MOCK_ProcessDatagram( uint8_t *Data, int Size, const struct sockaddr_in *From )
+{
+  struct json_object *Push;
+  struct json_object *RxpkArray;
+  int i;
+
+  if(Size < 4 || Data[3] > PKT_TX_ACK)
+  {
+    printf("MOCK_ProcessDatagram: Unknown datagram of %d bytes\n", Size);
+    return;
+  }
+  if(MOCK_Chance(MOCK_Loss))
+  {
+    MOCK_NumRxLost++;
+    MOCK_Record("lost", Data, Size);
+    return;
+  }
+  MOCK_NumRx[Data[3]]++;
+  MOCK_Record("rx", Data, Size);
+
+  switch(Data[3])
+  {
+    case PKT_PUSH_DATA:
+      MOCK_SendAck(Data, PKT_PUSH_ACK, From);
+      if(Size > 12)
+      {
+        Data[Size] = 0;
+        Push = json_tokener_parse((char *)Data + 12);
+        if(Push != NULL && json_object_object_get_ex(Push, "rxpk", &RxpkArray))
+        {
+          for(i = 0; i < (int)json_object_array_length(RxpkArray); i++)
+          {
+            MOCK_ProcessUplink(json_object_array_get_idx(RxpkArray, i));
+          }
+        }
+        if(Push != NULL)
+        {
+          json_object_put(Push);
+        }
+      }
+    break;
+
+    case PKT_PULL_DATA:
+      MOCK_SendAck(Data, PKT_PULL_ACK, From);
+      MOCK_PullAddr = *From;
+      MOCK_PullAddrValid = 1;
+    break;
+
+    default:
+    break;
+  }
+}
+
+/**
+* __Function__: MOCK_LoadScript
+*
+* __Description__: Read the downlink script, one downlink per line: <uplink number> <delay us> <payload in hex>
+*
+* __Input__: File name
+*
+* __Output__: Error code: 0 = no error, 1 = Error reading the file
+*
+* __Status__: Completed
+*
+* __Remarks__: Uplinks are counted from 1, the delay is added to the tmst of the uplink
+*/
+static int MOCK_LoadScript( const char *FileName )
+{
+  FILE *File;
+  char Line[1024];
+  char Hex[1024];
+  unsigned int Uplink, Delay, Byte;
+  int i;
+
+  if((File = fopen(FileName, "r")) == NULL)
+  {
+    printf("MOCK_LoadScript: Error opening: %s\n", FileName);
+    return 1;
+  }
+  while(fgets(Line, sizeof(Line), File) != NULL && MOCK_ScriptLen < MOCK_MAX_SCRIPT)
+  {
+    if(Line[0] == '#' || sscanf(Line, "%u %u %1023s", &Uplink, &Delay, Hex) != 3)
+    {
+      continue;
+    }
+    for(i = 0; Hex[2 * i] && Hex[2 * i + 1] && i < LORA_TX_MX_FRAME_SIZE; i++)
+    {
+      sscanf(Hex + 2 * i, "%2x", &Byte);
+      MOCK_Script[MOCK_ScriptLen].Frame[i] = Byte;
+    }
+    MOCK_Script[MOCK_ScriptLen].FrameSize = i;
+    MOCK_Script[MOCK_ScriptLen].Uplink = Uplink;
+    MOCK_Script[MOCK_ScriptLen].Delay = Delay;
+    MOCK_ScriptLen++;
+  }
+  fclose(File);
+  printf("MOCK_LoadScript: %d downlinks loaded from: %s\n", MOCK_ScriptLen, FileName);
+  return 0;
+}
+
+/**
+* __Function__: MOCK_PrintStats
+*
+* __Description__: Print a summary of what has been seen and sent
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void MOCK_PrintStats( void )
+{
+  int i;
+
+  printf("\nMock LNS summary:\n");
+  for(i = 0; i <= PKT_TX_ACK; i++)
+  {
+    printf("  %-10s received: %u sent: %u\n", MOCK_TypeNames[i], MOCK_NumRx[i], MOCK_NumTx[i]);
+  }
+  printf("  uplinks (rxpk): %u\n", MOCK_NumUplinks);
+  printf("  lost received: %u lost sent: %u\n", MOCK_NumRxLost, MOCK_NumTxLost);
+  printf("  downlinks without PULL_DATA: %u queue full: %u\n", MOCK_NumNoRoute, MOCK_NumQueueFull);
+}
+
+static void MOCK_Signal( int Signal )
+{
+  MOCK_Stop = 1;
+}
+
+/**
+* __Function__: Usage
+*
+* __Description__: Print the command line options
+*
+* __Input__: Name of the programme
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void Usage( const char *Name )
+{
+  printf("Usage: %s [-p port] [-w file] [-D pct] [-S file] [-r us] [-a us] [-l us] [-j us] [-L pct] [-o pct] [-x seed]\n", Name);
+  printf("  -p port  Port to listen on, default %d\n", MOCK_DEFAULT_PORT);
+  printf("  -w file  Record every datagram in file, - = stdout\n");
+  printf("  -D pct   Answer pct %% of the uplinks with a random downlink\n");
+  printf("  -S file  Scripted downlinks, one per line: <uplink number> <delay us> <hex payload>\n");
+  printf("  -r us    RX delay of the random downlinks, tmst = uplink tmst + us, default %d\n", MOCK_DEFAULT_RX_DELAY);
+  printf("  -a us    Send the PULL_RESP us before the requested tmst, default %d\n", MOCK_DEFAULT_LEAD);
+  printf("  -l us    Latency added to every datagram sent\n");
+  printf("  -j us    Random jitter 0..us added to every datagram sent\n");
+  printf("  -L pct   Lose pct %% of the datagrams, both ways\n");
+  printf("  -o pct   Hold back pct %% of the datagrams sent by %d us, reordering them\n", MOCK_REORDER_DELAY);
+  printf("  -x seed  Seed of the random generator, for repeatable runs\n");
+}
+
+int main( int argc, char *argv[] )
+{
+  struct sockaddr_in Addr;
+  struct sockaddr_in From;
+  socklen_t FromLen;
+  uint8_t Data[MOCK_DATAGRAM_SIZE + 1];
+  int Port = MOCK_DEFAULT_PORT;
+  int Option, NumBytes;
+
+  srand(1);
+  while((Option = getopt(argc, argv, "p:w:D:S:r:a:l:j:L:o:x:h")) != -1)
+  {
+    switch(Option)
+    {
+      case 'p': Port = atoi(optarg); break;
+      case 'w':
+        MOCK_Log = strcmp(optarg, "-") == 0 ? stdout : fopen(optarg, "w");
+        if(MOCK_Log == NULL)
+        {
+          printf("Error opening: %s\n", optarg);
+          return 1;
+        }
+      break;
+      case 'D': MOCK_DownlinkRate = atoi(optarg); break;
+      case 'S':
+        if(MOCK_LoadScript(optarg) != 0)
+        {
+          return 1;
+        }
+      break;
+      case 'r': MOCK_RxDelay = strtoul(optarg, NULL, 10); break;
+      case 'a': MOCK_Lead = strtoul(optarg, NULL, 10); break;
+      case 'l': MOCK_Latency = strtoul(optarg, NULL, 10); break;
+      case 'j': MOCK_Jitter = strtoul(optarg, NULL, 10); break;
+      case 'L': MOCK_Loss = atoi(optarg); break;
+      case 'o': MOCK_Reorder = atoi(optarg); break;
+      case 'x': srand(strtoul(optarg, NULL, 10)); break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if((MOCK_Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+  {
+    printf("Error creating a socket!\n");
+    return 1;
+  }
+  memset((char *) &Addr, 0, sizeof(Addr));
+  Addr.sin_family = AF_INET;
+  Addr.sin_port = htons(Port);
+  Addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(MOCK_Socket, (struct sockaddr *) &Addr, sizeof(Addr)) == -1)
+  {
+    printf("Error binding to port %d!\n", Port);
+    return 1;
+  }
+  // Change the socket into non-blocking state
+  fcntl(MOCK_Socket, F_SETFL, O_NONBLOCK);
+
+  signal(SIGINT, MOCK_Signal);
+  signal(SIGTERM, MOCK_Signal);
+  printf("Mock LNS listening on udp port %d\n", Port);
+
+  while(!MOCK_Stop)
+  {
+    FromLen = sizeof(From);
+    while((NumBytes = recvfrom(MOCK_Socket, Data, MOCK_DATAGRAM_SIZE, 0, (struct sockaddr *)&From, &FromLen)) > 0)
+    {
+      MOCK_ProcessDatagram(Data, NumBytes, &From);
+      FromLen = sizeof(From);
+    }
+    MOCK_Queue_Send();
+    OS_Delay(1);
+  }
+
+  MOCK_PrintStats();
+  return 0;
+}
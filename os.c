@@ -1,7 +1,13 @@
 #include <stdint.h>    // Required for unint8 etc
 #include <cstdio>      // Required for printf etc
 #include<json-c/json.h> // required for json file manipulation
+#include <cstring>     // Required for strerror
+#include <cerrno>
+#include <pthread.h>   // Required for the scheduling and affinity of threads
+#include <sched.h>
+#include <sys/mman.h>  // Required for mlockall
 #include "os.h"
+#include "clock.h"     // Time source
 
 
 /**
@@ -240,3 +246,110 @@ void OS_PrintFrame(uint8_t *Frame, int LEN)
  printf("LSB Last\n");
 
 }
+
+/**
+ * __Function__: OS_GetMicros
+ *
+ * __Description__: Get a monotonic time stamp in micro seconds
+ *
+ * __Input__: void
+ *
+ * __Output__: uint64_t micro seconds since an arbitrary point in the past
+ *
+ * __Status__: Complete
+ *
+ * __Remarks__: Not affected by changes of the wall clock, use it to measure intervals. From the selected clock, clock.c
+ */
+uint64_t OS_GetMicros( void )
+{
+ /// __Incode Comments:__
+ return CLK_GetMicros();
+}
+
+/**
+ * __Function__: OS_Delay
+ *
+ * __Description__: Wait a number of milli seconds
+ *
+ * __Input__: Number of milli seconds
+ *
+ * __Output__: void
+ *
+ * __Status__: Complete
+ *
+ * __Remarks__: Same as the wiringPi delay(), without needing wiringPi. On the selected clock, clock.c
+ */
+void OS_Delay( unsigned int Millis )
+{
+ /// __Incode Comments:__
+ CLK_Delay(Millis);
+}
+
+/**
+ * __Function__: OS_SetRealtime
+ *
+ * __Description__: Give the calling thread a SCHED_FIFO priority and pin it to a CPU
+ *
+ * __Input__: Priority = 1..99 for SCHED_FIFO, 0 = keep the normal scheduling, Cpu = CPU to run on, -1 = any
+ *
+ * __Output__: Error code: 0 = no error, 1 = priority not set, 2 = affinity not set
+ *
+ * __Status__: Complete
+ *
+ * __Remarks__: SCHED_FIFO needs root or CAP_SYS_NICE, on an error the thread keeps running as it was
+ */
+int OS_SetRealtime( int Priority, int Cpu )
+{
+ /// __Incode Comments:__
+ struct sched_param Param;
+ cpu_set_t CpuSet;
+ int Result;
+
+ if(Priority > 0)
+ {
+   memset(&Param, 0, sizeof(Param));
+   Param.sched_priority = Priority;
+   Result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &Param);
+   if(Result != 0)
+   {
+     printf("OS_SetRealtime: Error: SCHED_FIFO priority %d not set: %s\n", Priority, strerror(Result));
+     return 1;
+   }
+ }
+ if(Cpu >= 0)
+ {
+   CPU_ZERO(&CpuSet);
+   CPU_SET(Cpu, &CpuSet);
+   Result = pthread_setaffinity_np(pthread_self(), sizeof(CpuSet), &CpuSet);
+   if(Result != 0)
+   {
+     printf("OS_SetRealtime: Error: not pinned to CPU %d: %s\n", Cpu, strerror(Result));
+     return 2;
+   }
+ }
+ return 0;
+}
+
+/**
+ * __Function__: OS_LockMemory
+ *
+ * __Description__: Lock all pages of the process in RAM, now and in the future
+ *
+ * __Input__: void
+ *
+ * __Output__: Error code: 0 = no error, 1 = mlockall failed
+ *
+ * __Status__: Complete
+ *
+ * __Remarks__: No page faults on the radio path once running, needs root or CAP_IPC_LOCK
+ */
+int OS_LockMemory( void )
+{
+ /// __Incode Comments:__
+ if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+ {
+   printf("OS_LockMemory: Error: mlockall failed: %s\n", strerror(errno));
+   return 1;
+ }
+ return 0;
+}
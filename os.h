@@ -1,6 +1,7 @@
 #ifndef _os_hpp_
 #define _os_hpp_
 
+#include <stdint.h>    // Required for unint8 etc
 
 // Define the functions and pocedures
 void OS_PrintFrame(uint8_t *Frame, int LEN);
@@ -9,6 +10,10 @@ struct json_object * OS_GetJSONFromNVM(char *ConfigName);
 int OS_CheckNVMExists( char *ConfigName);
 int OS_CreateNVMEntry( char *ConfigName);
 int OS_WriteJSONtoNVM( char *ConfigName, struct json_object *JSON_Config);
+uint64_t OS_GetMicros( void );
+void OS_Delay( unsigned int Millis );
+int OS_SetRealtime( int Priority, int Cpu );         // Calling thread: SCHED_FIFO priority (0 = normal), CPU (-1 = any)
+int OS_LockMemory( void );                           // mlockall
 
 
 static const int CONFIG_FILE_SIZE = 1024; /// JSON file buffer is 1024 bytes, might need to be changed
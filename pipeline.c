@@ -0,0 +1,366 @@
+/*******************************************************************************
+ * Pipeline, the forwarder as three threads
+ *
+ * Alternative to the cooperative main loop: HAL_Engine, GW_Engine and
+ * UDP_Engine each run on a thread of their own, the radio stage services all
+ * radios of the gateway. The stages only talk through the bounded lock-free
+ * FIFOs of the HAL and UDP contexts (spsc.h):
+ *
+ *   radio --LORA RX FIFO--> gateway --UDP TX FIFO--> network
+ *   radio <--LORA TX FIFO-- gateway <--UDP RX FIFO-- network
+ *
+ * With backpressure, the gateway leaves an uplink in the LORA RX FIFO while
+ * the UDP TX FIFO is full, so when the network falls behind frames are only
+ * dropped at the radio. A stage runs its engine again at once while its input
+ * has frames and sleeps PL_IDLE_US otherwise. It counts the time spent in the
+ * engine, its utilisation is on the metrics endpoint.
+ *
+ * PL_Stop stops the stages in the order of the uplinks: first the radio, then
+ * the gateway after it emptied the LORA RX FIFO and forwarded the uplinks held
+ * by the duplicate suppression, then the network after it sent what is in the
+ * UDP TX FIFO, so no uplink is lost on a clean shutdown.
+ *
+ * Needs the real clock, the simulated clock is not thread safe.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include <time.h>             // Required for nanosleep
+#include <pthread.h>
+#include "hal.h"
+#include "udp.h"
+#include "gateway.h"
+#include "dedup.h"
+#include "clock.h"
+#include "os.h"
+#include "pipeline.h"
+
+/**
+* One stage of the pipeline
+*/
+struct PL_STAGE_STRUCT {
+  const char  *Name;                                  /**< Name of the stage, for the logs and metrics */
+  int         (*Engine)( void );                      /**< One run of the engine of the stage */
+  int         (*Pending)( void );                     /**< 1 = there is input the engine can process now */
+  void        (*Flush)( void );                       /**< Release what the stage holds back, on a stop before draining, NULL = none */
+  pthread_t   Thread;
+  int         Running;                                /**< 1 = Thread has been started */
+  int         Stop;                                   /**< Set by PL_Stop */
+  int         Priority;                               /**< SCHED_FIFO priority, 0 = normal scheduling */
+  int         Cpu;                                    /**< CPU the thread is pinned to, -1 = any */
+  uint64_t    BusyMicros;                             /**< Time spent in Engine */
+  uint64_t    Loops;                                  /**< Runs of Engine */
+};
+
+static int PL_RadioEngine( void );
+static int PL_RadioPending( void );
+static int PL_GatewayEngine( void );
+static int PL_GatewayPending( void );
+static void PL_GatewayFlush( void );
+static int PL_NetworkEngine( void );
+static int PL_NetworkPending( void );
+
+// Pipeline Variables
+static struct PL_STAGE_STRUCT PL_Stages[PL_NUM_STAGES] = {
+  { "radio",   PL_RadioEngine,   PL_RadioPending,   NULL,            0, 0, 0, 0, -1, 0, 0 },
+  { "gateway", PL_GatewayEngine, PL_GatewayPending, PL_GatewayFlush, 0, 0, 0, 0, -1, 0, 0 },
+  { "network", PL_NetworkEngine, PL_NetworkPending, NULL,            0, 0, 0, 0, -1, 0, 0 }
+};
+static struct UDP_CONTEXT_STRUCT *PL_Udp = NULL;
+static struct GW_CONTEXT_STRUCT *PL_Gw = NULL;
+static int PL_IsRunning = 0;
+static uint64_t PL_StartTime = 0;
+static uint64_t PL_StopTime = 0;                    // 0 = still running
+
+
+/**
+* Engines of the stages and whether their input has work for them now
+*/
+static int PL_RadioEngine( void )
+{
+  int i;
+
+  // Every radio of the gateway, one after the other
+  for(i = 0; i < PL_Gw->NumRadios; i++)
+  {
+    HAL_Engine(PL_Gw->Hal[i]);
+  }
+  return 0;
+}
+
+static int PL_RadioPending( void )
+{
+  int i;
+
+  // The chips are polled, only a queued downlink is known to be waiting. Not drained on a stop, no TX after it
+  if(__atomic_load_n(&PL_Stages[PL_STAGE_RADIO].Stop, __ATOMIC_ACQUIRE))
+  {
+    return 0;
+  }
+  for(i = 0; i < PL_Gw->NumRadios; i++)
+  {
+    if(HAL_GetTxFifoLevel(PL_Gw->Hal[i]) > 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int PL_GatewayEngine( void )
+{
+  return GW_Engine(PL_Gw);
+}
+
+static int PL_GatewayPending( void )
+{
+  int i;
+
+  if(UDP_GetRxFifoLevel(PL_Udp) > 0)
+  {
+    return 1;
+  }
+  if(UDP_GetTxFifoLevel(PL_Udp) >= UDP_TX_FIFO_DEPTH)
+  {
+    return 0;
+  }
+  for(i = 0; i < PL_Gw->NumRadios; i++)
+  {
+    if(HAL_GetRxFifoLevel(PL_Gw->Hal[i]) > 0)
+    {
+      return 1;
+    }
+  }
+  // A held uplink only counts once its hold time has passed, the stage sleeps meanwhile
+  return PL_Gw->Dup != NULL && DUP_Pending(PL_Gw->Dup, CLK_GetMicros());
+}
+
+static void PL_GatewayFlush( void )
+{
+  if(PL_Gw->Dup != NULL)
+  {
+    DUP_Flush(PL_Gw->Dup);
+  }
+}
+
+static int PL_NetworkEngine( void )
+{
+  return UDP_Engine(PL_Udp);
+}
+
+static int PL_NetworkPending( void )
+{
+  return UDP_GetTxFifoLevel(PL_Udp) > 0;
+}
+
+/**
+* __Function__: PL_Thread
+*
+* __Description__: Body of the thread of a stage, runs its engine until PL_Stop, then drains its input
+*
+* __Input__: Stage
+*
+* __Output__: NULL
+*
+* __Status__: Completed
+*
+* __Remarks__: The priority and affinity are set from the thread itself, a failure is logged and the thread runs on
+*/
+static void *PL_Thread( void *Arg )
+{
+  struct PL_STAGE_STRUCT *Stage = (struct PL_STAGE_STRUCT *)Arg;
+  struct timespec Idle = { 0, PL_IDLE_US * 1000 };
+  uint64_t Start;
+  int i;
+
+  OS_SetRealtime(Stage->Priority, Stage->Cpu);
+  while(__atomic_load_n(&Stage->Stop, __ATOMIC_ACQUIRE) == 0)
+  {
+    Start = OS_GetMicros();
+    Stage->Engine();
+    __atomic_fetch_add(&Stage->BusyMicros, OS_GetMicros() - Start, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&Stage->Loops, 1, __ATOMIC_RELAXED);
+    if(!Stage->Pending())
+    {
+      nanosleep(&Idle, NULL);
+    }
+  }
+
+  // The stage before this one has stopped, what is in the input FIFO is all there is
+  if(Stage->Flush != NULL)
+  {
+    Stage->Flush();
+  }
+  for(i = 0; i < PL_DRAIN_LOOPS && Stage->Pending(); i++)
+  {
+    Stage->Engine();
+  }
+  return NULL;
+}
+
+/**
+* __Function__: PL_SetStage
+*
+* __Description__: Set the scheduling of the thread of a stage
+*
+* __Input__: Stage = one of pl_stage_t, Priority = SCHED_FIFO priority 1..99, 0 = normal scheduling, Cpu = CPU to pin to, -1 = any
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before PL_Start
+*/
+void PL_SetStage( int Stage, int Priority, int Cpu )
+{
+  PL_Stages[Stage].Priority = Priority;
+  PL_Stages[Stage].Cpu = Cpu;
+}
+
+/**
+* __Function__: PL_Start
+*
+* __Description__: Start the threads of the radio, gateway and network stage
+*
+* __Input__: GW context, initialised with its radios and upstream
+*
+* __Output__: Error code: 0 = no error, 1 = thread not created, the stages started are stopped again
+*
+* __Status__: Completed
+*
+* __Remarks__: From now on HAL_Engine, GW_Engine and UDP_Engine must not be called from the main loop
+*/
+int PL_Start( struct GW_CONTEXT_STRUCT *Gw )
+{
+  int Result;
+  int i;
+
+  PL_Udp = Gw->Udp;
+  PL_Gw = Gw;
+  PL_StartTime = OS_GetMicros();
+  PL_StopTime = 0;
+
+  // Start at the end of the pipeline, every stage finds the one it feeds running
+  for(i = PL_NUM_STAGES - 1; i >= 0; i--)
+  {
+    PL_Stages[i].Stop = 0;
+    PL_Stages[i].BusyMicros = 0;
+    PL_Stages[i].Loops = 0;
+    Result = pthread_create(&PL_Stages[i].Thread, NULL, PL_Thread, &PL_Stages[i]);
+    if(Result != 0)
+    {
+      printf("PL_Start: Error: %s thread not created: %s\n", PL_Stages[i].Name, strerror(Result));
+      PL_IsRunning = 1;
+      PL_Stop();
+      return 1;
+    }
+    PL_Stages[i].Running = 1;
+    printf("PL_Start: %s stage started, priority %d, cpu %d\n", PL_Stages[i].Name, PL_Stages[i].Priority, PL_Stages[i].Cpu);
+  }
+  PL_IsRunning = 1;
+  return 0;
+}
+
+/**
+* __Function__: PL_Stop
+*
+* __Description__: Stop the stages in the order of the uplinks and wait for their threads
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Every stage first empties its input FIFO, at most PL_DRAIN_LOOPS runs of its engine
+*/
+void PL_Stop( void )
+{
+  int i;
+
+  if(!PL_IsRunning)
+  {
+    return;
+  }
+  for(i = 0; i < PL_NUM_STAGES; i++)
+  {
+    if(PL_Stages[i].Running)
+    {
+      __atomic_store_n(&PL_Stages[i].Stop, 1, __ATOMIC_RELEASE);
+      pthread_join(PL_Stages[i].Thread, NULL);
+      PL_Stages[i].Running = 0;
+    }
+  }
+  PL_StopTime = OS_GetMicros();
+  PL_IsRunning = 0;
+}
+
+int PL_Running( void )
+{
+  return PL_IsRunning;
+}
+
+const char *PL_GetStageName( int Stage )
+{
+  return PL_Stages[Stage].Name;
+}
+
+uint64_t PL_GetBusyMicros( int Stage )
+{
+  return __atomic_load_n(&PL_Stages[Stage].BusyMicros, __ATOMIC_RELAXED);
+}
+
+uint64_t PL_GetLoops( int Stage )
+{
+  return __atomic_load_n(&PL_Stages[Stage].Loops, __ATOMIC_RELAXED);
+}
+
+/**
+* __Function__: PL_GetUtilisation
+*
+* __Description__: Part of the time a stage was busy in its engine since PL_Start
+*
+* __Input__: Stage = one of pl_stage_t
+*
+* __Output__: 0..1, 1 = the stage is the bottleneck
+*
+* __Status__: Completed
+*
+* __Remarks__: Up to PL_Stop when the pipeline has been stopped
+*/
+double PL_GetUtilisation( int Stage )
+{
+  uint64_t Elapsed = (PL_StopTime ? PL_StopTime : OS_GetMicros()) - PL_StartTime;
+
+  if(PL_StartTime == 0 || Elapsed == 0)
+  {
+    return 0;
+  }
+  return (double)PL_GetBusyMicros(Stage) / Elapsed;
+}
+
+/**
+* __Function__: PL_Report
+*
+* __Description__: Print the utilisation of every stage
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void PL_Report( void )
+{
+  int i;
+
+  for(i = 0; i < PL_NUM_STAGES; i++)
+  {
+    printf("PL_Report: %-8s busy %8.3f s, utilisation %5.1f %%, %llu runs\n", PL_Stages[i].Name,
+      PL_GetBusyMicros(i) / 1e6, PL_GetUtilisation(i) * 100, (unsigned long long)PL_GetLoops(i));
+  }
+}
@@ -0,0 +1,44 @@
+/*******************************************************************************
+ * Pipeline Header file
+ *******************************************************************************/
+
+#ifndef _pipeline_h_
+#define _pipeline_h_
+
+#include <stdint.h>           // Required for unint8 etc
+
+struct GW_CONTEXT_STRUCT;
+
+/**
+* Pipeline Public Functions and Procedures, HAL_Init, UDP_Init and GW_Init first
+*/
+void PL_SetStage( int Stage, int Priority, int Cpu );  // Before PL_Start: SCHED_FIFO priority (0 = normal), CPU (-1 = any)
+int PL_Start( struct GW_CONTEXT_STRUCT *Gw );       // The radios and upstream of the gateway
+void PL_Stop( void );                                // Stops the stages in order, each after draining its input
+
+/**
+* Pipeline Supporting Functions and Procedures
+*/
+int PL_Running( void );                              // 1 = between PL_Start and PL_Stop
+const char *PL_GetStageName( int Stage );
+uint64_t PL_GetBusyMicros( int Stage );              // Time the stage spent in its engine since PL_Start
+uint64_t PL_GetLoops( int Stage );                   // Runs of the engine since PL_Start
+double PL_GetUtilisation( int Stage );               // Busy time / time since PL_Start, 0..1
+void PL_Report( void );                              // Print the utilisation of every stage
+
+
+/**
+* Stages, in the order the uplinks flow through them
+*/
+enum pl_stage_t {
+  PL_STAGE_RADIO = 0,           // HAL_Engine of every radio: drain the chip, key TX
+  PL_STAGE_GATEWAY,             // GW_Engine: rxpk / txpk JSON, status, PULL_DATA
+  PL_STAGE_NETWORK,             // UDP_Engine: sendto / recvfrom
+  PL_NUM_STAGES
+};
+
+#define PL_IDLE_US                250       // Sleep of a stage that has nothing to do
+#define PL_DRAIN_LOOPS            1000      // Engine runs a stopping stage gets at most to empty its input
+
+
+#endif // _pipeline_h_
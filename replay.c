@@ -0,0 +1,366 @@
+/*******************************************************************************
+ * Replay
+ *
+ * Generator for the virtual radio (VR_SetGenerator) that plays a LoRaTap pcap
+ * back into the HAL, e.g. one written with -w, so the GW_ProcessRX_Lora ->
+ * UDP_SendUDP path runs with the shape of real traffic:
+ *
+ *   single_chan_pkt_fwd -v replay:file=lora.pcap,speed=10
+ *
+ * - the uplinks keep their relative timing, divided by the speed, and their
+ *   RSSI, SNR and CRC status; downlinks (inverted IQ) are skipped
+ * - speed=max hands the next uplink to the radio on every poll, the forwarder
+ *   then runs as fast as its main loop allows and RPL_Report shows the
+ *   throughput and where frames were dropped
+ * - loop=N plays the file N times
+ *
+ * Both byte orders and micro and nano second pcap files are read.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include "hal.h"
+#include "os.h"
+#include "metrics.h"          // Drop counters for the report
+#include "capture.h"          // LoRaTap layout
+#include "vradio.h"
+#include "replay.h"
+
+static int RPL_Open( void );
+static int RPL_ReadRecord( void );
+static uint32_t RPL_Get32( const uint8_t *Data );
+
+// Replay configuration, see RPL_Configure
+char RPL_FileName[256] = "";
+double RPL_Speed = 1;                     // RPL_SPEED_MAX = as fast as the radio is polled
+int RPL_Loops = 1;
+
+// Replay Variables
+FILE *RPL_File = NULL;
+int RPL_Swapped = 0;                      // 1 = file written on a host with the other byte order
+int RPL_Nanos = 0;                        // 1 = nano second timestamps
+int RPL_Loop = 0;                         // Loop being played
+struct VR_FRAME_STRUCT RPL_Next;          // Next uplink
+int RPL_NextValid = 0;
+uint64_t RPL_NextTs;                      // Time of the next uplink since the first record, micro seconds
+uint64_t RPL_LastTs = 0;                  // Time of the last record read since the first record
+int RPL_HaveFirst = 0;
+uint64_t RPL_FirstTs;                     // Capture time of the first record
+uint64_t RPL_LoopOffset = 0;              // Added to the time in later loops
+int RPL_Found = 0;                        // 1 = the file holds at least one uplink
+int RPL_Started = 0;
+uint64_t RPL_StartTime;                   // OS_GetMicros of the first poll
+uint64_t RPL_EndTime;                     // OS_GetMicros of the last uplink
+
+uint32_t RPL_NumReplayed = 0;
+uint32_t RPL_NumCrcErrors = 0;
+uint32_t RPL_NumSkipped = 0;
+
+
+/**
+* __Function__: RPL_Configure
+*
+* __Description__: Set up the replay from a spec and open the file
+*
+* __Input__: Spec, comma separated key=value pairs:
+*            file=name    LoRaTap pcap (linktype 270) to replay
+*            speed=N|max  N times as fast as captured, default 1, max = no gaps
+*            loop=N       Play the file N times, default 1
+*
+* __Output__: Error code: 0 = no error, 1 = Error in the spec, 2 = Cannot read the file
+*
+* __Status__: Completed
+*
+* __Remarks__: e.g. file=lora.pcap,speed=max,loop=10
+*/
+int RPL_Configure( const char *Spec )
+{
+  char Buffer[512];
+  char *Token, *Save, *Value;
+  int Error;
+
+  snprintf(Buffer, sizeof(Buffer), "%s", Spec);
+  for(Token = strtok_r(Buffer, ",", &Save); Token != NULL; Token = strtok_r(NULL, ",", &Save))
+  {
+    if((Value = strchr(Token, '=')) == NULL)
+    {
+      printf("RPL_Configure: Expected key=value: %s\n", Token);
+      return 1;
+    }
+    *Value++ = 0;
+    Error = 0;
+
+    if(strcmp(Token, "file") == 0)
+    {
+      snprintf(RPL_FileName, sizeof(RPL_FileName), "%s", Value);
+    }
+    else if(strcmp(Token, "speed") == 0)
+    {
+      RPL_Speed = strcmp(Value, "max") == 0 ? RPL_SPEED_MAX : atof(Value);
+      Error = strcmp(Value, "max") != 0 && RPL_Speed <= 0;
+    }
+    else if(strcmp(Token, "loop") == 0)
+    {
+      RPL_Loops = atoi(Value);
+      Error = RPL_Loops < 1;
+    }
+    else
+    {
+      printf("RPL_Configure: Unknown key: %s\n", Token);
+      return 1;
+    }
+    if(Error)
+    {
+      printf("RPL_Configure: Invalid value for %s: %s\n", Token, Value);
+      return 1;
+    }
+  }
+  if(RPL_FileName[0] == 0)
+  {
+    printf("RPL_Configure: No file given\n");
+    return 1;
+  }
+  if(RPL_Open() != 0)
+  {
+    return 2;
+  }
+  if(RPL_Speed == RPL_SPEED_MAX)
+  {
+    printf("RPL_Configure: Replaying %s %d times at maximum speed\n", RPL_FileName, RPL_Loops);
+  }
+  else
+  {
+    printf("RPL_Configure: Replaying %s %d times at %gx\n", RPL_FileName, RPL_Loops, RPL_Speed);
+  }
+  return 0;
+}
+
+/**
+* __Function__: RPL_Generate
+*
+* __Description__: Generator for the virtual radio, hand over the next uplink when it is due
+*
+* __Input__: HAL context of the virtual radio, not used, uplink to fill
+*
+* __Output__: 1 = Uplink filled, 0 = nothing to receive yet or the file has been played
+*
+* __Status__: Completed
+*
+* __Remarks__: The time line starts at the first poll
+*/
+int RPL_Generate( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink )
+{
+  uint64_t Now = OS_GetMicros();
+
+  if(!RPL_Started)
+  {
+    RPL_StartTime = Now;
+    RPL_EndTime = Now;
+    __atomic_store_n(&RPL_Started, 1, __ATOMIC_RELEASE);
+  }
+  if(!RPL_NextValid)
+  {
+    return 0;
+  }
+  if(RPL_Speed != RPL_SPEED_MAX && Now < RPL_StartTime + (uint64_t)(RPL_NextTs / RPL_Speed))
+  {
+    return 0;
+  }
+
+  *Uplink = RPL_Next;
+  RPL_NumReplayed++;
+  if(Uplink->CrcError)
+  {
+    RPL_NumCrcErrors++;
+  }
+  RPL_EndTime = Now;
+  __atomic_store_n(&RPL_NextValid, RPL_ReadRecord() == 0, __ATOMIC_RELEASE);   // RPL_Done may be asked from another thread
+  return 1;
+}
+
+int RPL_Done( void )
+{
+  return __atomic_load_n(&RPL_Started, __ATOMIC_ACQUIRE) && !__atomic_load_n(&RPL_NextValid, __ATOMIC_ACQUIRE);
+}
+
+/**
+* __Function__: RPL_Report
+*
+* __Description__: Print what has been replayed, the throughput and where frames were dropped
+*
+* __Input__: Frames received and of which CRC ok, summed over the radios
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: The drop points are the counters of the metrics, MET_Init clears them
+*/
+void RPL_Report( uint32_t NumRx, uint32_t RxOk )
+{
+  double Seconds = RPL_Started ? (RPL_EndTime - RPL_StartTime) / 1e6 : 0;
+  double Captured = RPL_NextTs / 1e6;
+
+  printf("RPL_Report: %u uplinks replayed (%u with a CRC error), %u records skipped, in %.3f s", RPL_NumReplayed,
+    RPL_NumCrcErrors, RPL_NumSkipped, Seconds);
+  if(Seconds > 0)
+  {
+    printf(", %.1f uplinks/s, %.1fx the capture", RPL_NumReplayed / Seconds, Captured / Seconds);
+  }
+  printf("\n");
+  printf("RPL_Report: received %u, CRC ok %u, datagrams sent %u, dropped: LORA RX FIFO %u, UDP TX FIFO %u\n",
+    NumRx, RxOk, MET_GetCounter(MET_UDP_TX_FRAMES), MET_GetCounter(MET_LORA_RX_DROPPED),
+    MET_GetCounter(MET_UDP_TX_DROPPED));
+}
+
+uint32_t RPL_GetNumReplayed( void )
+{
+  return RPL_NumReplayed;
+}
+
+uint32_t RPL_GetNumSkipped( void )
+{
+  return RPL_NumSkipped;
+}
+
+/**
+* __Function__: RPL_Open
+*
+* __Description__: Open the pcap file, check the file header and read the first uplink
+*
+* __Input__: void
+*
+* __Output__: Error code: 0 = no error, 1 = Cannot open the file, 2 = Not a LoRaTap pcap
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static int RPL_Open( void )
+{
+  uint8_t Header[24];
+  uint32_t Magic;
+
+  if((RPL_File = fopen(RPL_FileName, "rb")) == NULL)
+  {
+    printf("RPL_Open: Error opening: %s\n", RPL_FileName);
+    return 1;       /// Error 1: Cannot open the file
+  }
+  if(fread(Header, sizeof(Header), 1, RPL_File) != 1)
+  {
+    printf("RPL_Open: Error: %s is not a pcap file\n", RPL_FileName);
+    return 2;       /// Error 2: Not a LoRaTap pcap
+  }
+  memcpy(&Magic, Header, sizeof(Magic));
+  RPL_Swapped = Magic == __builtin_bswap32(RPL_PCAP_MAGIC_US) || Magic == __builtin_bswap32(RPL_PCAP_MAGIC_NS);
+  Magic = RPL_Get32(Header);
+  RPL_Nanos = Magic == RPL_PCAP_MAGIC_NS;
+  if(Magic != RPL_PCAP_MAGIC_US && Magic != RPL_PCAP_MAGIC_NS)
+  {
+    printf("RPL_Open: Error: %s is not a pcap file\n", RPL_FileName);
+    return 2;
+  }
+  if(RPL_Get32(Header + 20) != CAP_LINKTYPE_LORATAP)
+  {
+    printf("RPL_Open: Error: linktype of %s is %u, expected LoRaTap (%d)\n", RPL_FileName, RPL_Get32(Header + 20), CAP_LINKTYPE_LORATAP);
+    return 2;
+  }
+
+  RPL_NextValid = (RPL_ReadRecord() == 0);
+  if(!RPL_NextValid)
+  {
+    printf("RPL_Open: Warning: no uplinks in %s\n", RPL_FileName);
+  }
+  return 0;
+}
+
+/**
+* __Function__: RPL_ReadRecord
+*
+* __Description__: Read records until the next uplink, start the next loop at the end of the file
+*
+* __Input__: void
+*
+* __Output__: 0 = RPL_Next holds the next uplink, 1 = end of the file in the last loop
+*
+* __Status__: Completed
+*
+* __Remarks__: Downlinks, records that are not LoRaTap v1 and frames that do not fit are skipped. The frequency
+*              and SF of the LoRaTap header go with the uplink, an SF out of SF7-SF12 = the SF of the radio
+*/
+static int RPL_ReadRecord( void )
+{
+  uint8_t Header[16];
+  uint8_t Record[RPL_MAX_RECORD];
+  uint32_t Length;
+  int TapLength;
+  uint64_t Ts;
+
+  for(;;)
+  {
+    if(fread(Header, sizeof(Header), 1, RPL_File) != 1)
+    {
+      // End of the file, play it again after the last record
+      if(++RPL_Loop >= RPL_Loops || !RPL_Found)
+      {
+        return 1;
+      }
+      RPL_LoopOffset = RPL_LastTs;
+      fseek(RPL_File, 24, SEEK_SET);
+      continue;
+    }
+    Length = RPL_Get32(Header + 8);
+    if(Length > sizeof(Record))
+    {
+      fseek(RPL_File, Length, SEEK_CUR);
+      RPL_NumSkipped++;
+      continue;
+    }
+    if(fread(Record, Length, 1, RPL_File) != 1)
+    {
+      return 1;     // Truncated record, the capture was still being written
+    }
+    Ts = (uint64_t)RPL_Get32(Header) * 1000000 + RPL_Get32(Header + 4) / (RPL_Nanos ? 1000 : 1);
+    if(!RPL_HaveFirst)
+    {
+      RPL_FirstTs = Ts;
+      RPL_HaveFirst = 1;
+    }
+    RPL_LastTs = (Ts > RPL_FirstTs ? Ts - RPL_FirstTs : 0) + RPL_LoopOffset;
+
+    // LoRaTap v1, the header length is big endian
+    TapLength = Length >= 4 ? (Record[2] << 8) | Record[3] : 0;
+    if(Length < CAP_LORATAP_LENGTH || Record[0] != CAP_LORATAP_VERSION || TapLength < CAP_LORATAP_LENGTH || TapLength >= (int)Length
+      || (int)Length - TapLength > LORA_RX_MX_FRAME_SIZE || (Record[27] & (CAP_FLAG_IQ_INVERTED | CAP_FLAG_MOD_FSK)))
+    {
+      RPL_NumSkipped++;
+      continue;
+    }
+
+    RPL_Next.FrameSize = Length - TapLength;
+    memcpy(RPL_Next.Frame, Record + TapLength, RPL_Next.FrameSize);
+    RPL_Next.Rssi = Record[10] - 139;
+    RPL_Next.Snr = (int8_t)Record[13] / 4;
+    RPL_Next.CrcError = (Record[27] & CAP_FLAG_CRC_BAD) != 0;
+    // Only the radios on the frequency and SF of the capture hear it, as on the gateway it was captured on
+    RPL_Next.Freq = ((uint32_t)Record[4] << 24) | (Record[5] << 16) | (Record[6] << 8) | Record[7];
+    RPL_Next.SF = Record[9] >= SF7 && Record[9] <= SF12 ? Record[9] : 0;
+    RPL_NextTs = RPL_LastTs;
+    RPL_Found = 1;
+    return 0;
+  }
+}
+
+/**
+* Read a 32 bit field of the pcap headers, in the byte order of the file
+*/
+static uint32_t RPL_Get32( const uint8_t *Data )
+{
+  uint32_t Value;
+
+  memcpy(&Value, Data, sizeof(Value));
+  return RPL_Swapped ? __builtin_bswap32(Value) : Value;
+}
@@ -0,0 +1,34 @@
+/*******************************************************************************
+ * Replay Header file
+ *******************************************************************************/
+
+#ifndef _replay_h_
+#define _replay_h_
+
+#include <stdint.h>           // Required for unint8 etc
+#include "vradio.h"
+
+/**
+* Replay Public Functions and Procedures, to be called before HAL_Init
+*/
+int RPL_Configure( const char *Spec );               // key=value[,key=value...], see RPL_Configure in replay.c
+int RPL_Generate( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink );  // Generator for VR_SetGenerator
+
+/**
+* Replay Supporting Functions and Procedures
+*/
+int RPL_Done( void );                                // 1 = every record has been replayed
+void RPL_Report( uint32_t NumRx, uint32_t RxOk );   // Print throughput and where frames were dropped
+uint32_t RPL_GetNumReplayed( void );                 // Uplinks handed to the virtual radio
+uint32_t RPL_GetNumSkipped( void );                  // Downlinks and records that are not LoRa
+
+
+#define RPL_SPEED_MAX             0         // speed=max, no gaps between the uplinks
+#define RPL_DRAIN_US              1000000   // Time the pipeline gets after the last uplink before main stops
+
+#define RPL_PCAP_MAGIC_US         0xA1B2C3D4
+#define RPL_PCAP_MAGIC_NS         0xA1B23C4D
+#define RPL_MAX_RECORD            512       // Bytes of a record, LoRaTap header and frame
+
+
+#endif // _replay_h_
@@ -0,0 +1,187 @@
+/*******************************************************************************
+ * Single producer single consumer queue Header file
+ *
+ * Lock-free index pair of a bounded FIFO whose slots are an array owned by the
+ * caller, so the frames keep their own buffer structs and nothing is
+ * allocated. One thread may put frames in and one other thread may take them
+ * out without any lock: the producer only writes Head, the consumer only
+ * writes Tail, and each publishes its index with a release store after it is
+ * done with the slot. Head and Tail sit on cache lines of their own so that
+ * the two sides do not bounce one line between cores.
+ *
+ * Indices run from 0 to 2 * Depth - 1, so a full queue (Head - Tail == Depth)
+ * can be told from an empty one (Head == Tail) for any depth, not only powers
+ * of two.
+ *
+ * Producer:                                Consumer:
+ *   Slot = SPSC_WriteSlot(&Q, DEPTH);        Slot = SPSC_ReadSlot(&Q, DEPTH);
+ *   if(Slot >= 0) {                          if(Slot >= 0) {
+ *     fill Fifo[Slot]                          use Fifo[Slot]
+ *     SPSC_Publish(&Q, DEPTH);                 SPSC_Release(&Q, DEPTH);
+ *   }                                        }
+ *******************************************************************************/
+
+#ifndef _spsc_h_
+#define _spsc_h_
+
+#include <stdint.h>           // Required for unint8 etc
+
+#define SPSC_CACHE_LINE           64        // Bytes, Cortex-A53 / A72 and x86
+
+/**
+* Index pair of one queue, clear it with SPSC_Reset before use
+*/
+struct SPSC_STRUCT {
+  uint32_t  Head __attribute__((aligned(SPSC_CACHE_LINE)));   /**< Next slot to fill, written by the producer */
+  uint32_t  Tail __attribute__((aligned(SPSC_CACHE_LINE)));   /**< Next slot to take, written by the consumer */
+} __attribute__((aligned(SPSC_CACHE_LINE)));
+
+/**
+* __Function__: SPSC_Reset
+*
+* __Description__: Empty a queue
+*
+* __Input__: Queue
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Only while neither side is running
+*/
+static inline void SPSC_Reset( struct SPSC_STRUCT *Queue )
+{
+  __atomic_store_n(&Queue->Head, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&Queue->Tail, 0, __ATOMIC_RELAXED);
+}
+
+/**
+* Next value of an index, wraps at 2 * Depth
+*/
+static inline uint32_t SPSC_Next( uint32_t Index, int Depth )
+{
+  return (Index + 1 == (uint32_t)(2 * Depth)) ? 0 : Index + 1;
+}
+
+/**
+* Slot of the array an index points at
+*/
+static inline int SPSC_Slot( uint32_t Index, int Depth )
+{
+  return (Index < (uint32_t)Depth) ? Index : Index - Depth;
+}
+
+/**
+* __Function__: SPSC_Level
+*
+* __Description__: Number of frames in a queue
+*
+* __Input__: Queue, number of slots
+*
+* __Output__: 0 to Depth
+*
+* __Status__: Completed
+*
+* __Remarks__: Safe from any thread, a snapshot that may be out of date by the time it is used
+*/
+static inline int SPSC_Level( const struct SPSC_STRUCT *Queue, int Depth )
+{
+  uint32_t Head = __atomic_load_n(&Queue->Head, __ATOMIC_ACQUIRE);
+  uint32_t Tail = __atomic_load_n(&Queue->Tail, __ATOMIC_ACQUIRE);
+
+  return (Head >= Tail) ? Head - Tail : Head + 2 * Depth - Tail;
+}
+
+/**
+* __Function__: SPSC_WriteSlot
+*
+* __Description__: Get the slot the producer can fill next
+*
+* __Input__: Queue, number of slots
+*
+* __Output__: Slot index, -1 = queue full
+*
+* __Status__: Completed
+*
+* __Remarks__: Producer only, the frame is not visible to the consumer until SPSC_Publish
+*/
+static inline int SPSC_WriteSlot( struct SPSC_STRUCT *Queue, int Depth )
+{
+  uint32_t Head = __atomic_load_n(&Queue->Head, __ATOMIC_RELAXED);
+  uint32_t Tail = __atomic_load_n(&Queue->Tail, __ATOMIC_ACQUIRE);
+  uint32_t Used = (Head >= Tail) ? Head - Tail : Head + 2 * Depth - Tail;
+
+  if(Used >= (uint32_t)Depth)
+  {
+    return -1;
+  }
+  return SPSC_Slot(Head, Depth);
+}
+
+/**
+* __Function__: SPSC_Publish
+*
+* __Description__: Hand the slot filled after SPSC_WriteSlot to the consumer
+*
+* __Input__: Queue, number of slots
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Producer only
+*/
+static inline void SPSC_Publish( struct SPSC_STRUCT *Queue, int Depth )
+{
+  uint32_t Head = __atomic_load_n(&Queue->Head, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&Queue->Head, SPSC_Next(Head, Depth), __ATOMIC_RELEASE);
+}
+
+/**
+* __Function__: SPSC_ReadSlot
+*
+* __Description__: Get the oldest slot in the queue
+*
+* __Input__: Queue, number of slots
+*
+* __Output__: Slot index, -1 = queue empty
+*
+* __Status__: Completed
+*
+* __Remarks__: Consumer only, the slot stays valid until SPSC_Release
+*/
+static inline int SPSC_ReadSlot( struct SPSC_STRUCT *Queue, int Depth )
+{
+  uint32_t Tail = __atomic_load_n(&Queue->Tail, __ATOMIC_RELAXED);
+  uint32_t Head = __atomic_load_n(&Queue->Head, __ATOMIC_ACQUIRE);
+
+  if(Head == Tail)
+  {
+    return -1;
+  }
+  return SPSC_Slot(Tail, Depth);
+}
+
+/**
+* __Function__: SPSC_Release
+*
+* __Description__: Give the slot taken with SPSC_ReadSlot back to the producer
+*
+* __Input__: Queue, number of slots
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Consumer only
+*/
+static inline void SPSC_Release( struct SPSC_STRUCT *Queue, int Depth )
+{
+  uint32_t Tail = __atomic_load_n(&Queue->Tail, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&Queue->Tail, SPSC_Next(Tail, Depth), __ATOMIC_RELEASE);
+}
+
+
+#endif // _spsc_h_
@@ -0,0 +1,919 @@
+/*******************************************************************************
+ * SX127x emulator
+ *
+ * A register level model of the Semtech SX1272 / SX1276 behind the SPI / GPIO
+ * transport of the SX127x backend, see HAL_SpiEmulator. The real HAL code
+ * paths (setup, RX drain, TX load, re-arm) run against it without hardware.
+ *
+ * Modelled are REG_VERSION, reset, opmode transitions (the LoRa bit only
+ * changes in sleep, the FIFO is cleared in sleep), the FIFO and its pointers,
+ * IRQ flags and mask, and DIO0 and DIO1 following the DIO mapping, DIO1 only
+ * when the radio has it wired (dio1=). RxDone, TxDone and
+ * CadDone are raised once the modelled time on air has passed, from the
+ * modem configuration in the registers. A frame is only received on its own
+ * frequency and SF, when the chip was listening before the last
+ * EMU_LOCK_SYMBOLS of its preamble and kept listening to the end. CAD detects
+ * a preamble on its frequency and SF that overlaps the CAD by a symbol, RX
+ * single raises RxTimeout after the symbol timeout unless it locked on a
+ * frame. Uplinks have normal IQ, RX with InvertIQ set hears none of them.
+ * RegModemStat shows a frame the chip is locked on.
+ *
+ * Uplinks come from the virtual radio sources (VR_Poll) or EMU_InjectFrame,
+ * frames transmitted are recorded with VR_RecordDownlink, with the frequency,
+ * modem and power in the registers. There is one emulated chip, the HAL
+ * context the transport is called with is only handed on to VR_Poll.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include "hal.h"
+#include "os.h"
+#include "vradio.h"
+#include "sx127x_emu.h"
+
+int EMU_Init( struct HAL_CONTEXT_STRUCT *Hal );
+void EMU_Transfer( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *Buffer, int Length );
+int EMU_TransferBatch( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_XFER_STRUCT *Xfers, int Count );
+int EMU_ReadDIO0( struct HAL_CONTEXT_STRUCT *Hal );
+int EMU_ReadDIO1( struct HAL_CONTEXT_STRUCT *Hal );
+void EMU_WriteReset( struct HAL_CONTEXT_STRUCT *Hal, int Level );
+void EMU_Delay( unsigned int Millis );
+
+/**
+* The emulator transport
+*/
+const struct HAL_SPI_STRUCT HAL_SpiEmulator = {
+  "sx127x-emulator",
+  EMU_Init,
+  EMU_Transfer,
+  EMU_TransferBatch,
+  EMU_ReadDIO0,
+  EMU_ReadDIO1,
+  EMU_WriteReset,
+  EMU_Delay
+};
+
+/**
+* Bandwidth of the SX1276 per value of RegModemConfig1 bits 7-4, in Hz
+*/
+static const uint32_t EMU_Bandwidths[10] = {
+  7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000
+};
+
+// SX127x emulator Variables
+int EMU_Version = EMU_VERSION_SX1272;         // Chip being emulated
+uint8_t EMU_Reg[EMU_NUM_REGISTERS];           // Register file
+uint8_t EMU_Fifo[EMU_FIFO_SIZE];              // FIFO data buffer
+int EMU_InReset = 0;                          // 1 = reset pin asserted, the chip does not answer
+
+uint8_t EMU_RxAddr = 0;                       // Where the next frame received goes in the FIFO
+uint64_t EMU_RxStart = 0;                     // Time the chip started listening
+uint64_t EMU_TxEnd = 0;                       // Time TxDone is due
+uint64_t EMU_TxStart = 0;                     // Time TX was keyed
+uint64_t EMU_CadStart = 0;                    // Time the CAD was started
+uint64_t EMU_CadEnd = 0;                      // Time CadDone is due
+
+struct VR_FRAME_STRUCT EMU_OnAir;             // Frame on the air
+int EMU_OnAirValid = 0;                       // 1 = EMU_OnAir is being sent
+int EMU_OnAirSF = 0;                          // Its spreading factor
+uint64_t EMU_OnAirStart = 0;                  // Time the preamble of EMU_OnAir started
+uint64_t EMU_OnAirEnd = 0;                    // Time the last symbol of EMU_OnAir is sent
+
+uint32_t EMU_NumTransfers = 0;
+uint32_t EMU_NumReceived = 0;
+uint32_t EMU_NumMissed = 0;
+uint32_t EMU_NumTransmitted = 0;
+
+
+/**
+* __Function__: EMU_SetChip
+*
+* __Description__: Select the chip to emulate, to be called before HAL_Init
+*
+* __Input__: Version = EMU_VERSION_SX1272 or EMU_VERSION_SX1276
+*
+* __Output__: Error code: 0 = no error, 1 = Unknown chip
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+int EMU_SetChip( int Version )
+{
+  if(Version != EMU_VERSION_SX1272 && Version != EMU_VERSION_SX1276)
+  {
+    printf("EMU_SetChip: Unknown chip version: 0x%x\n", Version);
+    return 1;
+  }
+  EMU_Version = Version;
+  return 0;
+}
+
+/**
+* __Function__: EMU_Reset
+*
+* __Description__: Put the register file in its power on state
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: A frame on the air is not affected, but one being sent by the chip is aborted
+*/
+static void EMU_Reset( void )
+{
+  memset(EMU_Reg, 0, sizeof(EMU_Reg));
+  memset(EMU_Fifo, 0, sizeof(EMU_Fifo));
+
+  EMU_Reg[REG_OPMODE] = 0x01;                 // FSK, standby
+  EMU_Reg[REG_FRF_MSB] = 0x6C;
+  EMU_Reg[REG_FRF_MID] = 0x80;
+  EMU_Reg[REG_FRF_LSB] = 0x00;
+  EMU_Reg[REG_LNA] = 0x20;
+  EMU_Reg[REG_FIFO_TX_BASE_AD] = 0x80;
+  EMU_Reg[REG_MODEM_CONFIG] = (EMU_Version == EMU_VERSION_SX1272) ? 0x08 : 0x72;
+  EMU_Reg[REG_MODEM_CONFIG2] = 0x70;
+  EMU_Reg[REG_SYMB_TIMEOUT_LSB] = 0x64;
+  EMU_Reg[REG_PREAMBLE_LSB] = 0x08;
+  EMU_Reg[REG_PAYLOAD_LENGTH] = 0x01;
+  EMU_Reg[REG_MAX_PAYLOAD_LENGTH] = 0xFF;
+  EMU_Reg[REG_MODEM_CONFIG3] = 0x04;
+  EMU_Reg[REG_SYNC_WORD] = 0x12;
+  EMU_Reg[REG_INVERTIQ] = INVERTIQ_NORMAL;
+  EMU_Reg[REG_INVERTIQ2] = INVERTIQ2_NORMAL;
+  EMU_Reg[REG_PA_CONFIG] = (EMU_Version == EMU_VERSION_SX1272) ? 0x0F : 0x4F;   // RFO, 14 / 13.2 dBm
+  EMU_Reg[REG_OCP] = OCP_NORMAL;
+  EMU_Reg[REG_PA_DAC_SX1272] = PA_DAC_NORMAL;
+  EMU_Reg[REG_PA_DAC_SX1276] = PA_DAC_NORMAL;
+  EMU_Reg[REG_VERSION] = EMU_Version;
+  EMU_RxAddr = 0;
+}
+
+/**
+* __Function__: EMU_Init
+*
+* __Description__: Initialise the emulator and open the virtual radio sources for the uplinks
+*
+* __Input__: HAL context
+*
+* __Output__: Error code: 0 = no error, 1 = Error opening the source
+*
+* __Status__: Completed
+*
+* __Remarks__: Called by HAL_SX127x_Init
+*/
+int EMU_Init( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  EMU_Reset();
+  EMU_InReset = 0;
+  EMU_OnAirValid = 0;
+
+  if(VR_Open() != 0)
+  {
+    return 1;
+  }
+  printf("EMU_Init: Emulating an %s\n", (EMU_Version == EMU_VERSION_SX1272) ? "SX1272" : "SX1276");
+  return 0;
+}
+
+/**
+* Spreading factor in the registers
+*/
+static int EMU_RegSF( void )
+{
+  int SF = EMU_Reg[REG_MODEM_CONFIG2] >> 4;
+
+  return SF < 6 ? 6 : SF;
+}
+
+/**
+* Bandwidth in the registers in Hz
+*/
+static uint32_t EMU_Bandwidth( void )
+{
+  uint8_t Config1 = EMU_Reg[REG_MODEM_CONFIG];
+
+  if(EMU_Version == EMU_VERSION_SX1272)
+  {
+    return 125000 << ((Config1 >> 6) == 3 ? 2 : (Config1 >> 6));
+  }
+  return EMU_Bandwidths[(Config1 >> 4) > 9 ? 9 : (Config1 >> 4)];
+}
+
+/**
+* Length of a symbol of an SF at the bandwidth in the registers in micro seconds
+*/
+static uint64_t EMU_SymbolUs( int SF )
+{
+  return ((uint64_t)1000000 << SF) / EMU_Bandwidth();
+}
+
+/**
+* Preamble length in the registers in symbols
+*/
+static int EMU_Preamble( void )
+{
+  return (EMU_Reg[REG_PREAMBLE_MSB] << 8) | EMU_Reg[REG_PREAMBLE_LSB];
+}
+
+/**
+* __Function__: EMU_Airtime
+*
+* __Description__: Time on air of a frame with the modem configuration in the registers
+*
+* __Input__: Spreading factor, Size of the payload, Crc = 1 when the frame has a payload CRC
+*
+* __Output__: Time on air in micro seconds
+*
+* __Status__: Completed
+*
+* __Remarks__: The SF is the one of the frame, an uplink may be sent on another SF than the chip is set to
+*/
+static uint32_t EMU_Airtime( int SF, int PayloadSize, int Crc )
+{
+  uint8_t Config1 = EMU_Reg[REG_MODEM_CONFIG];
+  uint32_t Bandwidth = EMU_Bandwidth();
+  int CodingRate, ImplicitHeader, LowDataRate;
+
+  if(EMU_Version == EMU_VERSION_SX1272)
+  {
+    CodingRate = (Config1 >> 3) & 0x07;
+    ImplicitHeader = (Config1 >> 2) & 0x01;
+    LowDataRate = Config1 & 0x01;
+  }
+  else
+  {
+    CodingRate = (Config1 >> 1) & 0x07;
+    ImplicitHeader = Config1 & 0x01;
+    LowDataRate = (EMU_Reg[REG_MODEM_CONFIG3] >> 3) & 0x01;
+  }
+  if(CodingRate < 1 || CodingRate > 4)
+  {
+    CodingRate = 1;
+  }
+
+  return HAL_AirtimeUs(SF, Bandwidth, CodingRate, PayloadSize, EMU_Preamble(), Crc, ImplicitHeader, LowDataRate);
+}
+
+/**
+* __Function__: EMU_CrcOn
+*
+* __Description__: Check if the modem is configured to send a payload CRC
+*
+* __Input__: void
+*
+* __Output__: 1 = CRC on, 0 = CRC off
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static int EMU_CrcOn( void )
+{
+  if(EMU_Version == EMU_VERSION_SX1272)
+  {
+    return (EMU_Reg[REG_MODEM_CONFIG] >> 1) & 0x01;
+  }
+  return (EMU_Reg[REG_MODEM_CONFIG2] >> 2) & 0x01;
+}
+
+/**
+* __Function__: EMU_TxParams
+*
+* __Description__: Frequency, modem and output power in the registers, as a frame would go out with
+*
+* __Input__: Pointer to the parameters to fill
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Recorded with every downlink, so a run shows what the SX127x code really wrote. The
+*              frequency is the one of the FRF steps, within 61 Hz of the txpk freq
+*/
+static void EMU_TxParams( struct HAL_TX_PARAMS_STRUCT *Tx )
+{
+  uint32_t Frf = (EMU_Reg[REG_FRF_MSB] << 16) | (EMU_Reg[REG_FRF_MID] << 8) | EMU_Reg[REG_FRF_LSB];
+  uint32_t Bandwidth = EMU_Bandwidth();
+  uint8_t Config1 = EMU_Reg[REG_MODEM_CONFIG];
+  uint8_t PaConfig = EMU_Reg[REG_PA_CONFIG];
+  uint8_t PaDac = EMU_Reg[EMU_Version == EMU_VERSION_SX1272 ? REG_PA_DAC_SX1272 : REG_PA_DAC_SX1276];
+  int CodingRate = (EMU_Version == EMU_VERSION_SX1272) ? (Config1 >> 3) & 0x07 : (Config1 >> 1) & 0x07;
+
+  Tx->Freq = (uint32_t)(((uint64_t)Frf * 32000000 + (1 << 18)) >> 19);
+  Tx->SF = EMU_RegSF();
+  Tx->BW = Bandwidth >= 500000 ? HAL_BW_500 : Bandwidth >= 250000 ? HAL_BW_250 : HAL_BW_125;
+  Tx->CR = (CodingRate < 1 || CodingRate > 4) ? HAL_CR_4_5 : HAL_CR_4_5 + CodingRate - 1;
+  Tx->IQ = (EMU_Reg[REG_INVERTIQ] & 0x40) ? HAL_IQ_INVERTED : HAL_IQ_NORMAL;
+  if(PaConfig & 0x80)
+  {
+    // PA_BOOST: Pout = 2 + OutputPower, 5 + OutputPower with the high power DAC
+    Tx->Power = ((PaDac & 0x07) == 0x07 ? 5 : 2) + (PaConfig & 0x0F);
+  }
+  else if(EMU_Version == EMU_VERSION_SX1272)
+  {
+    // RFO: Pout = -1 + OutputPower
+    Tx->Power = (PaConfig & 0x0F) - 1;
+  }
+  else
+  {
+    // RFO: Pout = Pmax - (15 - OutputPower), Pmax = 10.8 + 0.6 * MaxPower
+    Tx->Power = (108 + 6 * ((PaConfig >> 4) & 0x07)) / 10 - 15 + (PaConfig & 0x0F);
+  }
+}
+
+/**
+* __Function__: EMU_SetIrq
+*
+* __Description__: Raise IRQ flags, unless masked
+*
+* __Input__: Flags = IRQ_*
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void EMU_SetIrq( uint8_t Flags )
+{
+  EMU_Reg[REG_IRQ_FLAGS] |= Flags & ~EMU_Reg[REG_IRQ_FLAGS_MASK];
+}
+
+static int EMU_Mode( void )
+{
+  return EMU_Reg[REG_OPMODE] & 0x07;
+}
+
+/**
+* Symbol timeout of RX single in the registers, RegModemConfig2 bits 1-0 and RegSymbTimeoutLsb
+*/
+static int EMU_SymbTimeout( void )
+{
+  return ((EMU_Reg[REG_MODEM_CONFIG2] & 0x03) << 8) | EMU_Reg[REG_SYMB_TIMEOUT_LSB];
+}
+
+static int EMU_Listening( void )
+{
+  return (EMU_Reg[REG_OPMODE] & 0x80) && (EMU_Mode() == (SX72_MODE_RX_CONTINUOS & 0x07) || EMU_Mode() == (SX72_MODE_RX_SINGLE & 0x07));
+}
+
+/**
+* __Function__: EMU_StartFrame
+*
+* __Description__: Put an uplink on the air
+*
+* __Input__: Pointer to the uplink, SF of an uplink without one, time the preamble starts
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Uplinks always carry a payload CRC
+*/
+static void EMU_StartFrame( const struct VR_FRAME_STRUCT *Uplink, int SF, uint64_t Now )
+{
+  EMU_OnAir = *Uplink;
+  EMU_OnAirValid = 1;
+  EMU_OnAirSF = Uplink->SF ? Uplink->SF : SF;
+  EMU_OnAirStart = Now;
+  EMU_OnAirEnd = Now + EMU_Airtime(EMU_OnAirSF, Uplink->FrameSize, 1);
+}
+
+/**
+* Chip is tuned to the frequency of the frame on the air, a frame without one is heard on any
+*/
+static int EMU_Tuned( void )
+{
+  uint64_t Frf = ((uint64_t)EMU_OnAir.Freq << 19) / 32000000;
+
+  return EMU_OnAir.Freq == 0 || (EMU_Reg[REG_FRF_MSB] == (uint8_t)(Frf >> 16) &&
+    EMU_Reg[REG_FRF_MID] == (uint8_t)(Frf >> 8) && EMU_Reg[REG_FRF_LSB] == (uint8_t)Frf);
+}
+
+/**
+* __Function__: EMU_Locks
+*
+* __Description__: Check if the chip locks on the frame on the air
+*
+* __Input__: void
+*
+* __Output__: 1 = listening on its frequency and SF, IQ not inverted, since before the last EMU_LOCK_SYMBOLS of its preamble
+*
+* __Status__: Completed
+*
+* __Remarks__: The chip must keep listening until the frame ends to receive it
+*/
+static int EMU_Locks( void )
+{
+  int Symbols = EMU_Preamble() > EMU_LOCK_SYMBOLS ? EMU_Preamble() - EMU_LOCK_SYMBOLS : 0;
+  uint64_t LockBy = EMU_OnAirStart + Symbols * EMU_SymbolUs(EMU_OnAirSF);
+
+  return EMU_OnAirValid && !EMU_InReset && EMU_Listening() && EMU_Tuned() && EMU_RegSF() == EMU_OnAirSF &&
+    !(EMU_Reg[REG_INVERTIQ] & 0x40) && EMU_RxStart <= LockBy;
+}
+
+/**
+* __Function__: EMU_CadDetects
+*
+* __Description__: Check if the CAD that ended detected a preamble
+*
+* __Input__: void
+*
+* __Output__: 1 = the preamble of the frame on the air is on the frequency and SF of the CAD and overlapped it by a symbol
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static int EMU_CadDetects( void )
+{
+  uint64_t Symbol = EMU_SymbolUs(EMU_OnAirSF);
+  uint64_t PreambleEnd = EMU_OnAirStart + EMU_Preamble() * Symbol;
+  uint64_t From = EMU_CadStart > EMU_OnAirStart ? EMU_CadStart : EMU_OnAirStart;
+  uint64_t To = EMU_CadEnd < PreambleEnd ? EMU_CadEnd : PreambleEnd;
+
+  return EMU_OnAirValid && EMU_Tuned() && EMU_RegSF() == EMU_OnAirSF && To >= From + Symbol;
+}
+
+/**
+* __Function__: EMU_ReceiveFrame
+*
+* __Description__: The last symbol of the frame on the air has been received, store it and raise RxDone
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Like the chip the frame is written from the FIFO RX pointer onwards, wrapping at the end of the FIFO
+*/
+static void EMU_ReceiveFrame( void )
+{
+  int Corr = (EMU_Version == EMU_VERSION_SX1272) ? 139 : 157;
+  int Rssi = EMU_OnAir.Rssi + Corr;
+  int i;
+
+  if(Rssi < 0)
+  {
+    Rssi = 0;
+  }
+  else if(Rssi > 255)
+  {
+    Rssi = 255;
+  }
+
+  EMU_Reg[REG_FIFO_RX_CURRENT_ADDR] = EMU_RxAddr;
+  EMU_Reg[REG_RX_NB_BYTES] = EMU_OnAir.FrameSize;
+  for(i = 0; i < EMU_OnAir.FrameSize; i++)
+  {
+    EMU_Fifo[EMU_RxAddr++] = EMU_OnAir.Frame[i];
+  }
+  EMU_Reg[REG_PKT_SNR_VALUE] = (uint8_t)(int8_t)(EMU_OnAir.Snr * 4);
+  EMU_Reg[REG_PKT_RSSI_VALUE] = Rssi;
+  EMU_Reg[REG_RSSI_VALUE] = Rssi;
+
+  EMU_SetIrq(IRQ_VALID_HEADER | IRQ_RX_DONE | (EMU_OnAir.CrcError ? IRQ_PAYLOAD_CRC_ERROR : 0));
+  EMU_NumReceived++;
+
+  if(EMU_Mode() == (SX72_MODE_RX_SINGLE & 0x07))
+  {
+    EMU_Reg[REG_OPMODE] = (EMU_Reg[REG_OPMODE] & ~0x07) | (SX72_MODE_STANDBY & 0x07);
+  }
+}
+
+/**
+* __Function__: EMU_Update
+*
+* __Description__: Raise the IRQs of everything that finished on the air by now
+*
+* __Input__: Now = current time in micro seconds (OS_GetMicros)
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Called on every access of the chip, the model is only as fast as it is polled
+*/
+static void EMU_Update( uint64_t Now )
+{
+  uint64_t Timeout;
+  int Size;
+  uint8_t Frame[EMU_FIFO_SIZE];
+  struct HAL_TX_PARAMS_STRUCT Tx;
+  uint8_t Addr;
+  int i;
+
+  if(EMU_Mode() == (SX72_MODE_TX & 0x07) && Now >= EMU_TxEnd)
+  {
+    Size = EMU_Reg[REG_PAYLOAD_LENGTH];
+    Addr = EMU_Reg[REG_FIFO_TX_BASE_AD];
+    for(i = 0; i < Size; i++)
+    {
+      Frame[i] = EMU_Fifo[Addr++];
+    }
+    EMU_TxParams(&Tx);
+    VR_RecordDownlink(Frame, Size, EMU_TxStart, &Tx);
+    EMU_NumTransmitted++;
+    EMU_SetIrq(IRQ_TX_DONE);
+    EMU_Reg[REG_OPMODE] = (EMU_Reg[REG_OPMODE] & ~0x07) | (SX72_MODE_STANDBY & 0x07);
+  }
+
+  if(EMU_Mode() == (SX72_MODE_CAD & 0x07) && Now >= EMU_CadEnd)
+  {
+    EMU_SetIrq(IRQ_CAD_DONE | (EMU_CadDetects() ? IRQ_CAD_DETECTED : 0));
+    EMU_Reg[REG_OPMODE] = (EMU_Reg[REG_OPMODE] & ~0x07) | (SX72_MODE_STANDBY & 0x07);
+  }
+
+  // RX single gives up after the symbol timeout, unless it locked on a frame by then
+  Timeout = EMU_RxStart + EMU_SymbTimeout() * EMU_SymbolUs(EMU_RegSF());
+  if(EMU_Mode() == (SX72_MODE_RX_SINGLE & 0x07) && Now >= Timeout && !(EMU_Locks() && EMU_OnAirStart <= Timeout))
+  {
+    EMU_SetIrq(IRQ_RX_TIMEOUT);
+    EMU_Reg[REG_OPMODE] = (EMU_Reg[REG_OPMODE] & ~0x07) | (SX72_MODE_STANDBY & 0x07);
+  }
+
+  if(EMU_OnAirValid && Now >= EMU_OnAirEnd)
+  {
+    // Only received when the chip caught the preamble and kept listening
+    if(EMU_Locks())
+    {
+      EMU_ReceiveFrame();
+    }
+    else
+    {
+      EMU_NumMissed++;
+    }
+    EMU_OnAirValid = 0;
+  }
+}
+
+/**
+* __Function__: EMU_WriteOpMode
+*
+* __Description__: Write RegOpMode and start what the new mode does
+*
+* __Input__: Value to write, Now = current time in micro seconds
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: The LoRa bit can only be changed in sleep mode
+*/
+static void EMU_WriteOpMode( uint8_t Value, uint64_t Now )
+{
+  int OldMode = EMU_Mode();
+  int NewMode = Value & 0x07;
+  int WasListening = EMU_Listening();
+
+  if(OldMode != (SX72_MODE_SLEEP & 0x07) && NewMode != (SX72_MODE_SLEEP & 0x07))
+  {
+    Value = (Value & ~0x80) | (EMU_Reg[REG_OPMODE] & 0x80);
+  }
+  EMU_Reg[REG_OPMODE] = Value;
+
+  if(!(Value & 0x80))
+  {
+    // FSK / OOK is not modelled
+    return;
+  }
+
+  if(NewMode == (SX72_MODE_SLEEP & 0x07))
+  {
+    memset(EMU_Fifo, 0, sizeof(EMU_Fifo));
+  }
+  else if(NewMode == (SX72_MODE_TX & 0x07) && OldMode != NewMode)
+  {
+    EMU_TxStart = Now;
+    EMU_TxEnd = Now + EMU_Airtime(EMU_RegSF(), EMU_Reg[REG_PAYLOAD_LENGTH], EMU_CrcOn());
+  }
+  else if(NewMode == (SX72_MODE_CAD & 0x07) && OldMode != NewMode)
+  {
+    EMU_CadStart = Now;
+    EMU_CadEnd = Now + EMU_CAD_SYMBOLS * EMU_SymbolUs(EMU_RegSF());
+  }
+
+  if(EMU_Listening() && !WasListening)
+  {
+    EMU_RxAddr = EMU_Reg[REG_FIFO_RX_BASE_AD];
+    EMU_RxStart = Now;
+  }
+}
+
+/**
+* __Function__: EMU_WriteRegister
+*
+* __Description__: Register write as seen by the chip
+*
+* __Input__: Register address, value, Now = current time in micro seconds
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+static void EMU_WriteRegister( uint8_t Addr, uint8_t Value, uint64_t Now )
+{
+  switch(Addr)
+  {
+    case REG_FIFO:
+      // No FIFO access in sleep mode
+      if(EMU_Mode() != (SX72_MODE_SLEEP & 0x07))
+      {
+        EMU_Fifo[EMU_Reg[REG_FIFO_ADDR_PTR]++] = Value;
+      }
+    break;
+
+    case REG_OPMODE:
+      EMU_WriteOpMode(Value, Now);
+    break;
+
+    case REG_IRQ_FLAGS:
+      // Write 1 to clear
+      EMU_Reg[REG_IRQ_FLAGS] &= ~Value;
+    break;
+
+    case REG_FIFO_RX_CURRENT_ADDR:
+    case REG_RX_NB_BYTES:
+    case REG_PKT_SNR_VALUE:
+    case REG_PKT_RSSI_VALUE:
+    case REG_RSSI_VALUE:
+    case REG_VERSION:
+      // Read only
+    break;
+
+    default:
+      EMU_Reg[Addr] = Value;
+    break;
+  }
+}
+
+/**
+* __Function__: EMU_ReadRegister
+*
+* __Description__: Register read as seen by the chip
+*
+* __Input__: Register address
+*
+* __Output__: Contents of the register
+*
+* __Status__: Completed
+*
+* __Remarks__: Reading REG_FIFO advances the FIFO address pointer
+*/
+static uint8_t EMU_ReadRegister( uint8_t Addr )
+{
+  if(Addr == REG_FIFO)
+  {
+    if(EMU_Mode() == (SX72_MODE_SLEEP & 0x07))
+    {
+      return 0;
+    }
+    return EMU_Fifo[EMU_Reg[REG_FIFO_ADDR_PTR]++];
+  }
+  if(Addr == REG_MODEM_STAT)
+  {
+    // Synchronised and receiving while locked on a frame, only detected when it came too late to lock
+    if(EMU_OnAirValid && EMU_Listening() && EMU_Tuned() && EMU_RegSF() == EMU_OnAirSF)
+    {
+      return EMU_Locks() ? MODEM_STAT_SIGNAL_DETECTED | MODEM_STAT_SIGNAL_SYNC | MODEM_STAT_RX_ONGOING : MODEM_STAT_SIGNAL_DETECTED;
+    }
+    return MODEM_STAT_CLEAR;
+  }
+  return EMU_Reg[Addr];
+}
+
+/**
+* __Function__: EMU_Transfer
+*
+* __Description__: One SPI transaction with the emulated chip
+*
+* __Input__: HAL context, buffer with the bytes to send, number of bytes
+*
+* __Output__: void, the bytes received overwrite Buffer
+*
+* __Status__: Completed
+*
+* __Remarks__: First byte is the address with bit 7 set for a write, the address increments after
+*              every byte (burst access) except for REG_FIFO
+*/
+void EMU_Transfer( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *Buffer, int Length )
+{
+  uint64_t Now = OS_GetMicros();
+  uint8_t Addr = Buffer[0] & 0x7F;
+  int Write = Buffer[0] & 0x80;
+  int i;
+
+  EMU_NumTransfers++;
+  EMU_Update(Now);
+
+  Buffer[0] = 0;
+  for(i = 1; i < Length; i++)
+  {
+    if(EMU_InReset)
+    {
+      Buffer[i] = 0;
+      continue;
+    }
+    if(Write)
+    {
+      EMU_WriteRegister(Addr, Buffer[i], Now);
+      Buffer[i] = 0;
+    }
+    else
+    {
+      Buffer[i] = EMU_ReadRegister(Addr);
+    }
+    if(Addr != REG_FIFO)
+    {
+      Addr = (Addr + 1) & 0x7F;
+    }
+  }
+}
+
+/**
+* __Function__: EMU_TransferBatch
+*
+* __Description__: SPI transactions with the emulated chip, one after the other
+*
+* __Input__: HAL context, the transactions, number of transactions
+*
+* __Output__: 1, the calls a transport with hardware chip select makes for them
+*
+* __Status__: Completed
+*
+* __Remarks__: Every transaction is one EMU_Transfer, the chip sees the same as without a batch
+*/
+int EMU_TransferBatch( struct HAL_CONTEXT_STRUCT *Hal, struct HAL_SPI_XFER_STRUCT *Xfers, int Count )
+{
+  int i;
+
+  for(i = 0; i < Count; i++)
+  {
+    EMU_Transfer(Hal, Xfers[i].Buffer, Xfers[i].Length);
+  }
+  return 1;
+}
+
+/**
+* __Function__: EMU_ReadDIO0
+*
+* __Description__: Level of DIO0, polls the uplink source for the next frame on the air first
+*
+* __Input__: HAL context
+*
+* __Output__: 1 = high, 0 = low
+*
+* __Status__: Completed
+*
+* __Remarks__: DIO0 mapping 00 = RxDone, 01 = TxDone, 10 = CadDone
+*/
+int EMU_ReadDIO0( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  uint64_t Now = OS_GetMicros();
+  struct VR_FRAME_STRUCT Uplink;
+  uint8_t Flags;
+
+  if(!EMU_OnAirValid && VR_Poll(Hal, &Uplink))
+  {
+    EMU_StartFrame(&Uplink, HAL_GetSF(Hal), Now);
+  }
+  EMU_Update(Now);
+
+  Flags = EMU_Reg[REG_IRQ_FLAGS];
+  switch(EMU_Reg[REG_DIO_MAPPING_1] >> 6)
+  {
+    case 0:
+      return (Flags & IRQ_RX_DONE) ? 1 : 0;
+    case 1:
+      return (Flags & IRQ_TX_DONE) ? 1 : 0;
+    case 2:
+      return (Flags & IRQ_CAD_DONE) ? 1 : 0;
+    default:
+      return 0;
+  }
+}
+
+/**
+* __Function__: EMU_ReadDIO1
+*
+* __Description__: Level of DIO1
+*
+* __Input__: HAL context
+*
+* __Output__: 1 = high, 0 = low, -1 = not wired, PinDio1 of the context < 0
+*
+* __Status__: Completed
+*
+* __Remarks__: DIO1 mapping 00 = RxTimeout, 01 = FhssChangeChannel, 10 = CadDetected
+*/
+int EMU_ReadDIO1( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  uint8_t Flags;
+
+  if(Hal->PinDio1 < 0)
+  {
+    return -1;
+  }
+  EMU_Update(OS_GetMicros());
+
+  Flags = EMU_Reg[REG_IRQ_FLAGS];
+  switch((EMU_Reg[REG_DIO_MAPPING_1] >> 4) & 0x3)
+  {
+    case 0:
+      return (Flags & IRQ_RX_TIMEOUT) ? 1 : 0;
+    case 1:
+      return (Flags & IRQ_FHSS_CHANGE_CHANNEL) ? 1 : 0;
+    case 2:
+      return (Flags & IRQ_CAD_DETECTED) ? 1 : 0;
+    default:
+      return 0;
+  }
+}
+
+/**
+* __Function__: EMU_WriteReset
+*
+* __Description__: Drive the reset pin of the emulated chip
+*
+* __Input__: HAL context, level of the pin
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: The SX1272 is held in reset with the pin high, the SX1276 with the pin low
+*/
+void EMU_WriteReset( struct HAL_CONTEXT_STRUCT *Hal, int Level )
+{
+  int Active = (EMU_Version == EMU_VERSION_SX1272) ? (Level != 0) : (Level == 0);
+
+  if(Active)
+  {
+    EMU_Reset();
+  }
+  EMU_InReset = Active;
+}
+
+void EMU_Delay( unsigned int Millis )
+{
+  OS_Delay(Millis);
+}
+
+/**
+* __Function__: EMU_InjectFrame
+*
+* __Description__: Start sending an uplink over the air now
+*
+* __Input__: Pointer to the uplink
+*
+* __Output__: Error code: 0 = no error, 1 = Another frame is on the air
+*
+* __Status__: Completed
+*
+* __Remarks__: RxDone follows after the time on air if the chip is listening
+*/
+int EMU_InjectFrame( const struct VR_FRAME_STRUCT *Uplink )
+{
+  uint64_t Now = OS_GetMicros();
+
+  EMU_Update(Now);
+  if(EMU_OnAirValid)
+  {
+    return 1;
+  }
+  EMU_StartFrame(Uplink, EMU_RegSF(), Now);
+  return 0;
+}
+
+uint8_t EMU_PeekRegister( uint8_t Addr )
+{
+  return EMU_Reg[Addr & 0x7F];
+}
+
+uint32_t EMU_GetNumTransfers( void )
+{
+  return EMU_NumTransfers;
+}
+
+uint32_t EMU_GetNumReceived( void )
+{
+  return EMU_NumReceived;
+}
+
+uint32_t EMU_GetNumMissed( void )
+{
+  return EMU_NumMissed;
+}
+
+uint32_t EMU_GetNumTransmitted( void )
+{
+  return EMU_NumTransmitted;
+}
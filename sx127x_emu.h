@@ -0,0 +1,36 @@
+/*******************************************************************************
+ * SX127x emulator Header file
+ *******************************************************************************/
+
+#ifndef _sx127x_emu_h_
+#define _sx127x_emu_h_
+
+#include <stdint.h>           // Required for unint8 etc
+#include "vradio.h"
+
+/**
+* SX127x emulator Public Functions and Procedures, to be called before HAL_Init
+*/
+int EMU_SetChip( int Version );                      // EMU_VERSION_SX1272 or EMU_VERSION_SX1276
+
+/**
+* SX127x emulator Supporting Functions and Procedures
+*/
+int EMU_InjectFrame( const struct VR_FRAME_STRUCT *Uplink );  // Start sending an uplink over the air now
+uint8_t EMU_PeekRegister( uint8_t Addr );            // Read a register without side effects
+uint32_t EMU_GetNumTransfers( void );                // SPI transactions seen by the chip
+uint32_t EMU_GetNumReceived( void );                 // Frames that ended in RxDone
+uint32_t EMU_GetNumMissed( void );                   // Frames on the air while the chip was not listening
+uint32_t EMU_GetNumTransmitted( void );              // Frames that ended in TxDone
+
+
+#define EMU_VERSION_SX1272          0x22    // REG_VERSION of the SX1272
+#define EMU_VERSION_SX1276          0x12    // REG_VERSION of the SX1276
+
+#define EMU_NUM_REGISTERS           0x80    // Register addresses are 7 bits
+#define EMU_FIFO_SIZE               256     // Bytes in the chip FIFO
+#define EMU_CAD_SYMBOLS             2       // CAD takes about two symbols
+#define EMU_LOCK_SYMBOLS            4       // RX must start this many symbols before the end of the preamble to lock on it
+
+
+#endif // _sx127x_emu_h_
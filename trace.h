@@ -0,0 +1,60 @@
+/*******************************************************************************
+ * Trace Header file
+ *
+ * Statically defined tracepoints (USDT) at the stage boundaries of the HAL,
+ * UDP and GW layers. When built with systemtap's sys/sdt.h every tracepoint is
+ * a single nop until a tracer attaches, e.g.:
+ *
+ *   bpftrace -l 'usdt:./single_chan_pkt_fwd:scpf:*'
+ *   bpftrace -e 'usdt:./single_chan_pkt_fwd:scpf:hal_rx { @len = hist(arg0); }'
+ *
+ * Without sys/sdt.h (apt install systemtap-sdt-dev) the tracepoints compile
+ * to nothing. All times are in micro seconds, see OS_GetMicros.
+ *******************************************************************************/
+
+#ifndef _trace_h_
+#define _trace_h_
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+// Frame drained from the radio: length, packet RSSI, SNR, DIO0 time, drained time
+#define TRACE_HAL_RX(Len, Rssi, Snr, Dio0Time, DrainedTime) \
+  DTRACE_PROBE5(scpf, hal_rx, Len, Rssi, Snr, Dio0Time, DrainedTime)
+// Frame with a CRC error: DIO0 time
+#define TRACE_HAL_RX_CRC(Dio0Time) \
+  DTRACE_PROBE1(scpf, hal_rx_crc, Dio0Time)
+// TX keyed: length, keyed time
+#define TRACE_HAL_TX_KEYED(Len, KeyedTime) \
+  DTRACE_PROBE2(scpf, hal_tx_keyed, Len, KeyedTime)
+// TxDone seen: length, keyed time, TxDone time
+#define TRACE_HAL_TX_DONE(Len, KeyedTime, DoneTime) \
+  DTRACE_PROBE3(scpf, hal_tx_done, Len, KeyedTime, DoneTime)
+// Datagram sent: length, packet type, token, time queued, sent time
+#define TRACE_UDP_TX(Len, Type, Token, QueuedTime, SentTime) \
+  DTRACE_PROBE5(scpf, udp_tx, Len, Type, Token, QueuedTime, SentTime)
+// Datagram received: length, packet type, token, received time
+#define TRACE_UDP_RX(Len, Type, Token, RxTime) \
+  DTRACE_PROBE4(scpf, udp_rx, Len, Type, Token, RxTime)
+// rxpk built: frame length, tmst, token, dequeue time, serialised time
+#define TRACE_GW_RX_LORA(Len, Tmst, Token, DequeueTime, SerialisedTime) \
+  DTRACE_PROBE5(scpf, gw_rx_lora, Len, Tmst, Token, DequeueTime, SerialisedTime)
+// Datagram processed by the gateway: packet type, token, length, time
+#define TRACE_GW_RX_UDP(Type, Token, Len, Time) \
+  DTRACE_PROBE4(scpf, gw_rx_udp, Type, Token, Len, Time)
+
+#else
+
+#define TRACE_HAL_RX(Len, Rssi, Snr, Dio0Time, DrainedTime)           do {} while(0)
+#define TRACE_HAL_RX_CRC(Dio0Time)                                    do {} while(0)
+#define TRACE_HAL_TX_KEYED(Len, KeyedTime)                            do {} while(0)
+#define TRACE_HAL_TX_DONE(Len, KeyedTime, DoneTime)                   do {} while(0)
+#define TRACE_UDP_TX(Len, Type, Token, QueuedTime, SentTime)          do {} while(0)
+#define TRACE_UDP_RX(Len, Type, Token, RxTime)                        do {} while(0)
+#define TRACE_GW_RX_LORA(Len, Tmst, Token, DequeueTime, SerialisedTime) do {} while(0)
+#define TRACE_GW_RX_UDP(Type, Token, Len, Time)                       do {} while(0)
+
+#endif // HAVE_SYS_SDT_H
+
+#endif // _trace_h_
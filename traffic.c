@@ -0,0 +1,676 @@
+/*******************************************************************************
+ * Traffic generator
+ *
+ * Generator for the virtual radio (VR_SetGenerator) that simulates a
+ * population of end devices in front of the gateway, so that capacity can be
+ * planned with load that looks like a real fleet:
+ *
+ *   single_chan_pkt_fwd -v traffic:devices=2000,interval=300,size=5-40
+ *
+ * - N devices with consecutive DevAddr and DevEUI, every device has its own
+ *   mean RSSI at the gateway and a frame counter
+ * - Poisson or periodic uplinks per device, FRMPayload size fixed, uniform or
+ *   normal, a share of them confirmed
+ * - join storms, a share of the devices sends a join request within a window
+ * - the air is modelled with the airtime of every frame at the configured
+ *   SF/BW/CR: the radio locks on the first frame, frames that start while it
+ *   is on the air are lost and destroy it unless it is stronger by the capture
+ *   margin (delivered with a CRC error), noise hits a frame with a probability
+ *   that grows with its airtime (CRC error), frames below the demodulation
+ *   floor of the SF are not received
+ * - with a list of frequencies every uplink goes out on one of them at random,
+ *   each frequency has air of its own, only the radio listening on it hears
+ *   the frame (struct VR_FRAME_STRUCT Freq)
+ * - with an SF range every device gets an SF from it, as ADR would, the
+ *   airtime and demodulation floor follow the SF of the frame. Frames of
+ *   another SF do not destroy the one the radio is locked on, but it cannot
+ *   receive them meanwhile. Only a radio on the SF, or scanning it, hears the
+ *   frame (struct VR_FRAME_STRUCT SF)
+ *
+ * The schedule only depends on the seed, so runs can be repeated.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include <math.h>             // Required for log, exp
+#include "hal.h"
+#include "gateway.h"          // Frame layout
+#include "os.h"
+#include "vradio.h"
+#include "traffic.h"
+
+/**
+* State of one end device
+*/
+struct TG_DEVICE_STRUCT {
+  uint32_t  DevAddr;
+  uint64_t  DevEUI;
+  uint16_t  FCnt;                             /**< Frame counter of the next data uplink */
+  uint16_t  DevNonce;                         /**< DevNonce of the next join request */
+  uint8_t   Joining;                          /**< 1 = next uplink is a join request */
+  uint8_t   SF;                               /**< Spreading factor of its uplinks */
+  int       Rssi;                             /**< Mean RSSI at the gateway in dBm */
+  uint64_t  NextStart;                        /**< Time the next uplink starts on the air */
+};
+
+// Traffic generator configuration, see TG_Configure
+int TG_NumDevices = 100;
+uint32_t TG_DevAddrBase = 0x26011000;
+uint64_t TG_DevEUIBase = 0x70B3D57ED0000000ULL;
+uint64_t TG_JoinEUI = 0x70B3D57ED0000000ULL;
+int TG_Schedule = TG_SCHEDULE_POISSON;
+double TG_IntervalUs = 60e6;              // Mean time between uplinks of one device
+int TG_SizeDist = TG_SIZE_FIXED;
+int TG_SizeA = 10;                        // Size, minimum or mean
+int TG_SizeB = 10;                        // Size, maximum or standard deviation
+int TG_ConfirmedPct = 0;
+int TG_FPort = 1;
+int TG_SF = 0;                            // 0 = the SF the gateway listens on
+int TG_SFMax = 0;                         // Above TG_SF = every device uses an SF from TG_SF to TG_SFMax
+int TG_SFGiven = 0;                       // 1 = the uplinks carry their SF, only radios on it hear them
+uint32_t TG_Bandwidth = 125000;
+int TG_CodingRate = 1;                    // 4/5
+double TG_StormAtUs = 0;
+int TG_StormPct = 0;                      // 0 = no join storm
+double TG_StormWindowUs = 10e6;
+double TG_NoiseRate = 0;                  // Noise bursts per second of airtime
+int TG_RssiMin = -115;
+int TG_RssiMax = -60;
+int TG_FadeDb = 3;                        // Per frame variation around the mean RSSI of the device
+int TG_CaptureDb = 6;                     // A frame survives an interferer this much weaker
+int TG_Air = 1;                           // 0 = no shared air, frames do not collide (many gateways)
+uint32_t TG_Freq[TG_MAX_CHANNELS];        // Frequencies in Hz, 0 = any radio
+int TG_NumChannels = 1;
+uint64_t TG_Seed = 1;
+
+// Traffic generator Variables
+struct TG_DEVICE_STRUCT TG_Devices[TG_MAX_DEVICES];
+int TG_Heap[TG_MAX_DEVICES];              // Device numbers, min-heap on NextStart
+int TG_Started = 0;
+int TG_StormDone = 0;
+uint64_t TG_StartTime = 0;
+uint64_t TG_Random = 1;                   // State of the random generator
+
+struct VR_FRAME_STRUCT TG_OnAir[TG_MAX_CHANNELS];   // Per frequency the frame a radio is locked on
+int TG_OnAirValid[TG_MAX_CHANNELS];
+int TG_OnAirCollided[TG_MAX_CHANNELS];    // 1 = destroyed by an interferer
+uint64_t TG_OnAirEnd[TG_MAX_CHANNELS];    // Time it ends on the air
+
+uint32_t TG_NumGenerated = 0;
+uint32_t TG_NumJoinRequests = 0;
+uint32_t TG_NumCollided = 0;
+uint32_t TG_NumCrcErrors = 0;
+uint32_t TG_NumBelowSensitivity = 0;
+
+/**
+* Random generator, xorshift64*, repeatable for a given seed
+*/
+static uint64_t TG_Rand( void )
+{
+  TG_Random ^= TG_Random >> 12;
+  TG_Random ^= TG_Random << 25;
+  TG_Random ^= TG_Random >> 27;
+  return TG_Random * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in [0, 1)
+static double TG_Uniform( void )
+{
+  return (TG_Rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Uniform in Min..Max
+static int TG_Between( int Min, int Max )
+{
+  return Min + (int)(TG_Uniform() * (Max - Min + 1));
+}
+
+/**
+* __Function__: TG_Configure
+*
+* __Description__: Configure the device population from a comma separated list of key=value
+*
+* __Input__: Spec, the keys are:
+*            devices=N          number of devices, default 100
+*            devaddr=HEX        DevAddr of the first device, default 26011000
+*            deveui=HEX         DevEUI of the first device, default 70B3D57ED0000000
+*            joineui=HEX        JoinEUI in the join requests, default 70B3D57ED0000000
+*            schedule=S         poisson or periodic, default poisson
+*            interval=SEC       mean time between uplinks of one device, default 60
+*            size=N | MIN-MAX | MEAN/SD   FRMPayload size, fixed, uniform or normal, default 10
+*            confirmed=PCT      share of confirmed uplinks, default 0
+*            fport=N            FPort of the data uplinks, default 1
+*            sf=N bw=KHZ cr=N   modulation for the airtime, default the gateway SF, 125, 1 (4/5). With sf the
+*                               uplinks are only heard by radios on the SF
+*            sf=MIN-MAX         every device uses an SF from MIN to MAX, uniform
+*            joinstorm=AT:PCT:WINDOW   PCT % of the devices join within WINDOW s from AT s after the start
+*            noise=R            noise bursts per second that destroy the frame on the air, default 0
+*            rssi=MIN:MAX       range of the mean RSSI of the devices, default -115:-60
+*            fade=DB            per frame RSSI variation, default 3
+*            capture=DB         capture margin, default 6
+*            air=0|1            0 = frames do not collide, e.g. when they go to many gateways, default 1
+*            freq=MHZ[:MHZ...]  frequencies the uplinks are sent on at random, up to TG_MAX_CHANNELS,
+*                               default any, every radio hears every uplink
+*            seed=N             seed of the random generator, default 1
+*
+* __Output__: Error code: 0 = no error, 1 = Unknown key or invalid value
+*
+* __Status__: Completed
+*
+* __Remarks__: Select the generator with VR_SetGenerator(TG_Generate)
+*/
+int TG_Configure( const char *Spec )
+{
+  char Buffer[512];
+  char *Token, *Save, *Value;
+  char *Channel, *SaveChannel;
+  double At, Window;
+  int a, b, Pct;
+  int Error;
+
+  snprintf(Buffer, sizeof(Buffer), "%s", Spec);
+  for(Token = strtok_r(Buffer, ",", &Save); Token != NULL; Token = strtok_r(NULL, ",", &Save))
+  {
+    if((Value = strchr(Token, '=')) == NULL)
+    {
+      printf("TG_Configure: Expected key=value: %s\n", Token);
+      return 1;
+    }
+    *Value++ = 0;
+    Error = 0;
+
+    if(strcmp(Token, "devices") == 0)
+    {
+      TG_NumDevices = atoi(Value);
+      Error = TG_NumDevices < 1 || TG_NumDevices > TG_MAX_DEVICES;
+    }
+    else if(strcmp(Token, "devaddr") == 0)
+    {
+      TG_DevAddrBase = strtoul(Value, NULL, 16);
+    }
+    else if(strcmp(Token, "deveui") == 0)
+    {
+      TG_DevEUIBase = strtoull(Value, NULL, 16);
+    }
+    else if(strcmp(Token, "joineui") == 0)
+    {
+      TG_JoinEUI = strtoull(Value, NULL, 16);
+    }
+    else if(strcmp(Token, "schedule") == 0)
+    {
+      TG_Schedule = strcmp(Value, "periodic") == 0 ? TG_SCHEDULE_PERIODIC : TG_SCHEDULE_POISSON;
+      Error = TG_Schedule == TG_SCHEDULE_POISSON && strcmp(Value, "poisson") != 0;
+    }
+    else if(strcmp(Token, "interval") == 0)
+    {
+      TG_IntervalUs = atof(Value) * 1e6;
+      Error = TG_IntervalUs < 1000;
+    }
+    else if(strcmp(Token, "size") == 0)
+    {
+      if(sscanf(Value, "%d-%d", &a, &b) == 2)
+      {
+        TG_SizeDist = TG_SIZE_UNIFORM;
+      }
+      else if(sscanf(Value, "%d/%d", &a, &b) == 2)
+      {
+        TG_SizeDist = TG_SIZE_NORMAL;
+      }
+      else
+      {
+        TG_SizeDist = TG_SIZE_FIXED;
+        a = b = atoi(Value);
+      }
+      TG_SizeA = a;
+      TG_SizeB = b;
+      Error = a < 0 || a > TG_MAX_PAYLOAD || b < 0 || (TG_SizeDist == TG_SIZE_UNIFORM && (b < a || b > TG_MAX_PAYLOAD));
+    }
+    else if(strcmp(Token, "confirmed") == 0)
+    {
+      TG_ConfirmedPct = atoi(Value);
+      Error = TG_ConfirmedPct < 0 || TG_ConfirmedPct > 100;
+    }
+    else if(strcmp(Token, "fport") == 0)
+    {
+      TG_FPort = atoi(Value);
+      Error = TG_FPort < 1 || TG_FPort > 223;
+    }
+    else if(strcmp(Token, "sf") == 0)
+    {
+      TG_SFMax = 0;
+      Error = sscanf(Value, "%d-%d", &TG_SF, &TG_SFMax) < 1;
+      Error |= TG_SF < SF7 || TG_SF > SF12 || (TG_SFMax != 0 && (TG_SFMax <= TG_SF || TG_SFMax > SF12));
+      TG_SFGiven = 1;
+    }
+    else if(strcmp(Token, "bw") == 0)
+    {
+      TG_Bandwidth = atoi(Value) * 1000;
+      Error = TG_Bandwidth != 125000 && TG_Bandwidth != 250000 && TG_Bandwidth != 500000;
+    }
+    else if(strcmp(Token, "cr") == 0)
+    {
+      TG_CodingRate = atoi(Value);
+      Error = TG_CodingRate < 1 || TG_CodingRate > 4;
+    }
+    else if(strcmp(Token, "joinstorm") == 0)
+    {
+      Error = sscanf(Value, "%lf:%d:%lf", &At, &Pct, &Window) != 3 || At < 0 || Pct < 0 || Pct > 100 || Window < 0;
+      TG_StormAtUs = At * 1e6;
+      TG_StormPct = Pct;
+      TG_StormWindowUs = Window * 1e6;
+    }
+    else if(strcmp(Token, "noise") == 0)
+    {
+      TG_NoiseRate = atof(Value);
+      Error = TG_NoiseRate < 0;
+    }
+    else if(strcmp(Token, "rssi") == 0)
+    {
+      Error = sscanf(Value, "%d:%d", &TG_RssiMin, &TG_RssiMax) != 2 || TG_RssiMax < TG_RssiMin;
+    }
+    else if(strcmp(Token, "fade") == 0)
+    {
+      TG_FadeDb = atoi(Value);
+      Error = TG_FadeDb < 0;
+    }
+    else if(strcmp(Token, "capture") == 0)
+    {
+      TG_CaptureDb = atoi(Value);
+    }
+    else if(strcmp(Token, "air") == 0)
+    {
+      TG_Air = atoi(Value);
+      Error = TG_Air != 0 && TG_Air != 1;
+    }
+    else if(strcmp(Token, "seed") == 0)
+    {
+      TG_Seed = strtoull(Value, NULL, 0);
+    }
+    else if(strcmp(Token, "freq") == 0)
+    {
+      for(TG_NumChannels = 0, Channel = strtok_r(Value, ":", &SaveChannel); Channel != NULL && TG_NumChannels < TG_MAX_CHANNELS;
+          Channel = strtok_r(NULL, ":", &SaveChannel))
+      {
+        TG_Freq[TG_NumChannels++] = (uint32_t)(atof(Channel) * 1000000 + 0.5);
+        Error |= TG_Freq[TG_NumChannels - 1] == 0;
+      }
+      Error |= TG_NumChannels == 0 || Channel != NULL;
+    }
+    else
+    {
+      printf("TG_Configure: Unknown key: %s\n", Token);
+      return 1;
+    }
+
+    if(Error)
+    {
+      printf("TG_Configure: Invalid value for %s: %s\n", Token, Value);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+* Min-heap of the devices on the time their next uplink starts
+*/
+static void TG_HeapDown( int i, int Size )
+{
+  int Child, Tmp;
+
+  while((Child = 2 * i + 1) < Size)
+  {
+    if(Child + 1 < Size && TG_Devices[TG_Heap[Child + 1]].NextStart < TG_Devices[TG_Heap[Child]].NextStart)
+    {
+      Child++;
+    }
+    if(TG_Devices[TG_Heap[i]].NextStart <= TG_Devices[TG_Heap[Child]].NextStart)
+    {
+      break;
+    }
+    Tmp = TG_Heap[i];
+    TG_Heap[i] = TG_Heap[Child];
+    TG_Heap[Child] = Tmp;
+    i = Child;
+  }
+}
+
+static void TG_HeapBuild( void )
+{
+  int i;
+
+  for(i = TG_NumDevices / 2 - 1; i >= 0; i--)
+  {
+    TG_HeapDown(i, TG_NumDevices);
+  }
+}
+
+// Time from one uplink of a device to the next
+static uint64_t TG_NextInterval( void )
+{
+  if(TG_Schedule == TG_SCHEDULE_PERIODIC)
+  {
+    return (uint64_t)TG_IntervalUs;
+  }
+  return (uint64_t)(-TG_IntervalUs * log(1.0 - TG_Uniform()));
+}
+
+static int TG_PayloadSize( void )
+{
+  double Size;
+
+  switch(TG_SizeDist)
+  {
+    case TG_SIZE_UNIFORM:
+      return TG_Between(TG_SizeA, TG_SizeB);
+
+    case TG_SIZE_NORMAL:
+      // Box-Muller
+      Size = TG_SizeA + TG_SizeB * sqrt(-2.0 * log(1.0 - TG_Uniform())) * cos(2 * M_PI * TG_Uniform());
+      return Size < 0 ? 0 : (Size > TG_MAX_PAYLOAD ? TG_MAX_PAYLOAD : (int)(Size + 0.5));
+
+    default:
+      return TG_SizeA;
+  }
+}
+
+/**
+* __Function__: TG_Start
+*
+* __Description__: Create the device population and schedule the first uplink of every device
+*
+* __Input__: HAL context of the radio, NULL = HAL_DEFAULT_SF, time of the first poll
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: Called on the first poll, by then HAL_Init has set the SF the radio listens on
+*/
+static void TG_Start( struct HAL_CONTEXT_STRUCT *Hal, uint64_t Now )
+{
+  char Range[8] = "";
+  int i;
+
+  TG_Random = TG_Seed ? TG_Seed : 1;
+  TG_StartTime = Now;
+  if(TG_SF == 0)
+  {
+    TG_SF = (Hal != NULL) ? HAL_GetSF(Hal) : HAL_DEFAULT_SF;
+  }
+
+  for(i = 0; i < TG_NumDevices; i++)
+  {
+    TG_Devices[i].DevAddr = TG_DevAddrBase + i;
+    TG_Devices[i].DevEUI = TG_DevEUIBase + i;
+    TG_Devices[i].FCnt = 0;
+    TG_Devices[i].DevNonce = 0;
+    TG_Devices[i].Joining = 0;
+    TG_Devices[i].Rssi = TG_Between(TG_RssiMin, TG_RssiMax);
+    TG_Devices[i].SF = TG_SFMax ? TG_Between(TG_SF, TG_SFMax) : TG_SF;
+    // Periodic devices start at a random phase
+    TG_Devices[i].NextStart = Now + (TG_Schedule == TG_SCHEDULE_PERIODIC ? (uint64_t)(TG_Uniform() * TG_IntervalUs) : TG_NextInterval());
+    TG_Heap[i] = i;
+  }
+  TG_HeapBuild();
+  TG_Started = 1;
+  if(TG_SFMax)
+  {
+    snprintf(Range, sizeof(Range), "-%d", TG_SFMax);
+  }
+
+  printf("TG_Start: %d devices, %s uplinks every %.1f s, %.2f uplinks/s offered, SF%d%s BW%u\n", TG_NumDevices,
+    TG_Schedule == TG_SCHEDULE_PERIODIC ? "periodic" : "poisson", TG_IntervalUs / 1e6, TG_NumDevices * 1e6 / TG_IntervalUs,
+    TG_SF, Range, TG_Bandwidth / 1000);
+}
+
+/**
+* __Function__: TG_JoinStorm
+*
+* __Description__: Let TG_StormPct % of the devices send a join request within the storm window
+*
+* __Input__: void
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: As after a power cut, the devices go back to their schedule after the join
+*/
+static void TG_JoinStorm( void )
+{
+  uint64_t Start = TG_StartTime + (uint64_t)TG_StormAtUs;
+  int i, Joining = 0;
+
+  for(i = 0; i < TG_NumDevices; i++)
+  {
+    if(TG_Between(1, 100) <= TG_StormPct)
+    {
+      TG_Devices[i].Joining = 1;
+      TG_Devices[i].NextStart = Start + (uint64_t)(TG_Uniform() * TG_StormWindowUs);
+      Joining++;
+    }
+  }
+  TG_HeapBuild();
+  TG_StormDone = 1;
+  printf("TG_JoinStorm: %d devices join within %.1f s\n", Joining, TG_StormWindowUs / 1e6);
+}
+
+/**
+* __Function__: TG_NextFrame
+*
+* __Description__: Compose the next uplink of a device and reschedule the device
+*
+* __Input__: Device number, frame to fill, channel the frame is sent on
+*
+* __Output__: Airtime of the frame in micro seconds
+*
+* __Status__: Completed
+*
+* __Remarks__: Dev must be at the top of the heap. The MIC is random, the gateway does not check it
+*/
+static uint32_t TG_NextFrame( int Dev, struct VR_FRAME_STRUCT *Frame, int *Channel )
+{
+  struct TG_DEVICE_STRUCT *Device = &TG_Devices[Dev];
+  uint8_t *p = Frame->Frame;
+  int NoiseFloor, Size, i;
+
+  if(Device->Joining)
+  {
+    p[OFF_JR_HDR] = MHDR_JOIN_REQUEST;
+    for(i = 0; i < 8; i++)
+    {
+      p[OFF_JR_JOINEUI + i] = (uint8_t)(TG_JoinEUI >> (8 * i));
+      p[OFF_JR_DEVEUI + i] = (uint8_t)(Device->DevEUI >> (8 * i));
+    }
+    p[OFF_JR_DEVNONCE] = (uint8_t)Device->DevNonce;
+    p[OFF_JR_DEVNONCE + 1] = (uint8_t)(Device->DevNonce >> 8);
+    Frame->FrameSize = LEN_JR;
+    Device->DevNonce++;
+    Device->FCnt = 0;
+    Device->Joining = 0;
+    TG_NumJoinRequests++;
+  }
+  else
+  {
+    p[OFF_DAT_HDR] = TG_Between(1, 100) <= TG_ConfirmedPct ? MHDR_CONFIRMED_UP : MHDR_UNCONFIRMED_UP;
+    for(i = 0; i < 4; i++)
+    {
+      p[OFF_DAT_ADDR + i] = (uint8_t)(Device->DevAddr >> (8 * i));
+    }
+    p[OFF_DAT_FCT] = 0;
+    p[OFF_DAT_SEQNO] = (uint8_t)Device->FCnt;
+    p[OFF_DAT_SEQNO + 1] = (uint8_t)(Device->FCnt >> 8);
+    Frame->FrameSize = OFF_DAT_OPTS;
+    if((Size = TG_PayloadSize()) > 0)
+    {
+      p[OFF_DAT_OPTS] = TG_FPort;
+      for(i = 0; i < Size; i++)
+      {
+        p[OFF_DAT_PAYLOAD + i] = (uint8_t)TG_Rand();
+      }
+      Frame->FrameSize = OFF_DAT_PAYLOAD + Size;
+    }
+    Frame->FrameSize += TG_MIC_SIZE;
+    Device->FCnt++;
+  }
+  for(i = Frame->FrameSize - TG_MIC_SIZE; i < Frame->FrameSize; i++)
+  {
+    p[i] = (uint8_t)TG_Rand();
+  }
+
+  // Signal at the gateway, thermal noise + noise figure over the bandwidth
+  NoiseFloor = (int)(-174 + 10 * log10((double)TG_Bandwidth) + TG_NOISE_FIGURE);
+  Frame->Rssi = Device->Rssi + TG_Between(-TG_FadeDb, TG_FadeDb);
+  Frame->Snr = Frame->Rssi - NoiseFloor;
+  Frame->CrcError = 0;
+  // Random channel, like a LoRaWAN device, one channel draws nothing so the schedule stays the same
+  *Channel = TG_NumChannels > 1 ? (int)(TG_Rand() % TG_NumChannels) : 0;
+  Frame->Freq = TG_Freq[*Channel];
+  Frame->SF = Device->SF;
+  TG_NumGenerated++;
+
+  // Next uplink of the device, from this one so the schedule does not depend on the polling
+  Device->NextStart += TG_NextInterval();
+  TG_HeapDown(0, TG_NumDevices);
+
+  return HAL_AirtimeUs(Frame->SF, TG_Bandwidth, TG_CodingRate, Frame->FrameSize, TG_PREAMBLE_LENGTH, 1, 0,
+    TG_Bandwidth == 125000 && Frame->SF >= SF11);
+}
+
+// Lowest SNR that the SF can demodulate: -7.5 dB at SF7 down to -20 dB at SF12
+static int TG_Demodulates( long int Snr, int SF )
+{
+  return Snr * 2 >= -5 * (SF - 4);
+}
+
+/**
+* __Function__: TG_Generate
+*
+* __Description__: Generator for the virtual radio, returns the uplinks of the population as they end on the air
+*
+* __Input__: HAL context of the radio that polls, NULL = none, pointer to the uplink to fill
+*
+* __Output__: 1 = Uplink filled, 0 = nothing due
+*
+* __Status__: Completed
+*
+* __Remarks__: Every uplink that started up to now is put on the air in order of its start time, the uplinks that
+*              ended are returned in order of their end time
+*/
+int TG_Generate( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink )
+{
+  struct VR_FRAME_STRUCT Frame;
+  uint64_t Now = OS_GetMicros();
+  uint64_t Start;
+  uint32_t Airtime;
+  int Channel, First, c;
+
+  if(!TG_Started)
+  {
+    TG_Start(Hal, Now);
+  }
+  if(TG_StormPct && !TG_StormDone && Now >= TG_StartTime + (uint64_t)TG_StormAtUs)
+  {
+    TG_JoinStorm();
+  }
+
+  for(;;)
+  {
+    Start = TG_Devices[TG_Heap[0]].NextStart;
+
+    // The frame that ends first is received once it is off the air, unless the next uplink starts before
+    First = -1;
+    for(c = 0; c < TG_NumChannels; c++)
+    {
+      if(TG_OnAirValid[c] && (First < 0 || TG_OnAirEnd[c] < TG_OnAirEnd[First]))
+      {
+        First = c;
+      }
+    }
+    if(First >= 0 && TG_OnAirEnd[First] <= Now && TG_OnAirEnd[First] <= Start)
+    {
+      *Uplink = TG_OnAir[First];
+      if(Uplink->Snr > TG_SNR_MAX)
+      {
+        Uplink->Snr = TG_SNR_MAX;
+      }
+      // Without sf in the spec the uplinks are on the SF of whichever radio hears them
+      if(!TG_SFGiven)
+      {
+        Uplink->SF = 0;
+      }
+      TG_OnAirValid[First] = 0;
+      return 1;
+    }
+
+    if(Start > Now)
+    {
+      return 0;
+    }
+    Airtime = TG_NextFrame(TG_Heap[0], &Frame, &Channel);
+    if(!TG_Demodulates(Frame.Snr, Frame.SF))
+    {
+      TG_NumBelowSensitivity++;
+      continue;
+    }
+
+    // The radio on the channel is locked on a frame, everything that starts before it ends is lost, on the same SF
+    // it interferes
+    if(TG_OnAirValid[Channel])
+    {
+      TG_NumCollided++;
+      if(TG_OnAir[Channel].SF == Frame.SF && TG_OnAir[Channel].Rssi - Frame.Rssi < TG_CaptureDb && !TG_OnAirCollided[Channel])
+      {
+        TG_OnAir[Channel].CrcError = 1;
+        TG_OnAirCollided[Channel] = 1;
+        TG_NumCollided++;
+      }
+      continue;
+    }
+
+    // Chance of a noise burst during the frame
+    if(TG_NoiseRate > 0 && TG_Uniform() < 1.0 - exp(-TG_NoiseRate * Airtime / 1e6))
+    {
+      Frame.CrcError = 1;
+      TG_NumCrcErrors++;
+    }
+    TG_OnAir[Channel] = Frame;
+    TG_OnAirEnd[Channel] = Start + Airtime;
+    TG_OnAirCollided[Channel] = 0;
+    TG_OnAirValid[Channel] = 1;
+    // Without shared air the frame is received at once, whatever else is on the air
+    if(!TG_Air)
+    {
+      TG_OnAirEnd[Channel] = Start;
+    }
+  }
+}
+
+uint32_t TG_GetNumGenerated( void )
+{
+  return TG_NumGenerated;
+}
+
+uint32_t TG_GetNumJoinRequests( void )
+{
+  return TG_NumJoinRequests;
+}
+
+uint32_t TG_GetNumCollided( void )
+{
+  return TG_NumCollided;
+}
+
+uint32_t TG_GetNumCrcErrors( void )
+{
+  return TG_NumCrcErrors;
+}
+
+uint32_t TG_GetNumBelowSensitivity( void )
+{
+  return TG_NumBelowSensitivity;
+}
@@ -0,0 +1,53 @@
+/*******************************************************************************
+ * Traffic generator Header file
+ *******************************************************************************/
+
+#ifndef _traffic_h_
+#define _traffic_h_
+
+#include <stdint.h>           // Required for unint8 etc
+#include "vradio.h"
+
+/**
+* Traffic generator Public Functions and Procedures, to be called before HAL_Init
+*/
+int TG_Configure( const char *Spec );                // key=value[,key=value...], see TG_Configure in traffic.c
+int TG_Generate( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink );   // Generator for VR_SetGenerator
+
+/**
+* Traffic generator Supporting Functions and Procedures
+*/
+uint32_t TG_GetNumGenerated( void );                 // Frames put on the air
+uint32_t TG_GetNumJoinRequests( void );              // Of which join requests
+uint32_t TG_GetNumCollided( void );                  // Frames destroyed by an overlapping frame
+uint32_t TG_GetNumCrcErrors( void );                 // Frames hit by noise, delivered with a CRC error
+uint32_t TG_GetNumBelowSensitivity( void );          // Frames too weak to demodulate
+
+
+/**
+* Uplink schedule of every device
+*/
+enum tg_schedule_t {
+  TG_SCHEDULE_POISSON = 0,    // Exponential time between uplinks, mean = interval
+  TG_SCHEDULE_PERIODIC        // Fixed interval, random phase per device
+};
+
+/**
+* Distribution of the FRMPayload size
+*/
+enum tg_size_t {
+  TG_SIZE_FIXED = 0,          // size=N
+  TG_SIZE_UNIFORM,            // size=MIN-MAX
+  TG_SIZE_NORMAL              // size=MEAN/SD, clipped to 0..TG_MAX_PAYLOAD
+};
+
+#define TG_MAX_DEVICES            16384     // Devices in the population
+#define TG_MAX_CHANNELS           8         // Frequencies the devices hop over
+#define TG_MAX_PAYLOAD            242       // FRMPayload that fits a 255 byte PHYPayload
+#define TG_MIC_SIZE               4
+#define TG_PREAMBLE_LENGTH        8         // Symbols, LoRaWAN uplinks
+#define TG_NOISE_FIGURE           6         // dB, receiver noise figure for the SNR
+#define TG_SNR_MAX                10        // dB, the SX127x does not report higher
+
+
+#endif // _traffic_h_
@@ -14,8 +14,6 @@
  *
  *******************************************************************************/
 
-/// TODO: Change init to accept server IP and port
-
 /**
 *
 * __Description__:
@@ -23,6 +21,9 @@
 * UDP Procedures and functions source file, call UDP_Init before the main Loop
 * call UDP_Engine in the main loop of the programme to process any packages
 *
+* The socket, server address and FIFOs of an upstream are kept in a UDP context
+* (struct UDP_CONTEXT_STRUCT), set it up with UDP_InitContext first
+*
 */
 
 #include <string>
@@ -40,58 +41,42 @@
 #include <fcntl.h>            // Added for the nonblocking socket
 #include "base64.h"
 #include "udp.h"
+#include "os.h"
+#include "metrics.h"          // Instrumentation
+#include "trace.h"            // Tracepoints
 
 typedef bool boolean;
 typedef unsigned char byte;
 
-struct sockaddr_in ServerAddr;  // Struct var to store the Server address
-int ServerSocket;               // Server Socket
-int slen=sizeof(ServerAddr);    // Length of server address
-struct ifreq ifr;               // Struct far to store the MAC address of ETH0
-
-/**
-* UDP TX_Buffer structure
-*/
-struct UDP_TX_BUFFER_STRUCT {
- uint8_t   UDP_TX_FRAME[UDP_TX_MX_FRAME_SIZE];      /**< TX Frame */
- byte      UDP_TX_FRAME_SIZE;                       /**< Size of frame to transmit */
- uint8_t   UDP_TX_FLAG;                             /**< TX_FLAG: 0 = No frame to send, 1 = Frame to send */
- /// Maybe add other data, flags etc?
-};
-/**
-* UDP TX FIFO Buffer
-*/
-struct UDP_TX_BUFFER_STRUCT UDP_TX_FIFO_Buffer[UDP_TX_FIFO_DEPTH];
-/**
-* TXFifo index
-*/
-uint8_t UDP_TX_FIFO_Idx = 0;
-
-/**
-* UDP RX_Buffer structure
-*/
-struct UDP_RX_BUFFER_STRUCT {
- uint8_t   UDP_RX_FRAME[UDP_RX_MX_FRAME_SIZE];      /**< RX Frame */
- byte      UDP_RX_FRAME_SIZE;                       /**< Size of frame received */
- uint8_t   UDP_RX_FLAG;                             /**< RX_FLAG: 0 = No frame received, 1 = Frame received */
- /// Maybe add other data, flags etc?
-};
-/**
-* UDP RX FIFO Buffer
-*/
-struct UDP_RX_BUFFER_STRUCT UDP_RX_FIFO_Buffer[UDP_RX_FIFO_DEPTH];
 /**
-* RX Fifo index
+* __Function__: UDP_InitContext
+*
+* __Description__: Set a UDP context to the defaults, forward to SERVER:PORT
+*
+* __Input__: UDP context
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before any other UDP function
 */
-uint8_t UDP_RX_FIFO_Idx = 0;
-
+void UDP_InitContext( struct UDP_CONTEXT_STRUCT *Udp )
+{
+  memset(Udp, 0, sizeof(*Udp));
+  SPSC_Reset(&Udp->TxQueue);
+  SPSC_Reset(&Udp->RxQueue);
+  Udp->Socket = -1;
+  strcpy(Udp->Server, SERVER);
+  Udp->Port = PORT;
+}
 
  /**
  * __Function__: UDP_Init
  *
  * __Description__: UDP Initialisation
  *
- * __Input__: void
+ * __Input__: UDP context
  *
  * __Output__: Error code: 0 = no error, -1 = Socket error
  *
@@ -99,44 +84,73 @@ uint8_t UDP_RX_FIFO_Idx = 0;
  *
  * __Remarks__: Sets up non-blocking socket with server x on port y
  */
-int UDP_Init( void )
+int UDP_Init( struct UDP_CONTEXT_STRUCT *Udp )
 {
   // Init vars
-  // Make sure the TX fifo pointer points to the first entry in the fifo
-  UDP_TX_FIFO_Idx = 0;
-  // Make sure the RX fifo pointer points to the first entry in the fifo
-  UDP_RX_FIFO_Idx = 0;
+  // Make sure both FIFOs start empty
+  SPSC_Reset(&Udp->TxQueue);
+  SPSC_Reset(&Udp->RxQueue);
 
   // Open Socket
-  if (( ServerSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+  if (( Udp->Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
   {
     printf("UDP_init: Error creating a socket!\n");
     return -1;     /// Error code: -1 = socket error
   }
   // Change the socket into non-blocking state
-  fcntl(ServerSocket, F_SETFL, O_NONBLOCK);
+  fcntl(Udp->Socket, F_SETFL, O_NONBLOCK);
 
-  memset((char *) &ServerAddr, 0, sizeof(ServerAddr));
-  ServerAddr.sin_family = AF_INET;
-  ServerAddr.sin_port = htons(PORT);
+  memset((char *) &Udp->ServerAddr, 0, sizeof(Udp->ServerAddr));
+  Udp->ServerAddr.sin_family = AF_INET;
+  Udp->ServerAddr.sin_port = htons(Udp->Port);
 
   // Load the server address in the structure var
-  inet_aton(SERVER , &ServerAddr.sin_addr);
+  if(inet_aton(Udp->Server, &Udp->ServerAddr.sin_addr) == 0)
+  {
+    printf("UDP_init: Invalid server address: %s\n", Udp->Server);
+    return -1;
+  }
+  printf("UDP_init: Forwarding to %s:%d\n", Udp->Server, Udp->Port);
 
   // Get the mac address of ETH to be used as gateway address
-  ifr.ifr_addr.sa_family = AF_INET;
-  strncpy(ifr.ifr_name, "eth0", IFNAMSIZ-1);  // can we rely on eth0?
-  ioctl(ServerSocket, SIOCGIFHWADDR, &ifr);
+  Udp->Ifr.ifr_addr.sa_family = AF_INET;
+  strncpy(Udp->Ifr.ifr_name, "eth0", IFNAMSIZ-1);  // can we rely on eth0?
+  ioctl(Udp->Socket, SIOCGIFHWADDR, &Udp->Ifr);
 
   return 0;
 }
 
+/**
+* __Function__: UDP_SetServer
+*
+* __Description__: Forward to another server than SERVER:PORT, to be called before UDP_Init
+*
+* __Input__: UDP context, server IP address, port
+*
+* __Output__: Error code: 0 = no error, 1 = Address too long
+*
+* __Status__: Completed
+*
+* __Remarks__: e.g. the mock LNS on 127.0.0.1 for testing
+*/
+int UDP_SetServer( struct UDP_CONTEXT_STRUCT *Udp, const char *Server, int Port )
+{
+  if(strlen(Server) >= sizeof(Udp->Server))
+  {
+    printf("UDP_SetServer: Server address too long: %s\n", Server);
+    return 1;
+  }
+  strcpy(Udp->Server, Server);
+  Udp->Port = Port;
+  return 0;
+}
+
 /**
 * __Function__: UDP_Engine
 *
 * __Description__: UDP procedures to be called in the main loop
 *
-* __Input__: void
+* __Input__: UDP context
 *
 * __Output__: Error code: 0 = no error, 1 =
 *
@@ -144,14 +158,14 @@ int UDP_Init( void )
 *
 * __Remarks__:
 */
-int UDP_Engine(void)
+int UDP_Engine( struct UDP_CONTEXT_STRUCT *Udp )
 {
 
   // Check if any UDP packets are received and put them in the UDP RX FIFO
-  UDP_CheckRX();
+  UDP_CheckRX(Udp);
 
   // UDP Send messages put in to the UDP TX FIFO if Any
-  UDP_CheckTX();
+  UDP_CheckTX(Udp);
 
   return 0;
 }
@@ -161,33 +175,35 @@ int UDP_Engine(void)
 *
 * __Description__: Send a UDP Message
 *
-* __Input__: char *msg, pointer to the message to be transmitted, length of packages
+* __Input__: UDP context, char *msg, pointer to the message to be transmitted, length of packages
 *
 * __Output__: Error code: 0 = no error, 1 = UDP TX Buffer Full, 2 = FRame to big
 *
 * __Status__: Work in Progress
 *
-* __Remarks__: Procedure to be called from application, add a frame to the TX Buffer
+* __Remarks__: Procedure to be called from application, add a frame to the TX Buffer. Producer of the UDP TX FIFO,
+*              one thread only
 */
-int UDP_SendUDP(char *TxFrame, int FrameSize)
+int UDP_SendUDP( struct UDP_CONTEXT_STRUCT *Udp, char *TxFrame, int FrameSize )
 {
+  int Slot;
+
   /// __Incode Comments:__
 
   // check for space in UDP TX FIFO
-  // Buffer Index runs from 0 to UDP_FIFO_DEPTH - 1
-  if(UDP_TX_FIFO_Idx < (UDP_TX_FIFO_DEPTH))
+  Slot = SPSC_WriteSlot(&Udp->TxQueue, UDP_TX_FIFO_DEPTH);
+  if(Slot >= 0)
   {
     if(FrameSize <= UDP_TX_MX_FRAME_SIZE)
     {
       // Copy frame in buffer
-      memcpy(UDP_TX_FIFO_Buffer[UDP_TX_FIFO_Idx].UDP_TX_FRAME, TxFrame, FrameSize);
-      // set send flag
-      UDP_TX_FIFO_Buffer[UDP_TX_FIFO_Idx].UDP_TX_FLAG = 1;                 // Set flag to one to indicate there is a frame to be send
-      UDP_TX_FIFO_Buffer[UDP_TX_FIFO_Idx].UDP_TX_FRAME_SIZE = FrameSize;   // Add frame size
+      memcpy(Udp->TxFifo[Slot].UDP_TX_FRAME, TxFrame, FrameSize);
+      Udp->TxFifo[Slot].UDP_TX_FRAME_SIZE = FrameSize;   // Add frame size
+      Udp->TxFifo[Slot].UDP_TX_QUEUED_TIME = OS_GetMicros();
       //printf("LW_AddFrameToTXBuffer: Frame added to buffer at position: %d\n", LW_TX_FIFO_Idx );
-      printf("UDP_SendUDP: Frame with size: %d added to TX FIFO at position: %d \n", FrameSize, UDP_TX_FIFO_Idx);
-      //Increase the fifo index
-      UDP_TX_FIFO_Idx++;
+      printf("UDP_SendUDP: Frame with size: %d added to TX FIFO at position: %d \n", FrameSize, Slot);
+      // Hand the frame to UDP_CheckTX
+      SPSC_Publish(&Udp->TxQueue, UDP_TX_FIFO_DEPTH);
       // No error, return
       /// The sending of the frame from the UDP TX Fifo is handled in UDP_Engine (UDP_Transmit)
       return 0;
@@ -203,6 +219,7 @@ int UDP_SendUDP(char *TxFrame, int FrameSize)
   {
     // Buffer full
     printf("UDP_SendUDP: Buffer full, frame cannot be send!\n");
+    MET_Count(MET_UDP_TX_DROPPED);
     return 1;       /// Error 1: TX Buffer full
   }
 }
@@ -212,28 +229,30 @@ int UDP_SendUDP(char *TxFrame, int FrameSize)
 *
 * __Description__: Check if any UDP packets have been received and are in the FIFO buffer
 *
-* __Input__: char *buffer = pointer to a buffer
+* __Input__: UDP context, char *buffer = pointer to a buffer
 *
 * __Output__: Number of bytes or nothing in FIFO = -1
 *
 * __Status__: Work in Progress
 *
-* __Remarks__: Procedure is called by the application
+* __Remarks__: Procedure is called by the application. Consumer of the UDP RX FIFO, one thread only
 */
-int UDP_ReceiveUDP( char *RxBuffer )
+int UDP_ReceiveUDP( struct UDP_CONTEXT_STRUCT *Udp, char *RxBuffer )
 {
   int BytesReceived;
+  int Slot;
 
   // Check for message in FIFO, if not available return -1
-  if( UDP_RX_FIFO_Buffer[0].UDP_RX_FLAG != 0)
+  Slot = SPSC_ReadSlot(&Udp->RxQueue, UDP_RX_FIFO_DEPTH);
+  if( Slot >= 0)
   {
     // Copy the frame from the FIFO in the application buffer
-    memcpy( RxBuffer, UDP_RX_FIFO_Buffer[0].UDP_RX_FRAME, UDP_RX_FIFO_Buffer[0].UDP_RX_FRAME_SIZE);
-    UDP_RX_FIFO_Buffer[0].UDP_RX_FLAG = 0;                  // Set flag to 0 to indicate frame has been processed
-    BytesReceived = UDP_RX_FIFO_Buffer[0].UDP_RX_FRAME_SIZE;
+    memcpy( RxBuffer, Udp->RxFifo[Slot].UDP_RX_FRAME, Udp->RxFifo[Slot].UDP_RX_FRAME_SIZE);
+    BytesReceived = Udp->RxFifo[Slot].UDP_RX_FRAME_SIZE;
+    Udp->RxFrameTime = Udp->RxFifo[Slot].UDP_RX_TIME;
     printf("UDP_ReceiveUDP: RX Frame processed with size : %d \n", BytesReceived);         /// Debug
 
-    UDP_RX_FIFO_Update();                                   // Move received frames down the UDP RX FIFO
+    UDP_RX_FIFO_Update(Udp);                                   // Give the slot back to UDP_CheckRX
     return BytesReceived;         // Return number of bytes received
   }
   else
@@ -248,7 +267,7 @@ int UDP_ReceiveUDP( char *RxBuffer )
 *
 * __Description__: Get the Ethernet 0 MAC address from the UDP layer
 *
-* __Input__: void
+* __Input__: UDP context
 *
 * __Output__: Error code: 0 = no error, -1 = Socket error
 *
@@ -256,14 +275,14 @@ int UDP_ReceiveUDP( char *RxBuffer )
 *
 * __Remarks__:
 */
-int UDP_GetEth0Mac( struct ifreq *eth0_ifr)
+int UDP_GetEth0Mac( struct UDP_CONTEXT_STRUCT *Udp, struct ifreq *eth0_ifr )
 {
-  eth0_ifr->ifr_hwaddr.sa_data[0] = ifr.ifr_hwaddr.sa_data[0];
-  eth0_ifr->ifr_hwaddr.sa_data[1] = ifr.ifr_hwaddr.sa_data[1];
-  eth0_ifr->ifr_hwaddr.sa_data[2] = ifr.ifr_hwaddr.sa_data[2];
-  eth0_ifr->ifr_hwaddr.sa_data[3] = ifr.ifr_hwaddr.sa_data[3];
-  eth0_ifr->ifr_hwaddr.sa_data[4] = ifr.ifr_hwaddr.sa_data[4];
-  eth0_ifr->ifr_hwaddr.sa_data[5] = ifr.ifr_hwaddr.sa_data[5];
+  eth0_ifr->ifr_hwaddr.sa_data[0] = Udp->Ifr.ifr_hwaddr.sa_data[0];
+  eth0_ifr->ifr_hwaddr.sa_data[1] = Udp->Ifr.ifr_hwaddr.sa_data[1];
+  eth0_ifr->ifr_hwaddr.sa_data[2] = Udp->Ifr.ifr_hwaddr.sa_data[2];
+  eth0_ifr->ifr_hwaddr.sa_data[3] = Udp->Ifr.ifr_hwaddr.sa_data[3];
+  eth0_ifr->ifr_hwaddr.sa_data[4] = Udp->Ifr.ifr_hwaddr.sa_data[4];
+  eth0_ifr->ifr_hwaddr.sa_data[5] = Udp->Ifr.ifr_hwaddr.sa_data[5];
 
  return 0;
 }
@@ -273,7 +292,7 @@ int UDP_GetEth0Mac( struct ifreq *eth0_ifr)
 *
 * __Description__: Send a UDP Message
 *
-* __Input__: void
+* __Input__: UDP context
 *
 * __Output__: Error code: 0 = no error, -1 = unable to send UDP frame
 *
@@ -281,16 +300,19 @@ int UDP_GetEth0Mac( struct ifreq *eth0_ifr)
 *
 * __Remarks__: Procedure to be called from UDP engine, sending TX frames from the UDP TX FIFO
 */
-int UDP_CheckTX( void )
+int UDP_CheckTX( struct UDP_CONTEXT_STRUCT *Udp )
 {
+  int Slot;
+
   // Check UDP TX fifo
-  if( UDP_TX_FIFO_Buffer[0].UDP_TX_FLAG != 0)
+  Slot = SPSC_ReadSlot(&Udp->TxQueue, UDP_TX_FIFO_DEPTH);
+  if( Slot >= 0)
   {
     // Send the first message in the Fifo
     printf("UDP_Transmit: There is something to send!\n");    /// Debug
 
     // Send the frame
-    if( sendto(ServerSocket, UDP_TX_FIFO_Buffer[0].UDP_TX_FRAME, UDP_TX_FIFO_Buffer[0].UDP_TX_FRAME_SIZE, 0 , (struct sockaddr *) &ServerAddr, slen) == -1 )
+    if( sendto(Udp->Socket, Udp->TxFifo[Slot].UDP_TX_FRAME, Udp->TxFifo[Slot].UDP_TX_FRAME_SIZE, 0 , (struct sockaddr *) &Udp->ServerAddr, sizeof(Udp->ServerAddr)) == -1 )
     {
       // error
       printf("UDP_Transmit: Send frame error!\n");
@@ -298,10 +320,16 @@ int UDP_CheckTX( void )
     }
     else
     {
+      uint64_t SentTime = OS_GetMicros();
+      MET_Latency(MET_LAT_SERIALISED_TO_SENT, SentTime - Udp->TxFifo[Slot].UDP_TX_QUEUED_TIME);
+      TRACE_UDP_TX(Udp->TxFifo[Slot].UDP_TX_FRAME_SIZE, Udp->TxFifo[Slot].UDP_TX_FRAME[3],
+        (Udp->TxFifo[Slot].UDP_TX_FRAME[1] << 8) | Udp->TxFifo[Slot].UDP_TX_FRAME[2],
+        Udp->TxFifo[Slot].UDP_TX_QUEUED_TIME, SentTime);
+      MET_Count(MET_UDP_TX_FRAMES);
+      MET_TrackRequest(Udp->TxFifo[Slot].UDP_TX_FRAME, Udp->TxFifo[Slot].UDP_TX_FRAME_SIZE);
       //Move frames down the Fifo
       printf("UDP_Transmit: TX Frame processed\n");   /// Debug
-      UDP_TX_FIFO_Buffer[0].UDP_TX_FLAG = 0;          // Set flag to 0 to indicate frame has been processed
-      UDP_TX_FIFO_Update();                           // Shift frames fown the FIFO if applicable
+      UDP_TX_FIFO_Update(Udp);                           // Give the slot back to UDP_SendUDP
     }
   }
   else
@@ -317,7 +345,7 @@ int UDP_CheckTX( void )
 *
 * __Description__: Check if any UDP packets have been received, if so add to UDP FIFO
 *
-* __Input__: void
+* __Input__: UDP context
 *
 * __Output__: Error code: 0 = nothing received, -1 = FIF full, Error code > 0 = number of bytes
 *
@@ -325,7 +353,7 @@ int UDP_CheckTX( void )
 *
 * __Remarks__: Procedure is called by UDP_Engine to get UDP frames and stores them in the UDP RX FIFO
 */
-int UDP_CheckRX( void )
+int UDP_CheckRX( struct UDP_CONTEXT_STRUCT *Udp )
 {
   int NumRXBytes = 0;                   // Number of Bytes received
   char RxBuffer[MAXLINE];               // Receive buffer
@@ -333,23 +361,18 @@ int UDP_CheckRX( void )
   struct sockaddr_in SenderAddr;        // struct to store the sender (in this case the server) address in
 
 
-  if(UDP_RX_FIFO_Idx < UDP_RX_FIFO_DEPTH)
+  if(SPSC_Level(&Udp->RxQueue, UDP_RX_FIFO_DEPTH) < UDP_RX_FIFO_DEPTH)
   {
     // There is space in the UDP RX FIFO so lets get a package
-    NumRXBytes = recvfrom(ServerSocket, (char *)RxBuffer, MAXLINE, MSG_WAITALL, ( struct sockaddr *) &SenderAddr, &AddressLength);
+    NumRXBytes = recvfrom(Udp->Socket, (char *)RxBuffer, MAXLINE, MSG_WAITALL, ( struct sockaddr *) &SenderAddr, &AddressLength);
 
     /// Do I need to double check the package received is from the server to avoid spoofing ?
 
     if(NumRXBytes != -1)
     {
-      // Add to UDP FIFO buffer
-      memcpy(UDP_RX_FIFO_Buffer[UDP_RX_FIFO_Idx].UDP_RX_FRAME, RxBuffer, NumRXBytes);
-      // set send flag
-      UDP_RX_FIFO_Buffer[UDP_RX_FIFO_Idx].UDP_RX_FLAG = 1;                   // Set flag to one to indicate there is a frame to be send
-      UDP_RX_FIFO_Buffer[UDP_RX_FIFO_Idx].UDP_RX_FRAME_SIZE = NumRXBytes;   // Add frame size
-      printf("UDP_Receive: Frame received with size: %d and added to buffer at position: %d\n", NumRXBytes, UDP_RX_FIFO_Idx );
-      //Increase the fifo index
-      UDP_RX_FIFO_Idx++;
+      MET_Count(MET_UDP_RX_FRAMES);
+      MET_TrackAck((uint8_t *)RxBuffer, NumRXBytes);
+      UDP_RX_FIFO_Add(Udp, RxBuffer, NumRXBytes);
       return NumRXBytes;
     }
     else
@@ -368,85 +391,133 @@ int UDP_CheckRX( void )
 }
 
 /**
- * __Function__: UDP_TX_FIFO_Update
+ * __Function__: UDP_RX_FIFO_Add
  *
- * __Description__: Move frames down the fifo
+ * __Description__: Add a received datagram to the UDP RX FIFO
  *
- * __Input__: Void
+ * __Input__: UDP context, pointer to the datagram, datagram size
  *
- * __Output__: void
+ * __Output__: Error code: 0 = no error, 1 = RX FIFO full, 2 = FrameSize to big
  *
  * __Status__: Completed
  *
- * __Remarks__: none
+ * __Remarks__: Split from UDP_CheckRX so that the FIFO can be benchmarked without a socket, bench_micro.c
  */
-void UDP_TX_FIFO_Update( void )
+int UDP_RX_FIFO_Add( struct UDP_CONTEXT_STRUCT *Udp, char *RxFrame, int FrameSize )
 {
-  int i;
-
-  // printf("LW_FIFO_Update: index : %d \n", LW_TX_FIFO_Idx);
+  int Slot = SPSC_WriteSlot(&Udp->RxQueue, UDP_RX_FIFO_DEPTH);
 
-  if(UDP_TX_FIFO_Idx)
+  if(Slot < 0)
   {
-    // update FIFO if Required
-    for(i=0; i < (UDP_TX_FIFO_DEPTH - 1); ++i)
-    {
-      // Move frames down
-      UDP_TX_FIFO_Buffer[i] = UDP_TX_FIFO_Buffer[i+1];
-      // printf("LW_FIFO_Update: Move queue position : %d to : %d \n", i+1, i);
-    }
-    //Decrease the fifo index
-    UDP_TX_FIFO_Idx--;
-    // Make sure the flag is set to 0 to indicate there is space in the buffer
-    UDP_TX_FIFO_Buffer[UDP_TX_FIFO_DEPTH - 1].UDP_TX_FLAG = 0;
-    // printf("LW_FIFO_Update: Updating position : %d to indicate free space!\n", LW_FIFO_DEPTH - 1 );
-    // printf("LW_FIFO_Update: New FIFO Idx: %d\n", LW_TX_FIFO_Idx );
+    return 1;       /// Error 1: RX FIFO full
   }
-  else
+  if(FrameSize > UDP_RX_MX_FRAME_SIZE)
   {
-    // Nothing to do, IDX at 0
-    // printf("LW_FIFO_Update: Nothing to do, idx at : 0\n");
+    return 2;       /// Error 2: FrameSize to big
   }
+  // Add to UDP FIFO buffer
+  memcpy(Udp->RxFifo[Slot].UDP_RX_FRAME, RxFrame, FrameSize);
+  Udp->RxFifo[Slot].UDP_RX_FRAME_SIZE = FrameSize;   // Add frame size
+  Udp->RxFifo[Slot].UDP_RX_TIME = OS_GetMicros();     // Add receive time
+  TRACE_UDP_RX(FrameSize, (uint8_t)RxFrame[3], ((uint8_t)RxFrame[1] << 8) | (uint8_t)RxFrame[2], Udp->RxFifo[Slot].UDP_RX_TIME);
+  printf("UDP_Receive: Frame received with size: %d and added to buffer at position: %d\n", FrameSize, Slot );
+  // Hand the frame to UDP_ReceiveUDP
+  SPSC_Publish(&Udp->RxQueue, UDP_RX_FIFO_DEPTH);
+  return 0;
 }
 
 /**
- * __Function__: UDP_RX_FIFO_Update
+ * __Function__: UDP_TX_FIFO_Update
  *
- * __Description__: Move frames down the fifo
+ * __Description__: Take the oldest frame out of the UDP TX FIFO
  *
- * __Input__: Void
+ * __Input__: UDP context
  *
  * __Output__: void
  *
  * __Status__: Completed
  *
- * __Remarks__: none
+ * __Remarks__: Consumer side, O(1), the frames are no longer moved down the FIFO
  */
-void UDP_RX_FIFO_Update( void )
+void UDP_TX_FIFO_Update( struct UDP_CONTEXT_STRUCT *Udp )
 {
-  int i;
-
-  // printf("LW_FIFO_Update: index : %d \n", LW_TX_FIFO_Idx);
-
-  if(UDP_RX_FIFO_Idx)
+  if(SPSC_ReadSlot(&Udp->TxQueue, UDP_TX_FIFO_DEPTH) >= 0)
   {
-    // update FIFO if Required
-    for(i=0; i < (UDP_RX_FIFO_DEPTH - 1); ++i)
-    {
-      // Move frames down
-      UDP_RX_FIFO_Buffer[i] = UDP_RX_FIFO_Buffer[i+1];
-      // printf("LW_FIFO_Update: Move queue position : %d to : %d \n", i+1, i);
-    }
-    //Decrease the fifo index
-    UDP_RX_FIFO_Idx--;
-    // Make sure the flag is set to 0 to indicate there is space in the buffer
-    UDP_RX_FIFO_Buffer[UDP_RX_FIFO_DEPTH - 1].UDP_RX_FLAG = 0;
-    // printf("LW_FIFO_Update: Updating position : %d to indicate free space!\n", LW_FIFO_DEPTH - 1 );
-    // printf("LW_FIFO_Update: New FIFO Idx: %d\n", LW_TX_FIFO_Idx );
+    SPSC_Release(&Udp->TxQueue, UDP_TX_FIFO_DEPTH);
   }
-  else
+}
+
+/**
+ * __Function__: UDP_RX_FIFO_Update
+ *
+ * __Description__: Take the oldest frame out of the UDP RX FIFO
+ *
+ * __Input__: UDP context
+ *
+ * __Output__: void
+ *
+ * __Status__: Completed
+ *
+ * __Remarks__: Consumer side, O(1), the frames are no longer moved down the FIFO
+ */
+void UDP_RX_FIFO_Update( struct UDP_CONTEXT_STRUCT *Udp )
+{
+  if(SPSC_ReadSlot(&Udp->RxQueue, UDP_RX_FIFO_DEPTH) >= 0)
   {
-    // Nothing to do, IDX at 0
-    // printf("LW_FIFO_Update: Nothing to do, idx at : 0\n");
+    SPSC_Release(&Udp->RxQueue, UDP_RX_FIFO_DEPTH);
   }
 }
+
+/**
+ * __Function__: UDP_GetTxFifoLevel
+ *
+ * __Description__: Get the number of frames waiting in the UDP TX FIFO
+ *
+ * __Input__: UDP context
+ *
+ * __Output__: Number of frames
+ *
+ * __Status__: Completed
+ *
+ * __Remarks__: none
+ */
+int UDP_GetTxFifoLevel( struct UDP_CONTEXT_STRUCT *Udp )
+{
+  return SPSC_Level(&Udp->TxQueue, UDP_TX_FIFO_DEPTH);
+}
+
+/**
+ * __Function__: UDP_GetRxFifoLevel
+ *
+ * __Description__: Get the number of frames waiting in the UDP RX FIFO
+ *
+ * __Input__: UDP context
+ *
+ * __Output__: Number of frames
+ *
+ * __Status__: Completed
+ *
+ * __Remarks__: none
+ */
+int UDP_GetRxFifoLevel( struct UDP_CONTEXT_STRUCT *Udp )
+{
+  return SPSC_Level(&Udp->RxQueue, UDP_RX_FIFO_DEPTH);
+}
+
+/**
+ * __Function__: UDP_GetRxTimestamp
+ *
+ * __Description__: Get the time the frame last returned by UDP_ReceiveUDP was received
+ *
+ * __Input__: UDP context
+ *
+ * __Output__: uint64_t micro seconds, see OS_GetMicros
+ *
+ * __Status__: Completed
+ *
+ * __Remarks__: none
+ */
+uint64_t UDP_GetRxTimestamp( struct UDP_CONTEXT_STRUCT *Udp )
+{
+  return Udp->RxFrameTime;
+}
@@ -5,20 +5,33 @@
 #ifndef _udp_hpp_
 #define _udp_hpp_
 
+#include <stdint.h>           // Required for unint8 etc
+#include <netinet/in.h>       // struct sockaddr_in
+#include <net/if.h>           // struct ifreq
+#include "spsc.h"             // Lock-free FIFOs between the gateway and the network
+
+struct UDP_CONTEXT_STRUCT;
+
 // Functions which can be called external from the UDP layer
-int UDP_Init( void );                           // To be called in the init phase
-int UDP_Engine( void );                         // To be called in the main programme loop
-int UDP_ReceiveUDP( char *RxBuffer );           // To be called by the Application to receive UDP
-int UDP_SendUDP(char *TxFrame, int FrameSize);  // To be called ny the application to send UDP
+void UDP_InitContext( struct UDP_CONTEXT_STRUCT *Udp );     // Defaults SERVER and PORT, to be called first
+int UDP_SetServer( struct UDP_CONTEXT_STRUCT *Udp, const char *Server, int Port );  // To be called before UDP_Init to override SERVER and PORT
+int UDP_Init( struct UDP_CONTEXT_STRUCT *Udp );                   // To be called in the init phase
+int UDP_Engine( struct UDP_CONTEXT_STRUCT *Udp );                 // To be called in the main programme loop
+int UDP_ReceiveUDP( struct UDP_CONTEXT_STRUCT *Udp, char *RxBuffer );            // To be called by the Application to receive UDP
+int UDP_SendUDP( struct UDP_CONTEXT_STRUCT *Udp, char *TxFrame, int FrameSize ); // To be called ny the application to send UDP
 
 // Supporting Functions
-int UDP_GetEth0Mac( struct ifreq *eth0_ifr);    // Get the MAC address of ETH0
+int UDP_GetEth0Mac( struct UDP_CONTEXT_STRUCT *Udp, struct ifreq *eth0_ifr );   // Get the MAC address of ETH0
+int UDP_GetTxFifoLevel( struct UDP_CONTEXT_STRUCT *Udp );         // Number of frames waiting in the UDP TX FIFO
+int UDP_GetRxFifoLevel( struct UDP_CONTEXT_STRUCT *Udp );         // Number of frames waiting in the UDP RX FIFO
+uint64_t UDP_GetRxTimestamp( struct UDP_CONTEXT_STRUCT *Udp );    // Receive time of the frame last returned by UDP_ReceiveUDP
 
 // Functions Internal to the UDP Layer
-void UDP_TX_FIFO_Update( void );
-void UDP_RX_FIFO_Update( void );
-int UDP_CheckTX( void );
-int UDP_CheckRX( void );
+void UDP_TX_FIFO_Update( struct UDP_CONTEXT_STRUCT *Udp );
+void UDP_RX_FIFO_Update( struct UDP_CONTEXT_STRUCT *Udp );
+int UDP_RX_FIFO_Add( struct UDP_CONTEXT_STRUCT *Udp, char *RxFrame, int FrameSize );
+int UDP_CheckTX( struct UDP_CONTEXT_STRUCT *Udp );
+int UDP_CheckRX( struct UDP_CONTEXT_STRUCT *Udp );
 
 
 /// Define your server IP address below
@@ -40,4 +53,43 @@ int UDP_CheckRX( void );
 #define UDP_RX_FIFO_DEPTH         10   // Max 10 frames in UDP TX buffer
 
 
+/**
+* UDP TX_Buffer structure
+*/
+struct UDP_TX_BUFFER_STRUCT {
+ uint8_t   UDP_TX_FRAME[UDP_TX_MX_FRAME_SIZE];      /**< TX Frame */
+ int       UDP_TX_FRAME_SIZE;                       /**< Size of frame to transmit */
+ uint64_t  UDP_TX_QUEUED_TIME;                      /**< Time the frame was queued in micro seconds */
+ /// Maybe add other data, flags etc?
+};
+
+/**
+* UDP RX_Buffer structure
+*/
+struct UDP_RX_BUFFER_STRUCT {
+ uint8_t   UDP_RX_FRAME[UDP_RX_MX_FRAME_SIZE];      /**< RX Frame */
+ int       UDP_RX_FRAME_SIZE;                       /**< Size of frame received */
+ uint64_t  UDP_RX_TIME;                             /**< Time the frame was received in micro seconds */
+ /// Maybe add other data, flags etc?
+};
+
+/**
+* One upstream, the socket to a server with its FIFOs, every UDP function works on one of these.
+* Set it up with UDP_InitContext. The small, often used fields come first, the FIFOs last.
+* The FIFOs are single producer single consumer queues: TxFifo is filled by the gateway (UDP_SendUDP)
+* and emptied by UDP_Engine, RxFifo the other way round, so UDP_Engine can run on a thread of its own.
+*/
+struct UDP_CONTEXT_STRUCT {
+  int                 Socket;                       /**< Server Socket */
+  uint64_t            RxFrameTime;                  /**< Receive time of the frame last returned by UDP_ReceiveUDP */
+  struct sockaddr_in  ServerAddr;                   /**< Server address */
+  char                Server[64];                   /**< Server address, SERVER unless changed with UDP_SetServer */
+  int                 Port;                         /**< Server port, PORT unless changed with UDP_SetServer */
+  struct ifreq        Ifr;                          /**< MAC address of ETH0 */
+  struct SPSC_STRUCT  TxQueue;                      /**< Indices of TxFifo */
+  struct SPSC_STRUCT  RxQueue;                      /**< Indices of RxFifo */
+  struct UDP_TX_BUFFER_STRUCT TxFifo[UDP_TX_FIFO_DEPTH];
+  struct UDP_RX_BUFFER_STRUCT RxFifo[UDP_RX_FIFO_DEPTH];
+};
+
 #endif // _udp_hpp_
@@ -0,0 +1,641 @@
+/*******************************************************************************
+ * Virtual radio
+ *
+ * A frame level radio backend (HAL_RadioVirtual) that needs no hardware. It
+ * delivers uplinks from a file, a UDP socket or a generator function into the
+ * LORA RX FIFO and records every downlink with the time it was sent. With it
+ * the complete HAL, GW and UDP pipeline runs on any Linux box.
+ *
+ * Several virtual radios share one source. An uplink with a frequency only
+ * reaches the radios listening on it, so the traffic generator can spread its
+ * uplinks over the radios of a multi radio gateway. Radios on the same
+ * frequency each receive a copy, as antennas side by side would. Likewise an
+ * uplink with an SF only reaches the radios on that SF, or scanning it.
+ *
+ * The same sources feed the SX127x emulator (sx127x_emu.c) through VR_Open,
+ * VR_Poll and VR_RecordDownlink, there the frames go over the modelled air
+ * into the register file instead of straight into the LORA RX FIFO.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>           // Required for unint8 etc
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>            // Required for the nonblocking socket
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>          // Required for the lock of the source
+#include "hal.h"
+#include "os.h"
+#include "vradio.h"
+
+int VR_Init( struct HAL_CONTEXT_STRUCT *Hal );
+int VR_ProcessRX( struct HAL_CONTEXT_STRUCT *Hal );
+int VR_SendFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *TxFrame, byte FrameSize, const struct HAL_TX_PARAMS_STRUCT *Tx );
+static int VR_Deliver( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink );
+static int VR_PollSource( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink );
+static int VR_Hears( struct HAL_CONTEXT_STRUCT *Hal, const struct VR_FRAME_STRUCT *Uplink );
+
+/**
+* The virtual radio backend
+*/
+const struct HAL_RADIO_STRUCT HAL_RadioVirtual = {
+  "virtual",
+  VR_Init,
+  VR_ProcessRX,
+  VR_SendFrame
+};
+
+// Virtual radio Variables
+int VR_Source = VR_SOURCE_NONE;         // Where the uplinks come from
+char VR_SourceArg[256] = "";            // File name or port of the source
+VR_GENERATOR VR_Generator = NULL;       // Generator function
+VR_DOWNLINK_HOOK VR_DownlinkHook = NULL;
+char VR_DownlinkLogName[256] = "";      // File downlinks are recorded in
+
+FILE *VR_File = NULL;                   // Uplink file
+FILE *VR_DownlinkLog = NULL;            // Downlink file
+int VR_Socket = -1;                     // Uplink socket
+int VR_FileDone = 0;                    // 1 = end of the uplink file reached
+
+struct VR_FRAME_STRUCT VR_Next;         // Next uplink read from the file
+uint64_t VR_NextTime = 0;               // Time the next uplink from the file is due
+int VR_NextValid = 0;                   // 1 = VR_Next holds an uplink
+
+uint32_t VR_NumUplinks = 0;
+uint32_t VR_NumDownlinks = 0;
+uint32_t VR_NumUnheard = 0;
+static pthread_mutex_t VR_Lock = PTHREAD_MUTEX_INITIALIZER;    // Source and downlink file, shared by the radios
+
+struct HAL_CONTEXT_STRUCT *VR_Radios[VR_MAX_RADIOS];  // Virtual radios sharing the source, VR_Init
+int VR_NumRadios = 0;
+struct VR_FRAME_STRUCT VR_Parked[VR_MAX_RADIOS];    // Uplink polled by one radio for the radio on its frequency
+int VR_ParkedValid[VR_MAX_RADIOS];
+
+
+/**
+* __Function__: VR_SetSource
+*
+* __Description__: Select where the virtual radio gets its uplinks from
+*
+* __Input__: Source = one of vr_source_t, Arg = file name for VR_SOURCE_FILE, port for VR_SOURCE_SOCKET (NULL = default)
+*
+* __Output__: Error code: 0 = no error, 1 = unknown source
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before HAL_Init, the source is opened by HAL_Init
+*/
+int VR_SetSource( int Source, const char *Arg )
+{
+  if(Source < VR_SOURCE_NONE || Source > VR_SOURCE_GENERATOR)
+  {
+    printf("VR_SetSource: Unknown source: %d\n", Source);
+    return 1;
+  }
+  VR_Source = Source;
+  snprintf(VR_SourceArg, sizeof(VR_SourceArg), "%s", Arg ? Arg : "");
+  return 0;
+}
+
+/**
+* __Function__: VR_SetGenerator
+*
+* __Description__: Use a function to generate the uplinks
+*
+* __Input__: Pointer to the generator function
+*
+* __Output__: Error code: 0 = no error
+*
+* __Status__: Completed
+*
+* __Remarks__: Selects VR_SOURCE_GENERATOR
+*/
+int VR_SetGenerator( VR_GENERATOR Generator )
+{
+  VR_Generator = Generator;
+  return VR_SetSource(VR_SOURCE_GENERATOR, NULL);
+}
+
+/**
+* __Function__: VR_SetDownlinkLog
+*
+* __Description__: Record all downlinks in a file
+*
+* __Input__: File name, one downlink per line: <time us> <size> <payload in hex> <freq Hz> <datr> <codr> <powe dBm> <ipol 0|1>,
+*            datr and codr as in the txpk, e.g. 868100000 SF9BW125 4/5 14 1
+*
+* __Output__: Error code: 0 = no error
+*
+* __Status__: Completed
+*
+* __Remarks__: To be called before HAL_Init
+*/
+int VR_SetDownlinkLog( const char *FileName )
+{
+  snprintf(VR_DownlinkLogName, sizeof(VR_DownlinkLogName), "%s", FileName);
+  return 0;
+}
+
+/**
+* __Function__: VR_SetDownlinkHook
+*
+* __Description__: Call a function for every downlink
+*
+* __Input__: Pointer to the hook, NULL = no hook
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+void VR_SetDownlinkHook( VR_DOWNLINK_HOOK Hook )
+{
+  VR_DownlinkHook = Hook;
+}
+
+/**
+* __Function__: VR_ReadLine
+*
+* __Description__: Read the next uplink from the uplink file in VR_Next
+*
+* __Input__: void
+*
+* __Output__: Error code: 0 = uplink read, 1 = end of file
+*
+* __Status__: Completed
+*
+* __Remarks__: Empty lines and lines starting with # are skipped
+*/
+static int VR_ReadLine( void )
+{
+  char Line[VR_LINE_SIZE];
+  char Hex[VR_LINE_SIZE];
+  unsigned int DelayMs, Byte;
+  int i;
+
+  while(fgets(Line, sizeof(Line), VR_File) != NULL)
+  {
+    if(Line[0] == '#' || Line[0] == '\n' || Line[0] == '\r')
+    {
+      continue;
+    }
+    if(sscanf(Line, "%u %d %ld %1023s", &DelayMs, &VR_Next.Rssi, &VR_Next.Snr, Hex) != 4)
+    {
+      printf("VR_ReadLine: Skipping malformed line: %s", Line);
+      continue;
+    }
+    VR_Next.FrameSize = 0;
+    for(i = 0; Hex[i] && Hex[i+1] && VR_Next.FrameSize < LORA_RX_MX_FRAME_SIZE; i += 2)
+    {
+      sscanf(&Hex[i], "%2x", &Byte);
+      VR_Next.Frame[VR_Next.FrameSize++] = (uint8_t)Byte;
+    }
+    VR_Next.CrcError = 0;
+    VR_NextTime += (uint64_t)DelayMs * 1000;
+    return 0;
+  }
+  return 1;
+}
+
+/**
+* __Function__: VR_Open
+*
+* __Description__: Open the uplink source and downlink file
+*
+* __Input__: void
+*
+* __Output__: Error code: 0 = no error, 1 = Error opening the source
+*
+* __Status__: Completed
+*
+* __Remarks__: Called by VR_Init, or by the SX127x emulator when it takes its uplinks from here
+*/
+int VR_Open( void )
+{
+  struct sockaddr_in Addr;
+  int Port;
+
+  VR_NumUplinks = 0;
+  VR_NumDownlinks = 0;
+  VR_NumUnheard = 0;
+  VR_FileDone = 0;
+  VR_NextValid = 0;
+
+  switch(VR_Source)
+  {
+    case VR_SOURCE_FILE:
+      if((VR_File = fopen(VR_SourceArg, "r")) == NULL)
+      {
+        printf("VR_Open: Error opening uplink file: %s\n", VR_SourceArg);
+        return 1;
+      }
+      VR_NextTime = OS_GetMicros();
+      VR_NextValid = (VR_ReadLine() == 0);
+      VR_FileDone = !VR_NextValid;
+      printf("VR_Open: Reading uplinks from: %s\n", VR_SourceArg);
+    break;
+
+    case VR_SOURCE_SOCKET:
+      Port = VR_SourceArg[0] ? atoi(VR_SourceArg) : VR_DEFAULT_SOCKET_PORT;
+      if((VR_Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+      {
+        printf("VR_Open: Error creating a socket!\n");
+        return 1;
+      }
+      memset((char *) &Addr, 0, sizeof(Addr));
+      Addr.sin_family = AF_INET;
+      Addr.sin_port = htons(Port);
+      inet_aton(VR_SOCKET_ADDR, &Addr.sin_addr);
+      if(bind(VR_Socket, (struct sockaddr *) &Addr, sizeof(Addr)) == -1)
+      {
+        printf("VR_Open: Error binding to %s:%d!\n", VR_SOCKET_ADDR, Port);
+        close(VR_Socket);
+        VR_Socket = -1;
+        return 1;
+      }
+      // Change the socket into non-blocking state
+      fcntl(VR_Socket, F_SETFL, O_NONBLOCK);
+      printf("VR_Open: Waiting for uplinks on udp://%s:%d\n", VR_SOCKET_ADDR, Port);
+    break;
+
+    case VR_SOURCE_GENERATOR:
+      if(VR_Generator == NULL)
+      {
+        printf("VR_Open: No generator set!\n");
+        return 1;
+      }
+    break;
+
+    default:
+    break;
+  }
+
+  if(VR_DownlinkLogName[0])
+  {
+    if((VR_DownlinkLog = fopen(VR_DownlinkLogName, "a")) == NULL)
+    {
+      printf("VR_Open: Error opening downlink file: %s\n", VR_DownlinkLogName);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+* __Function__: VR_Init
+*
+* __Description__: Initialise the virtual radio
+*
+* __Input__: HAL context
+*
+* __Output__: Error code: 0 = no error, 1 = Error opening the source
+*
+* __Status__: Completed
+*
+* __Remarks__: Called by HAL_Init of every virtual radio, the first one opens the source that all of them share
+*/
+int VR_Init( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  if(VR_NumRadios >= VR_MAX_RADIOS)
+  {
+    printf("VR_Init: Error: at most %d virtual radios\n", VR_MAX_RADIOS);
+    return 1;
+  }
+  if(VR_NumRadios == 0 && VR_Open() != 0)
+  {
+    return 1;
+  }
+  VR_Radios[VR_NumRadios] = Hal;
+  VR_ParkedValid[VR_NumRadios] = 0;
+  VR_NumRadios++;
+
+  printf("VR_Init: Virtual radio ready, SF%d on %.6lf Mhz\n", HAL_GetSF(Hal), (double)HAL_GetFreq(Hal)/1000000);
+  return 0;
+}
+
+/**
+* __Function__: VR_Inject
+*
+* __Description__: Deliver an uplink to the HAL as if it was received over the air
+*
+* __Input__: HAL context of the virtual radio, pointer to the uplink
+*
+* __Output__: Error code: 0 = no error, 1 = LORA RX FIFO full, uplink dropped
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+int VR_Inject( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink )
+{
+  VR_NumUplinks++;
+  return VR_Deliver(Hal, Uplink);
+}
+
+/**
+* __Function__: VR_Deliver
+*
+* __Description__: Put an uplink in the LORA RX FIFO
+*
+* __Input__: HAL context, pointer to the uplink
+*
+* __Output__: Error code: 0 = no error, 1 = LORA RX FIFO full, uplink dropped
+*
+* __Status__: Completed
+*
+* __Remarks__: A virtual radio with several channels hears them all at once, the uplink is received on its own
+*/
+static int VR_Deliver( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink )
+{
+  uint64_t Dio0Time = OS_GetMicros();
+  int SF = Uplink->SF ? Uplink->SF : HAL_GetSF(Hal);
+  int Chan = HAL_FindChan(Hal, Uplink->Freq);
+
+  Hal->Chan = Chan >= 0 ? Chan : 0;
+
+  if(Uplink->CrcError)
+  {
+    HAL_RX_CrcError(Hal, SF, Dio0Time);
+    return 0;
+  }
+  return HAL_RX_FIFO_Add(Hal, Uplink->Frame, Uplink->FrameSize, Uplink->Rssi, Uplink->Rssi, Uplink->Snr, SF, Dio0Time);
+}
+
+/**
+* Radio is on the frequency, one of its channels, and SF of the uplink
+*/
+static int VR_Hears( struct HAL_CONTEXT_STRUCT *Hal, const struct VR_FRAME_STRUCT *Uplink )
+{
+  return (Uplink->Freq == 0 || HAL_FindChan(Hal, Uplink->Freq) >= 0) && (Uplink->SF == 0 || HAL_ListensOn(Hal, Uplink->SF));
+}
+
+/**
+* Next uplink of the source, VR_Poll with the lock held
+*/
+static int VR_PollSource( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink )
+{
+  uint8_t Datagram[LORA_RX_MX_FRAME_SIZE + 2];
+  int NumBytes;
+
+  Uplink->Freq = 0;         // Any radio, unless the source says otherwise
+  Uplink->SF = 0;
+  switch(VR_Source)
+  {
+    case VR_SOURCE_FILE:
+      if(VR_NextValid && OS_GetMicros() >= VR_NextTime)
+      {
+        *Uplink = VR_Next;
+        VR_NextValid = (VR_ReadLine() == 0);
+        VR_FileDone = !VR_NextValid;
+        VR_NumUplinks++;
+        return 1;
+      }
+    break;
+
+    case VR_SOURCE_SOCKET:
+      NumBytes = recv(VR_Socket, Datagram, sizeof(Datagram), MSG_DONTWAIT);
+      if(NumBytes > 2)
+      {
+        Uplink->Rssi = (int8_t)Datagram[0];
+        Uplink->Snr = (int8_t)Datagram[1];
+        Uplink->FrameSize = NumBytes - 2;
+        Uplink->CrcError = 0;
+        memcpy(Uplink->Frame, Datagram + 2, Uplink->FrameSize);
+        VR_NumUplinks++;
+        return 1;
+      }
+    break;
+
+    case VR_SOURCE_GENERATOR:
+      if(VR_Generator(Hal, Uplink))
+      {
+        VR_NumUplinks++;
+        return 1;
+      }
+    break;
+
+    default:
+    break;
+  }
+  return 0;
+}
+
+/**
+* __Function__: VR_OthersParked
+*
+* __Description__: Check whether a radio other than Self has a parked uplink it has not picked up
+*
+* __Input__: Index of the polling radio in VR_Radios, -1 = not a virtual radio
+*
+* __Output__: 1 = yes, 0 = no
+*
+* __Status__: Completed
+*
+* __Remarks__: Called with VR_Lock held
+*/
+static int VR_OthersParked( int Self )
+{
+  int i;
+
+  for(i = 0; i < VR_NumRadios; i++)
+  {
+    if(i != Self && VR_ParkedValid[i])
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+* __Function__: VR_Poll
+*
+* __Description__: Poll the uplink source for the next uplink
+*
+* __Input__: HAL context of the radio that polls, handed to the generator, pointer to the uplink to fill
+*
+* __Output__: 1 = Uplink has been filled, 0 = nothing due
+*
+* __Status__: Completed
+*
+* __Remarks__: At most one uplink per call. The radios share the source, each may run on a thread of its own,
+*              they take turns polling it. An uplink on the frequency of other virtual radios is parked for each
+*              of them, one on a frequency or SF no radio listens on is lost. The source is not polled while
+*              another radio has not picked up its parked uplink, so a fast source (replay) is not drained by a
+*              radio that hears none of it
+*/
+int VR_Poll( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink )
+{
+  int Result = 0;
+  int Self = -1;
+  int Heard;
+  int i;
+
+  pthread_mutex_lock(&VR_Lock);
+  for(i = 0; i < VR_NumRadios; i++)
+  {
+    if(VR_Radios[i] == Hal)
+    {
+      Self = i;
+    }
+  }
+  if(Self >= 0 && VR_ParkedValid[Self])
+  {
+    *Uplink = VR_Parked[Self];
+    VR_ParkedValid[Self] = 0;
+    Result = 1;
+  }
+  while(!Result && !VR_OthersParked(Self) && VR_PollSource(Hal, Uplink))
+  {
+    Heard = 0;
+    if(VR_Hears(Hal, Uplink))
+    {
+      Result = 1;
+      Heard = 1;
+    }
+    // Every other radio on the frequency gets a copy, unless it has not picked up the last one yet. Without a
+    // frequency one radio on the SF gets it
+    for(i = 0; i < VR_NumRadios; i++)
+    {
+      if(i == Self || VR_ParkedValid[i] || !VR_Hears(VR_Radios[i], Uplink))
+      {
+        continue;
+      }
+      if(Uplink->Freq == 0 && Heard)
+      {
+        break;
+      }
+      VR_Parked[i] = *Uplink;
+      VR_ParkedValid[i] = 1;
+      Heard = 1;
+    }
+    if(!Heard)
+    {
+      VR_NumUnheard++;
+    }
+  }
+  pthread_mutex_unlock(&VR_Lock);
+  return Result;
+}
+
+/**
+* __Function__: VR_ProcessRX
+*
+* __Description__: Poll the uplink source, deliver at most one uplink per call
+*
+* __Input__: HAL context
+*
+* __Output__: Error code: 0 = no error
+*
+* __Status__: Completed
+*
+* __Remarks__: Called by HAL_Process_RX, like a real radio at most one frame is received per poll
+*/
+int VR_ProcessRX( struct HAL_CONTEXT_STRUCT *Hal )
+{
+  struct VR_FRAME_STRUCT Uplink;
+
+  if(VR_Poll(Hal, &Uplink))
+  {
+    VR_Deliver(Hal, &Uplink);
+  }
+  return 0;
+}
+
+/**
+* __Function__: VR_SendFrame
+*
+* __Description__: Transmit a frame on the virtual radio, it is recorded instead
+*
+* __Input__: HAL context, pointer to the frame buffer, Buffer length, radio parameters, recorded with the frame
+*
+* __Output__: Error code: 0 = no error
+*
+* __Status__: Completed
+*
+* __Remarks__: Called by HAL_SendFrame
+*/
+int VR_SendFrame( struct HAL_CONTEXT_STRUCT *Hal, uint8_t *TxFrame, byte FrameSize, const struct HAL_TX_PARAMS_STRUCT *Tx )
+{
+  HAL_TX_Keyed(Hal, FrameSize);
+  VR_RecordDownlink(TxFrame, FrameSize, OS_GetMicros(), Tx);
+  HAL_TX_Done(Hal, FrameSize);
+  return 0;
+}
+
+/**
+* __Function__: VR_RecordDownlink
+*
+* __Description__: Record a frame that went on the air in the downlink file and pass it to the downlink hook
+*
+* __Input__: Pointer to the frame, size of the frame, time TX was keyed in micro seconds (OS_GetMicros),
+*            frequency, modem and power the frame went out with
+*
+* __Output__: void
+*
+* __Status__: Completed
+*
+* __Remarks__: See VR_SetDownlinkLog for the format
+*/
+void VR_RecordDownlink( const uint8_t *TxFrame, int FrameSize, uint64_t TxTime, const struct HAL_TX_PARAMS_STRUCT *Tx )
+{
+  int i;
+
+  pthread_mutex_lock(&VR_Lock);
+  VR_NumDownlinks++;
+
+  if(VR_DownlinkLog != NULL)
+  {
+    fprintf(VR_DownlinkLog, "%llu %d ", (unsigned long long)TxTime, FrameSize);
+    for(i = 0; i < FrameSize; i++)
+    {
+      fprintf(VR_DownlinkLog, "%02x", TxFrame[i]);
+    }
+    fprintf(VR_DownlinkLog, " %u SF%dBW%d 4/%d %d %d\n", Tx->Freq, Tx->SF, 125 << Tx->BW, Tx->CR + 5, Tx->Power, Tx->IQ == HAL_IQ_INVERTED);
+    fflush(VR_DownlinkLog);
+  }
+  pthread_mutex_unlock(&VR_Lock);
+  if(VR_DownlinkHook != NULL)
+  {
+    VR_DownlinkHook(TxFrame, FrameSize, TxTime, Tx);
+  }
+}
+
+/**
+* __Function__: VR_SourceDone
+*
+* __Description__: Check if all uplinks of the uplink file have been delivered
+*
+* __Input__: void
+*
+* __Output__: 1 = done, 0 = not done or not reading from a file
+*
+* __Status__: Completed
+*
+* __Remarks__:
+*/
+int VR_SourceDone( void )
+{
+  return VR_FileDone;
+}
+
+uint32_t VR_GetNumUplinks( void )
+{
+  return VR_NumUplinks;
+}
+
+uint32_t VR_GetNumDownlinks( void )
+{
+  return VR_NumDownlinks;
+}
+
+uint32_t VR_GetNumUnheard( void )
+{
+  return VR_NumUnheard;
+}
@@ -0,0 +1,76 @@
+/*******************************************************************************
+ * Virtual radio Header file
+ *******************************************************************************/
+
+#ifndef _vradio_h_
+#define _vradio_h_
+
+#include <stdint.h>           // Required for unint8 etc
+#include "hal.h"
+
+/**
+* Uplink as delivered by the virtual radio
+*/
+struct VR_FRAME_STRUCT {
+  uint8_t   Frame[LORA_RX_MX_FRAME_SIZE];     /**< Frame as received over the air */
+  int       FrameSize;                        /**< Size of the frame */
+  int       Rssi;                             /**< Packet RSSI in dBm */
+  long int  Snr;                              /**< Signal to noise ratio in dB */
+  int       CrcError;                         /**< 1 = deliver as a frame with a CRC error */
+  uint32_t  Freq;                             /**< Frequency it is sent on in Hz, only a radio on it hears it, 0 = any radio */
+  int       SF;                               /**< Spreading factor it is sent with, only a radio listening on it hears it, 0 = the SF of the radio */
+};
+
+/**
+* Generator, called every time the radio is polled with the HAL context of that radio. Return 1 when Uplink has been filled, 0 when there is nothing to receive
+*/
+typedef int (*VR_GENERATOR)( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink );
+
+/**
+* Downlink hook, called for every frame transmitted on the virtual radio, TxTime in micro seconds (OS_GetMicros),
+* Tx = frequency, modem and power the frame went out with
+*/
+typedef void (*VR_DOWNLINK_HOOK)( const uint8_t *Frame, int FrameSize, uint64_t TxTime, const struct HAL_TX_PARAMS_STRUCT *Tx );
+
+/**
+* Virtual radio Public Functions and Procedures, to be called before HAL_Init
+*/
+int VR_SetSource( int Source, const char *Arg );
+int VR_SetGenerator( VR_GENERATOR Generator );
+int VR_SetDownlinkLog( const char *FileName );
+void VR_SetDownlinkHook( VR_DOWNLINK_HOOK Hook );
+
+/**
+* Virtual radio Supporting Functions and Procedures
+*/
+int VR_Inject( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink );   // Deliver an uplink right now
+int VR_SourceDone( void );                           // 1 = the uplink file has been read completely
+uint32_t VR_GetNumUplinks( void );
+uint32_t VR_GetNumDownlinks( void );
+uint32_t VR_GetNumUnheard( void );                   // Uplinks on a frequency or SF no radio listens on
+
+/**
+* Virtual radio Functions for the SX127x emulator
+*/
+int VR_Open( void );                                 // Open the uplink source and downlink file
+int VR_Poll( struct HAL_CONTEXT_STRUCT *Hal, struct VR_FRAME_STRUCT *Uplink );     // 1 = Uplink filled with the next uplink from the source
+void VR_RecordDownlink( const uint8_t *TxFrame, int FrameSize, uint64_t TxTime, const struct HAL_TX_PARAMS_STRUCT *Tx );
+
+
+/**
+* Sources of uplinks
+*/
+enum vr_source_t {
+  VR_SOURCE_NONE = 0,       // Only uplinks delivered with VR_Inject
+  VR_SOURCE_FILE,           // Text file, one uplink per line: <delay ms> <rssi> <snr> <payload in hex>
+  VR_SOURCE_SOCKET,         // UDP socket, one uplink per datagram: <int8 rssi> <int8 snr> <payload>
+  VR_SOURCE_GENERATOR       // Function, see VR_SetGenerator
+};
+
+#define VR_SOCKET_ADDR            "127.0.0.1"   // Only listen on localhost for injected uplinks
+#define VR_DEFAULT_SOCKET_PORT    1701          // Default port of the uplink socket
+#define VR_LINE_SIZE              1024          // Max line length in the uplink file
+#define VR_MAX_RADIOS             4             // Virtual radios sharing one source
+
+
+#endif // _vradio_h_